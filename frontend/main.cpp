@@ -3,6 +3,7 @@
 //  Distributed under the Boost Software License, Version 1.0. (See accompanying
 //  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
+#include "octotiger/buffer_pool.hpp"
 #include "octotiger/compute_factor.hpp"
 #include "octotiger/defs.hpp"
 #include "octotiger/future.hpp"
@@ -13,10 +14,12 @@
 #include "octotiger/options.hpp"
 #include "octotiger/physcon.hpp"
 #include "octotiger/problem.hpp"
+#include "octotiger/trace.hpp"
 #include "octotiger/test_problems/rotating_star.hpp"
 #include "octotiger/test_problems/blast.hpp"
 #include "octotiger/unitiger/physics.hpp"
 #include "octotiger/unitiger/physics_impl.hpp"
+#include "octotiger/wire_codec.hpp"
 
 #include "octotiger/test_problems/amr/amr.hpp"
 
@@ -27,6 +30,7 @@
 #include "octotiger/multipole_interactions/cuda_multipole_interaction_interface.hpp"
 #endif
 #include "octotiger/common_kernel/interaction_constants.hpp"
+#include "octotiger/common_kernel/kernel_autotune.hpp"
 #include "octotiger/monopole_interactions/calculate_stencil.hpp"
 #include "octotiger/monopole_interactions/p2m_interaction_interface.hpp"
 #include "octotiger/monopole_interactions/p2p_interaction_interface.hpp"
@@ -154,6 +158,7 @@ void initialize(options _opts, std::vector<hpx::id_type> const& localities) {
 
 	options::all_localities = localities;
 	opts() = _opts;
+	trace_initialize();
 	physics<NDIM>::set_n_species(opts().n_species);
 	physics<NDIM>::update_n_field();
 	grid::get_omega() = opts().omega;
@@ -490,6 +495,7 @@ int hpx_main(int argc, char* argv[]) {
 		if (opts().process_options(argc, argv)) {
 			auto all_locs = hpx::find_all_localities();
 			hpx::lcos::broadcast<initialize_action>(all_locs, opts(), all_locs).get();
+			octotiger::fmm::autotune_interaction_kernels();
 
 			hpx::id_type root_id = hpx::new_<node_server>(hpx::find_here()).get();
 			node_client root_client(root_id);
@@ -532,6 +538,9 @@ int hpx_main(int argc, char* argv[]) {
 				output_all(root, "X", 0, true);
 			}
 			root->report_timing();
+			trace_output();
+			wire_output();
+			buffer_pool_output();
             accumulate_distributed_counters();
 		}
 	} catch (...) {
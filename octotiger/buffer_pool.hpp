@@ -0,0 +1,141 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef OCTOTIGER_BUFFER_POOL_HPP_
+#define OCTOTIGER_BUFFER_POOL_HPP_
+
+#include <hpx/synchronization/spinlock.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* Per-locality free lists of std::vector buffers, one pool per element type, kept by size. The FMM and halo buffers
+ * come in a handful of sizes (sub-grid, half sub-grid, faces, edges and corners) and are allocated and dropped by every
+ * node in every solve, recycling them keeps the allocator and the page fault handler out of the solver. Every worker
+ * thread keeps up to local_max buffers of each size without locking, the rest spills into a locked list of at most
+ * global_max buffers of each size, anything beyond is freed. The contents of a buffer from the pool are unspecified. */
+
+struct buffer_pool_counters {
+	std::atomic<std::uint64_t> requests { 0 };
+	std::atomic<std::uint64_t> hits { 0 };
+	/* bytes in the free lists */
+	std::atomic<std::uint64_t> pooled_bytes { 0 };
+	/* bytes in buffers from get_shared that are still referenced */
+	std::atomic<std::uint64_t> live_bytes { 0 };
+};
+
+template<class T>
+class buffer_pool {
+	static constexpr std::size_t local_max = 8;
+	static constexpr std::size_t global_max = 256;
+	using free_list = std::vector<std::vector<T>>;
+	struct state_type {
+		hpx::lcos::local::spinlock mtx;
+		std::unordered_map<std::size_t, free_list> free;
+		buffer_pool_counters counters;
+	};
+	/* never destroyed, shared buffers may still be released during static destruction */
+	static state_type& state() {
+		static state_type *s = new state_type;
+		return *s;
+	}
+	/* the cache of this worker thread, only a handful of sizes are in use so they are searched linearly. Nothing in
+	 * between the lookup and the last use of the list may suspend the HPX thread, it could resume on another worker */
+	static free_list& local(std::size_t size) {
+		static thread_local std::vector<std::pair<std::size_t, free_list>> *cache =
+				new std::vector<std::pair<std::size_t, free_list>>;
+		for (auto &entry : *cache) {
+			if (entry.first == size) {
+				return entry.second;
+			}
+		}
+		cache->emplace_back(size, free_list());
+		cache->back().second.reserve(local_max);
+		return cache->back().second;
+	}
+public:
+	static std::vector<T> get(std::size_t size) {
+		if (size == 0) {
+			return std::vector<T>();
+		}
+		auto &s = state();
+		std::vector<T> buffer;
+		s.counters.requests++;
+		{
+			auto &list = local(size);
+			if (!list.empty()) {
+				buffer = std::move(list.back());
+				list.pop_back();
+			}
+		}
+		if (buffer.capacity() == 0) {
+			std::lock_guard<hpx::lcos::local::spinlock> lock(s.mtx);
+			auto it = s.free.find(size);
+			if (it != s.free.end() && !it->second.empty()) {
+				buffer = std::move(it->second.back());
+				it->second.pop_back();
+			}
+		}
+		if (buffer.capacity() != 0) {
+			s.counters.hits++;
+			s.counters.pooled_bytes -= buffer.capacity() * sizeof(T);
+		}
+		buffer.resize(size);
+		return buffer;
+	}
+
+	/* max_free bounds the global list of this size further, for buffers whose numbers come in bursts */
+	static void recycle(std::vector<T> &&buffer, std::size_t max_free = global_max) {
+		if (buffer.capacity() == 0) {
+			return;
+		}
+		auto &s = state();
+		const std::size_t bytes = buffer.capacity() * sizeof(T);
+		const std::size_t size = buffer.size();
+		{
+			auto &list = local(size);
+			if (list.size() < local_max) {
+				list.push_back(std::move(buffer));
+				s.counters.pooled_bytes += bytes;
+				return;
+			}
+		}
+		std::lock_guard<hpx::lcos::local::spinlock> lock(s.mtx);
+		auto &list = s.free[size];
+		const std::size_t cap = max_free < global_max ? max_free : global_max;
+		if (list.size() < cap) {
+			list.push_back(std::move(buffer));
+			s.counters.pooled_bytes += bytes;
+		}
+	}
+
+	/* for buffers shared between nodes, the buffer goes back into the pool once the last reference is gone */
+	static std::shared_ptr<std::vector<T>> get_shared(std::size_t size) {
+		auto &s = state();
+		auto *buffer = new std::vector<T>(get(size));
+		const std::size_t bytes = buffer->capacity() * sizeof(T);
+		s.counters.live_bytes += bytes;
+		return std::shared_ptr<std::vector<T>>(buffer, [bytes](std::vector<T> *p) {
+			state().counters.live_bytes -= bytes;
+			recycle(std::move(*p));
+			delete p;
+		});
+	}
+
+	static const buffer_pool_counters& counters() {
+		return state().counters;
+	}
+};
+
+/* prints the counters of the FMM and halo buffer pools summed over all localities, called on the root */
+void buffer_pool_output();
+
+#endif /* OCTOTIGER_BUFFER_POOL_HPP_ */
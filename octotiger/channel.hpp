@@ -81,6 +81,22 @@ public:
 
 };
 
+/* counting semaphore whose wait is a future, every future consumes one signal in the order they were requested */
+class signal_channel {
+private:
+	channel<bool> ch;
+public:
+	void signal() {
+		ch.set_value(true);
+	}
+
+	hpx::future<void> get_future() {
+		return ch.get_future().then(hpx::launch::sync, [](hpx::future<bool> &&f) {
+			f.get();
+		});
+	}
+};
+
 
 
 #endif /* CHANNEL_HPP_ */
@@ -11,6 +11,7 @@
 #include "octotiger/common_kernel/multiindex.hpp"
 #include "octotiger/taylor.hpp"
 
+#include <cstdint>
 #include <vector>
 
 namespace octotiger {
@@ -129,6 +130,11 @@ namespace fmm {
             }
         }
 
+        /** Padded flat indices of the cells a compact gravity boundary from direction dir holds,
+         * in the order of the message (grid::get_ilist_n_bnd). Built once per locality on first
+         * use, so the kernels can scatter the boundary straight into their staging areas */
+        const std::vector<std::uint32_t>& compact_boundary_indices(const geo::direction& dir);
+
         // meant to iterate the input data structure
         // template <typename F>
         // void iterate_cells_padded(const F& f) {
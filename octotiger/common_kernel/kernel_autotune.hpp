@@ -0,0 +1,23 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "octotiger/config/export_definitions.hpp"
+
+namespace octotiger {
+namespace fmm {
+
+    /** Replaces every FMM interaction kernel type set to AUTO (multipole, p2p, p2m) by the
+     * fastest CPU variant. The variants are timed on the root only, on a synthetic sub-grid with
+     * all 26 neighbors present, and the choices are sent to every locality. They are appended to
+     * opts().kernel_tuning_file and reused by later runs with the same CPU model, SIMD flavor,
+     * sub-grid size and theta. Has to run on the root after every locality is initialized and
+     * before the tree is built.
+     */
+    OCTOTIGER_EXPORT void autotune_interaction_kernels();
+
+}    // namespace fmm
+}    // namespace octotiger
@@ -0,0 +1,118 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <hpx/include/async.hpp>
+#include <hpx/include/lcos.hpp>
+#include <hpx/include/threads.hpp>
+#include <hpx/synchronization/spinlock.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace octotiger {
+namespace fmm {
+
+    /** Sub-grids of this locality waiting for a batched interaction kernel. A sub-grid is only
+      * queued once its input is staged, so everything in the queue is ready to run. As soon as
+      * max_batch sub-grids with the same key are queued they run as one batch, on the thread of
+      * the last one. Whatever is left is taken by a low priority task, which the scheduler only
+      * starts when it has nothing else to run, that is once every sub-grid that could have
+      * joined has been queued or is still waiting for its own input.
+      * Item has a key() that is equal for sub-grids that can share a batch, a
+      * hpx::lcos::local::promise<void> done that is set once its results are written, and a
+      * double kernel_share that the run function sets to its part of the kernel time */
+    template <class Item>
+    class kernel_batch_queue
+    {
+    public:
+        using batch_type = std::vector<Item*>;
+
+        explicit kernel_batch_queue(std::function<void(const batch_type&)> run)
+          : run_(std::move(run)) {}
+
+        kernel_batch_queue(const kernel_batch_queue&) = delete;
+        kernel_batch_queue& operator=(const kernel_batch_queue&) = delete;
+
+        /// Queues item, its done promise is set once its batch has run
+        void submit(Item& item, std::size_t max_batch) {
+            batch_type batch;
+            bool schedule_flush = false;
+            {
+                std::lock_guard<hpx::lcos::local::spinlock> lock(mtx_);
+                max_batch_ = max_batch;
+                queue_.push_back(&item);
+                std::size_t same = 0;
+                for (const auto* waiting : queue_) {
+                    if (waiting->key() == item.key()) {
+                        same++;
+                    }
+                }
+                if (same >= max_batch) {
+                    batch = take(queue_, item.key(), max_batch);
+                } else if (!flush_scheduled_) {
+                    flush_scheduled_ = schedule_flush = true;
+                }
+            }
+            if (schedule_flush) {
+                hpx::async(hpx::launch::async(hpx::threads::thread_priority_low),
+                    [this]() { flush(); });
+            }
+            if (!batch.empty()) {
+                run_batch(batch);
+            }
+        }
+
+    private:
+        /// Up to max_batch entries of q with key, oldest first
+        template <class Key>
+        static batch_type take(std::deque<Item*>& q, const Key& key, std::size_t max_batch) {
+            batch_type batch;
+            for (auto it = q.begin(); it != q.end() && batch.size() < max_batch;) {
+                if ((*it)->key() == key) {
+                    batch.push_back(*it);
+                    it = q.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            return batch;
+        }
+
+        void flush() {
+            std::deque<Item*> waiting;
+            std::size_t max_batch;
+            {
+                std::lock_guard<hpx::lcos::local::spinlock> lock(mtx_);
+                flush_scheduled_ = false;
+                waiting.swap(queue_);
+                max_batch = max_batch_;
+            }
+            while (!waiting.empty()) {
+                const auto key = waiting.front()->key();
+                run_batch(take(waiting, key, max_batch));
+            }
+        }
+
+        void run_batch(const batch_type& batch) {
+            run_(batch);
+            for (auto* item : batch) {
+                item->done.set_value();
+            }
+        }
+
+        std::function<void(const batch_type&)> run_;
+        hpx::lcos::local::spinlock mtx_;
+        std::deque<Item*> queue_;
+        std::size_t max_batch_ = 1;
+        bool flush_scheduled_ = false;
+    };
+}    // namespace fmm
+}    // namespace octotiger
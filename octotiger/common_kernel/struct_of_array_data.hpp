@@ -6,6 +6,12 @@
 #pragma once
 
 #include "kernel_simd_types.hpp"
+
+#include <boost/align/aligned_allocator.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
 #ifdef OCTOTIGER_HAVE_CUDA
 #include "../cuda_util/cuda_helper.hpp"
 #endif
@@ -47,6 +53,19 @@ namespace fmm {
                 data.data() + flat_index + component_array_offset);
         }
 
+        /// Same as pointer and value, for loops over the components
+        inline component_type* pointer(const size_t component_access, const size_t flat_index) {
+            return data.data() + flat_index + component_access * padded_entries_per_component;
+        }
+        inline m2m_vector value(const size_t component_access, const size_t flat_index) const {
+            return m2m_vector(
+                data.data() + flat_index + component_access * padded_entries_per_component);
+        }
+        /// Sets every entry to zero, for areas that are reused
+        void clear() {
+            std::fill(data.begin(), data.end(), component_type(0));
+        }
+
         template <typename AoS_temp_type>
         void set_AoS_value(AoS_temp_type&& value, size_t flatindex) {
             for (size_t component = 0; component < num_components; component++) {
@@ -122,5 +141,62 @@ namespace fmm {
             }
         }
     };
+
+    // Same layout as struct_of_array_data, but the number of components and entries is only
+    // known at runtime (e.g. the number of hydro fields depends on n_species). All components
+    // live in one contiguous buffer, each one padded to a multiple of the alignment so that
+    // every component starts on an aligned address.
+    template <typename component_type, size_t alignment = 64,
+        typename backend_t = std::vector<component_type,
+            boost::alignment::aligned_allocator<component_type, alignment>>>
+    class struct_of_array_slabs
+    {
+    private:
+        size_t num_components_;
+        size_t padded_entries_per_component_;
+        /// data in SoA form - one slab per component
+        backend_t data;
+
+    public:
+        static constexpr size_t entries_per_alignment = alignment / sizeof(component_type);
+
+        static constexpr size_t padded_size(const size_t entries) {
+            return ((entries + entries_per_alignment - 1) / entries_per_alignment) *
+                entries_per_alignment;
+        }
+
+        struct_of_array_slabs()
+          : num_components_(0)
+          , padded_entries_per_component_(0) {}
+
+        struct_of_array_slabs(const size_t num_components, const size_t entries) {
+            resize(num_components, entries);
+        }
+
+        void resize(const size_t num_components, const size_t entries) {
+            num_components_ = num_components;
+            padded_entries_per_component_ = padded_size(entries);
+            data.resize(num_components_ * padded_entries_per_component_, component_type(0));
+        }
+
+        inline component_type* get_pod() {
+            return data.data();
+        }
+        inline const component_type* get_pod() const {
+            return data.data();
+        }
+        inline component_type* slab(const size_t component) {
+            return data.data() + component * padded_entries_per_component_;
+        }
+        inline const component_type* slab(const size_t component) const {
+            return data.data() + component * padded_entries_per_component_;
+        }
+        inline size_t num_components() const {
+            return num_components_;
+        }
+        inline size_t padded_entries_per_component() const {
+            return padded_entries_per_component_;
+        }
+    };
 }    // namespace fmm
 }    // namespace octotiger
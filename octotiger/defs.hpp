@@ -165,9 +165,14 @@ constexpr real ei_floor = 1.0e-15;
 #ifdef USE_RK3
 constexpr integer NRK = 3;
 constexpr real rk_beta[3] = { 1.0, 1.0/4.0, 2.0/3.0 };
+/* weight of each stage's dU/dt in the whole step, and the time of the stage's state within the step */
+constexpr real rk_weight[3] = { 1.0/6.0, 1.0/6.0, 2.0/3.0 };
+constexpr real rk_time[3] = { 0.0, 1.0, 0.5 };
 #else
 constexpr integer NRK = 2;
 constexpr real rk_beta[2] = { ONE, HALF };
+constexpr real rk_weight[2] = { HALF, HALF };
+constexpr real rk_time[2] = { ZERO, ONE };
 #endif
 
 
@@ -81,6 +81,11 @@ struct diagnostics_t {
 		l2_phi = -std::numeric_limits<safe_real>::max();
 		l3_phi = -std::numeric_limits<safe_real>::max();
 	}
+	/* DWD refines the Roche geometry over five stages, each one a reduction over the tree. The sums that do not
+	 * depend on the geometry are only taken in the last one */
+	static inline integer last_stage() {
+		return opts().problem == DWD ? 5 : 1;
+	}
 	static inline safe_real RL_radius(safe_real q) {
 		const safe_real q13 = std::pow(q, 1.0 / 3.0);
 		const safe_real q23 = q13 * q13;
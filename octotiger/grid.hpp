@@ -28,6 +28,7 @@
 #include <hpx/serialization/serialize.hpp>
 #include <hpx/serialization/traits/is_bitwise_serializable.hpp>
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <utility>
@@ -128,6 +129,8 @@ private:
 	std::vector<std::vector<safe_real>> U0;
 	std::vector<std::vector<safe_real>> dUdt;
 	std::vector<hydro_state_t<std::vector<safe_real>>> F;
+	/* fluxes on the faces of the block summed over the stages and steps of --hydro_subcycle, times dt */
+	std::vector<hydro_state_t<std::vector<safe_real>>> F_sum;
 	std::vector<std::vector<safe_real>> X;
 	std::vector<v4sd> G;
 	std::shared_ptr<std::vector<multipole>> M_ptr;
@@ -148,6 +151,8 @@ private:
 	std::vector<real> U_out0;
 	std::vector<std::shared_ptr<std::vector<space_vector>>> com_ptr;
 	static bool xpoint_eq(const xpoint& a, const xpoint& b);
+	static std::vector<real> restrict_faces(const std::vector<hydro_state_t<std::vector<safe_real>>>& f, const std::array<integer, NDIM>& lb,
+			const std::array<integer, NDIM>& ub, const geo::dimension& dim);
 	void compute_boundary_interactions_multipole_multipole(gsolve_type type, const std::vector<boundary_interaction_type>&,
 			const gravity_boundary_type&);
 	void compute_boundary_interactions_monopole_monopole(gsolve_type type, const std::vector<boundary_interaction_type>&,
@@ -226,6 +231,12 @@ public:
 		scaling_factor = f;
 	}
 	diagnostics_t diagnostics(const diagnostics_t& diags);
+	/* copy of the fields diagnostics() reads, so the diagnostics can be reduced while this grid steps on */
+	std::shared_ptr<grid> diagnostics_snapshot() const;
+	/* takes the Roche lobes diagnostics() computed on a snapshot */
+	void set_roche_lobe(grid&& snapshot) {
+		roche_lobe = std::move(snapshot.roche_lobe);
+	}
 	static real get_scaling_factor() {
 		return scaling_factor;
 	}
@@ -268,7 +279,13 @@ public:
 	std::vector<real> get_flux_check(const geo::face&);
 	void set_flux_check(const std::vector<real>&, const geo::face&);
 	void set_hydro_boundary(const std::vector<real>&, const geo::direction&, bool energy_only);
-	std::vector<real> get_hydro_boundary(const geo::direction& face, bool energy_only);
+	/* same as above, copying straight from the interior of a sibling on this locality */
+	void set_hydro_boundary(const grid& sibling, const geo::direction&, bool energy_only);
+	/* theta < 1 sends the state interpolated in time between the last store and now */
+	std::vector<real> get_hydro_boundary(const geo::direction& face, bool energy_only, real theta = 1.0);
+	/* message buffers for remote boundaries, received buffers go back into the pool once they are unpacked */
+	static std::vector<real> get_hydro_buffer(std::size_t size);
+	static void recycle_hydro_buffer(std::vector<real>&& buffer);
 	scf_data_t scf_params();
 	real scf_update(real, real, real, real, real, real, real, struct_eos, struct_eos);
 	std::pair<std::vector<real>, std::vector<real> > field_range() const;
@@ -285,6 +302,12 @@ public:
 	void set_restrict(const std::vector<real>&, const geo::octant&);
 	void set_flux_restrict(const std::vector<real>&, const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub,
 			const geo::dimension&);
+	void add_flux_sum(real weight);
+	void clear_flux_sum(const geo::face&);
+	std::vector<real> get_flux_sum_restrict(const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub,
+			const geo::dimension&) const;
+	void reflux(const std::vector<real>&, const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub, const geo::face&);
+	void clear_dphi_dt();
 	space_vector center_of_mass() const;
 	bool refine_me(integer lev, integer last_ngrids) const;
 	void compute_dudt();
@@ -329,13 +352,12 @@ public:
 #endif
 	space_vector get_cell_center(integer i, integer j, integer k);
 	gravity_boundary_type get_gravity_boundary(const geo::direction& dir, bool is_local);
-	neighbor_gravity_type fill_received_array(neighbor_gravity_type raw_input);
 
-	const std::vector<boundary_interaction_type>& get_ilist_n_bnd(const geo::direction &dir);
+	static const std::vector<boundary_interaction_type>& get_ilist_n_bnd(const geo::direction &dir);
 	void allocate();
 	void store();
 	void restore();
-	timestep_t compute_fluxes();
+	timestep_t compute_fluxes(hydro::region region = hydro::region::all);
 	real compute_positivity_speed_limit() const;
 	void compute_sources(real t, real);
 	void set_physical_boundaries(const geo::face&, real t);
@@ -375,6 +397,33 @@ struct is_bitwise_serializable<grid::node_point> : std::true_type {
 }
 }
 
+/* a hydro boundary on its way to a sibling. Remote siblings get the ghost zone values packed into data. Siblings on
+ * the same locality get a pointer to the sending grid, copy from its interior and then signal local_semaphore, the
+ * sender must not change its interior before that */
+struct hydro_boundary_type {
+	std::vector<real> data;
+	const grid* local_grid = nullptr;
+	semaphore* local_semaphore = nullptr;
+	template<class Arc>
+	void save(Arc& arc, unsigned) const {
+		const std::uintptr_t g = reinterpret_cast<std::uintptr_t>(local_grid);
+		const std::uintptr_t s = reinterpret_cast<std::uintptr_t>(local_semaphore);
+		wire_save(arc, data, wire_hydro_boundary);
+		arc << g;
+		arc << s;
+	}
+	template<class Arc>
+	void load(Arc& arc, unsigned) {
+		std::uintptr_t g, s;
+		wire_load(arc, data);
+		arc >> g;
+		arc >> s;
+		local_grid = reinterpret_cast<const grid*>(g);
+		local_semaphore = reinterpret_cast<semaphore*>(s);
+	}
+	HPX_SERIALIZATION_SPLIT_MEMBER();
+};
+
 void scf_binary_init();
 
 template<class Archive>
@@ -5,12 +5,12 @@
 
 #pragma once
 
+#include "octotiger/channel.hpp"
 #include "octotiger/geometry.hpp"
 #include "octotiger/simd.hpp"
 #include "octotiger/space_vector.hpp"
 #include "octotiger/taylor.hpp"
-
-#include <hpx/synchronization/counting_semaphore.hpp>
+#include "octotiger/wire_codec.hpp"
 
 #include <Vc/Vc>
 
@@ -21,7 +21,7 @@
 
 using multipole_pass_type = std::pair<std::vector<multipole>, std::vector<space_vector>>;
 using expansion_pass_type = std::pair<std::vector<expansion>, std::vector<space_vector>>;
-using semaphore = hpx::lcos::local::counting_semaphore;
+using semaphore = signal_channel;
 
 struct gravity_boundary_type
 {
@@ -42,15 +42,27 @@ struct gravity_boundary_type
         }
     }
     template <class Archive>
-    void serialize(Archive& arc, unsigned) {
-        allocate();
+    void save(Archive& arc, unsigned) const {
+        static const std::vector<multipole> no_M;
+        static const std::vector<real> no_m;
+        static const std::vector<space_vector> no_x;
         std::uintptr_t tmp = reinterpret_cast<std::uintptr_t>(local_semaphore);
-        arc& M;
-        arc& m;
-        arc& x;
-        arc& tmp;
+        wire_save(arc, M ? *M : no_M);
+        wire_save(arc, m ? *m : no_m, wire_gravity_boundary);
+        wire_save(arc, x ? *x : no_x);
+        arc << tmp;
+    }
+    template <class Archive>
+    void load(Archive& arc, unsigned) {
+        allocate();
+        std::uintptr_t tmp;
+        wire_load(arc, *M);
+        wire_load(arc, *m);
+        wire_load(arc, *x);
+        arc >> tmp;
         local_semaphore = reinterpret_cast<decltype(local_semaphore)>(tmp);
     }
+    HPX_SERIALIZATION_SPLIT_MEMBER();
 };
 Vc_DECLARE_ALLOCATOR(gravity_boundary_type)
 
@@ -138,5 +150,5 @@ Vc_DECLARE_ALLOCATOR(boundary_interaction_type)
 #include "options_enum.hpp"
 #include <boost/algorithm/string.hpp>
 
-COMMAND_LINE_ENUM(interaction_kernel_type,SOA_CPU,OLD,SOA_CUDA);
+COMMAND_LINE_ENUM(interaction_kernel_type,SOA_CPU,OLD,SOA_CUDA,AUTO);
 
@@ -20,6 +20,13 @@ namespace fmm {
             tmpstore[2] = tmpstore[2] + four[2] * monopole * d_components[1];
             tmpstore[3] = tmpstore[3] + four[3] * monopole * d_components[1];
         }
+
+        /// Potential only, for solves that never read the gradient (DRHODT at the leaves)
+        template <typename T>
+        CUDA_CALLABLE_METHOD inline void compute_monopole_potential(const T& monopole,
+            T (&tmpstore)[4], const T (&four)[4], const T (&d_components)[2]) noexcept {
+            tmpstore[0] = tmpstore[0] + four[0] * monopole * d_components[0];
+        }
     }    // namespace monopole_interactions
 }    // namespace fmm
 }    // namespace octotiger
@@ -89,7 +89,7 @@ namespace fmm {
             std::vector<space_vector> const& com0 = *(com_ptr[0]);
 
             iterate_inner_cells_padded([&center_of_masses_SoA, &local_expansions_SoA,
-                                        &local_monopoles, mons, multipoles, com0]
+                                        &local_monopoles, &mons, &multipoles, &com0]
                                        (const multiindex<>& i, const size_t flat_index,
                 const multiindex<>& i_unpadded, const size_t flat_index_unpadded) {
                 center_of_masses_SoA.set_AoS_value(
@@ -142,7 +142,7 @@ namespace fmm {
                             iterate_inner_cells_padding(
                                 dir,
                                 [&local_monopoles, &local_expansions_SoA, &center_of_masses_SoA,
-                                    neighbor_M_ptr, neighbor_com0](const multiindex<>& i,
+                                    &neighbor_M_ptr, &neighbor_com0](const multiindex<>& i,
                                     const size_t flat_index, const multiindex<>& i_unpadded,
                                     const size_t flat_index_unpadded) {
                                     local_expansions_SoA.set_AoS_value(
@@ -166,24 +166,13 @@ namespace fmm {
                                         std::move(space_vector()), flat_index);
                                     local_monopoles.at(flat_index) = 0.0;
                                 });
-                            auto list = grid_ptr->get_ilist_n_bnd(dir);
-                            size_t counter = 0;
-                            for (auto i : list) {
-                                const integer iii = i.second;
-                                const multiindex<> offset =
-                                    flat_index_to_multiindex_not_padded(iii);
-                                const multiindex<> m(offset.x + INNER_CELLS_PADDING_DEPTH +
-                                        dir[0] * INNER_CELLS_PADDING_DEPTH,
-                                    offset.y + INNER_CELLS_PADDING_DEPTH +
-                                        dir[1] * INNER_CELLS_PADDING_DEPTH,
-                                    offset.z + INNER_CELLS_PADDING_DEPTH +
-                                        dir[2] * INNER_CELLS_PADDING_DEPTH);
-                                const size_t flat_index = to_flat_index_padded(m);
+                            const auto& indices = compact_boundary_indices(dir);
+                            for (size_t counter = 0; counter < indices.size(); counter++) {
+                                const size_t flat_index = indices[counter];
                                 local_expansions_SoA.set_AoS_value(
-                                    std::move(neighbor_M_ptr.at(counter)), flat_index);
+                                    std::move(neighbor_M_ptr[counter]), flat_index);
                                 center_of_masses_SoA.set_AoS_value(
-                                    std::move(neighbor_com0.at(counter)), flat_index);
-                                counter++;
+                                    std::move(neighbor_com0[counter]), flat_index);
                             }
                         }
                     }
@@ -11,6 +11,7 @@
 #include "octotiger/common_kernel/multiindex.hpp"
 #include "octotiger/common_kernel/struct_of_array_data.hpp"
 
+#include "octotiger/defs.hpp"
 #include "octotiger/real.hpp"
 #include "octotiger/taylor.hpp"
 
@@ -24,6 +25,8 @@ namespace fmm {
     namespace monopole_interactions {
 
         constexpr uint64_t P2P_STENCIL_BLOCKING = 24;
+        /// Largest number of sub-grids apply_stencil_batched handles at once
+        constexpr size_t P2P_MAX_BATCH = 8;
         class p2p_cpu_kernel
         {
         private:
@@ -46,7 +49,17 @@ namespace fmm {
                 const size_t cell_flat_index_unpadded,
                 const std::vector<bool>& __restrict__ stencil,
                 const std::vector<std::array<real, 4>>& __restrict__ four_constants,
-                const size_t outer_stencil_index, real dx);
+                const size_t outer_stencil_index, real dx, gsolve_type type);
+
+            void cell_interactions_batched(const std::vector<const std::vector<real>*>& mons,
+                const std::vector<struct_of_array_data<expansion, real, 20, INNER_CELLS,
+                    SOA_PADDING>*>& potential_expansions_SoA,
+                const multiindex<>& __restrict__ cell_index,
+                const multiindex<m2m_int_vector>& __restrict__ cell_index_coarse,
+                const size_t cell_flat_index_unpadded,
+                const std::vector<bool>& __restrict__ stencil,
+                const std::vector<std::array<real, 4>>& __restrict__ four_constants, real dx,
+                gsolve_type type);
 
         public:
             p2p_cpu_kernel(std::vector<bool>& neighbor_empty);
@@ -62,7 +75,16 @@ namespace fmm {
                     potential_expansions_SoA,
                 const std::vector<bool>& stencil, const
                 std::vector<std::array<real, 4>>& four,
-                real dx);
+                real dx, gsolve_type type);
+
+            /** Same as apply_stencil for up to P2P_MAX_BATCH sub-grids of one level. The stencil
+              * masks and the distance criteria only depend on the cell, they are evaluated once
+              * and applied to every sub-grid of the batch */
+            void apply_stencil_batched(const std::vector<const std::vector<real>*>& mons,
+                const std::vector<struct_of_array_data<expansion, real, 20, INNER_CELLS,
+                    SOA_PADDING>*>& potential_expansions_SoA,
+                const std::vector<bool>& stencil, const std::vector<std::array<real, 4>>& four,
+                real dx, gsolve_type type);
         };
 
     }    // namespace monopole_interactions
@@ -14,15 +14,34 @@
 #include "octotiger/interaction_types.hpp"
 #include "octotiger/monopole_interactions/p2p_cpu_kernel.hpp"
 
+#include <hpx/include/lcos.hpp>
+
 #include <array>
 #include <cstddef>
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace octotiger {
 namespace fmm {
     namespace monopole_interactions {
 
+        /// A sub-grid waiting for the batched p2p kernel
+        struct p2p_batch_item
+        {
+            std::vector<real> monopoles;
+            std::shared_ptr<grid> grid_ptr;
+            real dx;
+            gsolve_type type;
+            /// seconds of the batch kernel that belong to this sub-grid
+            double kernel_share = 0.0;
+            hpx::lcos::local::promise<void> done;
+            /// sub-grids of one level share dx, only those can share a batch
+            std::pair<real, gsolve_type> key() const {
+                return {dx, type};
+            }
+        };
+
         /// Interface for the new monopole-monopole compute kernel
         class p2p_interaction_interface
         {
@@ -33,6 +52,11 @@ namespace fmm {
             void compute_p2p_interactions(std::vector<real>& monopoles,
                 std::vector<neighbor_gravity_type>& neighbors, gsolve_type type, real dx,
                 std::array<bool, geo::direction::count()>& is_direction_empty);
+            /** Seconds of the last compute_p2p_interactions spent on the batch's other
+              * sub-grids or waiting for them, not to be counted as cost of this sub-grid */
+            double other_grids_time() const {
+                return other_grids_time_;
+            }
             /// Sets the grid pointer - usually only required once
             void set_grid_ptr(std::shared_ptr<grid> ptr) {
                 grid_ptr = ptr;
@@ -46,9 +70,17 @@ namespace fmm {
             void compute_interactions(gsolve_type type,
                 std::array<bool, geo::direction::count()>& is_direction_empty,
                 std::vector<neighbor_gravity_type>& all_neighbor_interaction_data, real dx);
+            /** SOA_CPU with --p2p_batch_size > 1: queues the staged input of this sub-grid with
+              * the other ready sub-grids of the locality and returns once its potential is in L,
+              * see kernel_batch_queue */
+            void compute_interactions_batched(std::vector<real>& monopoles,
+                std::vector<neighbor_gravity_type>& neighbors, gsolve_type type, real dx);
 
+            /// the staged input of this sub-grid while it waits for its batch
+            p2p_batch_item batch_item_;
             std::shared_ptr<grid> grid_ptr;
             interaction_kernel_type p2p_type;
+            double other_grids_time_ = 0.0;
         public:
             static OCTOTIGER_EXPORT size_t& cpu_launch_counter();
             static OCTOTIGER_EXPORT size_t& cuda_launch_counter();
@@ -70,7 +102,7 @@ namespace fmm {
             std::vector<neighbor_gravity_type>& neighbors, gsolve_type type,
             monopole_container& local_monopoles) {
             iterate_inner_cells_padded(
-                [&local_monopoles, mons](const multiindex<>& i, const size_t flat_index,
+                [&local_monopoles, &mons](const multiindex<>& i, const size_t flat_index,
                     const multiindex<>& i_unpadded, const size_t flat_index_unpadded) {
                     local_monopoles.at(flat_index) = mons.at(flat_index_unpadded);
                 });
@@ -105,7 +137,7 @@ namespace fmm {
                             const bool fullsizes = neighbor_mons.size() == INNER_CELLS;
                             if (fullsizes) {
                                 iterate_inner_cells_padding(
-                                    dir, [&local_monopoles, neighbor_mons](const multiindex<>& i,
+                                    dir, [&local_monopoles, &neighbor_mons](const multiindex<>& i,
                                              const size_t flat_index, const multiindex<>&,
                                              const size_t flat_index_unpadded) {
                                         // initializes whole expansion, relatively expansion
@@ -121,22 +153,10 @@ namespace fmm {
                                         // initializes whole expansion, relatively expansion
                                         local_monopoles.at(flat_index) = 0.0;
                                     });
-                                auto list = grid_ptr->get_ilist_n_bnd(dir);
-                                size_t counter = 0;
-                                // Load relevant stuff
-                                for (auto i : list) {
-                                    const integer iii = i.second;
-                                    const multiindex<> offset =
-                                        flat_index_to_multiindex_not_padded(iii);
-                                    const multiindex<> m(offset.x + INNER_CELLS_PADDING_DEPTH +
-                                            dir[0] * INNER_CELLS_PADDING_DEPTH,
-                                        offset.y + INNER_CELLS_PADDING_DEPTH +
-                                            dir[1] * INNER_CELLS_PADDING_DEPTH,
-                                        offset.z + INNER_CELLS_PADDING_DEPTH +
-                                            dir[2] * INNER_CELLS_PADDING_DEPTH);
-                                    const size_t flat_index = to_flat_index_padded(m);
-                                    local_monopoles.at(flat_index) = neighbor_mons.at(counter);
-                                    counter++;
+                                const auto& indices = compact_boundary_indices(dir);
+                                for (size_t counter = 0; counter < indices.size(); counter++) {
+                                    const size_t flat_index = indices[counter];
+                                    local_monopoles.at(flat_index) = neighbor_mons[counter];
                                 }
                             }
                         }
@@ -21,6 +21,9 @@ namespace octotiger {
 namespace fmm {
     namespace multipole_interactions {
 
+        /// Largest number of sub-grids the interface hands to apply_stencil_batched at once
+        constexpr size_t MULTIPOLE_MAX_BATCH = 8;
+
         /** Controls the order in which the cpu multipole FMM interactions are calculated
          * (blocking). The actual numeric operations are found in compute_kernel_templates.hpp. This
          * class is mostly responsible for loading data and control the order to increase cache
@@ -89,6 +92,21 @@ namespace fmm {
                 const std::vector<bool>& stencil, const
                 std::vector<bool>& inner_mask, const size_t outer_stencil_index);
 
+            /// Interactions of one cell of one sub-grid of a batch with the partners selected by
+            /// apply_stencil_batched
+            void batched_interaction(bool rho, const struct_of_array_data<expansion, real, 20,
+                                                   ENTRIES, SOA_PADDING>& local_expansions_SoA,
+                const struct_of_array_data<space_vector, real, 3, ENTRIES, SOA_PADDING>&
+                    center_of_masses_SoA,
+                struct_of_array_data<expansion, real, 20, INNER_CELLS, SOA_PADDING>&
+                    potential_expansions_SoA,
+                struct_of_array_data<space_vector, real, 3, INNER_CELLS, SOA_PADDING>&
+                    angular_corrections_SoA,
+                const std::vector<real>& mons, const size_t cell_flat_index,
+                const size_t cell_flat_index_unpadded, const size_t* partner_flat_index,
+                const m2m_vector::mask_type* partner_mask,
+                const m2m_vector::mask_type* partner_mask_phase_one, const size_t partners);
+
         public:
             multipole_cpu_kernel();
 
@@ -119,6 +137,21 @@ namespace fmm {
                     angular_corrections_SoA,
                 const std::vector<real>& mons, const std::vector<bool> &stencil, const std::vector<bool>&
                 inner_stencil, gsolve_type type);
+
+            /// Same as apply_stencil for several sub-grids of the same gsolve_type. The partners
+            /// of a cell that pass the opening criterion do not depend on the sub-grid, they are
+            /// found once per block and cell and then used for every sub-grid of the batch
+            void apply_stencil_batched(
+                const std::vector<const struct_of_array_data<expansion, real, 20, ENTRIES,
+                    SOA_PADDING>*>& local_expansions_SoA,
+                const std::vector<const struct_of_array_data<space_vector, real, 3, ENTRIES,
+                    SOA_PADDING>*>& center_of_masses_SoA,
+                const std::vector<struct_of_array_data<expansion, real, 20, INNER_CELLS,
+                    SOA_PADDING>*>& potential_expansions_SoA,
+                const std::vector<struct_of_array_data<space_vector, real, 3, INNER_CELLS,
+                    SOA_PADDING>*>& angular_corrections_SoA,
+                const std::vector<const std::vector<real>*>& mons, const two_phase_stencil& stencil,
+                gsolve_type type);
         };
 
     }    // namespace multipole_interactions
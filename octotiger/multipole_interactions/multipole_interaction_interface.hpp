@@ -16,6 +16,8 @@
 #include "octotiger/interaction_types.hpp"
 #include "octotiger/taylor.hpp"
 
+#include <hpx/include/lcos.hpp>
+
 #include <array>
 #include <memory>
 #include <vector>
@@ -24,6 +26,27 @@ namespace octotiger {
 namespace fmm {
     namespace multipole_interactions {
 
+        /// A sub-grid waiting for the batched multipole kernel
+        struct multipole_batch_item
+        {
+            /// staged input, owned by the interface until the batch has run
+            const std::vector<real>* monopoles = nullptr;
+            const struct_of_array_data<expansion, real, 20, ENTRIES, SOA_PADDING>*
+                local_expansions = nullptr;
+            const struct_of_array_data<space_vector, real, 3, ENTRIES, SOA_PADDING>*
+                center_of_masses = nullptr;
+            std::shared_ptr<grid> grid_ptr;
+            gsolve_type type;
+            /// seconds of the batch kernel that belong to this sub-grid
+            double kernel_share = 0.0;
+            hpx::lcos::local::promise<void> done;
+            /// the opening criterion works on cell indices, so sub-grids of all levels can share
+            /// a batch as long as they compute the same kind of interactions
+            gsolve_type key() const {
+                return type;
+            }
+        };
+
         /// Interface to the SoA FMM interaction kernels
         class multipole_interaction_interface
         {
@@ -40,6 +63,10 @@ namespace fmm {
             void set_grid_ptr(std::shared_ptr<grid> ptr) {
                 grid_ptr = ptr;
             }
+            /// Seconds of the last call that were spent on the kernels of other sub-grids
+            double other_grids_time() const {
+                return other_grids_time_;
+            }
         public:
             static OCTOTIGER_EXPORT size_t& cpu_launch_counter();
             static OCTOTIGER_EXPORT size_t& cuda_launch_counter();
@@ -65,6 +92,15 @@ namespace fmm {
                 const struct_of_array_data<space_vector, real, 3, ENTRIES, SOA_PADDING>&
                     center_of_masses_SoA);
 
+            /** SOA_CPU with the blocked stencil and --multipole_batch_size > 1: queues the staged
+              * input of this sub-grid with the other ready sub-grids of the locality and returns
+              * once its results are in L and L_c, see kernel_batch_queue */
+            void compute_interactions_batched(std::vector<real>& monopoles,
+                std::vector<multipole>& M_ptr,
+                std::vector<std::shared_ptr<std::vector<space_vector>>>& com_ptr,
+                std::vector<neighbor_gravity_type>& neighbors, gsolve_type type, real dx,
+                std::array<real, NDIM> xbase);
+
         protected:
             gsolve_type type;
             real dX;
@@ -73,6 +109,11 @@ namespace fmm {
             std::shared_ptr<grid> grid_ptr;
             /// Option whether SoA Kernels should be called or the old AoS methods
             interaction_kernel_type m2m_type;
+            /// SOA_CPU only: use apply_stencil instead of apply_stencil_non_blocked
+            bool blocked_stencil;
+            /// the staged input of this sub-grid while it waits for its batch
+            multipole_batch_item batch_item_;
+            double other_grids_time_ = 0.0;
 
         private:
             /// SoA conversion area - used as input for compute_interactions
@@ -105,7 +146,7 @@ namespace fmm {
             xBase = xbase;
             std::vector<space_vector> const& com0 = *(com_ptr[0]);
 
-            iterate_inner_cells_padded([M_ptr, com0, &local_expansions_SoA, &center_of_masses_SoA,
+            iterate_inner_cells_padded([&M_ptr, &com0, &local_expansions_SoA, &center_of_masses_SoA,
                 &local_monopoles](const multiindex<>& i, const size_t flat_index,
                 const multiindex<>& i_unpadded, const size_t flat_index_unpadded) {
                 local_expansions_SoA.set_AoS_value(
@@ -141,7 +182,7 @@ namespace fmm {
                             iterate_inner_cells_padding(
                                 dir,
                                 [&local_expansions_SoA, &center_of_masses_SoA, &local_monopoles,
-                                    neighbor_M_ptr, neighbor_com0](const multiindex<>& i,
+                                    &neighbor_M_ptr, &neighbor_com0](const multiindex<>& i,
                                     const size_t flat_index, const multiindex<>& i_unpadded,
                                     const size_t flat_index_unpadded) {
                                     local_expansions_SoA.set_AoS_value(
@@ -166,24 +207,13 @@ namespace fmm {
                                     local_monopoles.at(flat_index) = 0.0;
 
                                 });
-                            auto list = grid_ptr->get_ilist_n_bnd(dir);
-                            size_t counter = 0;
-                            for (auto i : list) {
-                                const integer iii = i.second;
-                                const multiindex<> offset =
-                                    flat_index_to_multiindex_not_padded(iii);
-                                const multiindex<> m(offset.x + INNER_CELLS_PADDING_DEPTH +
-                                        dir[0] * INNER_CELLS_PADDING_DEPTH,
-                                    offset.y + INNER_CELLS_PADDING_DEPTH +
-                                        dir[1] * INNER_CELLS_PADDING_DEPTH,
-                                    offset.z + INNER_CELLS_PADDING_DEPTH +
-                                        dir[2] * INNER_CELLS_PADDING_DEPTH);
-                                const size_t flat_index = to_flat_index_padded(m);
+                            const auto& indices = compact_boundary_indices(dir);
+                            for (size_t counter = 0; counter < indices.size(); counter++) {
+                                const size_t flat_index = indices[counter];
                                 local_expansions_SoA.set_AoS_value(
-                                    std::move(neighbor_M_ptr.at(counter)), flat_index);
+                                    std::move(neighbor_M_ptr[counter]), flat_index);
                                 center_of_masses_SoA.set_AoS_value(
-                                    std::move(neighbor_com0.at(counter)), flat_index);
-                                counter++;
+                                    std::move(neighbor_com0[counter]), flat_index);
                             }
                         }
                     }
@@ -208,7 +238,7 @@ namespace fmm {
                             iterate_inner_cells_padding(
                                 dir,
                                 [&local_expansions_SoA, &center_of_masses_SoA, &local_monopoles,
-                                 neighbor_mons, xbase, dx](const multiindex<>& i,
+                                 &neighbor_mons, xbase, dx](const multiindex<>& i,
                                                            const size_t flat_index, const multiindex<>& i_unpadded,
                                                            const size_t flat_index_unpadded) {
                                     space_vector e;
@@ -239,21 +269,10 @@ namespace fmm {
 
                                 });
                             // Load relevant values
-                            auto list = grid_ptr->get_ilist_n_bnd(dir);
-                            size_t counter = 0;
-                            for (auto i : list) {
-                                const integer iii = i.second;
-                                const multiindex<> offset =
-                                    flat_index_to_multiindex_not_padded(iii);
-                                const multiindex<> m(offset.x + INNER_CELLS_PADDING_DEPTH +
-                                        dir[0] * INNER_CELLS_PADDING_DEPTH,
-                                    offset.y + INNER_CELLS_PADDING_DEPTH +
-                                        dir[1] * INNER_CELLS_PADDING_DEPTH,
-                                    offset.z + INNER_CELLS_PADDING_DEPTH +
-                                        dir[2] * INNER_CELLS_PADDING_DEPTH);
-                                const size_t flat_index = to_flat_index_padded(m);
-                                local_monopoles.at(flat_index) = neighbor_mons.at(counter);
-                                counter++;
+                            const auto& indices = compact_boundary_indices(dir);
+                            for (size_t counter = 0; counter < indices.size(); counter++) {
+                                const size_t flat_index = indices[counter];
+                                local_monopoles.at(flat_index) = neighbor_mons[counter];
                             }
                         }
                     }
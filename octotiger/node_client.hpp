@@ -30,6 +30,7 @@ using set_child_aunt_type = integer;
 #endif
 
 struct node_count_type;
+struct load_balance_type;
 
 namespace hpx {
     using mutex = hpx::lcos::local::spinlock;
@@ -76,6 +77,7 @@ public:
     future<real> scf_update(
         real, real, real, real, real, real, real, struct_eos, struct_eos) const;
     future<std::pair<real,real>> amr_error() const;
+    future<std::vector<std::pair<real, integer>>> level_timesteps() const;
     void send_hydro_children(
         std::vector<real>&&, const geo::octant& ci, std::size_t cycle) const;
     void send_hydro_flux_correct(std::vector<real>&&, const geo::face& face,
@@ -85,6 +87,8 @@ public:
     void send_rad_flux_correct(std::vector<real>&&, const geo::face& face,
         const geo::octant& ci) const;
     future<diagnostics_t> diagnostics(const diagnostics_t&) const;
+    future<void> take_diagnostics_snapshot() const;
+    future<diagnostics_t> snapshot_diagnostics(const diagnostics_t&) const;
     future<analytic_t> compare_analytic() const;
     //	hpx::future<void> set_parent(hpx::id_type);
     node_client();
@@ -96,13 +100,13 @@ public:
         hpx::id_type&&, hpx::id_type&&, std::vector<hpx::id_type>&&);
     future<hpx::id_type> get_child_client(
         const node_location& parent_loc, const geo::octant&);
-    future<void> regrid_scatter(integer, integer) const;
+    future<void> regrid_scatter(integer, integer, real, load_balance_type) const;
     future<node_count_type> regrid_gather(bool) const;
     future<line_of_centers_t> line_of_centers(
         const std::pair<space_vector, space_vector>& line) const;
     void send_flux_check(std::vector<real>&&, const geo::direction& dir,
         std::size_t cycle) const;
-    void send_hydro_boundary(std::vector<real>&&, const geo::direction& dir,
+    void send_hydro_boundary(hydro_boundary_type&&, const geo::direction& dir,
         std::size_t cycle) const;
     void send_hydro_amr_boundary(std::vector<real>&&, const geo::direction& dir,
         std::size_t cycle) const;
@@ -131,6 +135,8 @@ public:
     void send_rad_boundary(
         std::vector<real>&&, const geo::direction&, std::size_t cycle) const;
     future<void> set_rad_grid(std::vector<real>&&) const;
+    void set_fld_partial(integer, std::vector<real>&&) const;
+    void fld_total_ascend(std::vector<real>&&) const;
     future<void> kill() const;
 };
 #endif /* NODE_CLIENT_HPP_ */
@@ -20,6 +20,7 @@
 #include "octotiger/node_client.hpp"
 #include "octotiger/node_location.hpp"
 #include "octotiger/profiler.hpp"
+#include "octotiger/trace.hpp"
 #include "octotiger/io/silo.hpp"
 //#include "octotiger/struct_eos.hpp"
 
@@ -38,14 +39,46 @@ struct node_count_type {
 	std::uint64_t total;
 	std::uint64_t leaf;
 	std::uint64_t amr_bnd;
+	/* measured kernel time of the nodes that have timings, and how many of them there are */
+	real cost;
+	std::uint64_t measured;
+	/* finest level with leaves */
+	integer finest_level;
 	template<class A>
 	void serialize(A& arc, unsigned) {
 		arc & total;
 		arc & leaf;
 		arc & amr_bnd;
+		arc & cost;
+		arc & measured;
+		arc & finest_level;
 	}
 	node_count_type() {
-		total = leaf = amr_bnd = std::uint64_t(0);
+		total = leaf = amr_bnd = measured = std::uint64_t(0);
+		cost = 0.0;
+		finest_level = 0;
+	}
+};
+
+/* Partition of the tree computed by node_server::regrid, passed down by regrid_scatter */
+struct load_balance_type {
+	/* weight of the whole tree */
+	real total;
+	/* weight assumed for a node that has no timings yet */
+	real unmeasured;
+	/* move existing nodes to their new locality, otherwise only new nodes are placed */
+	bool migrate;
+	/* keep the links of unchanged nodes, they are cleared before form_tree instead */
+	bool incremental;
+	real weight(const node_count_type& c) const {
+		return c.cost + real(c.total - c.measured) * unmeasured;
+	}
+	template<class A>
+	void serialize(A& arc, unsigned) {
+		arc & total;
+		arc & unmeasured;
+		arc & migrate;
+		arc & incremental;
 	}
 };
 
@@ -57,6 +90,8 @@ private:
 	struct sibling_hydro_type {
 		std::vector<real> data;
 		geo::direction direction;
+		const grid* local_grid = nullptr;
+		semaphore* local_semaphore = nullptr;
 	};
 	integer position;
 	std::atomic<integer> refinement_flag;
@@ -69,8 +104,14 @@ private:
 	real rotational_time;
 	std::shared_ptr<grid> grid_ptr; //
 	std::shared_ptr<rad_grid> rad_grid_ptr; //
+	/* leaves only, what the asynchronous diagnostics reduce while the grid steps on */
+	std::shared_ptr<grid> diagnostics_snapshot_;
 	std::atomic<bool> is_refined;
-	std::array<integer, NVERTEX> child_descendant_count;
+	std::array<node_count_type, NCHILD> child_descendant_count;
+	/* kernel time of this node measured up to the last regrid, zero if there were no timings */
+	real regrid_cost;
+	/* number of amr boundaries found below this node by the last form_tree */
+	int subtree_amr_bnd;
 	std::array<real, NDIM> xmin;
 	real dx;
 
@@ -96,6 +137,7 @@ private:
 	hpx::lcos::local::spinlock prolong_mtx;
 	channel<expansion_pass_type> parent_gravity_channel;
 	std::array<semaphore, geo::direction::count()> neighbor_signals;
+	std::array<semaphore, geo::direction::count()> hydro_signals;
 	std::array<unordered_channel<std::vector<real>>, NCHILD> child_hydro_channels;
 	std::array<unordered_channel<neighbor_gravity_type>, geo::direction::count()> neighbor_gravity_channels;
 	std::array<unordered_channel<sibling_hydro_type>, geo::direction::count()> sibling_hydro_channels;
@@ -105,6 +147,8 @@ private:
 	std::array<channel<timestep_t>, NCHILD + 1> local_timestep_channels;
 
 	timestep_t dt_;
+	/* the CFL step of this leaf alone, before the global minimum replaces it in dt_ */
+	real local_dt_ = ZERO;
 
 	octotiger::fmm::monopole_interactions::p2m_interaction_interface p2m_interactor;
 #ifdef OCTOTIGER_HAVE_CUDA
@@ -131,21 +175,51 @@ public:
 	static std::uint64_t cumulative_nodes_count(bool);
 	static std::uint64_t cumulative_leafs_count(bool);
 	static std::uint64_t cumulative_amrs_count(bool);
+	static node_count_type locality_load();
+	static void reset_locality_load();
+	static std::vector<node_location> regrid_changes();
+	static void prepare_relink(bool incremental, std::vector<node_location> changes);
+	static void set_finest_level(integer level);
 	static void register_counters();
 private:
 	static hpx::mutex node_count_mtx;
 	static node_count_type cumulative_node_count;
+	static node_count_type locality_load_;
+	/* nodes on this locality that were refined, derefined or moved during the current regrid */
+	static std::vector<node_location> regrid_changes_;
+	/* all changes of the last regrid, form_tree only descends into nodes close to one of them */
+	static std::vector<node_location> relink_changes_;
+	/* relink_changes_ by {level, 0, x, y, z} on their own level and by {level, 1, x, y, z} of their ancestors */
+	static std::map<std::array<integer, NDIM + 2>, std::vector<std::size_t>> relink_index_;
+	/* levels that have changes */
+	static std::vector<bool> relink_levels_;
+	static bool relink_incremental_;
+	/* finest level with leaves after the last regrid on the root, -1 before the first one */
+	static integer finest_level_;
 	static bool static_initialized;
 	static std::atomic<integer> static_initializing;
 	void initialize(real, real);
+	/* all is ready once every ghost zone has been written. faces[f] is ready once the sibling across face f has
+	 * written its part and is left empty if f borders a coarser node or the domain boundary */
+	struct hydro_exchange {
+		hpx::future<void> all;
+		std::array<hpx::shared_future<void>, NFACE> faces;
+	};
 	void send_hydro_amr_boundaries(bool energy_only=false);
-	void collect_hydro_boundaries(bool energy_only=false);
+	/* theta, per direction, is passed on to grid::get_hydro_boundary */
+	void collect_hydro_boundaries(bool energy_only=false, const std::array<real, geo::direction::count()>* theta = nullptr);
+	hydro_exchange exchange_hydro_boundaries(bool energy_only, const std::array<real, geo::direction::count()>* theta = nullptr);
+	void complete_hydro_boundaries(bool energy_only);
 	static void static_initialize();
 	void clear_family();
+	void record_regrid_change(const node_location&);
+	bool needs_relink() const;
 	hpx::future<void> exchange_flux_corrections();
+	void exchange_flux_sums(bool send, bool receive);
 
 	hpx::future<void> nonrefined_step();
 	void refined_step();
+	void subcycled_step();
 
 	diagnostics_t root_diagnostics(const diagnostics_t& diags);
 	diagnostics_t child_diagnostics(const diagnostics_t& diags);
@@ -157,7 +231,9 @@ public:
 		return step_num;
 	}
 	void exchange_interlevel_hydro_data();
-	void all_hydro_bounds();
+	void all_hydro_bounds(const std::array<real, geo::direction::count()>* theta = nullptr);
+	/* all_hydro_bounds without waiting for the siblings, once all is ready complete_hydro_boundaries fills the rest */
+	hydro_exchange start_hydro_bounds();
 	void energy_hydro_bounds();
 	static bool child_is_on_face(integer ci, integer face) {
 		return (((ci >> (face / 2)) & 1) == (face & 1));
@@ -185,8 +261,8 @@ public:
 	void reconstruct_tree();
 
 	/*TODO move radiation to*/
-	node_server(const node_location&, integer, bool, real, real, const std::array<integer, NCHILD>&, grid,
-			const std::vector<hpx::id_type>&, std::size_t, std::size_t, std::size_t, integer position);
+	node_server(const node_location&, integer, bool, real, real, const std::array<node_count_type, NCHILD>&, grid,
+			const std::vector<hpx::id_type>&, std::size_t, std::size_t, std::size_t, integer position, real regrid_cost);
 
 	void report_timing();/**/
 	HPX_DEFINE_COMPONENT_ACTION(node_server, report_timing, report_timing_action);
@@ -195,15 +271,15 @@ public:
 
 	hpx::future<hpx::id_type> create_child(hpx::id_type const& locality, integer ci);
 
-	void regrid_scatter(integer, integer);/**/HPX_DEFINE_COMPONENT_ACTION(node_server, regrid_scatter, regrid_scatter_action);
+	void regrid_scatter(integer, integer, real, load_balance_type);/**/HPX_DEFINE_COMPONENT_ACTION(node_server, regrid_scatter, regrid_scatter_action);
 
 	void recv_flux_check(std::vector<real>&&, const geo::direction&, std::size_t cycle);
 	/**/HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, recv_flux_check, send_flux_check_action);
 
-	void recv_hydro_boundary(std::vector<real>&&, const geo::direction&, std::size_t cycle);
+	void recv_hydro_boundary(hydro_boundary_type&&, const geo::direction&, std::size_t cycle);
 	/**/HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, recv_hydro_boundary, send_hydro_boundary_action);
 
-	void recv_hydro_amr_boundary(std::vector<real>&&, const geo::direction&, std::size_t cycle);
+	void recv_hydro_amr_boundary(wire_vector<wire_hydro_amr_boundary>&&, const geo::direction&, std::size_t cycle);
 	/**/HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, recv_hydro_amr_boundary, send_hydro_amr_boundary_action);
 
 	void recv_rad_amr_boundary(std::vector<real>&&, const geo::direction&, std::size_t cycle);
@@ -212,7 +288,7 @@ public:
 	void recv_hydro_children(std::vector<real>&&, const geo::octant& ci, std::size_t cycle);
 	/**/HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, recv_hydro_children, send_hydro_children_action);
 
-	void recv_hydro_flux_correct(std::vector<real>&&, const geo::face& face, const geo::octant& ci);
+	void recv_hydro_flux_correct(wire_vector<wire_hydro_flux_correct>&&, const geo::face& face, const geo::octant& ci);
 	/**/HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, recv_hydro_flux_correct, send_hydro_flux_correct_action);
 
 	void recv_gravity_boundary(gravity_boundary_type&&, const geo::direction&, bool monopole, std::size_t cycle);
@@ -229,9 +305,9 @@ public:
 
 	node_count_type regrid(const hpx::id_type& root_gid, real omega, real new_floor, bool rb, bool grav_energy_comp=true);
 
-	void compute_fmm(gsolve_type gs, bool energy_account, bool allocate_only = false);
+	hpx::future<void> compute_fmm(gsolve_type gs, bool energy_account, bool allocate_only = false);
 
-	void solve_gravity(bool ene, bool skip_solve);/**/
+	hpx::future<void> solve_gravity(bool ene, bool skip_solve);/**/
 	HPX_DEFINE_COMPONENT_ACTION(node_server, solve_gravity, solve_gravity_action);
 
 	void execute_solver(bool scf, node_count_type);
@@ -265,11 +341,26 @@ public:
 	std::pair<real,real> amr_error();
 	HPX_DEFINE_COMPONENT_ACTION(node_server, amr_error, amr_error_action);
 
+	/* smallest local CFL step and number of leaves on every level of the subtree */
+	std::vector<std::pair<real, integer>> level_timesteps();
+	HPX_DEFINE_COMPONENT_ACTION(node_server, level_timesteps, level_timesteps_action);
+
 	diagnostics_t diagnostics(const diagnostics_t&);/**/
 	HPX_DEFINE_COMPONENT_ACTION(node_server, diagnostics, diagnostics_action);
 
 	diagnostics_t diagnostics();
 
+	/* exchanges the hydro boundaries and copies every leaf for snapshot_diagnostics */
+	void take_diagnostics_snapshot();
+	HPX_DEFINE_COMPONENT_ACTION(node_server, take_diagnostics_snapshot, take_diagnostics_snapshot_action);
+
+	diagnostics_t snapshot_diagnostics(const diagnostics_t&);
+	HPX_DEFINE_COMPONENT_ACTION(node_server, snapshot_diagnostics, snapshot_diagnostics_action);
+
+	/* runs the diagnostics on a snapshot of the current state and writes them from an I/O thread, returns once the
+	 * snapshot is taken */
+	hpx::future<diagnostics_t> diagnostics_async();
+
 	void set_aunt(const hpx::id_type&, const geo::face& face);/**/
 	HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, set_aunt, set_aunt_action);
 
@@ -314,15 +405,30 @@ private:
 	std::array<unordered_channel<sibling_rad_type>, geo::direction::count()> sibling_rad_channels;
 	std::array<unordered_channel<std::vector<real>>, NCHILD> child_rad_channels;
 	unordered_channel<expansion_pass_type> parent_rad_channel;
+	/* partial sums of the implicit radiation solve from the children, and the totals from the root */
+	std::array<channel<std::vector<real>>, NCHILD> local_fld_channels;
+	channel<std::vector<real>> global_fld_channel;
 public:
 	hpx::future<void> exchange_rad_flux_corrections();
+	void exchange_rad_flux_sums(bool send, bool receive);
 	void compute_radiation(real dt, real omega);
+	void radiation_level_steps(integer nsteps, real dt, real omega, integer finest_level, integer max_shift);
 	hpx::future<void> exchange_interlevel_rad_data();
-	void all_rad_bounds();
+	/* theta, per direction, is passed on to rad_grid::get_boundary */
+	void all_rad_bounds(bool linear = false, const std::array<real, geo::direction::count()> *theta = nullptr);
 
-	void collect_radiation_bounds();
+	void collect_radiation_bounds(bool linear, const std::array<real, geo::direction::count()> *theta = nullptr);
 	void send_rad_amr_bounds();
 
+	void fld_solve(real dt);
+	std::vector<real> fld_allreduce(std::vector<real>&& sums);
+
+	void set_fld_partial(integer i, std::vector<real>&&);/**/
+	HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, set_fld_partial, set_fld_partial_action);
+
+	void fld_total_ascend(std::vector<real>&&);/**/
+	HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, fld_total_ascend, fld_total_ascend_action);
+
 	void recv_rad_flux_correct(std::vector<real>&&, const geo::face& face, const geo::octant& ci);/**/
 	HPX_DEFINE_COMPONENT_DIRECT_ACTION(node_server, recv_rad_flux_correct, send_rad_flux_correct_action);
 
@@ -379,6 +485,8 @@ HPX_REGISTER_ACTION_DECLARATION(node_server::get_child_client_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::form_tree_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::get_ptr_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::diagnostics_action);
+HPX_REGISTER_ACTION_DECLARATION(node_server::take_diagnostics_snapshot_action);
+HPX_REGISTER_ACTION_DECLARATION(node_server::snapshot_diagnostics_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::timestep_driver_ascend_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::scf_params_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::send_rad_boundary_action);
@@ -386,7 +494,10 @@ HPX_REGISTER_ACTION_DECLARATION(node_server::send_rad_children_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::send_rad_flux_correct_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::set_rad_grid_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::erad_init_action);
+HPX_REGISTER_ACTION_DECLARATION(node_server::set_fld_partial_action);
+HPX_REGISTER_ACTION_DECLARATION(node_server::fld_total_ascend_action);
 HPX_REGISTER_ACTION_DECLARATION(node_server::amr_error_action);
+HPX_REGISTER_ACTION_DECLARATION(node_server::level_timesteps_action);
 //HPX_REGISTER_ACTION_DECLARATION(node_server::set_parent_action);
 
 #endif /* NODE_SERVER_HPP_ */
@@ -28,6 +28,8 @@ COMMAND_LINE_ENUM(problem_type, DWD, SOD, BLAST, NONE, SOLID_SPHERE, STAR, MOVIN
 
 COMMAND_LINE_ENUM(eos_type, IDEAL, WD);
 
+COMMAND_LINE_ENUM(hydro_kernel_type, SCALAR, VC);
+
 class options {
 public:
 	bool inflow_bc;
@@ -50,10 +52,27 @@ public:
 	bool correct_am_hydro;
 	bool rotating_star_amr;
 	bool idle_rates;
+	bool cost_load_balance;
+	bool incremental_regrid;
+	bool parallel_restart;
+	bool trace;
+	bool multipole_blocked_stencil;
+	bool overlap_hydro_exchange;
+	bool wire_codec;
+	bool level_dt_report;
+	bool async_diagnostics;
+	bool rad_fld;
+	bool rad_level_steps;
 
 	integer scf_output_frequency;
 	integer silo_num_groups;
+	integer silo_max_in_flight;
 	integer amrbnd_order;
+	integer wire_float_order;
+	integer p2p_batch_size;
+	integer multipole_batch_size;
+	integer rad_fld_max_iter;
+	integer hydro_subcycle;
 	integer extra_regrid;
 	integer accretor_refine;
 	integer donor_refine;
@@ -88,6 +107,9 @@ public:
 	real cfl;
 	real rho_floor;
 	real tau_floor;
+	real load_balance_threshold;
+	real silo_staging_mb;
+	real rad_fld_tol;
 
 	real sod_rhol;
 	real sod_rhor;
@@ -127,6 +149,7 @@ public:
 	std::string data_dir;
 	std::string output_filename;
 	std::string restart_filename;
+	std::string kernel_tuning_file;
 	integer n_species;
 	integer n_fields;
 
@@ -138,6 +161,9 @@ public:
 	interaction_kernel_type p2m_kernel_type;
 	interaction_kernel_type p2p_kernel_type;
 
+	hydro_kernel_type reconstruct_kernel_type;
+	hydro_kernel_type flux_kernel_type;
+
 	std::vector<real> atomic_mass;
 	std::vector<real> atomic_number;
 	std::vector<real> X;
@@ -186,6 +212,8 @@ public:
 		arc & silo_offset_z;
 		arc & scf_output_frequency;
 		arc & silo_num_groups;
+		arc & silo_max_in_flight;
+		arc & silo_staging_mb;
 		arc & amrbnd_order;
 		arc & dual_energy_sw1;
 		arc & dual_energy_sw2;
@@ -205,6 +233,8 @@ public:
 		arc & m2m_kernel_type;
 		arc & p2m_kernel_type;
 		arc & p2p_kernel_type;
+		arc & reconstruct_kernel_type;
+		arc & flux_kernel_type;
 		arc & entropy_driving_rate;
 		arc & entropy_driving_time;
 		arc & driving_rate;
@@ -232,6 +262,25 @@ public:
 		arc & extra_regrid;
 		arc & accretor_refine;
 		arc & idle_rates;
+		arc & cost_load_balance;
+		arc & load_balance_threshold;
+		arc & incremental_regrid;
+		arc & parallel_restart;
+		arc & trace;
+		arc & multipole_blocked_stencil;
+		arc & overlap_hydro_exchange;
+		arc & wire_codec;
+		arc & wire_float_order;
+		arc & level_dt_report;
+		arc & p2p_batch_size;
+		arc & multipole_batch_size;
+		arc & async_diagnostics;
+		arc & rad_fld;
+		arc & rad_fld_tol;
+		arc & rad_fld_max_iter;
+		arc & rad_level_steps;
+		arc & hydro_subcycle;
+		arc & kernel_tuning_file;
 		int tmp = problem;
 		arc & tmp;
 		problem = static_cast<problem_type>(tmp);
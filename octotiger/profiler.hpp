@@ -31,7 +31,11 @@ struct timings
         time_find_localities = 4,
 		  time_fmm = 5,
 		  time_io = 6,
-	     time_last = 7
+		  /* per node kernel times, weights for the load balancer */
+		  time_node_hydro = 7,
+		  time_node_fmm = 8,
+		  time_node_radiation = 9,
+	     time_last = 10
     };
 
     struct scope
@@ -15,6 +15,7 @@
 #include "octotiger/roe.hpp"
 #include "octotiger/safe_math.hpp"
 #include "octotiger/space_vector.hpp"
+#include "octotiger/unitiger/simd.hpp"
 
 #include <array>
 #include <cassert>
@@ -75,7 +76,7 @@ namespace octotiger { namespace radiation {
             abort();
         }    // abort_if_solver_not_converged
 
-        std::pair<real, space_vector> implicit_radiation_step(real E0, real& e0,
+        inline std::pair<real, space_vector> implicit_radiation_step(real E0, real& e0,
             space_vector F0, space_vector u0, real rho, real mmw, real X,
             real Z, real dt)
         {
@@ -143,10 +144,187 @@ namespace octotiger { namespace radiation {
             return std::make_pair(
                 real((E - E0) * dtinv * rhoc2), ((F - F0) * dtinv * rhoc2 * c));
         }    // implicit_radiation_step
+
+        // The cells of a sub-grid for the batched form of implicit_radiation_step,
+        // in the units of rho c^2 and with the opacities multiplied by c dt.
+        // B_p is linear in e, both for MARSHAK and for T^4 = e / rho, so the
+        // Planck term is beta * e with beta taken once per cell.
+        struct implicit_radiation_batch
+        {
+            std::vector<real> E0, eg0, kp, kr, beta;
+            std::array<std::vector<real>, NDIM> F0, u0;
+            // Results, E and F and the internal energy
+            std::vector<real> E, ei;
+            std::array<std::vector<real>, NDIM> F;
+            // Cells that did not converge, they keep the last bracketed iterate
+            std::vector<int> unconverged;
+
+            void resize(std::size_t n)
+            {
+                for (auto* v : {&E0, &eg0, &kp, &kr, &beta, &E, &ei})
+                {
+                    v->resize(n);
+                }
+                for (int d = 0; d < NDIM; d++)
+                {
+                    F0[d].resize(n);
+                    u0[d].resize(n);
+                    F[d].resize(n);
+                }
+                unconverged.clear();
+            }
+
+            // Sets cell n from the radiation and gas state in cgs, e0 is the
+            // internal energy and v the velocity of the gas
+            void set_cell(std::size_t n, real rho, real e0, real mmw, real X,
+                real Z, real E_rad, std::array<real, NDIM> const& F_rad,
+                std::array<real, NDIM> const& v, real dt)
+            {
+                real const c = physcon().c;
+                real const rhoc2 = rho * c * c;
+                kp[n] = kappa_p(rho, e0, mmw, X, Z) * dt * c;
+                kr[n] = kappa_R(rho, e0, mmw, X, Z) * dt * c;
+                beta[n] = (4.0 * M_PI / c) * B_p(rho, rhoc2, mmw) / rhoc2;
+                E0[n] = E_rad / rhoc2;
+                real u2 = 0.0;
+                for (int d = 0; d < NDIM; d++)
+                {
+                    F0[d][n] = F_rad[d] / (rhoc2 * c);
+                    u0[d][n] = v[d] / c;
+                    u2 += u0[d][n] * u0[d][n];
+                }
+                eg0[n] = e0 / rhoc2 + 0.5 * u2;
+            }
+        };
+
+        template <class T>
+        struct implicit_radiation_lanes
+        {
+            T E0, eg0, kp, kr, beta;
+            std::array<T, NDIM> F0, u0;
+        };
+
+        // The residual of implicit_radiation_step at E and its derivative df,
+        // also sets F, u and the (unfloored) internal energy
+        template <class T>
+        inline T implicit_radiation_residual(
+            implicit_radiation_lanes<T> const& c, T const& E,
+            std::array<T, NDIM>& F, std::array<T, NDIM>& u, T& ei, T& df)
+        {
+            T const dden = T(4.0 / 3.0) * c.kr;
+            T const deninv = T(1.0) / (T(1.0) + c.kr + dden * E);
+            T u2 = T(0.0);
+            T du2 = T(0.0);
+            T udotF = T(0.0);
+            T dudotF = T(0.0);
+            for (int d = 0; d < NDIM; d++)
+            {
+                T const w = c.u0[d] + c.F0[d];
+                F[d] = (c.F0[d] + dden * E * w) * deninv;
+                T const dF = dden * (w - F[d]) * deninv;
+                u[d] = w - F[d];
+                u2 += u[d] * u[d];
+                du2 -= T(2.0) * u[d] * dF;
+                udotF += F[d] * u[d];
+                dudotF += dF * (u[d] - F[d]);
+            }
+            ei = c.eg0 + c.E0 - E - T(0.5) * u2;
+            T const e = hydro_simd::max(ei, T(0.0));
+            T const de = hydro_simd::select(
+                ei > T(0.0), T(-1.0) - T(0.5) * du2, T(0.0));
+            T const kf = c.kr - T(2.0) * c.kp;
+            df = T(1.0) + c.kp * (T(1.0) - c.beta * de) + kf * dudotF;
+            return E - c.E0 + c.kp * (E - c.beta * e) + kf * udotF;
+        }
+
+        // Safeguarded Newton iteration on the cells start to
+        // start + width<T>::value. The root is kept bracketed in [lo, hi],
+        // a Newton step that leaves the bracket or does not halve the step
+        // before it is replaced by bisection. Lanes drop out as they converge.
+        template <class T>
+        inline void implicit_radiation_solve_lanes(
+            implicit_radiation_batch& s, int start)
+        {
+            constexpr int MAX_ITERATIONS = 50;
+            real const error_tolerance = 1.0e-9;
+            implicit_radiation_lanes<T> c;
+            c.E0 = hydro_simd::load<T>(&s.E0[start]);
+            c.eg0 = hydro_simd::load<T>(&s.eg0[start]);
+            c.kp = hydro_simd::load<T>(&s.kp[start]);
+            c.kr = hydro_simd::load<T>(&s.kr[start]);
+            c.beta = hydro_simd::load<T>(&s.beta[start]);
+            for (int d = 0; d < NDIM; d++)
+            {
+                c.F0[d] = hydro_simd::load<T>(&s.F0[d][start]);
+                c.u0[d] = hydro_simd::load<T>(&s.u0[d][start]);
+            }
+            // E + eg_t is conserved
+            T const tol = T(error_tolerance) * (c.E0 + c.eg0);
+            std::array<T, NDIM> F, u;
+            T ei, df;
+            T lo = T(0.0);
+            T hi = c.E0 + c.eg0;
+            T f_lo = implicit_radiation_residual(c, lo, F, u, ei, df);
+            T x = c.E0;
+            T step = hi - lo;
+            T f = implicit_radiation_residual(c, x, F, u, ei, df);
+            auto active = hydro_simd::abs(f) >= tol;
+            for (int i = 0; i < MAX_ITERATIONS && hydro_simd::any_of(active);
+                 i++)
+            {
+                auto const same = hydro_simd::copysign(T(1.0), f) ==
+                    hydro_simd::copysign(T(1.0), f_lo);
+                lo = hydro_simd::select(same, x, lo);
+                f_lo = hydro_simd::select(same, f, f_lo);
+                hi = hydro_simd::select(same, hi, x);
+                T const mid = T(0.5) * (lo + hi);
+                T const newton =
+                    x - f / hydro_simd::select(df > T(0.0), df, T(1.0));
+                auto const take_newton = df > T(0.0) && newton > lo &&
+                    newton < hi &&
+                    hydro_simd::abs(newton - x) <
+                        T(0.5) * hydro_simd::abs(step);
+                T const next = hydro_simd::select(take_newton, newton, mid);
+                step = hydro_simd::select(active, next - x, step);
+                x = hydro_simd::select(active, next, x);
+                T const f_next =
+                    implicit_radiation_residual(c, x, F, u, ei, df);
+                f = hydro_simd::select(active, f_next, f);
+                active = active && hydro_simd::abs(f) >= tol;
+            }
+            // the converged lanes were last evaluated at an earlier x
+            implicit_radiation_residual(c, x, F, u, ei, df);
+            hydro_simd::store(&s.E[start], x);
+            hydro_simd::store(&s.ei[start], ei);
+            for (int d = 0; d < NDIM; d++)
+            {
+                hydro_simd::store(&s.F[d][start], F[d]);
+            }
+            for (int l = 0; l < hydro_simd::width<T>::value; l++)
+            {
+                if (hydro_simd::get_lane(active, l))
+                {
+                    s.unconverged.push_back(start + l);
+                }
+            }
+        }
+
+        // Solves the cells [0, n) of s, full vectors first and the rest one
+        // at a time, returns the number of cells that did not converge
+        inline std::size_t implicit_radiation_solve(
+            implicit_radiation_batch& s, int n)
+        {
+            s.unconverged.clear();
+            hydro_simd::for_each_block(0, n, [&s](auto t, int start) {
+                implicit_radiation_solve_lanes<decltype(t)>(s, start);
+            });
+            return s.unconverged.size();
+        }
     }        // namespace detail
 
+    // Returns the cells (rindex) where the implicit solve did not converge
     template <integer er_i, integer fx_i, integer fy_i, integer fz_i>
-    void radiation_cpu_kernel(integer const d,
+    std::vector<integer> radiation_cpu_kernel(integer const d,
         std::vector<real> const& rho,
         std::vector<real>& sx,
         std::vector<real>& sy,
@@ -161,6 +339,10 @@ namespace octotiger { namespace radiation {
         real dt,
         real const clightinv)
     {
+        real const c = physcon().c;
+        thread_local detail::implicit_radiation_batch s;
+        s.resize(INX * INX * INX);
+        int n = 0;
         for (integer i = RAD_BW; i != RAD_NX - RAD_BW; ++i)
         {
             for (integer j = RAD_BW; j != RAD_NX - RAD_BW; ++j)
@@ -188,26 +370,41 @@ namespace octotiger { namespace radiation {
                     {
                         e0 = std::pow(tau[iiih], fgamma);
                     }
-                    real E0 = U[er_i][iiir];
-                    space_vector F0;
-                    space_vector u0;
-                    F0[0] = U[fx_i][iiir];
-                    F0[1] = U[fy_i][iiir];
-                    F0[2] = U[fz_i][iiir];
-                    u0[0] = vx;
-                    u0[1] = vy;
-                    u0[2] = vz;
-                    real E1 = E0;
-                    space_vector F1 = F0;
-                    space_vector u1 = u0;
-                    real e1 = e0;
 
-                    auto const ddt = detail::implicit_radiation_step(E1, e1, F1,
-                        u1, den, mmw[iiir], X_spc[iiir], Z_spc[iiir], dt);
-                    real const dE_dt = ddt.first;
-                    real const dFx_dt = ddt.second[0];
-                    real const dFy_dt = ddt.second[1];
-                    real const dFz_dt = ddt.second[2];
+                    s.set_cell(n, den, e0, mmw[iiir], X_spc[iiir],
+                        Z_spc[iiir], U[er_i][iiir],
+                        {U[fx_i][iiir], U[fy_i][iiir], U[fz_i][iiir]},
+                        {vx, vy, vz}, dt);
+                    ++n;
+                }
+            }
+        }
+
+        detail::implicit_radiation_solve(s, n);
+
+        n = 0;
+        for (integer i = RAD_BW; i != RAD_NX - RAD_BW; ++i)
+        {
+            for (integer j = RAD_BW; j != RAD_NX - RAD_BW; ++j)
+            {
+                for (integer k = RAD_BW; k != RAD_NX - RAD_BW; ++k)
+                {
+                    integer const iiih = hindex(i + d, j + d, k + d);
+                    integer const iiir = rindex(i, j, k);
+                    real const den = rho[iiih];
+                    real const deninv = INVERSE(den);
+                    real const rhoc2 = den * c * c;
+                    real const dtinv = 1.0 / dt;
+                    real const E0 = s.E0[n] * rhoc2;
+                    real const e1 = s.ei[n] * rhoc2;
+                    real const dE_dt = (s.E[n] - s.E0[n]) * dtinv * rhoc2;
+                    real const dFx_dt =
+                        (s.F[0][n] - s.F0[0][n]) * dtinv * rhoc2 * c;
+                    real const dFy_dt =
+                        (s.F[1][n] - s.F0[1][n]) * dtinv * rhoc2 * c;
+                    real const dFz_dt =
+                        (s.F[2][n] - s.F0[2][n]) * dtinv * rhoc2 * c;
+                    ++n;
 
                     // Accumulate derivatives
                     U[er_i][iiir] += dE_dt * dt;
@@ -252,6 +449,13 @@ namespace octotiger { namespace radiation {
                 }
             }
         }
+        std::vector<integer> unconverged;
+        for (int const m : s.unconverged)
+        {
+            unconverged.push_back(rindex(RAD_BW + m / (INX * INX),
+                RAD_BW + (m / INX) % INX, RAD_BW + m % INX));
+        }
+        return unconverged;
     }    // radiation_cpu_kernel
 }}       // namespace octotiger::radiation
 
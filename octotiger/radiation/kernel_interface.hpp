@@ -143,8 +143,9 @@ namespace octotiger { namespace radiation {
     }
 #endif
 
+    // Returns the cells (rindex) where the implicit solve did not converge
     template <integer er_i, integer fx_i, integer fy_i, integer fz_i>
-    void radiation_kernel(integer const d,
+    std::vector<integer> radiation_kernel(integer const d,
         std::vector<real> const& rho,
         std::vector<real>& sx,
         std::vector<real>& sy,
@@ -172,14 +173,16 @@ namespace octotiger { namespace radiation {
         }).get();
 #endif
 
-        radiation_cpu_kernel<er_i, fx_i, fy_i, fz_i>(d, rho, sx, sy, sz, egas,
-            tau, fgamma, U, mmw, X_spc, Z_spc, dt, clightinv);
+        std::vector<integer> unconverged =
+            radiation_cpu_kernel<er_i, fx_i, fy_i, fz_i>(d, rho, sx, sy, sz,
+                egas, tau, fgamma, U, mmw, X_spc, Z_spc, dt, clightinv);
 
 #if defined(OCTOTIGER_DUMP_RADIATION_CASES)
         hpx::threads::run_as_os_thread([&]() {
             dumper::save_case_outs(index, sx, sy, sz, egas, tau, U);
         }).get();
 #endif
+        return unconverged;
     }
 
 }}
@@ -33,6 +33,10 @@ public:
 	static constexpr integer wx_i = 4;
 	static constexpr integer wy_i = 5;
 	static constexpr integer wz_i = 6;
+	/* work vectors of the implicit flux-limited diffusion solve, see fld.cpp */
+	enum fld_vector {
+		fld_b, fld_x, fld_e0, fld_r, fld_r0, fld_p, fld_v, fld_s, fld_t, fld_ph, fld_sh, fld_vector_count
+	};
 private:
 	static constexpr integer DX = RAD_NX * RAD_NX;
 	static constexpr integer DY = RAD_NX;
@@ -46,10 +50,21 @@ private:
 	std::vector<std::vector<real>> U;
 	std::array<std::vector<real>, NRF> U0;
 	std::vector<std::vector<std::vector<real>>> flux;
+	/* fluxes on the faces of the block summed over the stages and steps of --rad_level_steps, times dt */
+	std::vector<std::vector<std::vector<real>>> flux_sum;
 	std::array<std::array<std::vector<real>*, NDIM>, NDIM> P;
 	std::vector<std::vector<real>> X;
 	std::vector<real> mmw, X_spc, Z_spc;
 	hydro_computer<NDIM,INX,radiation_physics<NDIM>> hydro;
+	std::array<std::vector<real>, fld_vector_count> fld;
+	/* diffusion coefficient of every cell, and dt D / dx^2 on the lower face of every cell in each dimension */
+	std::vector<real> fld_D;
+	std::array<std::vector<real>, NDIM> fld_a;
+	/* fld_a without the faces on physical boundaries, whose ghost values are moved into fld_b */
+	std::array<std::vector<real>, NDIM> fld_c;
+	std::vector<real> fld_diag;
+	static std::vector<real> restrict_faces(const std::vector<std::vector<std::vector<real>>>& f, const std::array<integer, NDIM>& lb,
+			const std::array<integer, NDIM>& ub, const geo::dimension& dim);
 public:
 	static void static_init();
 	static std::vector<std::string> get_field_names();
@@ -83,6 +98,10 @@ public:
 	void set_flux_restrict(const std::vector<real>& data, const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub,
 			const geo::dimension& dim);
 	std::vector<real> get_flux_restrict(const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub, const geo::dimension& dim) const;
+	void add_flux_sum(real weight);
+	void clear_flux_sum(const geo::face& face);
+	std::vector<real> get_flux_sum_restrict(const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub, const geo::dimension& dim) const;
+	void reflux(const std::vector<real>& data, const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub, const geo::face& face);
 	std::vector<real> get_intensity(const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub, const geo::octant&);
 	void allocate();
 	rad_grid(real dx);
@@ -91,15 +110,29 @@ public:
 	real get_field(integer f, integer i, integer j, integer k) const;
 	void set_field(real v, integer f, integer i, integer j, integer k);
 	void set_physical_boundaries(geo::face f, real t);
-	std::vector<real> get_boundary(const geo::direction& dir);
+	/* theta < 1 sends the state interpolated in time between the last store and now */
+	std::vector<real> get_boundary(const geo::direction& dir, real theta = 1.0);
 	using kappa_type = std::function<real(real)>;
 
 	real hydro_signal_speed(const std::vector<real>& egas, const std::vector<real>& tau, const std::vector<real>& sx, const std::vector<real>& sy, const std::vector<real>& sz,
 			const std::vector<real>& rho);
 
+	void fld_init(const std::vector<real>& egas, const std::vector<real>& tau, const std::vector<real>& sx, const std::vector<real>& sy,
+			const std::vector<real>& sz, const std::vector<real>& rho, real dt, const std::array<bool, NFACE>& physical);
+	void fld_precondition(fld_vector in, fld_vector out);
+	void fld_load(fld_vector v);
+	void fld_apply(fld_vector out);
+	void fld_store_flux();
+	void fld_correct_flux(fld_vector out, const std::array<bool, NFACE>& fine);
+	real fld_dot(fld_vector a, fld_vector b) const;
+	void fld_axpby(fld_vector out, real a, fld_vector x, real b, fld_vector y);
+	std::array<real, 3> fld_balance() const;
+	void fld_flux();
+
 	void clear_amr();
 	void set_rad_amr_boundary(const std::vector<real>&, const geo::direction&);
-	void complete_rad_amr_boundary();
+	/* linear prolongs with unlimited slopes, which keeps the ghost cells a linear function of the coarse data */
+	void complete_rad_amr_boundary(bool linear);
 	std::vector<real> get_subset(const std::array<integer, NDIM>& lb, const std::array<integer, NDIM>& ub);
 
 	friend class node_server;
@@ -0,0 +1,71 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef OCTOTIGER_TRACE_HPP_
+#define OCTOTIGER_TRACE_HPP_
+
+#include <cstdint>
+
+/* Span tracing, enabled with --trace. Every span records its phase, the worker thread, the node and the
+ * step it belongs to. At the end of the run each locality writes a Chrome trace (chrome://tracing or
+ * ui.perfetto.dev) to trace.<locality>.json and the root prints the time spent in each phase. An HPX
+ * task can suspend and resume on another worker, and other tasks run on its worker meanwhile, so spans
+ * are written as async begin/end pairs keyed by a span id, with the worker they started and ended on. */
+
+enum trace_phase {
+	trace_hydro_reconstruct = 0,
+	trace_hydro_flux = 1,
+	trace_hydro = 2,
+	trace_fmm_multipole = 3,
+	trace_fmm_monopole = 4,
+	trace_fmm = 5,
+	trace_boundary_wait = 6,
+	trace_regrid = 7,
+	trace_io = 8,
+	trace_phase_last = 9
+};
+
+extern bool trace_enabled_;
+
+inline bool trace_enabled() {
+	return trace_enabled_;
+}
+
+/* reads --trace, called on every locality once the options are known */
+void trace_initialize();
+std::uint64_t trace_now();
+/* the worker thread the calling task runs on, -1 outside the HPX thread pools */
+int trace_worker();
+void trace_record(const char* name, trace_phase phase, std::uint64_t node, std::int64_t step, std::uint64_t start, int start_thread);
+/* writes the trace of every locality and prints the per phase summary, called on the root */
+void trace_output();
+
+struct trace_scope {
+	/* name has to be a string literal, node is a node_location id (0 if unknown), step -1 if unknown */
+	trace_scope(const char* name, trace_phase phase, std::uint64_t node = 0, std::int64_t step = -1) :
+			name_(name), phase_(phase), node_(node), step_(step), start_(trace_enabled() ? trace_now() : 0), thread_(
+					trace_enabled() ? trace_worker() : -1) {
+	}
+	~trace_scope() {
+		if (start_ != 0) {
+			trace_record(name_, phase_, node_, step_, start_, thread_);
+		}
+	}
+	trace_scope(const trace_scope&) = delete;
+	trace_scope& operator=(const trace_scope&) = delete;
+private:
+	const char* name_;
+	trace_phase phase_;
+	std::uint64_t node_;
+	std::int64_t step_;
+	std::uint64_t start_;
+	int thread_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(...) trace_scope TRACE_CONCAT(__trace_object__, __LINE__)(__VA_ARGS__)
+
+#endif /* OCTOTIGER_TRACE_HPP_ */
@@ -10,6 +10,15 @@
 
 #include "octotiger/unitiger/util.hpp"
 
+/* Cells [lo, hi) of every dimension of the H_NX^NDIM block the hydro kernels work on, the dimensions above NDIM span [0, 1).
+ * The cells [hole_lo, hole_hi) are left out, unless that range is empty in one of the dimensions */
+struct cell_box {
+	std::array<int, 3> lo;
+	std::array<int, 3> hi;
+	std::array<int, 3> hole_lo;
+	std::array<int, 3> hole_hi;
+};
+
 template<int NDIM, int INX>
 struct cell_geometry {
 
@@ -315,6 +324,67 @@ public:
 		return k;
 	}
 
+	/* the cells [lb, ub) of every dimension */
+	static cell_box make_box(int lb, int ub) {
+		cell_box b;
+		for (int dim = 0; dim < 3; dim++) {
+			b.lo[dim] = dim < NDIM ? lb : 0;
+			b.hi[dim] = dim < NDIM ? ub : 1;
+			b.hole_lo[dim] = b.hole_hi[dim] = 0;
+		}
+		return b;
+	}
+
+	/* box without the cells [lb, ub) of every dimension */
+	static cell_box make_shell(const cell_box &box, int lb, int ub) {
+		cell_box b = box;
+		for (int dim = 0; dim < 3; dim++) {
+			b.hole_lo[dim] = dim < NDIM ? lb : 0;
+			b.hole_hi[dim] = dim < NDIM ? ub : 1;
+		}
+		return b;
+	}
+
+	static bool has_hole(const cell_box &box) {
+		for (int dim = 0; dim < NDIM; dim++) {
+			if (box.hole_lo[dim] >= box.hole_hi[dim]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/* the whole block, ghost zones included */
+	static cell_box full_box() {
+		return make_box(0, cell_geometry::H_NX);
+	}
+
+	/* The cells a reconstruction loop over [bw, H_NX - bw) visits when only the values on box are needed. The
+	 * loops with bw 2 produce the face values, bw 1 the slopes they use and bw 0 the primitives, so box is
+	 * widened and its hole shrunk by 2 - bw. For the full box this is the unrestricted loop range */
+	static cell_box clip(const cell_box &box, int bw) {
+		cell_box b = box;
+		for (int dim = 0; dim < NDIM; dim++) {
+			b.lo[dim] = std::max(box.lo[dim] - (2 - bw), bw);
+			b.hi[dim] = std::min(box.hi[dim] + (2 - bw), cell_geometry::H_NX - bw);
+			b.hole_lo[dim] = box.hole_lo[dim] + (2 - bw);
+			b.hole_hi[dim] = box.hole_hi[dim] - (2 - bw);
+		}
+		return b;
+	}
+
+	static bool in_box(const cell_box &box, int i) {
+		const auto dims = index_to_dims<NDIM, cell_geometry::H_NX>(i);
+		bool in_hole = has_hole(box);
+		for (int dim = 0; dim < NDIM; dim++) {
+			if (dims[dim] < box.lo[dim] || dims[dim] >= box.hi[dim]) {
+				return false;
+			}
+			in_hole = in_hole && dims[dim] >= box.hole_lo[dim] && dims[dim] < box.hole_hi[dim];
+		}
+		return !in_hole;
+	}
+
 	static auto to_index(int j, int k, int l) {
 		if /*constexpr*/(NDIM == 1) {
 			return j;
@@ -21,6 +21,7 @@ using std::launch;
 
 #include "octotiger/unitiger/cell_geometry.hpp"
 #include "octotiger/unitiger/util.hpp"
+#include "octotiger/common_kernel/struct_of_array_data.hpp"
 
 
 
@@ -46,21 +47,129 @@ struct timestep_t {
 
 namespace hydro {
 
+using soa_storage = octotiger::fmm::struct_of_array_slabs<safe_real>;
+
+/* Working state of the hydro kernels in SoA form - one padded, aligned slab per field, all fields in a
+ * single contiguous buffer. U[f] is a plain pointer to the field, so U[f][i] reads like the vector version */
+class soa_state {
+	soa_storage data_;
+public:
+	soa_state() = default;
+	soa_state(int nf, int n) :
+			data_(nf, n) {
+	}
+	void resize(int nf, int n) {
+		data_.resize(nf, n);
+	}
+	/* sizes the slabs to hold U, the contents are left as they are if they already fit */
+	void fit(const std::vector<std::vector<safe_real>> &U) {
+		if (data_.num_components() != U.size() || data_.padded_entries_per_component() < U[0].size()) {
+			data_.resize(U.size(), U[0].size());
+		}
+	}
+	void assign(const std::vector<std::vector<safe_real>> &U) {
+		fit(U);
+		for (std::size_t f = 0; f < U.size(); f++) {
+			std::copy(U[f].begin(), U[f].end(), data_.slab(f));
+		}
+	}
+	int size() const {
+		return data_.num_components();
+	}
+	safe_real* operator[](int f) {
+		return data_.slab(f);
+	}
+	const safe_real* operator[](int f) const {
+		return data_.slab(f);
+	}
+};
+
+/* Two-level SoA block (e.g. field x direction for the reconstruction, dimension x field for the fluxes).
+ * Q[a] returns a slice, Q[a][b] a pointer to the padded slab, so Q[a][b][i] addresses one entry */
+class soa_block {
+	soa_storage data_;
+	int inner_;
+public:
+	template<class T>
+	class slice_t {
+		T *ptr_;
+		std::size_t stride_;
+	public:
+		slice_t(T *ptr, std::size_t stride) :
+				ptr_(ptr), stride_(stride) {
+		}
+		T* operator[](int b) const {
+			return ptr_ + b * stride_;
+		}
+	};
+	using slice = slice_t<safe_real>;
+	using const_slice = slice_t<const safe_real>;
+	soa_block() :
+			inner_(0) {
+	}
+	soa_block(int outer, int inner, int n) {
+		resize(outer, inner, n);
+	}
+	void resize(int outer, int inner, int n) {
+		inner_ = inner;
+		data_.resize(outer * inner, n);
+	}
+	int size() const {
+		return inner_ == 0 ? 0 : data_.num_components() / inner_;
+	}
+	slice operator[](int a) {
+		return slice(data_.slab(a * inner_), data_.padded_entries_per_component());
+	}
+	const_slice operator[](int a) const {
+		return const_slice(data_.slab(a * inner_), data_.padded_entries_per_component());
+	}
+};
+
 using x_type = std::vector<std::vector<safe_real>>;
 
-using flux_type = std::vector<std::vector<std::vector<safe_real>>>;
+using flux_type = soa_block;
 
 template<int NDIM>
-using recon_type =std::vector<std::vector<std::vector<safe_real>>>;
+using recon_type = soa_block;
 
 using state_type = std::vector<std::vector<safe_real>>;
+
+/* Part of the sub-grid a reconstruct/flux pass covers. The interior faces only depend on cells of the sub-grid
+ * itself, so they can be computed while the ghost zones are still being exchanged. The boundary faces next to face f
+ * of the sub-grid (dimension f / 2, the upper side if f is odd), away from its edges, only read the ghost zone
+ * across f and are covered by face_of(f) once that has arrived. The boundary pass does the rest, it leaves out
+ * the face regions whose bit is set in done */
+struct region {
+	enum kind_type {
+		all, interior, face, boundary
+	};
+	kind_type kind;
+	int face_index;
+	int done;
+	region(kind_type k = all) :
+			kind(k), face_index(-1), done(0) {
+	}
+	static region face_of(int f) {
+		region r(face);
+		r.face_index = f;
+		return r;
+	}
+	static region boundary_without(int done) {
+		region r(boundary);
+		r.done = done;
+		return r;
+	}
+};
 }
 
 template<int NDIM, int INX, class PHYSICS>
 struct hydro_computer: public cell_geometry<NDIM, INX> {
 
-	void reconstruct_ppm(std::vector<std::vector<safe_real>> &q, const std::vector<safe_real> &u, bool smooth, bool disc_detect,
-			const std::vector<std::vector<double>> &disc);
+	void reconstruct_ppm(hydro::soa_block::slice q, const safe_real *u, bool smooth, bool disc_detect,
+			const std::vector<std::vector<double>> &disc, const cell_box &box);
+
+	void reconstruct_ppm_simd(hydro::soa_block::slice q, const safe_real *u, bool smooth, bool disc_detect,
+			const std::vector<std::vector<double>> &disc, const cell_box &box);
 
 	using geo = cell_geometry<NDIM,INX>;
 
@@ -68,12 +177,26 @@ struct hydro_computer: public cell_geometry<NDIM, INX> {
 		OUTFLOW, PERIODIC
 	};
 
-	const hydro::recon_type<NDIM>& reconstruct(const hydro::state_type &U, const hydro::x_type&, safe_real);
-//#ifdef OCTOTIGER_WITH_CUDA
-	const hydro::recon_type<NDIM>& reconstruct_cuda(hydro::state_type &U, const hydro::x_type&, safe_real);
-//#endif
+	const hydro::recon_type<NDIM>& reconstruct(const hydro::state_type &U, const hydro::x_type&, safe_real, hydro::region region = hydro::region::all);
+
+	timestep_t flux(const hydro::state_type &U, const hydro::recon_type<NDIM> &Q, hydro::flux_type &F, hydro::x_type &X, safe_real omega,
+			hydro::region region = hydro::region::all);
 
-	timestep_t flux(const hydro::state_type &U, const hydro::recon_type<NDIM> &Q, hydro::flux_type &F, hydro::x_type &X, safe_real omega);
+	timestep_t flux_simd(const hydro::state_type &U, const hydro::recon_type<NDIM> &Q, hydro::flux_type &F, hydro::x_type &X, safe_real omega,
+			hydro::region region);
+
+	/* The faces of the interior region. The flux through a face reads the reconstruction of the cells on either
+	 * side, which reaches two cells further, so these stay three cells clear of the ghost zones */
+	static cell_box interior_box() {
+		return geo::make_box(geo::H_BW + 3, geo::H_BW + INX - 2);
+	}
+
+	/* The cells whose reconstruction the faces of region read, a face reads the cells on either side of it. Only the
+	 * interior faces read the cells one further in than their first face, the boundary pass leaves those out */
+	static cell_box recon_box(hydro::region region);
+
+	/* the faces of region in dimension dim, in index order */
+	static const std::vector<int>& flux_indexes(int dim, hydro::region region);
 
 	void post_process(hydro::state_type &U, const hydro::state_type &X, safe_real dx);
 
@@ -106,6 +229,14 @@ struct hydro_computer: public cell_geometry<NDIM, INX> {
 		experiment = num;
 	}
 
+	void use_simd_reconstruct(bool on) {
+		simd_reconstruct_ = on;
+	}
+
+	void use_simd_flux(bool on) {
+		simd_flux_ = on;
+	}
+
 	std::vector<safe_real> get_field_sums(const hydro::state_type &U, safe_real dx);
 
 	std::vector<safe_real> get_field_mags(const hydro::state_type &U, safe_real dx);
@@ -122,6 +253,8 @@ struct hydro_computer: public cell_geometry<NDIM, INX> {
 
 private:
 	int experiment;
+	bool simd_reconstruct_;
+	bool simd_flux_;
 	int nf_;
 	int angmom_index_;
 	std::vector<bool> smooth_field_;
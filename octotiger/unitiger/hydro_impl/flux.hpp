@@ -8,10 +8,121 @@
 
 #include "octotiger/unitiger/physics.hpp"
 #include "octotiger/unitiger/physics_impl.hpp"
+#include "octotiger/unitiger/hydro_impl/flux_simd.hpp"
+
+/* The faces of every region and the cells they read. A face is in the region of face f of the sub-grid if it lies
+ * beyond the interior faces on that side only, the faces beyond them on several sides are along the edges */
+template<int NDIM, int INX>
+struct region_faces {
+	using geo = cell_geometry<NDIM, INX>;
+	static constexpr int nface = 2 * NDIM;
+	static constexpr int edges = nface + 1;
+
+	std::array<std::vector<int>, NDIM> interior;
+	std::array<std::vector<int>, NDIM> boundary;
+	std::array<std::array<std::vector<int>, NDIM>, nface> face;
+	/* 0 for the interior faces, 1 + f for the region of face f, edges for the others */
+	std::array<std::vector<signed char>, NDIM> part;
+	std::array<cell_box, nface> face_cells;
+
+	/* the partition around the interior faces in box, built on first use */
+	static const region_faces& get(const cell_box &box) {
+		static const region_faces parts(box);
+		return parts;
+	}
+
+	region_faces(const cell_box &box) {
+		static const geo g;
+		for (int f = 0; f < nface; f++) {
+			face_cells[f] = geo::make_box(geo::H_NX, 0);
+		}
+		for (int dim = 0; dim < NDIM; dim++) {
+			part[dim].assign(geo::H_N3, 0);
+			for (const auto i : g.get_indexes(3, g.face_pts()[dim][0])) {
+				const auto dims = index_to_dims<NDIM, geo::H_NX>(i);
+				int p = 0;
+				int outside = 0;
+				for (int d = 0; d < NDIM; d++) {
+					if (dims[d] < box.lo[d]) {
+						p = 1 + 2 * d;
+						outside++;
+					} else if (dims[d] >= box.hi[d]) {
+						p = 2 + 2 * d;
+						outside++;
+					}
+				}
+				if (outside > 1) {
+					p = edges;
+				}
+				part[dim][i] = p;
+				if (p == 0) {
+					interior[dim].push_back(i);
+					continue;
+				}
+				boundary[dim].push_back(i);
+				if (p != edges) {
+					face[p - 1][dim].push_back(i);
+					/* the cells on either side of the face */
+					auto &c = face_cells[p - 1];
+					for (int d = 0; d < NDIM; d++) {
+						c.lo[d] = std::min(c.lo[d], dims[d] - (d == dim ? 1 : 0));
+						c.hi[d] = std::max(c.hi[d], dims[d] + 1);
+					}
+				}
+			}
+		}
+	}
+};
+
+template<int NDIM, int INX, class PHYS>
+const std::vector<int>& hydro_computer<NDIM, INX, PHYS>::flux_indexes(int dim, hydro::region region) {
+	static const cell_geometry<NDIM, INX> geo;
+	const auto &parts = region_faces<NDIM, INX>::get(interior_box());
+	switch (region.kind) {
+	case hydro::region::interior:
+		return parts.interior[dim];
+	case hydro::region::face:
+		return parts.face[region.face_index][dim];
+	case hydro::region::boundary:
+		if (region.done != 0) {
+			static thread_local std::array<std::vector<int>, NDIM> rest;
+			rest[dim].clear();
+			for (const auto i : parts.boundary[dim]) {
+				const int p = parts.part[dim][i];
+				if (p == parts.edges || !(region.done & (1 << (p - 1)))) {
+					rest[dim].push_back(i);
+				}
+			}
+			return rest[dim];
+		}
+		return parts.boundary[dim];
+	default:
+		return geo.get_indexes(3, geo.face_pts()[dim][0]);
+	}
+}
+
+template<int NDIM, int INX, class PHYS>
+cell_box hydro_computer<NDIM, INX, PHYS>::recon_box(hydro::region region) {
+	const auto &parts = region_faces<NDIM, INX>::get(interior_box());
+	switch (region.kind) {
+	case hydro::region::interior:
+		return geo::make_box(geo::H_BW + 2, geo::H_BW + INX - 2);
+	case hydro::region::face:
+		return parts.face_cells[region.face_index];
+	case hydro::region::boundary:
+		return geo::make_shell(geo::full_box(), geo::H_BW + 4, geo::H_BW + INX - 3);
+	default:
+		return geo::full_box();
+	}
+}
 
 template<int NDIM, int INX, class PHYS>
 timestep_t hydro_computer<NDIM, INX, PHYS>::flux(const hydro::state_type &U, const hydro::recon_type<NDIM> &Q, hydro::flux_type &F, hydro::x_type &X,
-		safe_real omega) {
+		safe_real omega, hydro::region region) {
+
+	if (simd_flux_) {
+		return flux_simd(U, Q, F, X, omega, region);
+	}
 
 	PROFILE();
 
@@ -30,7 +141,7 @@ timestep_t hydro_computer<NDIM, INX, PHYS>::flux(const hydro::state_type &U, con
 
 	for (int dim = 0; dim < NDIM; dim++) {
 
-		const auto indices = geo.get_indexes(3, geo.face_pts()[dim][0]);
+		const auto &indices = flux_indexes(dim, region);
 
 		// zero-initialize F
 		for (int f = 0; f < nf_; f++) {
@@ -0,0 +1,119 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "octotiger/unitiger/simd.hpp"
+
+/* Face flux for a block of hydro_simd::width<T> consecutive face indices starting at i. The
+ * reconstructed states are gathered into the field rows of UR/UL (width<T> entries per field), so
+ * the physics and the Riemann solver run on full vectors. Returns the max signal speed per lane. */
+template<int NDIM, int INX, class PHYS, class T>
+inline T flux_block(const hydro::recon_type<NDIM> &Q, hydro::flux_type &F, const hydro::x_type &X, safe_real omega, safe_real dx, int nf,
+		int dim, int i, safe_real *UR, safe_real *UL, safe_real *FR, safe_real *FL) {
+	using namespace hydro_simd;
+	using geo = cell_geometry<NDIM, INX>;
+	constexpr int W = width<T>::value;
+	static constexpr auto faces = geo::face_pts();
+	static constexpr auto weights = geo::face_weight();
+	static constexpr auto xloc = geo::xloc();
+	T ap = 0.0, am = 0.0;
+	for (int fi = 0; fi < geo::NFACEDIR; fi++) {
+		const auto d = faces[dim][fi];
+		const auto dl = geo::flip_dim(d, dim);
+		for (int f = 0; f < nf; f++) {
+			store(UR + f * W, load<T>(Q[f][d] + i));
+			store(UL + f * W, load<T>(Q[f][dl] + i - geo::H_DN[dim]));
+		}
+		std::array<T, NDIM> x;
+		std::array<T, NDIM> vg;
+		for (int dim = 0; dim < NDIM; dim++) {
+			x[dim] = load<T>(X[dim].data() + i) + T(0.5 * xloc[d][dim] * dx);
+		}
+		if constexpr (NDIM > 1) {
+			vg[0] = T(-omega) * (load<T>(X[1].data() + i) + T(0.5 * xloc[d][1] * dx));
+			vg[1] = T(+omega) * (load<T>(X[0].data() + i) + T(0.5 * xloc[d][0] * dx));
+			if constexpr (NDIM == 3) {
+				vg[2] = 0.0;
+			}
+		} else {
+			vg[0] = 0.0;
+		}
+		T amr, apr, aml, apl;
+		PHYS::template physical_flux_simd<INX>(UR, FR, dim, amr, apr, x, vg);
+		PHYS::template physical_flux_simd<INX>(UL, FL, dim, aml, apl, x, vg);
+		const T this_ap = max(max(apr, apl), T(0.0));
+		const T this_am = min(min(amr, aml), T(0.0));
+		const auto split = this_ap - this_am != T(0.0);
+		const T den = select(split, this_ap - this_am, T(1.0));
+		for (int f = 0; f < nf; f++) {
+			const T fr = load<T>(FR + f * W);
+			const T fl = load<T>(FL + f * W);
+			const T ur = load<T>(UR + f * W);
+			const T ul = load<T>(UL + f * W);
+			const T this_flux = select(split, (this_ap * fl - this_am * fr + this_ap * this_am * (ur - ul)) / den, (fl + fr) / T(2.0));
+			safe_real *Fi = F[dim][f] + i;
+			store(Fi, load<T>(Fi) + T(weights[fi]) * this_flux);
+		}
+		am = min(am, this_am);
+		ap = max(ap, this_ap);
+	}
+	return max(ap, T(-am));
+}
+
+template<int NDIM, int INX, class PHYS>
+timestep_t hydro_computer<NDIM, INX, PHYS>::flux_simd(const hydro::state_type &U, const hydro::recon_type<NDIM> &Q, hydro::flux_type &F,
+		hydro::x_type &X, safe_real omega, hydro::region region) {
+
+	PROFILE();
+
+	constexpr int W = hydro_simd::width<hydro_simd::vector_type>::value;
+	timestep_t ts;
+	ts.a = 0.0;
+	static thread_local std::vector<safe_real> UR(nf_ * W), UL(nf_ * W), FR(nf_ * W), FL(nf_ * W);
+
+	static const cell_geometry<NDIM, INX> geo;
+
+	const auto dx = X[0][geo.H_DNX] - X[0][0];
+
+	for (int dim = 0; dim < NDIM; dim++) {
+
+		const auto &indices = flux_indexes(dim, region);
+
+		// zero-initialize F
+		for (int f = 0; f < nf_; f++) {
+#pragma ivdep
+			for (const auto &i : indices) {
+				F[dim][f][i] = 0.0;
+			}
+		}
+
+		hydro_simd::for_each_run(indices, [&](int start, int len) {
+			hydro_simd::for_each_block(start, len, [&](auto tag, int i) {
+				using T = decltype(tag);
+				constexpr int w = hydro_simd::width<T>::value;
+				const T amax = flux_block<NDIM, INX, PHYS, T>(Q, F, X, omega, dx, nf_, dim, i, UR.data(), UL.data(), FR.data(), FL.data());
+				/* reduce in index order so the reported face matches the scalar kernel */
+				for (int l = 0; l < w; l++) {
+					const auto this_amax = hydro_simd::get_lane(amax, l);
+					if (this_amax > ts.a) {
+						ts.a = this_amax;
+						ts.x = X[0][i + l];
+						ts.y = X[1][i + l];
+						ts.z = X[2][i + l];
+						ts.ur.resize(nf_);
+						ts.ul.resize(nf_);
+						for (int f = 0; f < nf_; f++) {
+							ts.ur[f] = UL[f * w + l];
+							ts.ul[f] = UR[f * w + l];
+						}
+						ts.dim = dim;
+					}
+				}
+			});
+		});
+	}
+	return ts;
+}
@@ -17,6 +17,8 @@ hydro_computer<NDIM, INX, PHYS>::hydro_computer() {
 
 	angmom_index_ = -1;
 	experiment = 0;
+	simd_reconstruct_ = false;
+	simd_flux_ = false;
 	for( int f = 0; f < nf_; f++) {
 		smooth_field_.push_back(false);
 		disc_detect_.push_back(false);
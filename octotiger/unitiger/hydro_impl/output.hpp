@@ -85,8 +85,8 @@ void hydro_computer<NDIM, INX, PHYS>::outputQ(const hydro::recon_type<NDIM> &Q,
                 filename = test_type + "_Q_test_final.data";
         FILE *fp = fopen(filename.c_str(), "wb");
         for (int f = 0; f < nf_; f++) {
-                for (int i = 0; i < geo::H_NX; i++) {
-                                fwrite(Q[f][i].data(), sizeof(double), geo::NDIR, fp);
+                for (int d = 0; d < geo::NDIR; d++) {
+                                fwrite(Q[f][d], sizeof(double), geo::H_N3, fp);
                         }
                 }
         fclose(fp);
@@ -117,7 +117,7 @@ void hydro_computer<NDIM, INX, PHYS>::outputF(const hydro::flux_type &Fl, int nu
         for (int i=0; i < NDIM; i++)
         {
                 for (int f = 0; f < nf_; f++) {
-                fwrite(Fl[i][f].data(), sizeof(double), geo::H_N3, fp);
+                fwrite(Fl[i][f], sizeof(double), geo::H_N3, fp);
                 }
         }
         fclose(fp);
@@ -125,7 +125,7 @@ void hydro_computer<NDIM, INX, PHYS>::outputF(const hydro::flux_type &Fl, int nu
 template<int NDIM, int INX,class PHYS>
 int hydro_computer<NDIM, INX, PHYS>::compareQ(const hydro::recon_type<NDIM> &Q, int num, std::string test_type)
 {
-        double dline[geo::NDIR];
+        double dline[geo::H_N3];
         std::string filename;
 
         if (num > 0)
@@ -136,14 +136,14 @@ int hydro_computer<NDIM, INX, PHYS>::compareQ(const hydro::recon_type<NDIM> &Q,
         if (fp != nullptr)
         {
                 for (int f = 0; f < nf_; f++) {
-                        for (int i = 0; i < geo::H_NX; i++) {
-                                fread(&dline, sizeof(double), geo::NDIR, fp);
-                                for (int j = 0; j < geo::NDIR; j++)
+                        for (int i = 0; i < geo::NDIR; i++) {
+                                fread(&dline, sizeof(double), geo::H_N3, fp);
+                                for (int j = 0; j < geo::H_N3; j++)
                                 {
                                         if (std::abs(Q[f][i][j] - dline[j])/(1e-12+dline[j]+Q[f][i][j]) > 1e-12)
                                         {
                                                 printf("differnt Q values in: (%d of %d), (%d of %d), (%d of %d). The values are (old, new): %f, %f\n",
-                                                                f, nf_, i, geo::H_NX, j, geo::NDIR, dline[j], double(Q[f][i][j]));
+                                                                f, nf_, i, geo::NDIR, j, geo::H_N3, dline[j], double(Q[f][i][j]));
                                                 fclose(fp);
                                                 return 0;
                                         }
@@ -9,6 +9,7 @@
 
 #include "octotiger/unitiger/physics.hpp"
 #include "octotiger/unitiger/physics_impl.hpp"
+#include "octotiger/unitiger/hydro_impl/reconstruct_simd.hpp"
 
 #include <octotiger/cuda_util/cuda_helper.hpp>
 #include <octotiger/cuda_util/cuda_scheduler.hpp>
@@ -49,122 +50,83 @@ static inline bool PPM_test(const T &ql, const T &q0, const T &qr) {
 	return rc;
 }
 
-//#ifdef OCTOTIGER_WITH_CUDA
-template<int NDIM, int INX, class PHYS>
-const hydro::recon_type<NDIM>& hydro_computer<NDIM, INX, PHYS>::reconstruct_cuda(hydro::state_type &U_, const hydro::x_type &X, safe_real omega) {
-
-//	static thread_local octotiger::fmm::struct_of_array_data<std::array<safe_real, geo::NDIR>, safe_real, geo::NDIR, geo::H_N3, 19>
-//		D1_SoA;
-	/*static thread_local*/auto D1 = std::vector<std::array<safe_real, geo::NDIR / 2>>(geo::H_N3);
-	/*static thread_local*/auto Q = std::vector < std::vector<std::array<safe_real, geo::NDIR>>
-			> (nf_, std::vector<std::array<safe_real, geo::NDIR>>(geo::H_N3));
-
-	/*static thread_local*/octotiger::fmm::struct_of_array_data<std::array<safe_real, geo::NDIR>, safe_real, geo::NDIR, geo::H_N3, 19> D1_SoA;
-	/*static thread_local*/std::vector<octotiger::fmm::struct_of_array_data<std::array<safe_real, geo::NDIR>, safe_real, geo::NDIR, geo::H_N3, 19>> Q_SoA(nf_);
-
-	/* 	std::cout << " U_ " << U_.size();
-	 for (int i = 0; i < U_.size(); i++) {
-	 std::cout << U_[i].size() << " ";
-	 }
-	 std::cout << std::endl;
-	 std::cout << " X " << X.size();
-	 for (int i = 0; i < X.size(); i++) {
-	 std::cout << X[i].size() << " ";
-	 }
-	 std::cout << std::endl;
-	 std::cout << "Constants: NDIR:" << geo::NDIR << " H_N3:" << geo::H_N3 << std::endl; */
-
-	octotiger::fmm::struct_of_array_data<std::array<safe_real, geo::NDIR>, safe_real, geo::NDIR, geo::H_N3, 19> U_SoA;
-	U_SoA.concatenate_vectors(U_);
-
-	return Q;
-}
-//#endif
-
 template<int NDIM, int INX>
-void reconstruct_minmod(std::vector<std::vector<safe_real>> &q, const std::vector<safe_real> &u) {
+void reconstruct_minmod(hydro::soa_block::slice q, const safe_real *u, const cell_box &box) {
 	PROFILE();
 	static const cell_geometry<NDIM, INX> geo;
 	static constexpr auto dir = geo.direction();
+	const auto r = geo.clip(box, 1);
 	for (int d = 0; d < geo.NDIR; d++) {
 		const auto di = dir[d];
-		for (int j = 0; j < geo.H_NX_XM2; j++) {
-			for (int k = 0; k < geo.H_NX_YM2; k++) {
-				for (int l = 0; l < geo.H_NX_ZM2; l++) {
-					const int i = geo.to_index(j + 1, k + 1, l + 1);
-					q[d][i] = u[i] + 0.5 * minmod(u[i + di] - u[i], u[i] - u[i - di]);
-				}
+		hydro_simd::for_each_row<NDIM, INX>(r, [&](int start, int len) {
+			for (int i = start; i < start + len; i++) {
+				q[d][i] = u[i] + 0.5 * minmod(u[i + di] - u[i], u[i] - u[i - di]);
 			}
-		}
+		});
 	}
 }
 
 template<int NDIM, int INX, class PHYSICS>
-void hydro_computer<NDIM, INX, PHYSICS>::reconstruct_ppm(std::vector<std::vector<safe_real>> &q, const std::vector<safe_real> &u, bool smooth, bool disc_detect,
-		const std::vector<std::vector<double>> &disc) {
+void hydro_computer<NDIM, INX, PHYSICS>::reconstruct_ppm(hydro::soa_block::slice q, const safe_real *u, bool smooth, bool disc_detect,
+		const std::vector<std::vector<double>> &disc, const cell_box &box) {
+	/* the face averaging experiment is only implemented here */
+	if (simd_reconstruct_ && experiment != 1) {
+		reconstruct_ppm_simd(q, u, smooth, disc_detect, disc, box);
+		return;
+	}
 	PROFILE();
 
 	static const cell_geometry<NDIM, INX> geo;
 	static constexpr auto dir = geo.direction();
 	static thread_local auto D1 = std::vector < safe_real > (geo.H_N3, 0.0);
+	const auto r1 = geo.clip(box, 1);
+	const auto r2 = geo.clip(box, 2);
 	for (int d = 0; d < geo.NDIR / 2; d++) {
 		const auto di = dir[d];
-		for (int j = 0; j < geo.H_NX_XM2; j++) {
-			for (int k = 0; k < geo.H_NX_YM2; k++) {
+		hydro_simd::for_each_row<NDIM, INX>(r1, [&](int start, int len) {
 #pragma ivdep
-				for (int l = 0; l < geo.H_NX_ZM2; l++) {
-					const int i = geo.to_index(j + 1, k + 1, l + 1);
-					D1[i] = minmod_theta(u[i + di] - u[i], u[i] - u[i - di], 2.0);
-				}
+			for (int i = start; i < start + len; i++) {
+				D1[i] = minmod_theta(u[i + di] - u[i], u[i] - u[i - di], 2.0);
 			}
-		}
-		for (int j = 0; j < geo.H_NX_XM2; j++) {
-			for (int k = 0; k < geo.H_NX_YM2; k++) {
+		});
+		hydro_simd::for_each_row<NDIM, INX>(r1, [&](int start, int len) {
 #pragma ivdep
-				for (int l = 0; l < geo.H_NX_ZM2; l++) {
-					const int i = geo.to_index(j + 1, k + 1, l + 1);
-					q[d][i] = 0.5 * (u[i] + u[i + di]);
-					q[d][i] += (1.0 / 6.0) * (D1[i] - D1[i + di]);
-					q[geo.flip(d)][i + di] = q[d][i];
-				}
+			for (int i = start; i < start + len; i++) {
+				q[d][i] = 0.5 * (u[i] + u[i + di]);
+				q[d][i] += (1.0 / 6.0) * (D1[i] - D1[i + di]);
+				q[geo.flip(d)][i + di] = q[d][i];
 			}
-		}
+		});
 	}
 	if (experiment == 1) {
-		for (int j = 0; j < geo.H_NX_XM2; j++) {
-			for (int k = 0; k < geo.H_NX_YM2; k++) {
+		hydro_simd::for_each_row<NDIM, INX>(r1, [&](int start, int len) {
 #pragma ivdep
-				for (int l = 0; l < geo.H_NX_ZM2; l++) {
-					const int i = geo.to_index(j + 1, k + 1, l + 1);
-					for (int gi = 0; gi < geo::group_count(); gi++) {
-						safe_real sum = 0.0;
-						for (int n = 0; n < geo::group_size(gi); n++) {
-							const auto pair = geo::group_pair(gi, n);
-							sum += q[pair.second][i + pair.first];
-						}
-						sum /= safe_real(geo::group_size(gi));
-						for (int n = 0; n < geo::group_size(gi); n++) {
-							const auto pair = geo::group_pair(gi, n);
-							q[pair.second][i + pair.first] = sum;
-						}
+			for (int i = start; i < start + len; i++) {
+				for (int gi = 0; gi < geo::group_count(); gi++) {
+					safe_real sum = 0.0;
+					for (int n = 0; n < geo::group_size(gi); n++) {
+						const auto pair = geo::group_pair(gi, n);
+						sum += q[pair.second][i + pair.first];
+					}
+					sum /= safe_real(geo::group_size(gi));
+					for (int n = 0; n < geo::group_size(gi); n++) {
+						const auto pair = geo::group_pair(gi, n);
+						q[pair.second][i + pair.first] = sum;
 					}
 				}
 			}
-		}
+		});
 		for (int d = 0; d < geo.NDIR; d++) {
 			const auto di = dir[d];
-			for (int j = 0; j < geo.H_NX_XM2; j++) {
-				for (int k = 0; k < geo.H_NX_YM2; k++) {
+			hydro_simd::for_each_row<NDIM, INX>(r1, [&](int start, int len) {
 #pragma ivdep
-					for (int l = 0; l < geo.H_NX_ZM2; l++) {
-						const int i = geo.to_index(j + 1, k + 1, l + 1);
-						const auto mx = std::max(u[i + di], u[i]);
-						const auto mn = std::min(u[i + di], u[i]);
-						q[d][i] = std::min(mx, q[d][i]);
-						q[d][i] = std::max(mn, q[d][i]);
-					}
+				for (int i = start; i < start + len; i++) {
+					const auto mx = std::max(u[i + di], u[i]);
+					const auto mn = std::min(u[i + di], u[i]);
+					q[d][i] = std::min(mx, q[d][i]);
+					q[d][i] = std::max(mn, q[d][i]);
 				}
-			}
+			});
 		}
 	}
 	if (disc_detect) {
@@ -174,54 +136,48 @@ void hydro_computer<NDIM, INX, PHYSICS>::reconstruct_ppm(std::vector<std::vector
 		constexpr auto eta2 = 0.05;
 		for (int d = 0; d < geo.NDIR / 2; d++) {
 			const auto di = dir[d];
-			for (int j = 0; j < geo.H_NX_XM4; j++) {
-				for (int k = 0; k < geo.H_NX_YM4; k++) {
+			hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-					for (int l = 0; l < geo.H_NX_ZM4; l++) {
-						const int i = geo.to_index(j + 2, k + 2, l + 2);
-						const auto &up = u[i + di];
-						const auto &u0 = u[i];
-						const auto &um = u[i - di];
-						const auto dif = up - um;
-						if (std::abs(dif) > disc[d][i] * std::min(std::abs(up), std::abs(um))) {
-							if (std::min(std::abs(up), std::abs(um)) / std::max(std::abs(up), std::abs(um)) > eps2) {
-								const auto d2p = (1.0 / 6.0) * (u[i + 2 * di] + u0 - 2.0 * u[i + di]);
-								const auto d2m = (1.0 / 6.0) * (u0 + u[i - 2 * di] - 2.0 * u[i - di]);
-								if (d2p * d2m < 0.0) {
-									double eta = 0.0;
-									if (std::abs(dif) > eps * std::min(std::abs(up), std::abs(um))) {
-										eta = -(d2p - d2m) / dif;
-									}
-									eta = std::max(0.0, std::min(eta1 * (eta - eta2), 1.0));
-									if (eta > 0.0) {
-										auto ul = um + 0.5 * minmod_theta(u[i] - um, um - u[i - 2 * di], 2.0);
-										auto ur = up - 0.5 * minmod_theta(u[i + 2 * di] - up, up - u[i], 2.0);
-										auto &qp = q[d][i];
-										auto &qm = q[geo.flip(d)][i];
-										qp += eta * (ur - qp);
-										qm += eta * (ul - qm);
-									}
+				for (int i = start; i < start + len; i++) {
+					const auto &up = u[i + di];
+					const auto &u0 = u[i];
+					const auto &um = u[i - di];
+					const auto dif = up - um;
+					if (std::abs(dif) > disc[d][i] * std::min(std::abs(up), std::abs(um))) {
+						if (std::min(std::abs(up), std::abs(um)) / std::max(std::abs(up), std::abs(um)) > eps2) {
+							const auto d2p = (1.0 / 6.0) * (u[i + 2 * di] + u0 - 2.0 * u[i + di]);
+							const auto d2m = (1.0 / 6.0) * (u0 + u[i - 2 * di] - 2.0 * u[i - di]);
+							if (d2p * d2m < 0.0) {
+								double eta = 0.0;
+								if (std::abs(dif) > eps * std::min(std::abs(up), std::abs(um))) {
+									eta = -(d2p - d2m) / dif;
+								}
+								eta = std::max(0.0, std::min(eta1 * (eta - eta2), 1.0));
+								if (eta > 0.0) {
+									auto ul = um + 0.5 * minmod_theta(u[i] - um, um - u[i - 2 * di], 2.0);
+									auto ur = up - 0.5 * minmod_theta(u[i + 2 * di] - up, up - u[i], 2.0);
+									auto &qp = q[d][i];
+									auto &qm = q[geo.flip(d)][i];
+									qp += eta * (ur - qp);
+									qm += eta * (ul - qm);
 								}
 							}
 						}
 					}
 				}
-			}
+			});
 		}
 	}
 	if (!smooth) {
 		for (int d = 0; d < geo.NDIR / 2; d++) {
-			for (int j = 0; j < geo.H_NX_XM4; j++) {
-				for (int k = 0; k < geo.H_NX_YM4; k++) {
+			hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-					for (int l = 0; l < geo.H_NX_ZM4; l++) {
-						const int i = geo.to_index(j + 2, k + 2, l + 2);
-						auto &qp = q[geo.flip(d)][i];
-						auto &qm = q[d][i];
-						make_monotone(qm, u[i], qp);
-					}
+				for (int i = start; i < start + len; i++) {
+					auto &qp = q[geo.flip(d)][i];
+					auto &qm = q[d][i];
+					make_monotone(qm, u[i], qp);
 				}
-			}
+			});
 		}
 	}
 
@@ -253,69 +209,74 @@ inline safe_real ospre(safe_real a, safe_real b) {
 }
 
 template<int NDIM, int INX, class PHYS>
-const hydro::recon_type<NDIM>& hydro_computer<NDIM, INX, PHYS>::reconstruct(const hydro::state_type &U_, const hydro::x_type &X, safe_real omega) {
+const hydro::recon_type<NDIM>& hydro_computer<NDIM, INX, PHYS>::reconstruct(const hydro::state_type &U_, const hydro::x_type &X, safe_real omega,
+		hydro::region region) {
 	PROFILE();
 	static thread_local std::vector<std::vector<safe_real>> AM(geo::NANGMOM, std::vector < safe_real > (geo::H_N3));
-	static thread_local std::vector<std::vector<std::vector<safe_real>> > Q(nf_,
-			std::vector < std::vector < safe_real >> (geo::NDIR, std::vector < safe_real > (geo::H_N3)));
+	static thread_local hydro::recon_type<NDIM> Q(nf_, geo::NDIR, geo::H_N3);
 
 	static constexpr auto xloc = geo::xloc();
 	static constexpr auto levi_civita = geo::levi_civita();
 	static constexpr auto vw = geo::volume_weight();
 	static constexpr auto dir = geo::direction();
 
+	const auto box = recon_box(region);
+	const auto r2 = geo::clip(box, 2);
+
 	const auto dx = X[0][geo::H_DNX] - X[0][0];
-	const auto &U = PHYS::template pre_recon<INX>(U_, X, omega, angmom_index_ != -1);
-	const auto &cdiscs = PHYS::template find_contact_discs<INX>(U_);
+	const auto &U = PHYS::template pre_recon<INX>(U_, X, omega, angmom_index_ != -1, box);
+	const auto &cdiscs = PHYS::template find_contact_discs<INX>(U_, box);
 	if (angmom_index_ == -1 || NDIM == 1) {
 		for (int f = 0; f < nf_; f++) {
 			if (f < lx_i || f > lx_i + geo::NANGMOM || NDIM == 1) {
-				reconstruct_ppm(Q[f], U[f], smooth_field_[f], disc_detect_[f], cdiscs);
+				reconstruct_ppm(Q[f], U[f], smooth_field_[f], disc_detect_[f], cdiscs, box);
 			} else {
-				reconstruct_minmod<NDIM, INX>(Q[f], U[f]);
+				if (simd_reconstruct_) {
+					reconstruct_minmod_simd<NDIM, INX>(Q[f], U[f], box);
+				} else {
+					reconstruct_minmod<NDIM, INX>(Q[f], U[f], box);
+				}
 			}
 		}
 
 	} else {
 		for (int f = 0; f < angmom_index_; f++) {
-			reconstruct_ppm(Q[f], U[f], smooth_field_[f], disc_detect_[f], cdiscs);
+			reconstruct_ppm(Q[f], U[f], smooth_field_[f], disc_detect_[f], cdiscs, box);
 		}
 
 		int sx_i = angmom_index_;
 		int zx_i = sx_i + NDIM;
 
 		for (int f = sx_i; f < sx_i + NDIM; f++) {
-			reconstruct_ppm(Q[f], U[f], true, false, cdiscs);
+			reconstruct_ppm(Q[f], U[f], true, false, cdiscs, box);
 		}
 		for (int f = zx_i; f < zx_i + geo::NANGMOM; f++) {
-			reconstruct_minmod<NDIM, INX>(Q[f], U[f]);
+			if (simd_reconstruct_) {
+				reconstruct_minmod_simd<NDIM, INX>(Q[f], U[f], box);
+			} else {
+				reconstruct_minmod<NDIM, INX>(Q[f], U[f], box);
+			}
 		}
 
 		for (int n = 0; n < geo::NANGMOM; n++) {
-			for (int j = 0; j < geo::H_NX_XM4; j++) {
-				for (int k = 0; k < geo::H_NX_YM4; k++) {
+			hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-					for (int l = 0; l < geo::H_NX_ZM4; l++) {
-						const int i = geo::to_index(j + 2, k + 2, l + 2);
-						AM[n][i] = U[zx_i + n][i] * U[0][i];
-					}
+				for (int i = start; i < start + len; i++) {
+					AM[n][i] = U[zx_i + n][i] * U[0][i];
 				}
-			}
+			});
 			for (int m = 0; m < NDIM; m++) {
 				for (int q = 0; q < NDIM; q++) {
 					const auto lc = levi_civita[n][m][q];
 					if (lc != 0) {
 						for (int d = 0; d < geo::NDIR; d++) {
 							if (d != geo::NDIR / 2) {
-								for (int j = 0; j < geo::H_NX_XM4; j++) {
-									for (int k = 0; k < geo::H_NX_YM4; k++) {
+								hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-										for (int l = 0; l < geo::H_NX_ZM4; l++) {
-											const int i = geo::to_index(j + 2, k + 2, l + 2);
-											AM[n][i] -= vw[d] * lc * 0.5 * xloc[d][m] * Q[sx_i + q][d][i] * Q[0][d][i] * dx;
-										}
+									for (int i = start; i < start + len; i++) {
+										AM[n][i] -= vw[d] * lc * 0.5 * xloc[d][m] * Q[sx_i + q][d][i] * Q[0][d][i] * dx;
 									}
-								}
+								});
 							}
 						}
 					}
@@ -326,60 +287,57 @@ const hydro::recon_type<NDIM>& hydro_computer<NDIM, INX, PHYS>::reconstruct(cons
 			const auto f = sx_i + q;
 			for (int d = 0; d < geo::NDIR / 2; d++) {
 				const auto di = dir[d];
-				for (int j = 0; j < geo::H_NX_XM4; j++) {
-					for (int k = 0; k < geo::H_NX_YM4; k++) {
+				hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-						for (int l = 0; l < geo::H_NX_ZM4; l++) {
-							const int i = geo::to_index(j + 2, k + 2, l + 2);
-							const auto &rho_r = Q[0][d][i];
-							const auto &rho_l = Q[0][geo::flip(d)][i];
-							auto &qr = Q[f][d][i];
-							auto &ql = Q[f][geo::flip(d)][i];
-							const auto &ur = U[f][i + di];
-							const auto &u0 = U[f][i];
-							const auto &ul = U[f][i - di];
-							const auto b0 = qr - ql;
-							auto b = b0;
-							for (int n = 0; n < geo::NANGMOM; n++) {
-								for (int m = 0; m < NDIM; m++) {
-									const auto lc = levi_civita[n][m][q];
-									b += 12.0 * AM[n][i] * lc * xloc[d][m] / (dx * (rho_l + rho_r));
-								}
+					for (int i = start; i < start + len; i++) {
+						const auto &rho_r = Q[0][d][i];
+						const auto &rho_l = Q[0][geo::flip(d)][i];
+						auto &qr = Q[f][d][i];
+						auto &ql = Q[f][geo::flip(d)][i];
+						const auto &ur = U[f][i + di];
+						const auto &u0 = U[f][i];
+						const auto &ul = U[f][i - di];
+						const auto b0 = qr - ql;
+						auto b = b0;
+						for (int n = 0; n < geo::NANGMOM; n++) {
+							for (int m = 0; m < NDIM; m++) {
+								const auto lc = levi_civita[n][m][q];
+								b += 12.0 * AM[n][i] * lc * xloc[d][m] / (dx * (rho_l + rho_r));
 							}
-							double blim;
-							if ((ur - u0) * (u0 - ul) <= 0.0) {
-								blim = 0.0;
-							} else {
-								blim = b0;
+						}
+						double blim;
+						if ((ur - u0) * (u0 - ul) <= 0.0) {
+							blim = 0.0;
+						} else {
+							blim = b0;
+						}
+						b = minmod(blim, b);
+						qr += 0.5 * (b - b0);
+						ql -= 0.5 * (b - b0);
+						if (ur > u0 && u0 > ul) {
+							if (qr > ur) {
+								ql -= (qr - ur);
+								qr = ur;
+							} else if (ql < ul) {
+								qr -= (ql - ul);
+								ql = ul;
 							}
-							b = minmod(blim, b);
-							qr += 0.5 * (b - b0);
-							ql -= 0.5 * (b - b0);
-							if (ur > u0 && u0 > ul) {
-								if (qr > ur) {
-									ql -= (qr - ur);
-									qr = ur;
-								} else if (ql < ul) {
-									qr -= (ql - ul);
-									ql = ul;
-								}
-							} else if (ur < u0 && u0 < ul) {
-								if (qr < ur) {
-									ql -= (qr - ur);
-									qr = ur;
-								} else if (ql > ul) {
-									qr -= (ql - ul);
-									ql = ul;
-								}
+						} else if (ur < u0 && u0 < ul) {
+							if (qr < ur) {
+								ql -= (qr - ur);
+								qr = ur;
+							} else if (ql > ul) {
+								qr -= (ql - ul);
+								ql = ul;
 							}
-							make_monotone(qr, u0, ql);
 						}
+						make_monotone(qr, u0, ql);
 					}
-				}
+				});
 			}
 		}
 		for (int f = angmom_index_ + geo::NANGMOM + NDIM; f < nf_; f++) {
-			reconstruct_ppm(Q[f], U[f], smooth_field_[f], disc_detect_[f], cdiscs);
+			reconstruct_ppm(Q[f], U[f], smooth_field_[f], disc_detect_[f], cdiscs, box);
 		}
 
 	}
@@ -446,7 +404,7 @@ const hydro::recon_type<NDIM>& hydro_computer<NDIM, INX, PHYS>::reconstruct(cons
 	}
 
 #endif
-	PHYS::template post_recon<INX>(Q, X, omega, angmom_index_ != -1);
+	PHYS::template post_recon<INX>(Q, X, omega, angmom_index_ != -1, box);
 
 	return Q;
 }
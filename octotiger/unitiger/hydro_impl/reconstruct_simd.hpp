@@ -0,0 +1,170 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "octotiger/unitiger/simd.hpp"
+
+namespace hydro_simd {
+
+template<class T>
+inline T minmod(const T &a, const T &b) {
+	return (copysign(T(0.5), a) + copysign(T(0.5), b)) * min(abs(a), abs(b));
+}
+
+template<class T>
+inline T minmod_theta(const T &a, const T &b, const T &c) {
+	return minmod(c * minmod(a, b), T(0.5) * (a + b));
+}
+
+/* branch free version of make_monotone in unitiger/util.hpp */
+template<class T>
+inline void make_monotone(T &ql, const T &q0, T &qr) {
+	const T tmp1 = qr - ql;
+	const T tmp2 = qr + ql;
+	const auto extremum = (qr < q0) ^ (q0 < ql);
+	const T tmp3 = tmp1 * tmp1 / T(6.0);
+	const T tmp4 = tmp1 * (q0 - T(0.5) * tmp2);
+	const auto left = tmp4 > tmp3;
+	const auto right = !left && (-tmp3 > tmp4);
+	const T new_ql = select(left, T(3.0) * q0 - T(2.0) * qr, ql);
+	const T new_qr = select(right, T(3.0) * q0 - T(2.0) * ql, qr);
+	ql = select(extremum, q0, new_ql);
+	qr = select(extremum, q0, new_qr);
+}
+
+/* Per block kernels, i is the first cell of the block and di the stride of the direction */
+
+template<class T>
+inline void minmod_face(safe_real *q, const safe_real *u, int i, int di) {
+	const T u0 = load<T>(u + i);
+	store(q + i, u0 + T(0.5) * minmod(load<T>(u + i + di) - u0, u0 - load<T>(u + i - di)));
+}
+
+template<class T>
+inline void ppm_slope(safe_real *d1, const safe_real *u, int i, int di) {
+	const T u0 = load<T>(u + i);
+	store(d1 + i, minmod_theta(load<T>(u + i + di) - u0, u0 - load<T>(u + i - di), T(2.0)));
+}
+
+template<class T>
+inline void ppm_face(safe_real *qp, safe_real *qm, const safe_real *u, const safe_real *d1, int i, int di) {
+	T v = T(0.5) * (load<T>(u + i) + load<T>(u + i + di));
+	v += T(1.0 / 6.0) * (load<T>(d1 + i) - load<T>(d1 + i + di));
+	store(qp + i, v);
+	store(qm + i + di, v);
+}
+
+template<class T>
+inline void ppm_disc_detect(safe_real *qp, safe_real *qm, const safe_real *u, const safe_real *disc, int i, int di) {
+	constexpr auto eps = 0.01;
+	constexpr auto eps2 = 0.001;
+	constexpr auto eta1 = 20.0;
+	constexpr auto eta2 = 0.05;
+	const T up = load<T>(u + i + di);
+	const T u0 = load<T>(u + i);
+	const T um = load<T>(u + i - di);
+	const T upp = load<T>(u + i + 2 * di);
+	const T umm = load<T>(u + i - 2 * di);
+	const T dif = up - um;
+	const T abs_dif = abs(dif);
+	const T umin = min(abs(up), abs(um));
+	const T umax = max(abs(up), abs(um));
+	auto active = abs_dif > load<T>(disc + i) * umin;
+	/* every lane evaluates the divisions, keep the inactive ones finite */
+	active = active && (umin / select(active, umax, T(1.0)) > T(eps2));
+	const T d2p = T(1.0 / 6.0) * (upp + u0 - T(2.0) * up);
+	const T d2m = T(1.0 / 6.0) * (u0 + umm - T(2.0) * um);
+	active = active && (d2p * d2m < T(0.0));
+	const auto steep = abs_dif > T(eps) * umin;
+	T eta = select(steep, -(d2p - d2m) / select(steep, dif, T(1.0)), T(0.0));
+	eta = max(T(0.0), min(T(eta1) * (eta - T(eta2)), T(1.0)));
+	active = active && (eta > T(0.0));
+	const T ul = um + T(0.5) * minmod_theta(u0 - um, um - umm, T(2.0));
+	const T ur = up - T(0.5) * minmod_theta(upp - up, up - u0, T(2.0));
+	const T qp0 = load<T>(qp + i);
+	const T qm0 = load<T>(qm + i);
+	store(qp + i, select(active, qp0 + eta * (ur - qp0), qp0));
+	store(qm + i, select(active, qm0 + eta * (ul - qm0), qm0));
+}
+
+template<class T>
+inline void ppm_monotone(safe_real *qp, safe_real *qm, const safe_real *u, int i) {
+	T ql = load<T>(qm + i);
+	T qr = load<T>(qp + i);
+	make_monotone(ql, load<T>(u + i), qr);
+	store(qm + i, ql);
+	store(qp + i, qr);
+}
+
+}
+
+template<int NDIM, int INX>
+void reconstruct_minmod_simd(hydro::soa_block::slice q, const safe_real *u, const cell_box &box) {
+	PROFILE();
+	static const cell_geometry<NDIM, INX> geo;
+	static constexpr auto dir = geo.direction();
+	const auto r1 = geo.clip(box, 1);
+	for (int d = 0; d < geo.NDIR; d++) {
+		const auto di = dir[d];
+		safe_real *qd = q[d];
+		hydro_simd::for_each_row<NDIM, INX>(r1, [&](int start, int len) {
+			hydro_simd::for_each_block(start, len, [&](auto tag, int i) {
+				hydro_simd::minmod_face<decltype(tag)>(qd, u, i, di);
+			});
+		});
+	}
+}
+
+template<int NDIM, int INX, class PHYSICS>
+void hydro_computer<NDIM, INX, PHYSICS>::reconstruct_ppm_simd(hydro::soa_block::slice q, const safe_real *u, bool smooth, bool disc_detect,
+		const std::vector<std::vector<double>> &disc, const cell_box &box) {
+	PROFILE();
+	static const cell_geometry<NDIM, INX> geo;
+	static constexpr auto dir = geo.direction();
+	static thread_local auto D1 = std::vector < safe_real > (geo.H_N3, 0.0);
+	const auto r1 = geo.clip(box, 1);
+	const auto r2 = geo.clip(box, 2);
+	safe_real *d1 = D1.data();
+	for (int d = 0; d < geo.NDIR / 2; d++) {
+		const auto di = dir[d];
+		safe_real *qp = q[d];
+		safe_real *qm = q[geo.flip(d)];
+		hydro_simd::for_each_row<NDIM, INX>(r1, [&](int start, int len) {
+			hydro_simd::for_each_block(start, len, [&](auto tag, int i) {
+				hydro_simd::ppm_slope<decltype(tag)>(d1, u, i, di);
+			});
+		});
+		hydro_simd::for_each_row<NDIM, INX>(r1, [&](int start, int len) {
+			hydro_simd::for_each_block(start, len, [&](auto tag, int i) {
+				hydro_simd::ppm_face<decltype(tag)>(qp, qm, u, d1, i, di);
+			});
+		});
+	}
+	if (disc_detect) {
+		for (int d = 0; d < geo.NDIR / 2; d++) {
+			const auto di = dir[d];
+			const safe_real *disc_d = disc[d].data();
+			safe_real *qp = q[d];
+			safe_real *qm = q[geo.flip(d)];
+			hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
+				hydro_simd::for_each_block(start, len, [&](auto tag, int i) {
+					hydro_simd::ppm_disc_detect<decltype(tag)>(qp, qm, u, disc_d, i, di);
+				});
+			});
+		}
+	}
+	if (!smooth) {
+		for (int d = 0; d < geo.NDIR / 2; d++) {
+			safe_real *qp = q[geo.flip(d)];
+			safe_real *qm = q[d];
+			hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
+				hydro_simd::for_each_block(start, len, [&](auto tag, int i) {
+					hydro_simd::ppm_monotone<decltype(tag)>(qp, qm, u, i);
+				});
+			});
+		}
+	}
+}
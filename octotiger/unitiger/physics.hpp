@@ -66,6 +66,14 @@ struct physics {
 	static void physical_flux(const std::vector<safe_real> &U, std::vector<safe_real> &F, int dim, safe_real &am, safe_real &ap, std::array<safe_real, NDIM> &x,
 			std::array<safe_real, NDIM> &vg);
 
+	/* Batched versions of to_prim and physical_flux for hydro_simd::width<T> faces at once. U and F hold
+	 * one row of width<T> entries per field */
+	template<class T>
+	static void to_prim_simd(const safe_real *U, T &p, T &v, T &cs, int dim);
+
+	template<int INX, class T>
+	static void physical_flux_simd(const safe_real *U, safe_real *F, int dim, T &am, T &ap, std::array<T, NDIM> &x, std::array<T, NDIM> &vg);
+
 	template<int INX>
 	static void post_process(hydro::state_type &U, const hydro::x_type& X, safe_real dx);
 
@@ -76,10 +84,10 @@ struct physics {
 
 	/*** Reconstruct uses this - GPUize****/
 	template<int INX>
-	static const hydro::state_type& pre_recon(const hydro::state_type &U, const hydro::x_type X, safe_real omega, bool angmom);
+	static const hydro::soa_state& pre_recon(const hydro::state_type &U, const hydro::x_type X, safe_real omega, bool angmom, const cell_box &box);
 	/*** Reconstruct uses this - GPUize****/
 	template<int INX>
-	static void post_recon(std::vector<std::vector<std::vector<safe_real>>> &Q, const hydro::x_type X, safe_real omega, bool angmom);
+	static void post_recon(hydro::recon_type<NDIM> &Q, const hydro::x_type X, safe_real omega, bool angmom, const cell_box &box);
 	template<int INX>
 	using comp_type = hydro_computer<NDIM, INX, physics<NDIM>>;
 
@@ -90,7 +98,7 @@ struct physics {
 	static void analytic_solution(test_type test, hydro::state_type &U, const hydro::x_type &X, safe_real time);
 
 	template<int INX>
-	static const std::vector<std::vector<double>>& find_contact_discs(const hydro::state_type &U);
+	static const std::vector<std::vector<double>>& find_contact_discs(const hydro::state_type &U, const cell_box &box);
 
 	static void set_n_species(int n);
 
@@ -13,6 +13,7 @@
 #define OCTOTIGER_UNITIGER_PHYSICS_HPP12443_
 
 #include "octotiger/unitiger/safe_real.hpp"
+#include "octotiger/unitiger/simd.hpp"
 #include "octotiger/test_problems/blast.hpp"
 #include "octotiger/test_problems/exact_sod.hpp"
 #include "octotiger/profiler.hpp"
@@ -93,6 +94,87 @@ void physics<NDIM>::physical_flux(const std::vector<safe_real> &U, std::vector<s
 	}
 }
 
+template<int NDIM>
+template<class T>
+void physics<NDIM>::to_prim_simd(const safe_real *u, T &p, T &v, T &cs, int dim) {
+	using namespace hydro_simd;
+	constexpr int W = width<T>::value;
+	const T rho = load<T>(u + rho_i * W);
+	const T rhoinv = INVERSE(rho);
+	T hdeg = 0.0, pdeg = 0.0, edeg = 0.0, dpdeg_drho = 0.0;
+	if (A_ != 0.0) {
+		/* no vector cbrt or asinh: the cube root from exp and log polished by one Newton step, asinh(x) = log(x + sqrt(x^2 + 1)) */
+		const T r = rho * T(1.0 / B_);
+		T x = hydro_simd::exp(hydro_simd::log(r) * T(1.0 / 3.0));
+		x -= (x * x * x - r) / (T(3.0) * x * x);
+		const T x2 = x * x;
+		const T x5 = x2 * x2 * x;
+		const T s = hydro_simd::sqrt(x2 + T(1.0));
+		const auto small = x < T(0.001);
+		hdeg = T(8.0 * A_ / B_) * (s - T(1.0));
+		pdeg = hydro_simd::select(small, T(1.6 * A_) * x5, T(A_) * (x * (T(2.0) * x2 - T(3.0)) * s + T(3.0) * hydro_simd::log(x + s)));
+		edeg = hydro_simd::select(small, T(2.4 * A_) * x5, rho * hdeg - pdeg);
+		dpdeg_drho = T(8.0 / 3.0 * A_ / B_) * x2 / s;
+	}
+	T ek = 0.0;
+	for (int dim = 0; dim < NDIM; dim++) {
+		const T s = load<T>(u + (sx_i + dim) * W);
+		ek += s * s * rhoinv * T(0.5);
+	}
+	const T egas = load<T>(u + egas_i * W);
+	T ein = egas - ek - edeg;
+	const auto use_tau = ein <= T(de_switch_1) * egas;
+	if (any_of(use_tau)) {
+		for (int l = 0; l < W; l++) {
+			if (get_lane(use_tau, l)) {
+				set_lane(ein, l, POWER(u[tau_i * W + l], fgamma_));
+			}
+		}
+	}
+	const T dp_drho = dpdeg_drho + T(fgamma_ - 1.0) * ein * rhoinv;
+	const T dp_deps = T(fgamma_ - 1.0) * rho;
+	v = load<T>(u + (sx_i + dim) * W) * rhoinv;
+	p = T(fgamma_ - 1.0) * ein + pdeg;
+	const T z = p * rhoinv * rhoinv * dp_deps + dp_drho;
+	const auto negative = z < T(0.0);
+	if (any_of(negative)) {
+		for (int l = 0; l < W; l++) {
+			if (get_lane(negative, l)) {
+				printf("%e %e %e %e %e %e %e %e %e\n", get_lane(p, l), get_lane(rhoinv, l), get_lane(dpdeg_drho, l), get_lane(dp_deps, l),
+						get_lane(ein, l), get_lane(dp_drho, l), u[tau_i * W + l], get_lane(ek, l), get_lane(edeg, l));
+			}
+		}
+	}
+	cs = SQRT(z);
+}
+
+template<int NDIM>
+template<int INX, class T>
+void physics<NDIM>::physical_flux_simd(const safe_real *U, safe_real *F, int dim, T &am, T &ap, std::array<T, NDIM> &x,
+		std::array<T, NDIM> &vg) {
+	using namespace hydro_simd;
+	constexpr int W = width<T>::value;
+	static const cell_geometry<NDIM, INX> geo;
+	static constexpr auto levi_civita = geo.levi_civita();
+	T p, v, v0, c;
+	to_prim_simd(U, p, v0, c, dim);
+	v = v0 - vg[dim];
+	am = v - c;
+	ap = v + c;
+	for (int f = 0; f < nf_; f++) {
+		store(F + f * W, v * load<T>(U + f * W));
+	}
+	store(F + (sx_i + dim) * W, load<T>(F + (sx_i + dim) * W) + p);
+	store(F + egas_i * W, load<T>(F + egas_i * W) + v0 * p);
+	for (int n = 0; n < geo.NANGMOM; n++) {
+		T fl = load<T>(F + (lx_i + n) * W);
+		for (int m = 0; m < NDIM; m++) {
+			fl += T(levi_civita[n][m][dim]) * x[m] * p;
+		}
+		store(F + (lx_i + n) * W, fl);
+	}
+}
+
 template<int NDIM>
 template<int INX>
 void physics<NDIM>::post_process(hydro::state_type &U, const hydro::x_type &X, safe_real dx) {
@@ -188,72 +270,67 @@ void physics<NDIM>::source(hydro::state_type &dudt, const hydro::state_type &U,
 
 template<int NDIM>
 template<int INX>
-const hydro::state_type& physics<NDIM>::pre_recon(const hydro::state_type &U, const hydro::x_type X, safe_real omega, bool angmom) {
+const hydro::soa_state& physics<NDIM>::pre_recon(const hydro::state_type &U, const hydro::x_type X, safe_real omega, bool angmom, const cell_box &box) {
 	PROFILE();
 	static const cell_geometry<NDIM, INX> geo;
 	static const auto indices = geo.find_indices(0, geo.H_NX);
-	static thread_local hydro::state_type V;
-	V = U;
-	for (int j = 0; j < geo.H_NX_X; j++) {
-		for (int k = 0; k < geo.H_NX_Y; k++) {
+	static thread_local hydro::soa_state V;
+	const auto r0 = geo.clip(box, 0);
+	/* only the cells visited below are copied, the interior pass runs while the ghost zones are being filled */
+	V.fit(U);
+	for (int f = 0; f < int(U.size()); f++) {
+		hydro_simd::for_each_row<NDIM, INX>(r0, [&](int start, int len) {
+			std::copy(U[f].begin() + start, U[f].begin() + start + len, V[f] + start);
+		});
+	}
+	hydro_simd::for_each_row<NDIM, INX>(r0, [&](int start, int len) {
 #pragma ivdep
-			for (int l = 0; l < geo.H_NX_Z; l++) {
-				const int i = geo.to_index(j, k, l);
-				const auto rho = V[rho_i][i];
-				const auto rhoinv = 1.0 / rho;
-				for (int dim = 0; dim < NDIM; dim++) {
-					auto &s = V[sx_i + dim][i];
-					V[egas_i][i] -= 0.5 * s * s * rhoinv;
-					s *= rhoinv;
-				}
-				for (int si = 0; si < n_species_; si++) {
-					V[spc_i + si][i] *= rhoinv;
-				}
-				V[pot_i][i] *= rhoinv;
+		for (int i = start; i < start + len; i++) {
+			const auto rho = V[rho_i][i];
+			const auto rhoinv = 1.0 / rho;
+			for (int dim = 0; dim < NDIM; dim++) {
+				auto &s = V[sx_i + dim][i];
+				V[egas_i][i] -= 0.5 * s * s * rhoinv;
+				s *= rhoinv;
 			}
+			for (int si = 0; si < n_species_; si++) {
+				V[spc_i + si][i] *= rhoinv;
+			}
+			V[pot_i][i] *= rhoinv;
 		}
-	}
+	});
 	for (int n = 0; n < geo.NANGMOM; n++) {
-		for (int j = 0; j < geo.H_NX_X; j++) {
-			for (int k = 0; k < geo.H_NX_Y; k++) {
+		hydro_simd::for_each_row<NDIM, INX>(r0, [&](int start, int len) {
 #pragma ivdep
-				for (int l = 0; l < geo.H_NX_Z; l++) {
-					const int i = geo.to_index(j, k, l);
-					const auto rho = V[rho_i][i];
-					const auto rhoinv = 1.0 / rho;
-					V[lx_i + n][i] *= rhoinv;
-				}
+			for (int i = start; i < start + len; i++) {
+				const auto rho = V[rho_i][i];
+				const auto rhoinv = 1.0 / rho;
+				V[lx_i + n][i] *= rhoinv;
 			}
-		}
+		});
 		static constexpr auto levi_civita = geo.levi_civita();
 		for (int m = 0; m < NDIM; m++) {
 			for (int q = 0; q < NDIM; q++) {
 				const auto lc = levi_civita[n][m][q];
 				if (lc != 0) {
-					for (int j = 0; j < geo.H_NX_X; j++) {
-						for (int k = 0; k < geo.H_NX_Y; k++) {
+					hydro_simd::for_each_row<NDIM, INX>(r0, [&](int start, int len) {
 #pragma ivdep
-							for (int l = 0; l < geo.H_NX_Z; l++) {
-								const int i = geo.to_index(j, k, l);
-								V[lx_i + n][i] -= lc * X[m][i] * V[sx_i + q][i];
-							}
+						for (int i = start; i < start + len; i++) {
+							V[lx_i + n][i] -= lc * X[m][i] * V[sx_i + q][i];
 						}
-					}
+					});
 				}
 			}
 		}
 	}
 	if (NDIM >= 2) {
-		for (int j = 0; j < geo.H_NX_X; j++) {
-			for (int k = 0; k < geo.H_NX_Y; k++) {
+		hydro_simd::for_each_row<NDIM, INX>(r0, [&](int start, int len) {
 #pragma ivdep
-				for (int l = 0; l < geo.H_NX_Z; l++) {
-					const int i = geo.to_index(j, k, l);
-					V[sx_i][i] += omega * X[1][i];
-					V[sy_i][i] -= omega * X[0][i];
-				}
+			for (int i = start; i < start + len; i++) {
+				V[sx_i][i] += omega * X[1][i];
+				V[sy_i][i] -= omega * X[0][i];
 			}
-		}
+		});
 	}
 	return V;
 }
@@ -277,55 +354,51 @@ void physics<NDIM>::set_fgamma(safe_real fg) {
 
 template<int NDIM>
 template<int INX>
-const std::vector<std::vector<safe_real>>& physics<NDIM>::find_contact_discs(const hydro::state_type &U) {
+const std::vector<std::vector<safe_real>>& physics<NDIM>::find_contact_discs(const hydro::state_type &U, const cell_box &box) {
 	PROFILE();
 	static const cell_geometry<NDIM, INX> geo;
+	const auto r1 = geo.clip(box, 1);
+	const auto r2 = geo.clip(box, 2);
 	auto dir = geo.direction();
 	static thread_local std::vector<std::vector<safe_real>> disc(geo.NDIR / 2, std::vector<double>(geo.H_N3));
 	static thread_local std::vector<safe_real> P(H_N3);
-	for (int j = 0; j < geo.H_NX_XM2; j++) {
-		for (int k = 0; k < geo.H_NX_YM2; k++) {
+	hydro_simd::for_each_row<NDIM, INX>(r1, [&](int start, int len) {
 #pragma ivdep
-			for (int l = 0; l < geo.H_NX_ZM2; l++) {
-				const int i = geo.to_index(j + 1, k + 1, l + 1);
-				const auto rho = U[rho_i][i];
-				const auto rhoinv = 1.0 / U[rho_i][i];
-				double hdeg = 0.0, pdeg = 0.0, edeg = 0.0;
-				if (A_ != 0.0) {
-					const auto x = std::pow(rho / B_, 1.0 / 3.0);
-					hdeg = 8.0 * A_ / B_ * (std::sqrt(x * x + 1.0) - 1.0);
-					pdeg = deg_pres(x);
-					edeg = rho * hdeg - pdeg;
-				}
-				safe_real ek = 0.0;
-				for (int dim = 0; dim < NDIM; dim++) {
-					ek += pow(U[sx_i + dim][i], 2) * rhoinv * safe_real(0.5);
-				}
-				auto ein = U[egas_i][i] - ek - edeg;
-				if (ein < de_switch_1 * U[egas_i][i]) {
-					//	printf( "%e\n", U[tau_i][i]);
-					ein = pow(U[tau_i][i], fgamma_);
-				}
-				P[i] = (fgamma_ - 1.0) * ein + pdeg;
+		for (int i = start; i < start + len; i++) {
+			const auto rho = U[rho_i][i];
+			const auto rhoinv = 1.0 / U[rho_i][i];
+			double hdeg = 0.0, pdeg = 0.0, edeg = 0.0;
+			if (A_ != 0.0) {
+				const auto x = std::pow(rho / B_, 1.0 / 3.0);
+				hdeg = 8.0 * A_ / B_ * (std::sqrt(x * x + 1.0) - 1.0);
+				pdeg = deg_pres(x);
+				edeg = rho * hdeg - pdeg;
+			}
+			safe_real ek = 0.0;
+			for (int dim = 0; dim < NDIM; dim++) {
+				ek += pow(U[sx_i + dim][i], 2) * rhoinv * safe_real(0.5);
+			}
+			auto ein = U[egas_i][i] - ek - edeg;
+			if (ein < de_switch_1 * U[egas_i][i]) {
+				//	printf( "%e\n", U[tau_i][i]);
+				ein = pow(U[tau_i][i], fgamma_);
 			}
+			P[i] = (fgamma_ - 1.0) * ein + pdeg;
 		}
-	}
+	});
 	for (int d = 0; d < geo.NDIR / 2; d++) {
 		const auto di = dir[d];
-		for (int j = 0; j < geo.H_NX_XM4; j++) {
-			for (int k = 0; k < geo.H_NX_YM4; k++) {
+		hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-				for (int l = 0; l < geo.H_NX_ZM4; l++) {
-					constexpr auto K0 = 0.1;
-					const int i = geo.to_index(j + 2, k + 2, l + 2);
-					const auto P_r = P[i + di];
-					const auto P_l = P[i - di];
-					const auto tmp1 = fgamma_ * K0;
-					const auto tmp2 = std::abs(P_r - P_l) / std::min(std::abs(P_r), std::abs(P_l));
-					disc[d][i] = tmp2 / tmp1;
-				}
+			for (int i = start; i < start + len; i++) {
+				constexpr auto K0 = 0.1;
+				const auto P_r = P[i + di];
+				const auto P_l = P[i - di];
+				const auto tmp1 = fgamma_ * K0;
+				const auto tmp2 = std::abs(P_r - P_l) / std::min(std::abs(P_r), std::abs(P_l));
+				disc[d][i] = tmp2 / tmp1;
 			}
-		}
+		});
 	}
 	return disc;
 }
@@ -333,9 +406,10 @@ const std::vector<std::vector<safe_real>>& physics<NDIM>::find_contact_discs(con
 
 template<int NDIM>
 template<int INX>
-void physics<NDIM>::post_recon(std::vector<std::vector<std::vector<safe_real>>> &Q, const hydro::x_type X, safe_real omega, bool angmom) {
+void physics<NDIM>::post_recon(hydro::recon_type<NDIM> &Q, const hydro::x_type X, safe_real omega, bool angmom, const cell_box &box) {
 	PROFILE();
 	static const cell_geometry<NDIM, INX> geo;
+	const auto r2 = geo.clip(box, 2);
 	static const auto indices = geo.find_indices(2, geo.H_NX - 2);
 	const auto dx = X[0][geo.H_DNX] - X[0][0];
 	const auto xloc = geo.xloc();
@@ -345,16 +419,13 @@ void physics<NDIM>::post_recon(std::vector<std::vector<std::vector<safe_real>>>
 	for (int d = 0; d < geo.NDIR; d++) {
 		if (d != geo.NDIR / 2) {
 			if (NDIM >= 2) {
-				for (int j = 0; j < geo.H_NX_XM4; j++) {
-					for (int k = 0; k < geo.H_NX_YM4; k++) {
+				hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-						for (int l = 0; l < geo.H_NX_ZM4; l++) {
-							const int i = geo.to_index(j + 2, k + 2, l + 2);
-							Q[sx_i][d][i] -= omega * (X[1][i] + 0.5 * xloc[d][1] * dx);
-							Q[sy_i][d][i] += omega * (X[0][i] + 0.5 * xloc[d][0] * dx);
-						}
+					for (int i = start; i < start + len; i++) {
+						Q[sx_i][d][i] -= omega * (X[1][i] + 0.5 * xloc[d][1] * dx);
+						Q[sy_i][d][i] += omega * (X[0][i] + 0.5 * xloc[d][0] * dx);
 					}
-				}
+				});
 			}
 
 			for (int n = 0; n < geo.NANGMOM; n++) {
@@ -362,76 +433,61 @@ void physics<NDIM>::post_recon(std::vector<std::vector<std::vector<safe_real>>>
 					for (int m = 0; m < NDIM; m++) {
 						const auto lc = levi_civita[n][m][q];
 						if (lc != 0) {
-							for (int j = 0; j < geo.H_NX_XM4; j++) {
-								for (int k = 0; k < geo.H_NX_YM4; k++) {
+							hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-									for (int l = 0; l < geo.H_NX_ZM4; l++) {
-										const int i = geo.to_index(j + 2, k + 2, l + 2);
-										const auto rho = Q[rho_i][d][i];
-										Q[lx_i + n][d][i] += lc * (X[m][i] + 0.5 * xloc[d][m] * dx) * Q[sx_i + q][d][i];
-									}
+								for (int i = start; i < start + len; i++) {
+									const auto rho = Q[rho_i][d][i];
+									Q[lx_i + n][d][i] += lc * (X[m][i] + 0.5 * xloc[d][m] * dx) * Q[sx_i + q][d][i];
 								}
-							}
+							});
 						}
 					}
 				}
-				for (int j = 0; j < geo.H_NX_XM4; j++) {
-					for (int k = 0; k < geo.H_NX_YM4; k++) {
+				hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-						for (int l = 0; l < geo.H_NX_ZM4; l++) {
-							const int i = geo.to_index(j + 2, k + 2, l + 2);
-							const auto rho = Q[rho_i][d][i];
-							Q[lx_i + n][d][i] *= rho;
-						}
+					for (int i = start; i < start + len; i++) {
+						const auto rho = Q[rho_i][d][i];
+						Q[lx_i + n][d][i] *= rho;
 					}
-				}
+				});
 			}
 			for (int dim = 0; dim < NDIM; dim++) {
-				for (int j = 0; j < geo.H_NX_XM4; j++) {
-					for (int k = 0; k < geo.H_NX_YM4; k++) {
+				hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-						for (int l = 0; l < geo.H_NX_ZM4; l++) {
-							const int i = geo.to_index(j + 2, k + 2, l + 2);
-							const auto rho = Q[rho_i][d][i];
-							auto &v = Q[sx_i + dim][d][i];
-							Q[egas_i][d][i] += 0.5 * v * v * rho;
-							v *= rho;
-						}
+					for (int i = start; i < start + len; i++) {
+						const auto rho = Q[rho_i][d][i];
+						auto &v = Q[sx_i + dim][d][i];
+						Q[egas_i][d][i] += 0.5 * v * v * rho;
+						v *= rho;
 					}
-				}
+				});
 			}
-			for (int j = 0; j < geo.H_NX_XM4; j++) {
-				for (int k = 0; k < geo.H_NX_YM4; k++) {
+			hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-					for (int l = 0; l < geo.H_NX_ZM4; l++) {
-						const int i = geo.to_index(j + 2, k + 2, l + 2);
-						const auto rho = Q[rho_i][d][i];
-						Q[pot_i][d][i] *= rho;
-					}
+				for (int i = start; i < start + len; i++) {
+					const auto rho = Q[rho_i][d][i];
+					Q[pot_i][d][i] *= rho;
 				}
-			}
-			for (int j = 0; j < geo.H_NX_XM4; j++) {
-				for (int k = 0; k < geo.H_NX_YM4; k++) {
+			});
+			hydro_simd::for_each_row<NDIM, INX>(r2, [&](int start, int len) {
 #pragma ivdep
-					for (int l = 0; l < geo.H_NX_ZM4; l++) {
-						const int i = geo.to_index(j + 2, k + 2, l + 2);
-						const auto rho = Q[rho_i][d][i];
-						safe_real w = 0.0;
-						for (int si = 0; si < n_species_; si++) {
-							w += Q[spc_i + si][d][i];
-							Q[spc_i + si][d][i] *= rho;
-						}
-						if (w <= 0.0) {
-							printf("NO SPECIES %i\n", i);
-							abort();
-						}
-						w = 1.0 / w;
-						for (int si = 0; si < n_species_; si++) {
-							Q[spc_i + si][d][i] *= w;
-						}
+				for (int i = start; i < start + len; i++) {
+					const auto rho = Q[rho_i][d][i];
+					safe_real w = 0.0;
+					for (int si = 0; si < n_species_; si++) {
+						w += Q[spc_i + si][d][i];
+						Q[spc_i + si][d][i] *= rho;
+					}
+					if (w <= 0.0) {
+						printf("NO SPECIES %i\n", i);
+						abort();
+					}
+					w = 1.0 / w;
+					for (int si = 0; si < n_species_; si++) {
+						Q[spc_i + si][d][i] *= w;
 					}
 				}
-			}
+			});
 		}
 	}
 
@@ -45,7 +45,7 @@ struct radiation_physics {
 	}
 
 	template<int INX>
-	static const std::vector<std::vector<double>>& find_contact_discs(const hydro::state_type &U) {
+	static const std::vector<std::vector<double>>& find_contact_discs(const hydro::state_type &U, const cell_box &box) {
 		static std::vector<std::vector<double>> a;
 		return a;
 	}
@@ -54,6 +54,10 @@ struct radiation_physics {
 	static void physical_flux(const std::vector<safe_real> &U, std::vector<safe_real> &F, int dim, safe_real &am, safe_real &ap, std::array<safe_real, NDIM> &x,
 			std::array<safe_real, NDIM> &vg);
 
+	/* batched interface used by the vectorized flux kernel, the closure itself is evaluated lane by lane */
+	template<int INX, class T>
+	static void physical_flux_simd(const safe_real *U, safe_real *F, int dim, T &am, T &ap, std::array<T, NDIM> &x, std::array<T, NDIM> &vg);
+
 	template<int INX>
 	static void post_process(hydro::state_type &U, safe_real dx);
 
@@ -75,10 +79,10 @@ struct radiation_physics {
 
 	/*** Reconstruct uses this - GPUize****/
 	template<int INX>
-	static const hydro::state_type& pre_recon(const hydro::state_type &U, const hydro::x_type X, safe_real omega, bool angmom);
+	static const hydro::soa_state& pre_recon(const hydro::state_type &U, const hydro::x_type X, safe_real omega, bool angmom, const cell_box &box);
 	/*** Reconstruct uses this - GPUize****/
 	template<int INX>
-	static void post_recon(std::vector<std::vector<std::vector<safe_real>>> &Q, const hydro::x_type X, safe_real omega, bool angmom);
+	static void post_recon(hydro::recon_type<NDIM> &Q, const hydro::x_type X, safe_real omega, bool angmom, const cell_box &box);
 	template<int INX>
 	using comp_type = hydro_computer<NDIM, INX, radiation_physics<NDIM>>;
 
@@ -13,6 +13,7 @@
 #define OCTOTIGER_UNITIGER_radiation_physics_HPP12443_
 
 #include "octotiger/unitiger/safe_real.hpp"
+#include "octotiger/unitiger/simd.hpp"
 #include "octotiger/test_problems/blast.hpp"
 #include "octotiger/test_problems/exact_sod.hpp"
 
@@ -80,6 +81,33 @@ void radiation_physics<NDIM>::physical_flux(const std::vector<safe_real> &U, std
 
 }
 
+template<int NDIM>
+template<int INX, class T>
+void radiation_physics<NDIM>::physical_flux_simd(const safe_real *U, safe_real *F, int dim, T &am, T &ap, std::array<T, NDIM> &x,
+		std::array<T, NDIM> &vg) {
+	using namespace hydro_simd;
+	constexpr int W = width<T>::value;
+	static thread_local std::vector<safe_real> u(nf_), fl(nf_);
+	for (int l = 0; l < W; l++) {
+		std::array<safe_real, NDIM> x_l, vg_l;
+		for (int d = 0; d < NDIM; d++) {
+			x_l[d] = get_lane(x[d], l);
+			vg_l[d] = get_lane(vg[d], l);
+		}
+		for (int f = 0; f < nf_; f++) {
+			u[f] = U[f * W + l];
+			fl[f] = F[f * W + l];
+		}
+		safe_real am_l, ap_l;
+		physical_flux<INX>(u, fl, dim, am_l, ap_l, x_l, vg_l);
+		for (int f = 0; f < nf_; f++) {
+			F[f * W + l] = fl[f];
+		}
+		set_lane(am, l, am_l);
+		set_lane(ap, l, ap_l);
+	}
+}
+
 template<int NDIM>
 template<int INX>
 void radiation_physics<NDIM>::post_process(hydro::state_type &U, safe_real dx) {
@@ -144,15 +172,17 @@ void radiation_physics<NDIM>::post_angmom(const hydro::state_type &U, const hydr
 
 template<int NDIM>
 template<int INX>
-const hydro::state_type& radiation_physics<NDIM>::pre_recon(const hydro::state_type &U, const hydro::x_type X, safe_real omega, bool angmom) {
+const hydro::soa_state& radiation_physics<NDIM>::pre_recon(const hydro::state_type &U, const hydro::x_type X, safe_real omega, bool angmom,
+		const cell_box &box) {
 	static const cell_geometry<NDIM, INX> geo;
 	static const auto indices = geo.find_indices(0, geo.H_NX);
-	static thread_local hydro::state_type V;
-	V = U;
+	static thread_local hydro::soa_state V;
+	V.assign(U);
 	const auto dx = X[0][geo.H_DNX] - X[0][0];
-	for (int j = 0; j < geo.H_NX_X; j++) {
-		for (int k = 0; k < geo.H_NX_Y; k++) {
-			for (int l = 0; l < geo.H_NX_Z; l++) {
+	const auto r0 = geo.clip(box, 0);
+	for (int j = r0.lo[0]; j < r0.hi[0]; j++) {
+		for (int k = r0.lo[1]; k < r0.hi[1]; k++) {
+			for (int l = r0.lo[2]; l < r0.hi[2]; l++) {
 				const int i = geo.to_index(j, k, l);
 				const auto er = V[er_i][i];
 				const auto erinv = 1.0 / er;
@@ -178,16 +208,17 @@ const hydro::state_type& radiation_physics<NDIM>::pre_recon(const hydro::state_t
 
 template<int NDIM>
 template<int INX>
-void radiation_physics<NDIM>::post_recon(std::vector<std::vector<std::vector<safe_real>>> &Q, const hydro::x_type X, safe_real omega, bool angmom) {
+void radiation_physics<NDIM>::post_recon(hydro::recon_type<NDIM> &Q, const hydro::x_type X, safe_real omega, bool angmom, const cell_box &box) {
 	static const cell_geometry<NDIM, INX> geo;
 	const auto dx = X[0][geo.H_DNX] - X[0][0];
 	const auto xloc = geo.xloc();
+	const auto r2 = geo.clip(box, 2);
 	for (int d = 0; d < geo.NDIR; d++) {
 		if (d != geo.NDIR / 2) {
-			for (int j = 0; j < geo.H_NX_XM4; j++) {
-				for (int k = 0; k < geo.H_NX_YM4; k++) {
-					for (int l = 0; l < geo.H_NX_ZM4; l++) {
-						const int i = geo.to_index(j + 2, k + 2, l + 2);
+			for (int j = r2.lo[0]; j < r2.hi[0]; j++) {
+				for (int k = r2.lo[1]; k < r2.hi[1]; k++) {
+					for (int l = r2.lo[2]; l < r2.hi[2]; l++) {
+						const int i = geo.to_index(j, k, l);
 						const auto er = Q[er_i][d][i];
 						static constexpr auto lc = geo.levi_civita();
 						for (int n = 0; n < geo.NANGMOM; n++) {
@@ -0,0 +1,255 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef OCTOTIGER_UNITIGER_SIMD_HPP_
+#define OCTOTIGER_UNITIGER_SIMD_HPP_
+
+#include "octotiger/unitiger/safe_real.hpp"
+#include "octotiger/unitiger/cell_geometry.hpp"
+#include "octotiger/common_kernel/kernel_simd_types.hpp"
+
+#include "octotiger/safe_math.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/* Building blocks for the explicitly vectorized hydro kernels. Every kernel is written once as a
+ * template over T and instantiated with m2m_vector for the bulk of a row and with double for the
+ * remainder, so both paths execute the same sequence of operations. */
+namespace hydro_simd {
+
+#ifdef OCTOTIGER_HAVE_VC
+using vector_type = m2m_vector;
+#else
+using vector_type = double;
+#endif
+
+template<class T>
+struct width {
+	static constexpr int value = 1;
+};
+
+template<class T>
+inline T load(const safe_real *p);
+
+template<>
+inline double load<double>(const safe_real *p) {
+	return *p;
+}
+
+inline void store(safe_real *p, double v) {
+	*p = v;
+}
+
+inline double abs(double a) {
+	return std::abs(a);
+}
+
+inline double min(double a, double b) {
+	return std::min(a, b);
+}
+
+inline double max(double a, double b) {
+	return std::max(a, b);
+}
+
+inline double copysign(double a, double b) {
+	return std::copysign(a, b);
+}
+
+inline double sqrt(double a) {
+	return std::sqrt(a);
+}
+
+inline double exp(double a) {
+	return std::exp(a);
+}
+
+inline double log(double a) {
+	return std::log(a);
+}
+
+inline double select(bool m, double a, double b) {
+	return m ? a : b;
+}
+
+inline bool any_of(bool m) {
+	return m;
+}
+
+inline double get_lane(double v, int) {
+	return v;
+}
+
+inline bool get_lane(bool m, int) {
+	return m;
+}
+
+inline void set_lane(double &v, int, double x) {
+	v = x;
+}
+
+#ifdef OCTOTIGER_HAVE_VC
+template<>
+struct width<m2m_vector> {
+	static constexpr int value = m2m_vector::size();
+};
+
+template<>
+inline m2m_vector load<m2m_vector>(const safe_real *p) {
+	return m2m_vector(p);
+}
+
+inline void store(safe_real *p, const m2m_vector &v) {
+	v.store(p);
+}
+
+inline m2m_vector abs(const m2m_vector &a) {
+	return Vc::abs(a);
+}
+
+inline m2m_vector min(const m2m_vector &a, const m2m_vector &b) {
+	return Vc::min(a, b);
+}
+
+inline m2m_vector max(const m2m_vector &a, const m2m_vector &b) {
+	return Vc::max(a, b);
+}
+
+inline m2m_vector copysign(const m2m_vector &a, const m2m_vector &b) {
+	return Vc::copysign(a, b);
+}
+
+inline m2m_vector sqrt(const m2m_vector &a) {
+	return Vc::sqrt(a);
+}
+
+inline m2m_vector exp(const m2m_vector &a) {
+	return Vc::exp(a);
+}
+
+inline m2m_vector log(const m2m_vector &a) {
+	return Vc::log(a);
+}
+
+inline m2m_vector select(const m2m_vector::mask_type &m, const m2m_vector &a, const m2m_vector &b) {
+	return Vc::iif(m, a, b);
+}
+
+inline bool any_of(const m2m_vector::mask_type &m) {
+	return Vc::any_of(m);
+}
+
+inline double get_lane(const m2m_vector &v, int l) {
+	return v[l];
+}
+
+inline bool get_lane(const m2m_vector::mask_type &m, int l) {
+	return m[l];
+}
+
+inline void set_lane(m2m_vector &v, int l, double x) {
+	v[l] = x;
+}
+#endif
+
+/* calls f(start, length) for every contiguous row of box, the rows through its hole are split around it */
+template<int NDIM, int INX, class F>
+inline void for_each_row(const cell_box &box, F &&f) {
+	using geo = cell_geometry<NDIM, INX>;
+	constexpr int dl = NDIM - 1;
+	const bool hole = geo::has_hole(box);
+	const auto row = [&](int j, int k, bool through_hole) {
+		const auto index = [j, k](int l) {
+			return NDIM == 1 ? geo::to_index(l, 0, 0) : (NDIM == 2 ? geo::to_index(j, l, 0) : geo::to_index(j, k, l));
+		};
+		int lo = box.lo[dl];
+		const int hi = box.hi[dl];
+		if (through_hole) {
+			const int end = std::min(hi, box.hole_lo[dl]);
+			if (end > lo) {
+				f(index(lo), end - lo);
+			}
+			lo = std::max(lo, box.hole_hi[dl]);
+		}
+		if (hi > lo) {
+			f(index(lo), hi - lo);
+		}
+	};
+	const auto in_hole = [&box](int dim, int i) {
+		return i >= box.hole_lo[dim] && i < box.hole_hi[dim];
+	};
+	if constexpr (NDIM == 1) {
+		row(0, 0, hole);
+	} else if constexpr (NDIM == 2) {
+		for (int j = box.lo[0]; j < box.hi[0]; j++) {
+			row(j, 0, hole && in_hole(0, j));
+		}
+	} else {
+		for (int j = box.lo[0]; j < box.hi[0]; j++) {
+			for (int k = box.lo[1]; k < box.hi[1]; k++) {
+				row(j, k, hole && in_hole(0, j) && in_hole(1, k));
+			}
+		}
+	}
+}
+
+/* calls f(start, length) for every run of consecutive entries in a sorted index list */
+template<class F>
+inline void for_each_run(const std::vector<int> &indices, F &&f) {
+	const int n = indices.size();
+	int b = 0;
+	while (b < n) {
+		int e = b + 1;
+		while (e < n && indices[e] == indices[e - 1] + 1) {
+			e++;
+		}
+		f(indices[b], e - b);
+		b = e;
+	}
+}
+
+/* splits one row into full vectors and a scalar remainder, f(T(), i) is called with the type to use */
+template<class F>
+inline void for_each_block(int start, int len, F &&f) {
+	constexpr int W = width<vector_type>::value;
+	int l = 0;
+	for (; l + W <= len; l += W) {
+		f(vector_type(), start + l);
+	}
+	for (; l < len; l++) {
+		f(double(), start + l);
+	}
+}
+
+}
+
+#ifdef OCTOTIGER_HAVE_VC
+/* overloads picked up by the INVERSE and SQRT macros of safe_math.hpp */
+inline m2m_vector safe_inverse(const m2m_vector &a, const char *file, const int line) {
+#ifdef SAFE_MATH_ON
+	if (Vc::any_of(a == m2m_vector(0.0))) {
+		printf("Divide by zero. File:%s Line:%i\n", file, line);
+		abort();
+	}
+#endif
+	return m2m_vector(1.0) / a;
+}
+
+inline m2m_vector safe_sqrt(const m2m_vector &a, const char *file, const int line) {
+#ifdef SAFE_MATH_ON
+	for (std::size_t l = 0; l < m2m_vector::size(); l++) {
+		if (!(a[l] >= 0.0)) {
+			printf("Square root of a negative = %e. File:%s Line:%i\n", (double) a[l], file, line);
+			abort();
+		}
+	}
+#endif
+	return Vc::sqrt(a);
+}
+#endif
+
+#endif /* OCTOTIGER_UNITIGER_SIMD_HPP_ */
@@ -0,0 +1,215 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef OCTOTIGER_WIRE_CODEC_HPP_
+#define OCTOTIGER_WIRE_CODEC_HPP_
+
+#include "octotiger/real.hpp"
+#include "octotiger/space_vector.hpp"
+#include "octotiger/taylor.hpp"
+
+#include <hpx/serialization/serialize.hpp>
+#include <hpx/serialization/vector.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Wire format of the halo messages. Only messages to other localities are serialized, so only they are ever encoded.
+ * With --wire_codec the doubles are compressed losslessly: each one is XOR-ed with the one before it and only the bytes
+ * between the leading and trailing zero bytes of the result are sent. With --wire_float_order=n the multipole moments
+ * of order n and up in gravity boundaries are sent as floats (lossy, 4 keeps everything in double precision). Every
+ * message type counts its raw and encoded bytes, the root prints the totals at the end of the run. */
+
+enum wire_message_type {
+	wire_hydro_boundary = 0,
+	wire_hydro_amr_boundary = 1,
+	wire_hydro_flux_correct = 2,
+	wire_gravity_boundary = 3,
+	wire_message_type_last = 4
+};
+
+bool wire_codec_enabled();
+int wire_float_order();
+void wire_compress(const real* data, std::size_t n, std::vector<std::uint8_t>& out);
+void wire_decompress(const std::vector<std::uint8_t>& in, real* data, std::size_t n);
+void wire_count(wire_message_type type, std::size_t raw_bytes, std::size_t wire_bytes);
+/* prints the bytes of every message type summed over all localities, called on the root */
+void wire_output();
+
+/* the encoded buffers live on the stack of the save functions, so they are copied into the archive: HPX may send large
+ * vectors as zero-copy chunks that are only read after the save returned */
+template<class Arc, class T>
+void wire_save_copy(Arc& arc, const std::vector<T>& v) {
+	const std::uint64_t n = v.size();
+	arc << n;
+	if (n) {
+		arc.save_binary(v.data(), n * sizeof(T));
+	}
+}
+
+template<class Arc, class T>
+void wire_load_copy(Arc& arc, std::vector<T>& v) {
+	std::uint64_t n;
+	arc >> n;
+	v.resize(n);
+	if (n) {
+		arc.load_binary(v.data(), n * sizeof(T));
+	}
+}
+
+template<class Arc>
+void wire_save(Arc& arc, const std::vector<real>& v, wire_message_type type) {
+	const std::uint64_t n = v.size();
+	std::vector<std::uint8_t> bytes;
+	if (wire_codec_enabled()) {
+		wire_compress(v.data(), v.size(), bytes);
+	}
+	/* noise does not compress, it is sent as is */
+	const bool compressed = wire_codec_enabled() && bytes.size() < n * sizeof(real);
+	arc << compressed;
+	arc << n;
+	if (compressed) {
+		wire_save_copy(arc, bytes);
+		wire_count(type, n * sizeof(real), bytes.size());
+	} else {
+		wire_save_copy(arc, v);
+		wire_count(type, n * sizeof(real), n * sizeof(real));
+	}
+}
+
+template<class Arc>
+void wire_load(Arc& arc, std::vector<real>& v) {
+	bool compressed;
+	std::uint64_t n;
+	arc >> compressed;
+	arc >> n;
+	if (compressed) {
+		std::vector<std::uint8_t> bytes;
+		wire_load_copy(arc, bytes);
+		v.resize(n);
+		wire_decompress(bytes, v.data(), n);
+	} else {
+		wire_load_copy(arc, v);
+	}
+}
+
+/* without the codec and with all moments in double precision the vectors are sent as they are, otherwise the moments
+ * below wire_float_order() go through wire_save and the others as floats */
+template<class Arc>
+void wire_save(Arc& arc, const std::vector<multipole>& M) {
+	const bool direct = !wire_codec_enabled() && wire_float_order() == 4;
+	arc << direct;
+	if (direct) {
+		arc << M;
+		wire_count(wire_gravity_boundary, M.size() * 20 * sizeof(real), M.size() * 20 * sizeof(real));
+		return;
+	}
+	constexpr int order_begin[] = { 0, 1, 4, 10, 20 };
+	const int split = order_begin[wire_float_order()];
+	std::vector<real> hi;
+	std::vector<float> lo;
+	hi.reserve(M.size() * split);
+	lo.reserve(M.size() * (20 - split));
+	for (const auto& m : M) {
+		for (int i = 0; i != split; ++i) {
+			hi.push_back(m[i]);
+		}
+		for (int i = split; i != 20; ++i) {
+			lo.push_back(float(m[i]));
+		}
+	}
+	const std::uint64_t n = M.size();
+	const std::int32_t s = split;
+	arc << n;
+	arc << s;
+	wire_save(arc, hi, wire_gravity_boundary);
+	wire_save_copy(arc, lo);
+	wire_count(wire_gravity_boundary, lo.size() * sizeof(real), lo.size() * sizeof(float));
+}
+
+template<class Arc>
+void wire_load(Arc& arc, std::vector<multipole>& M) {
+	bool direct;
+	arc >> direct;
+	if (direct) {
+		arc >> M;
+		return;
+	}
+	std::uint64_t n;
+	std::int32_t split;
+	std::vector<real> hi;
+	std::vector<float> lo;
+	arc >> n;
+	arc >> split;
+	wire_load(arc, hi);
+	wire_load_copy(arc, lo);
+	M.resize(n);
+	std::size_t h = 0;
+	std::size_t l = 0;
+	for (auto& m : M) {
+		for (int i = 0; i != split; ++i) {
+			m[i] = hi[h++];
+		}
+		for (int i = split; i != 20; ++i) {
+			m[i] = lo[l++];
+		}
+	}
+}
+
+template<class Arc>
+void wire_save(Arc& arc, const std::vector<space_vector>& x) {
+	const bool direct = !wire_codec_enabled();
+	arc << direct;
+	if (direct) {
+		arc << x;
+		wire_count(wire_gravity_boundary, x.size() * NDIM * sizeof(real), x.size() * NDIM * sizeof(real));
+		return;
+	}
+	std::vector<real> flat;
+	flat.reserve(x.size() * NDIM);
+	for (const auto& v : x) {
+		for (int d = 0; d != NDIM; ++d) {
+			flat.push_back(v[d]);
+		}
+	}
+	wire_save(arc, flat, wire_gravity_boundary);
+}
+
+template<class Arc>
+void wire_load(Arc& arc, std::vector<space_vector>& x) {
+	bool direct;
+	arc >> direct;
+	if (direct) {
+		arc >> x;
+		return;
+	}
+	std::vector<real> flat;
+	wire_load(arc, flat);
+	x.resize(flat.size() / NDIM);
+	std::size_t j = 0;
+	for (auto& v : x) {
+		for (int d = 0; d != NDIM; ++d) {
+			v[d] = flat[j++];
+		}
+	}
+}
+
+/* action argument for plain vectors of hydro values */
+template<wire_message_type Type>
+struct wire_vector {
+	std::vector<real> data;
+	template<class Arc>
+	void save(Arc& arc, unsigned) const {
+		wire_save(arc, data, Type);
+	}
+	template<class Arc>
+	void load(Arc& arc, unsigned) {
+		wire_load(arc, data);
+	}
+	HPX_SERIALIZATION_SPLIT_MEMBER();
+};
+
+#endif /* OCTOTIGER_WIRE_CODEC_HPP_ */
@@ -0,0 +1,68 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "octotiger/buffer_pool.hpp"
+#include "octotiger/future.hpp"
+#include "octotiger/options.hpp"
+#include "octotiger/real.hpp"
+#include "octotiger/space_vector.hpp"
+#include "octotiger/taylor.hpp"
+
+#include <hpx/include/actions.hpp>
+#include <hpx/include/runtime.hpp>
+
+#include <cstdio>
+#include <vector>
+
+static constexpr int pool_count = 3;
+
+static const char *pool_names[pool_count] = { "real", "multipole", "space_vector" };
+
+static const buffer_pool_counters &pool_counters(int i) {
+	switch (i) {
+	case 0:
+		return buffer_pool<real>::counters();
+	case 1:
+		return buffer_pool<multipole>::counters();
+	default:
+		return buffer_pool<space_vector>::counters();
+	}
+}
+
+/* returns the requests, hits, pooled bytes and live bytes of every pool */
+std::vector<std::uint64_t> buffer_pool_statistics() {
+	std::vector<std::uint64_t> stats(4 * pool_count);
+	for (int i = 0; i < pool_count; i++) {
+		const auto &c = pool_counters(i);
+		stats[4 * i + 0] = c.requests;
+		stats[4 * i + 1] = c.hits;
+		stats[4 * i + 2] = c.pooled_bytes;
+		stats[4 * i + 3] = c.live_bytes;
+	}
+	return stats;
+}
+
+HPX_PLAIN_ACTION(buffer_pool_statistics, buffer_pool_statistics_action);
+
+void buffer_pool_output() {
+	std::vector<hpx::future<std::vector<std::uint64_t>>> futs;
+	for (const auto &loc : options::all_localities) {
+		futs.push_back(hpx::async<buffer_pool_statistics_action>(loc));
+	}
+	std::vector<std::uint64_t> stats(4 * pool_count, 0);
+	for (auto &f : futs) {
+		const auto this_stats = GET(f);
+		for (std::size_t i = 0; i < stats.size(); i++) {
+			stats[i] += this_stats[i];
+		}
+	}
+	printf("Buffer pools:\n");
+	for (int i = 0; i < pool_count; i++) {
+		const double requests = stats[4 * i + 0];
+		const double hits = stats[4 * i + 1];
+		printf("   %-14s %14.0f requests %7.3f hit rate %14.0f bytes pooled %14.0f bytes live\n", pool_names[i], requests,
+				requests > 0.0 ? hits / requests : 0.0, double(stats[4 * i + 2]), double(stats[4 * i + 3]));
+	}
+}
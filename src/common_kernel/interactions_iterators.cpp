@@ -4,13 +4,34 @@
 //  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
 #include "octotiger/common_kernel/interactions_iterators.hpp"
+#include "octotiger/grid.hpp"
 
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <limits>
+#include <vector>
 
 namespace octotiger {
 namespace fmm {
+        const std::vector<std::uint32_t>& compact_boundary_indices(const geo::direction& dir) {
+            static const std::vector<std::vector<std::uint32_t>> indices = []() {
+                std::vector<std::vector<std::uint32_t>> all(geo::direction::count());
+                for (const geo::direction& d : geo::direction::full_set()) {
+                    for (const auto& i : grid::get_ilist_n_bnd(d)) {
+                        const multiindex<> offset = flat_index_to_multiindex_not_padded(i.second);
+                        const multiindex<> m(
+                            offset.x + INNER_CELLS_PADDING_DEPTH + d[0] * INNER_CELLS_PADDING_DEPTH,
+                            offset.y + INNER_CELLS_PADDING_DEPTH + d[1] * INNER_CELLS_PADDING_DEPTH,
+                            offset.z + INNER_CELLS_PADDING_DEPTH + d[2] * INNER_CELLS_PADDING_DEPTH);
+                        all[d].push_back(to_flat_index_padded(m));
+                    }
+                }
+                return all;
+            }();
+            return indices[dir];
+        }
+
         bool expansion_comparator(const expansion& ref, const expansion& mine) {
             if (ref.size() != mine.size()) {
                 std::cout << "size of expansion doesn't match" << std::endl;
@@ -0,0 +1,309 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "octotiger/common_kernel/kernel_autotune.hpp"
+#include "octotiger/monopole_interactions/p2m_interaction_interface.hpp"
+#include "octotiger/monopole_interactions/p2p_interaction_interface.hpp"
+#include "octotiger/multipole_interactions/multipole_interaction_interface.hpp"
+
+#include "octotiger/defs.hpp"
+#include "octotiger/geometry.hpp"
+#include "octotiger/grid.hpp"
+#include "octotiger/interaction_types.hpp"
+#include "octotiger/options.hpp"
+#include "octotiger/real.hpp"
+
+#include <hpx/include/actions.hpp>
+#include <hpx/include/lcos.hpp>
+#include <hpx/include/runtime.hpp>
+#include <hpx/timing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace octotiger {
+namespace fmm {
+
+    namespace {
+        struct kernel_choice
+        {
+            interaction_kernel_type type;
+            bool blocked;
+        };
+
+        /// Identifies the hardware and the build settings the cached choices are valid for
+        std::string tuning_signature() {
+            std::string cpu = "unknown";
+            std::ifstream cpuinfo("/proc/cpuinfo");
+            std::string line;
+            while (std::getline(cpuinfo, line)) {
+                if (line.compare(0, 10, "model name") == 0) {
+                    const auto colon = line.find(':');
+                    if (colon != std::string::npos) {
+                        cpu = line.substr(colon + 1);
+                    }
+                    break;
+                }
+            }
+#if defined(__AVX512F__)
+            const char* simd = "AVX512";
+#elif defined(__AVX2__)
+            const char* simd = "AVX2";
+#elif defined(__AVX__)
+            const char* simd = "AVX";
+#else
+            const char* simd = "SSE2";
+#endif
+            std::ostringstream str;
+            str << cpu << "/" << simd << "/INX=" << INX << "/theta=" << opts().theta;
+            std::string sig;
+            for (char c : str.str()) {
+                if (!std::isspace(static_cast<unsigned char>(c))) {
+                    sig.push_back(c);
+                } else if (!sig.empty() && sig.back() != '_') {
+                    sig.push_back('_');
+                }
+            }
+            return sig;
+        }
+
+        /// Every line of the cache reads "signature kernel type blocked", later lines win
+        bool read_cached_choice(
+            const std::string& sig, const std::string& kernel, kernel_choice& choice) {
+            std::ifstream fs(opts().kernel_tuning_file);
+            std::string line;
+            bool found = false;
+            while (std::getline(fs, line)) {
+                std::istringstream in(line);
+                std::string this_sig, this_kernel;
+                kernel_choice this_choice;
+                if (in >> this_sig >> this_kernel >> this_choice.type >> this_choice.blocked) {
+                    if (this_sig == sig && this_kernel == kernel &&
+                        this_choice.type != interaction_kernel_type::AUTO) {
+                        choice = this_choice;
+                        found = true;
+                    }
+                }
+            }
+            return found;
+        }
+
+        void write_cached_choice(
+            const std::string& sig, const std::string& kernel, const kernel_choice& choice) {
+            FILE* fp = fopen(opts().kernel_tuning_file.c_str(), "at");
+            if (fp == NULL) {
+                printf("Unable to write kernel tuning cache %s\n",
+                    opts().kernel_tuning_file.c_str());
+                return;
+            }
+            fprintf(fp, "%s %s %s %i\n", sig.c_str(), kernel.c_str(),
+                to_string(choice.type).c_str(), int(choice.blocked));
+            fclose(fp);
+        }
+
+        /// Best of a few runs, after one untimed run that sets up the thread_local staging areas
+        template <class F>
+        double time_variant(F&& f) {
+            constexpr int reps = 5;
+            f();
+            double best = std::numeric_limits<double>::max();
+            for (int r = 0; r < reps; r++) {
+                hpx::util::high_resolution_timer timer;
+                f();
+                best = std::min(best, timer.elapsed());
+            }
+            return best;
+        }
+
+        /// A refined and a leaf sub-grid, each surrounded by 26 copies of itself
+        struct tuning_problem
+        {
+            std::shared_ptr<grid> refined;
+            std::shared_ptr<grid> leaf;
+            std::vector<neighbor_gravity_type> multipole_neighbors;
+            std::vector<neighbor_gravity_type> monopole_neighbors;
+            std::array<bool, geo::direction::count()> is_direction_empty;
+            std::array<real, NDIM> xbase;
+
+            tuning_problem() {
+                const real dx = 1.0 / INX;
+                const std::array<real, NDIM> xmin = {0.0, 0.0, 0.0};
+                const auto init = [](real x, real y, real z, real) {
+                    std::vector<real> u(opts().n_fields, 0.0);
+                    const real s =
+                        std::sin(2.0 * M_PI * x) * std::sin(2.0 * M_PI * y) * std::sin(2.0 * M_PI * z);
+                    u[rho_i] = 1.0 + 0.5 * s;
+                    u[egas_i] = 1.0;
+                    u[tau_i] = 1.0;
+                    for (integer f = spc_i; f != spc_i + opts().n_species; ++f) {
+                        u[f] = u[rho_i] / opts().n_species;
+                    }
+                    return u;
+                };
+                refined = std::make_shared<grid>(init, dx, xmin);
+                leaf = std::make_shared<grid>(init, dx, xmin);
+
+                /* the children of the refined grid are stood in for by one point mass per cell */
+                refined->set_leaf(false);
+                multipole_pass_type child_poles;
+                child_poles.first.resize(INX * INX * INX);
+                child_poles.second.resize(INX * INX * INX);
+                for (integer i = 0; i != INX; ++i) {
+                    for (integer j = 0; j != INX; ++j) {
+                        for (integer k = 0; k != INX; ++k) {
+                            const integer iii = (i * INX + j) * INX + k;
+                            child_poles.first[iii] = ZERO;
+                            child_poles.first[iii]() = dx * dx * dx *
+                                (1.0 + 0.5 * std::sin(2.0 * M_PI * (i + 0.5) * dx));
+                            child_poles.second[iii][XDIM] = (i + 0.5) * dx;
+                            child_poles.second[iii][YDIM] = (j + 0.5) * dx;
+                            child_poles.second[iii][ZDIM] = (k + 0.5) * dx;
+                        }
+                    }
+                }
+                refined->compute_multipoles(RHO, &child_poles);
+                leaf->compute_multipoles(RHO);
+
+                /* what a remote neighbor in direction dir would send, see node_server::compute_fmm */
+                for (auto const& dir : geo::direction::full_set()) {
+                    neighbor_gravity_type n;
+                    n.direction = dir;
+                    n.is_monopole = false;
+                    n.data = refined->get_gravity_boundary(dir.flip(), false);
+                    multipole_neighbors.push_back(n);
+                    n.is_monopole = true;
+                    n.data = leaf->get_gravity_boundary(dir.flip(), false);
+                    monopole_neighbors.push_back(n);
+                    is_direction_empty[dir] = false;
+                }
+                const auto& X = refined->get_X();
+                xbase = {X[XDIM][hindex(H_BW, H_BW, H_BW)], X[YDIM][hindex(H_BW, H_BW, H_BW)],
+                    X[ZDIM][hindex(H_BW, H_BW, H_BW)]};
+            }
+        };
+
+        double time_multipole(tuning_problem& p, const kernel_choice& c) {
+            opts().m2m_kernel_type = c.type;
+            opts().multipole_blocked_stencil = c.blocked;
+            multipole_interactions::multipole_interaction_interface interactor;
+            interactor.set_grid_ptr(p.refined);
+            return time_variant([&]() {
+                interactor.compute_multipole_interactions(p.refined->get_mon(),
+                    p.refined->get_M(), p.refined->get_com_ptr(), p.multipole_neighbors, RHO,
+                    p.refined->get_dx(), p.is_direction_empty, p.xbase);
+            });
+        }
+
+        double time_p2p(tuning_problem& p, const kernel_choice& c) {
+            opts().p2p_kernel_type = c.type;
+            monopole_interactions::p2p_interaction_interface interactor;
+            interactor.set_grid_ptr(p.leaf);
+            return time_variant([&]() {
+                interactor.compute_p2p_interactions(p.leaf->get_mon(), p.monopole_neighbors, RHO,
+                    p.leaf->get_dx(), p.is_direction_empty);
+            });
+        }
+
+        double time_p2m(tuning_problem& p, const kernel_choice& c) {
+            opts().p2m_kernel_type = c.type;
+            monopole_interactions::p2m_interaction_interface interactor;
+            interactor.set_grid_ptr(p.leaf);
+            return time_variant([&]() {
+                interactor.compute_p2m_interactions(p.leaf->get_mon(), p.leaf->get_M(),
+                    p.leaf->get_com_ptr(), p.multipole_neighbors, RHO, p.is_direction_empty);
+            });
+        }
+
+        template <class F>
+        kernel_choice tune(const std::string& sig, const std::string& kernel,
+            const std::vector<kernel_choice>& candidates, F&& time) {
+            kernel_choice best;
+            if (read_cached_choice(sig, kernel, best)) {
+                printf("%s kernel %s%s (cached in %s)\n", kernel.c_str(), to_string(best.type).c_str(), best.blocked ? " blocked" : "",
+                    opts().kernel_tuning_file.c_str());
+                return best;
+            }
+            double best_time = std::numeric_limits<double>::max();
+            for (const auto& c : candidates) {
+                const double t = time(c);
+                printf("%s kernel %s%s takes %e s\n", kernel.c_str(), to_string(c.type).c_str(), c.blocked ? " blocked" : "", t);
+                if (t < best_time) {
+                    best_time = t;
+                    best = c;
+                }
+            }
+            write_cached_choice(sig, kernel, best);
+            return best;
+        }
+
+        /// Sets the kernel choices made on the root, on one locality
+        void set_interaction_kernels(int m2m, bool m2m_blocked, int p2p, int p2m) {
+            opts().m2m_kernel_type = interaction_kernel_type(m2m);
+            opts().multipole_blocked_stencil = m2m_blocked;
+            opts().p2p_kernel_type = interaction_kernel_type(p2p);
+            opts().p2m_kernel_type = interaction_kernel_type(p2m);
+        }
+    }    // namespace
+}    // namespace fmm
+}    // namespace octotiger
+
+HPX_PLAIN_ACTION(octotiger::fmm::set_interaction_kernels, set_interaction_kernels_action);
+
+namespace octotiger {
+namespace fmm {
+
+    void autotune_interaction_kernels() {
+        const bool m2m_auto = opts().m2m_kernel_type == interaction_kernel_type::AUTO;
+        const bool p2p_auto = opts().p2p_kernel_type == interaction_kernel_type::AUTO;
+        const bool p2m_auto = opts().p2m_kernel_type == interaction_kernel_type::AUTO;
+        if (!m2m_auto && !p2p_auto && !p2m_auto) {
+            return;
+        }
+        const std::string sig = tuning_signature();
+        auto m2m = kernel_choice{opts().m2m_kernel_type, opts().multipole_blocked_stencil};
+        auto p2p = kernel_choice{opts().p2p_kernel_type, false};
+        auto p2m = kernel_choice{opts().p2m_kernel_type, false};
+        /* only CPU variants are probed, SOA_CUDA still has to be requested explicitly */
+        tuning_problem p;
+        if (m2m_auto) {
+            m2m = tune(sig, "multipole",
+                {{interaction_kernel_type::SOA_CPU, false}, {interaction_kernel_type::SOA_CPU, true},
+                    {interaction_kernel_type::OLD, false}},
+                [&](const kernel_choice& c) { return time_multipole(p, c); });
+        }
+        if (p2p_auto) {
+            p2p = tune(sig, "p2p",
+                {{interaction_kernel_type::SOA_CPU, false}, {interaction_kernel_type::OLD, false}},
+                [&](const kernel_choice& c) { return time_p2p(p, c); });
+        }
+        if (p2m_auto) {
+            p2m = tune(sig, "p2m",
+                {{interaction_kernel_type::SOA_CPU, false}, {interaction_kernel_type::OLD, false}},
+                [&](const kernel_choice& c) { return time_p2m(p, c); });
+        }
+        /* every locality runs the same kernels, also the root, which timed them */
+        std::vector<hpx::future<void>> futs;
+        for (const auto& loc : options::all_localities) {
+            futs.push_back(hpx::async<set_interaction_kernels_action>(loc, int(m2m.type),
+                m2m.blocked, int(p2p.type), int(p2m.type)));
+        }
+        hpx::wait_all(futs);
+        for (auto& f : futs) {
+            f.get();
+        }
+    }
+
+}    // namespace fmm
+}    // namespace octotiger
@@ -8,6 +8,7 @@
 
 #include <fenv.h>
 
+#include "octotiger/buffer_pool.hpp"
 #include "octotiger/diagnostics.hpp"
 #include "octotiger/future.hpp"
 #include "octotiger/grid.hpp"
@@ -15,6 +16,7 @@
 #include "octotiger/options.hpp"
 #include "octotiger/problem.hpp"
 #include "octotiger/profiler.hpp"
+#include "octotiger/trace.hpp"
 #include "octotiger/io/silo.hpp"
 #include "octotiger/taylor.hpp"
 #include "octotiger/unitiger/hydro.hpp"
@@ -494,6 +496,7 @@ diagnostics_t grid::diagnostics(const diagnostics_t &diags) {
 		}
 		return rc;
 	};
+	const bool last_stage = diags.stage == diagnostics_t::last_stage();
 	roche_lobe.resize(INX * INX * INX);
 	for (integer j = H_BW; j != H_NX - H_BW; ++j) {
 		for (integer k = H_BW; k != H_NX - H_BW; ++k) {
@@ -596,36 +599,38 @@ diagnostics_t grid::diagnostics(const diagnostics_t &diags) {
 					} else if (loc == 3) {
 						rc.l3_phi = std::max(phi_eff, rc.l3_phi);
 					}
-					const integer iii = hindex(j, k, l);
-					real ek = ZERO;
-					ek += HALF * pow(U[sx_i][iii], 2) * INVERSE(U[rho_i][iii]);
-					ek += HALF * pow(U[sy_i][iii], 2) * INVERSE(U[rho_i][iii]);
-					ek += HALF * pow(U[sz_i][iii], 2) * INVERSE(U[rho_i][iii]);
-					real ei;
-					if (opts().eos == WD) {
-						ei = U[egas_i][iii] - ek - ztwd_energy(U[rho_i][iii]);
-					} else {
-						ei = U[egas_i][iii] - ek;
-					}
-					real et = U[egas_i][iii];
-					if (ei < de_switch2 * et) {
-						ei = POWER(U[tau_i][iii], fgamma);
-					}
-					real p = (fgamma - 1.0) * ei;
-					if (opts().eos == WD) {
-						p += ztwd_pressure(U[rho_i][iii]);
-					}
-					if (opts().problem == DWD) {
-						rc.virial += (2.0 * ek + 0.5 * U[rho_i][iii] * G[iiig][phi_i] + 3.0 * p) * (dx * dx * dx);
-						rc.virial_norm += (2.0 * ek - 0.5 * U[rho_i][iii] * G[iiig][phi_i] + 3.0 * p) * (dx * dx * dx);
-					}
-					for (integer f = 0; f != opts().n_fields; ++f) {
-						rc.grid_sum[f] += U[f][iii] * dV;
+					if (last_stage) {
+						const integer iii = hindex(j, k, l);
+						real ek = ZERO;
+						ek += HALF * pow(U[sx_i][iii], 2) * INVERSE(U[rho_i][iii]);
+						ek += HALF * pow(U[sy_i][iii], 2) * INVERSE(U[rho_i][iii]);
+						ek += HALF * pow(U[sz_i][iii], 2) * INVERSE(U[rho_i][iii]);
+						real ei;
+						if (opts().eos == WD) {
+							ei = U[egas_i][iii] - ek - ztwd_energy(U[rho_i][iii]);
+						} else {
+							ei = U[egas_i][iii] - ek;
+						}
+						real et = U[egas_i][iii];
+						if (ei < de_switch2 * et) {
+							ei = POWER(U[tau_i][iii], fgamma);
+						}
+						real p = (fgamma - 1.0) * ei;
+						if (opts().eos == WD) {
+							p += ztwd_pressure(U[rho_i][iii]);
+						}
+						if (opts().problem == DWD) {
+							rc.virial += (2.0 * ek + 0.5 * U[rho_i][iii] * G[iiig][phi_i] + 3.0 * p) * (dx * dx * dx);
+							rc.virial_norm += (2.0 * ek - 0.5 * U[rho_i][iii] * G[iiig][phi_i] + 3.0 * p) * (dx * dx * dx);
+						}
+						for (integer f = 0; f != opts().n_fields; ++f) {
+							rc.grid_sum[f] += U[f][iii] * dV;
+						}
+						rc.grid_sum[egas_i] += 0.5 * U[pot_i][iii] * dV;
+						rc.lsum[0] += U[lx_i][iii] * dV - (X[YDIM][iii] * U[sz_i][iii] - X[ZDIM][iii] * U[sy_i][iii]) * dV;
+						rc.lsum[1] -= U[ly_i][iii] * dV - (X[XDIM][iii] * U[sz_i][iii] - X[ZDIM][iii] * U[sx_i][iii]) * dV;
+						rc.lsum[2] += U[lz_i][iii] * dV - (X[XDIM][iii] * U[sy_i][iii] - X[YDIM][iii] * U[sx_i][iii]) * dV;
 					}
-					rc.grid_sum[egas_i] += 0.5 * U[pot_i][iii] * dV;
-					rc.lsum[0] += U[lx_i][iii] * dV - (X[YDIM][iii] * U[sz_i][iii] - X[ZDIM][iii] * U[sy_i][iii]) * dV;
-					rc.lsum[1] -= U[ly_i][iii] * dV - (X[XDIM][iii] * U[sz_i][iii] - X[ZDIM][iii] * U[sx_i][iii]) * dV;
-					rc.lsum[2] += U[lz_i][iii] * dV - (X[XDIM][iii] * U[sy_i][iii] - X[YDIM][iii] * U[sx_i][iii]) * dV;
 				}
 
 				for (integer s = 0; s != nspec; ++s) {
@@ -651,14 +656,27 @@ diagnostics_t grid::diagnostics(const diagnostics_t &diags) {
 			rc.com_dot[s][ZDIM] *= tmp;
 		}
 	}
-	for (integer f = 0; f != opts().n_fields; ++f) {
-		rc.grid_out[f] += U_out[f];
+	if (last_stage) {
+		for (integer f = 0; f != opts().n_fields; ++f) {
+			rc.grid_out[f] += U_out[f];
+		}
+		rc.grid_out[egas_i] += U_out[pot_i];
 	}
-	rc.grid_out[egas_i] += U_out[pot_i];
 
 	return rc;
 }
 
+std::shared_ptr<grid> grid::diagnostics_snapshot() const {
+	auto snapshot = std::make_shared<grid>();
+	snapshot->dx = dx;
+	snapshot->xmin = xmin;
+	snapshot->U = U;
+	snapshot->X = X;
+	snapshot->G = G;
+	snapshot->U_out = U_out;
+	return snapshot;
+}
+
 hpx::lcos::local::spinlock grid::omega_mtx;
 real grid::omega = ZERO;
 real grid::scaling_factor = 1.0;
@@ -782,26 +800,54 @@ void grid::set_hydro_boundary(const std::vector<real> &data, const geo::directio
 	}
 }
 
-std::vector<real> grid::get_hydro_boundary(const geo::direction &dir, bool energy_only) {
+void grid::set_hydro_boundary(const grid &sibling, const geo::direction &dir, bool energy_only) {
+	PROFILE();
+	std::array<integer, NDIM> lb, ub;
+	const auto &bw = energy_only ? energy_bw : field_bw;
+	/* our ghost zones on side dir are the sibling's interior cells one sub-grid width further along dir */
+	const integer offset = INX * (dir[XDIM] * H_DNX + dir[YDIM] * H_DNY + dir[ZDIM] * H_DNZ);
+
+	for (integer field = 0; field != opts().n_fields; ++field) {
+		get_boundary_size(lb, ub, dir, OUTER, INX, H_BW, bw[field]);
+		auto &Ufield = U[field];
+		const auto &Vfield = sibling.U[field];
+		for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
+			for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
+				for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
+					const integer iii = hindex(i, j, k);
+					Ufield[iii] = Vfield[iii - offset];
+				}
+			}
+		}
+	}
+}
+
+std::vector<real> grid::get_hydro_boundary(const geo::direction &dir, bool energy_only, real theta) {
 	PROFILE();
 
 	const auto &bw = energy_only ? energy_bw : field_bw;
 	std::array<integer, NDIM> lb, ub;
-	std::vector<real> data;
 	integer size = 0;
 
 	for (integer field = 0; field != opts().n_fields; ++field) {
 		size += get_boundary_size(lb, ub, dir, INNER, INX, H_BW, bw[field]);
 	}
-	data.resize(size);
+	std::vector<real> data = get_hydro_buffer(size);
 	integer iter = 0;
 	for (integer field = 0; field != opts().n_fields; ++field) {
 		get_boundary_size(lb, ub, dir, INNER, INX, H_BW, bw[field]);
 		auto &Ufield = U[field];
+		auto &U0field = U0[field];
 		for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
 			for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
 				for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
-					data[iter] = Ufield[hindex(i, j, k)];
+					const integer iii = hindex(i, j, k);
+					if (theta == 1.0) {
+						data[iter] = Ufield[iii];
+					} else {
+						const real u0 = U0field[h0index(i - H_BW, j - H_BW, k - H_BW)];
+						data[iter] = u0 + theta * (Ufield[iii] - u0);
+					}
 					++iter;
 				}
 			}
@@ -811,6 +857,16 @@ std::vector<real> grid::get_hydro_boundary(const geo::direction &dir, bool energ
 
 }
 
+std::vector<real> grid::get_hydro_buffer(std::size_t size) {
+	return buffer_pool<real>::get(size);
+}
+
+void grid::recycle_hydro_buffer(std::vector<real> &&buffer) {
+	/* bounded, a burst of messages (e.g. right after a regrid) should not stay allocated for the rest of the run */
+	constexpr std::size_t max_free = 256;
+	buffer_pool<real>::recycle(std::move(buffer), max_free);
+}
+
 line_of_centers_t grid::line_of_centers(const std::pair<space_vector, space_vector> &line) {
 
 	line_of_centers_t loc;
@@ -928,6 +984,17 @@ void grid::velocity_inc(const space_vector &dv) {
 
 std::vector<real> grid::get_flux_restrict(const std::array<integer, NDIM> &lb, const std::array<integer, NDIM> &ub, const geo::dimension &dim) const {
 	PROFILE();
+	return restrict_faces(F, lb, ub, dim);
+}
+
+std::vector<real> grid::get_flux_sum_restrict(const std::array<integer, NDIM> &lb, const std::array<integer, NDIM> &ub,
+		const geo::dimension &dim) const {
+	PROFILE();
+	return restrict_faces(F_sum, lb, ub, dim);
+}
+
+std::vector<real> grid::restrict_faces(const std::vector<hydro_state_t<std::vector<safe_real>>> &f, const std::array<integer, NDIM> &lb,
+		const std::array<integer, NDIM> &ub, const geo::dimension &dim) {
 	std::vector<real> data;
 	integer size = 1;
 	for (auto &dim : geo::dimension::full_set()) {
@@ -947,10 +1014,10 @@ std::vector<real> grid::get_flux_restrict(const std::array<integer, NDIM> &lb, c
 					const integer i01 = i00 + stride2;
 					const integer i11 = i00 + stride1 + stride2;
 					real value = ZERO;
-					value += F[dim][field][i00];
-					value += F[dim][field][i10];
-					value += F[dim][field][i01];
-					value += F[dim][field][i11];
+					value += f[dim][field][i00];
+					value += f[dim][field][i10];
+					value += f[dim][field][i01];
+					value += f[dim][field][i11];
 					value /= real(4);
 					data.push_back(value);
 				}
@@ -977,6 +1044,93 @@ void grid::set_flux_restrict(const std::vector<real> &data, const std::array<int
 	}
 }
 
+/* bounds of the block faces of face, the plane of the face is the lower face of the cells at lb[dim] */
+static void block_face_bounds(const geo::face &face, std::array<integer, NDIM> &lb, std::array<integer, NDIM> &ub) {
+	const auto dim = face.get_dimension();
+	lb[XDIM] = lb[YDIM] = lb[ZDIM] = 0;
+	ub[XDIM] = ub[YDIM] = ub[ZDIM] = INX;
+	lb[dim] = face.get_side() == geo::MINUS ? 0 : INX;
+	ub[dim] = lb[dim] + 1;
+}
+
+void grid::add_flux_sum(real weight) {
+	PROFILE();
+	std::array<integer, NDIM> lb, ub;
+	for (auto const &face : geo::face::full_set()) {
+		const integer dim = face.get_dimension();
+		block_face_bounds(face, lb, ub);
+		for (integer field = 0; field != opts().n_fields; ++field) {
+			for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
+				for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
+					for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
+						const integer iii = findex(i, j, k);
+						F_sum[dim][field][iii] += weight * F[dim][field][iii];
+					}
+				}
+			}
+		}
+	}
+}
+
+void grid::clear_flux_sum(const geo::face &face) {
+	std::array<integer, NDIM> lb, ub;
+	const integer dim = face.get_dimension();
+	block_face_bounds(face, lb, ub);
+	for (integer field = 0; field != opts().n_fields; ++field) {
+		for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
+			for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
+				for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
+					F_sum[dim][field][findex(i, j, k)] = ZERO;
+				}
+			}
+		}
+	}
+}
+
+/* replaces the summed flux through the faces between lb and ub, which have a refined neighbor across face, with the
+ * sum the fine side sent. As in compute_dudt the potential energy flux goes into the gas energy, together with the
+ * work of the mass flux in the potential, which does not change between two gravity solves. */
+void grid::reflux(const std::vector<real> &data, const std::array<integer, NDIM> &lb, const std::array<integer, NDIM> &ub, const geo::face &face) {
+	PROFILE();
+	const integer dim = face.get_dimension();
+	const bool plus = face.get_side() == geo::PLUS;
+	const integer nfaces = (ub[XDIM] - lb[XDIM]) * (ub[YDIM] - lb[YDIM]) * (ub[ZDIM] - lb[ZDIM]);
+	std::vector<real> change(opts().n_fields);
+	integer index = 0;
+	for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
+		for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
+			for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
+				const integer iiif = findex(i, j, k);
+				for (integer field = 0; field != opts().n_fields; ++field) {
+					/* the data is ordered field by field */
+					change[field] = (data[field * nfaces + index] - F_sum[dim][field][iiif]) / dx;
+				}
+				++index;
+				std::array<integer, NDIM> c = { i, j, k };
+				if (plus) {
+					--c[dim];
+				}
+				if (opts().gravity) {
+					const integer iiig = gindex(c[XDIM], c[YDIM], c[ZDIM]);
+					change[egas_i] += change[pot_i];
+					change[pot_i] = ZERO;
+					change[egas_i] -= change[rho_i] * G[iiig][phi_i] * HALF;
+				}
+				const integer iii = hindex(c[XDIM] + H_BW, c[YDIM] + H_BW, c[ZDIM] + H_BW);
+				for (integer field = 0; field != opts().n_fields; ++field) {
+					U[field][iii] += plus ? -change[field] : change[field];
+				}
+			}
+		}
+	}
+}
+
+/* with --hydro_subcycle the potential only changes at the gravity solves, the egas_to_etot/etot_to_egas around them
+ * account for it */
+void grid::clear_dphi_dt() {
+	std::fill(dphi_dt.begin(), dphi_dt.end(), ZERO);
+}
+
 void grid::set_prolong(const std::vector<real> &data, std::vector<real> &&outflows) {
 	PROFILE();
 	integer index = 0;
@@ -1476,7 +1630,7 @@ space_vector grid::center_of_mass() const {
 }
 
 grid::grid(real _dx, std::array<real, NDIM> _xmin) :
-		is_coarse(H_N3), has_coarse(H_N3), Ushad(opts().n_fields), U(opts().n_fields), U0(opts().n_fields), dUdt(opts().n_fields), F(NDIM), X(NDIM), G(NGF), is_root(
+		is_coarse(H_N3), has_coarse(H_N3), Ushad(opts().n_fields), U(opts().n_fields), U0(opts().n_fields), dUdt(opts().n_fields), F(NDIM), F_sum(NDIM), X(NDIM), G(NGF), is_root(
 				false), is_leaf(true) {
 	dx = _dx;
 	xmin = _xmin;
@@ -1673,6 +1827,9 @@ void grid::allocate() {
 		dUdt[field].resize(INX * INX * INX);
 		for (integer dim = 0; dim != NDIM; ++dim) {
 			F[dim][field].resize(F_N3);
+			if (opts().hydro_subcycle > 0) {
+				F_sum[dim][field].resize(F_N3);
+			}
 		}
 	}
 	L.resize(G_N3);
@@ -1689,13 +1846,13 @@ void grid::allocate() {
 }
 
 grid::grid() :
-		is_coarse(H_N3), has_coarse(H_N3), Ushad(opts().n_fields), U(opts().n_fields), U0(opts().n_fields), dUdt(opts().n_fields), F(NDIM), X(NDIM), G(NGF), dphi_dt(
+		is_coarse(H_N3), has_coarse(H_N3), Ushad(opts().n_fields), U(opts().n_fields), U0(opts().n_fields), dUdt(opts().n_fields), F(NDIM), F_sum(NDIM), X(NDIM), G(NGF), dphi_dt(
 				H_N3), is_root(false), is_leaf(true), U_out(opts().n_fields, ZERO), U_out0(opts().n_fields, ZERO) {
 //	allocate();
 }
 
 grid::grid(const init_func_type &init_func, real _dx, std::array<real, NDIM> _xmin) :
-		is_coarse(H_N3), has_coarse(H_N3), Ushad(opts().n_fields), U(opts().n_fields), U0(opts().n_fields), dUdt(opts().n_fields), F(NDIM), X(NDIM), G(NGF), is_root(
+		is_coarse(H_N3), has_coarse(H_N3), Ushad(opts().n_fields), U(opts().n_fields), U0(opts().n_fields), dUdt(opts().n_fields), F(NDIM), F_sum(NDIM), X(NDIM), G(NGF), is_root(
 				false), is_leaf(true), U_out(opts().n_fields, ZERO), U_out0(opts().n_fields, ZERO), dphi_dt(H_N3) {
 
 	dx = _dx;
@@ -1762,7 +1919,7 @@ void grid::rad_init() {
 	rad_grid_ptr->initialize_erad(U[rho_i], U[tau_i]);
 }
 
-timestep_t grid::compute_fluxes() {
+timestep_t grid::compute_fluxes(hydro::region region) {
 	PROFILE();
 	static hpx::lcos::local::once_flag flag;
 	hpx::lcos::local::call_once(flag, [this]() {
@@ -1778,6 +1935,8 @@ timestep_t grid::compute_fluxes() {
 //	hydro.set_low_order();
 	/******************************/
 	hydro.use_experiment(opts().experiment);
+	hydro.use_simd_reconstruct(opts().reconstruct_kernel_type == VC);
+	hydro.use_simd_flux(opts().flux_kernel_type == VC);
 	if (opts().correct_am_hydro) {
 		hydro.use_angmom_correction(sx_i);
 	}
@@ -1788,28 +1947,64 @@ timestep_t grid::compute_fluxes() {
 		}
 	}
 	hydro.use_smooth_recon(pot_i);
-	static thread_local auto f = std::vector<std::vector<std::vector<safe_real>>>(NDIM,
-			std::vector<std::vector<safe_real>>(opts().n_fields, std::vector<safe_real>(H_N3)));
-	const auto &q = hydro.reconstruct(U, X, omega);
-	auto max_lambda = hydro.flux(U, q, f, X, omega);
-
-	for (int dim = 0; dim < NDIM; dim++) {
+	static thread_local hydro::flux_type f(NDIM, opts().n_fields, H_N3);
+	const hydro::recon_type<NDIM> *q;
+	{
+		TRACE_SCOPE("reconstruct", trace_hydro_reconstruct);
+		q = &hydro.reconstruct(U, X, omega, region);
+	}
+	timestep_t max_lambda;
+	{
+		TRACE_SCOPE("flux", trace_hydro_flux);
+		max_lambda = hydro.flux(U, *q, f, X, omega, region);
+	}
+
+	/* copies len faces along z, the density flux is rebuilt from the species fluxes while they are copied */
+	const auto copy_row = [&](int dim, integer h0, integer i0, integer len) {
+		const auto fdim = f[dim];
+		auto &Fdim = F[dim];
 		for (integer field = 0; field != opts().n_fields; ++field) {
+			if (field != rho_i) {
+				const safe_real *src = fdim[field] + h0;
+				safe_real *dest = Fdim[field].data() + i0;
 #pragma GCC ivdep
-			for (integer i = 0; i <= INX; ++i) {
-				for (integer j = 0; j <= INX; ++j) {
-					for (integer k = 0; k <= INX; ++k) {
-						const auto i0 = findex(i, j, k);
-						F[dim][field][i0] = f[dim][field][hindex(i + H_BW, j + H_BW, k + H_BW)];
-						real rho_tot = 0.0;
-						for (integer field = spc_i; field != spc_i + opts().n_species; ++field) {
-							rho_tot += F[dim][field][i0];
-						}
-						F[dim][rho_i][i0] = rho_tot;
-					}
+				for (integer k = 0; k < len; ++k) {
+					dest[k] = src[k];
 				}
 			}
 		}
+		safe_real *rho = Fdim[rho_i].data() + i0;
+#pragma GCC ivdep
+		for (integer k = 0; k < len; ++k) {
+			rho[k] = 0.0;
+		}
+		for (integer field = spc_i; field != spc_i + opts().n_species; ++field) {
+			const safe_real *spc = fdim[field] + h0;
+#pragma GCC ivdep
+			for (integer k = 0; k < len; ++k) {
+				rho[k] += spc[k];
+			}
+		}
+	};
+
+	if (region.kind != hydro::region::all) {
+		/* f is per thread, the faces of the other pass have to be left alone. The faces of a region are never a
+		 * full row of the sub-grid, so every run of consecutive indexes lies within one row */
+		for (int dim = 0; dim < NDIM; dim++) {
+			hydro_simd::for_each_run(hydro.flux_indexes(dim, region), [&](int h0, int len) {
+				const auto d = index_to_dims<NDIM, H_NX>(h0);
+				copy_row(dim, h0, findex(d[XDIM] - H_BW, d[YDIM] - H_BW, d[ZDIM] - H_BW), len);
+			});
+		}
+		return max_lambda;
+	}
+
+	for (int dim = 0; dim < NDIM; dim++) {
+		for (integer i = 0; i <= INX; ++i) {
+			for (integer j = 0; j <= INX; ++j) {
+				copy_row(dim, hindex(i + H_BW, j + H_BW, H_BW), findex(i, j, 0), INX + 1);
+			}
+		}
 	}
 	return max_lambda;
 }
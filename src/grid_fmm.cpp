@@ -3,6 +3,7 @@
 //  Distributed under the Boost Software License, Version 1.0. (See accompanying
 //  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
+#include "octotiger/buffer_pool.hpp"
 #include "octotiger/common_kernel/interaction_constants.hpp"
 #include "octotiger/common_kernel/interactions_iterators.hpp"
 #include "octotiger/common_kernel/struct_of_array_data.hpp"
@@ -19,6 +20,8 @@
 
 #include <hpx/include/parallel_for_loop.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstddef>
 #include <utility>
@@ -48,6 +51,61 @@ static std::vector<std::vector<boundary_interaction_type>> ilist_d_bnd(geo::dire
 static std::vector<std::vector<boundary_interaction_type>> ilist_n_bnd(geo::direction::count());
 extern taylor<4, real> factor;
 
+// The tree passes between the INX^3 cells of a sub-grid and its INX^3/8 parents run across parents, m2m_vector::size()
+// parents at a time. Children are staged octant major, entry ci * INX^3/8 + iiip holds child ci of parent iiip, so
+// that child ci of consecutive parents is one vector load per component.
+static constexpr std::size_t tree_parents = octotiger::fmm::INNER_CELLS / NCHILD;
+using tree_child_moments = octotiger::fmm::struct_of_array_data<multipole, real, 20, octotiger::fmm::INNER_CELLS,
+		octotiger::fmm::SOA_PADDING>;
+using tree_child_coms = octotiger::fmm::struct_of_array_data<space_vector, real, 3, octotiger::fmm::INNER_CELLS,
+		octotiger::fmm::SOA_PADDING>;
+using tree_parent_moments = octotiger::fmm::struct_of_array_data<multipole, real, 20, tree_parents,
+		octotiger::fmm::SOA_PADDING>;
+using tree_parent_coms = octotiger::fmm::struct_of_array_data<space_vector, real, 3, tree_parents,
+		octotiger::fmm::SOA_PADDING>;
+
+// flat index among the INX^3 cells of every octant major entry
+static const std::vector<integer>& tree_child_indices() {
+	static const std::vector<integer> indices = []() {
+		constexpr integer nxp = INX / 2;
+		std::vector<integer> indices(octotiger::fmm::INNER_CELLS);
+		for (integer ci = 0; ci != NCHILD; ++ci) {
+			for (integer ip = 0; ip != nxp; ++ip) {
+				for (integer jp = 0; jp != nxp; ++jp) {
+					for (integer kp = 0; kp != nxp; ++kp) {
+						const integer iiip = nxp * nxp * ip + nxp * jp + kp;
+						const integer ic = (2 * ip) + ((ci >> 0) & 1);
+						const integer jc = (2 * jp) + ((ci >> 1) & 1);
+						const integer kc = (2 * kp) + ((ci >> 2) & 1);
+						indices[ci * tree_parents + iiip] = INX * INX * ic + INX * jc + kc;
+					}
+				}
+			}
+		}
+		return indices;
+	}();
+	return indices;
+}
+
+template<class SoA>
+OCTOTIGER_FORCEINLINE void load_taylor(taylor<4, m2m_vector> &t, SoA &soa, std::size_t entry) {
+	for (integer j = 0; j != 20; ++j) {
+		t[j] = m2m_vector(soa.get_pod() + j * SoA::padded_entries_per_component + entry);
+	}
+}
+
+template<class SoA>
+OCTOTIGER_FORCEINLINE void store_taylor(const taylor<4, m2m_vector> &t, SoA &soa, std::size_t entry) {
+	for (integer j = 0; j != 20; ++j) {
+		t[j].store(soa.get_pod() + j * SoA::padded_entries_per_component + entry);
+	}
+}
+
+template<class SoA>
+OCTOTIGER_FORCEINLINE std::array<m2m_vector, NDIM> load_com(SoA &soa, std::size_t entry) {
+	return {{soa.template value<0>(entry), soa.template value<1>(entry), soa.template value<2>(entry)}};
+}
+
 template<class T>
 void load_multipole(taylor<4, T> &m, space_vector &c, const gravity_boundary_type &data, integer iter, bool monopole) {
 	if (monopole) {
@@ -1398,87 +1456,60 @@ expansion_pass_type grid::compute_expansions(gsolve_type type, const expansion_p
 
 	expansion_pass_type exp_ret;
 	if (!is_leaf) {
-		exp_ret.first.resize(INX * INX * INX);
+		exp_ret.first = buffer_pool<expansion>::get(INX * INX * INX);
 		if (type == RHO) {
-			exp_ret.second.resize(INX * INX * INX);
+			exp_ret.second = buffer_pool<space_vector>::get(INX * INX * INX);
 		}
 	}
-	const integer inx = INX;
-	const integer nxp = (inx / 2);
-	auto child_index = [=](integer ip, integer jp, integer kp, integer ci, integer bw = 0) -> integer {
-		const integer ic = (2 * (ip) + bw) + ((ci >> 0) & 1);
-		const integer jc = (2 * (jp) + bw) + ((ci >> 1) & 1);
-		const integer kc = (2 * (kp) + bw) + ((ci >> 2) & 1);
-		return (inx + 2 * bw) * (inx + 2 * bw) * ic + (inx + 2 * bw) * jc + kc;
-	};
-
-	for (integer ip = 0; ip != nxp; ++ip) {
-		for (integer jp = 0; jp != nxp; ++jp) {
-			for (integer kp = 0; kp != nxp; ++kp) {
-				const integer iiip = nxp * nxp * ip + nxp * jp + kp;
-				std::array<simd_vector, NDIM> X;
-				std::array<simd_vector, NDIM> dX;
-				taylor<4, simd_vector> l;
-				std::array<simd_vector, NDIM> lc;
-				if (!is_root) {
-					const integer index = (INX * INX / 4) * (ip) + (INX / 2) * (jp) + (kp);
-					for (integer j = 0; j != 20; ++j) {
-						l[j] = parent_expansions->first[index][j];
-					}
-					if (type == RHO) {
-						for (integer j = 0; j != NDIM; ++j) {
-							lc[j] = parent_expansions->second[index][j];
-						}
-					}
-				} else {
-					for (integer j = 0; j != 20; ++j) {
-						l[j] = 0.0;
-					}
-					for (integer j = 0; j != NDIM; ++j) {
-						lc[j] = 0.0;
-					}
-				}
-				for (integer ci = 0; ci != NCHILD; ++ci) {
-					const integer iiic = child_index(ip, jp, kp, ci);
-					for (integer d = 0; d < NDIM; ++d) {
-						X[d][ci] = (*(com_ptr[0]))[iiic][d];
-					}
-				}
-				const auto &Y = (*(com_ptr[1]))[iiip];
+	/* the root has no parent expansion to shift down */
+	if (!is_root) {
+		static thread_local tree_parent_moments parent_l;
+		static thread_local tree_parent_coms parent_com;
+		static thread_local tree_child_coms child_com;
+		static thread_local tree_child_moments child_l;
+		const auto &child_indices = tree_child_indices();
+		const auto &com0 = *(com_ptr[0]);
+		const auto &com1 = *(com_ptr[1]);
+		for (std::size_t iiip = 0; iiip != tree_parents; ++iiip) {
+			parent_l.set_AoS_value(parent_expansions->first[iiip], iiip);
+			parent_com.set_AoS_value(com1[iiip], iiip);
+		}
+		for (std::size_t entry = 0; entry != octotiger::fmm::INNER_CELLS; ++entry) {
+			child_com.set_AoS_value(com0[child_indices[entry]], entry);
+		}
+		for (std::size_t iiip = 0; iiip < tree_parents; iiip += m2m_vector::size()) {
+			taylor<4, m2m_vector> l;
+			load_taylor(l, parent_l, iiip);
+			const auto Y = load_com(parent_com, iiip);
+			for (integer ci = 0; ci != NCHILD; ++ci) {
+				const std::size_t entry = ci * tree_parents + iiip;
+				std::array<m2m_vector, NDIM> dX = load_com(child_com, entry);
 				for (integer d = 0; d < NDIM; ++d) {
-					dX[d] = X[d] - Y[d];
+					dX[d] -= Y[d];
 				}
-				l <<= dX;
-				for (integer ci = 0; ci != NCHILD; ++ci) {
-					const integer iiic = child_index(ip, jp, kp, ci);
-					expansion &Liiic = L[iiic];
-					for (integer j = 0; j != 20; ++j) {
-						Liiic[j] += l[j][ci];
-					}
-
-					space_vector &L_ciiic = L_c[iiic];
-					if (type == RHO) {
-						for (integer j = 0; j != NDIM; ++j) {
-							L_ciiic[j] += lc[j][ci];
-						}
-					}
-
-					if (!is_leaf) {
-						integer index = child_index(ip, jp, kp, ci, 0);
-						for (integer j = 0; j != 20; ++j) {
-							exp_ret.first[index][j] = Liiic[j];
-						}
-
-						if (type == RHO) {
-							for (integer j = 0; j != 3; ++j) {
-								exp_ret.second[index][j] = L_ciiic[j];
-							}
-						}
-					}
+				store_taylor(l << dX, child_l, entry);
+			}
+		}
+		for (std::size_t entry = 0; entry != octotiger::fmm::INNER_CELLS; ++entry) {
+			const integer iiic = child_indices[entry];
+			expansion &Liiic = L[iiic];
+			for (integer j = 0; j != 20; ++j) {
+				Liiic[j] += child_l.get_pod()[j * tree_child_moments::padded_entries_per_component + entry];
+			}
+			if (type == RHO) {
+				const space_vector &lc = parent_expansions->second[entry % tree_parents];
+				for (integer j = 0; j != NDIM; ++j) {
+					L_c[iiic][j] += lc[j];
 				}
 			}
 		}
 	}
+	if (!is_leaf) {
+		std::copy(L.begin(), L.begin() + INX * INX * INX, exp_ret.first.begin());
+		if (type == RHO) {
+			std::copy(L_c.begin(), L_c.begin() + INX * INX * INX, exp_ret.second.begin());
+		}
+	}
 
 	if (is_leaf) {
 		for (integer i = 0; i != G_NX; ++i) {
@@ -1509,24 +1540,17 @@ expansion_pass_type grid::compute_expansions(gsolve_type type, const expansion_p
 multipole_pass_type grid::compute_multipoles(gsolve_type type, const multipole_pass_type *child_poles) {
 	PROFILE();
 
-	integer lev = 0;
 	const real dx3 = dx * dx * dx;
-	M_ptr = std::make_shared<std::vector<multipole>>();
-	mon_ptr = std::make_shared<std::vector<real>>();
+	/* local neighbors may still hold the previous moments, they go back into the pool with the last reference */
+	M_ptr = buffer_pool<multipole>::get_shared(is_leaf ? 0 : G_N3);
+	mon_ptr = buffer_pool<real>::get_shared(is_leaf ? G_N3 : 0);
 	auto &M = *M_ptr;
 	auto &mon = *mon_ptr;
-	if (is_leaf) {
-		M.resize(0);
-		mon.resize(G_N3);
-	} else {
-		M.resize(G_N3);
-		mon.resize(0);
-	}
 	if (com_ptr[1] == nullptr) {
 		com_ptr[1] = std::make_shared<std::vector<space_vector>>(G_N3 / 8);
 	}
 	if (type == RHO) {
-		com_ptr[0] = std::make_shared<std::vector<space_vector>>(G_N3);
+		com_ptr[0] = buffer_pool<space_vector>::get_shared(G_N3);
 		const integer iii0 = hindex(H_BW, H_BW, H_BW);
 		const std::array<real, NDIM> x0 = { X[XDIM][iii0], X[YDIM][iii0], X[ZDIM][iii0] };
 		for (integer i = 0; i != G_NX; ++i) {
@@ -1546,127 +1570,102 @@ multipole_pass_type grid::compute_multipoles(gsolve_type type, const multipole_p
 	}
 	multipole_pass_type mret;
 	if (!is_root) {
-		mret.first.resize(INX * INX * INX / NCHILD);
-		mret.second.resize(INX * INX * INX / NCHILD);
+		mret.first = buffer_pool<multipole>::get(INX * INX * INX / NCHILD);
+		mret.second = buffer_pool<space_vector>::get(INX * INX * INX / NCHILD);
 	} else {
 	}
-	taylor<4, real> MM;
 	integer index = 0;
-	for (integer inx = INX; (inx >= INX / 2); inx >>= 1) {
-		const integer nxp = inx;
-		const integer nxc = (2 * inx);
-
-		auto child_index = [=](integer ip, integer jp, integer kp, integer ci) -> integer {
-			const integer ic = (2 * ip) + ((ci >> 0) & 1);
-			const integer jc = (2 * jp) + ((ci >> 1) & 1);
-			const integer kc = (2 * kp) + ((ci >> 2) & 1);
-			return nxc * nxc * ic + nxc * jc + kc;
-		};
-
-		for (integer ip = 0; ip != nxp; ++ip) {
-			for (integer jp = 0; jp != nxp; ++jp) {
-				for (integer kp = 0; kp != nxp; ++kp) {
-					const integer iiip = nxp * nxp * ip + nxp * jp + kp;
-					if (lev != 0) {
-						if (type == RHO) {
-							simd_vector mc;
-							std::array<simd_vector, NDIM> X;
-							for (integer ci = 0; ci != NCHILD; ++ci) {
-								const integer iiic = child_index(ip, jp, kp, ci);
-								if (is_leaf) {
-									mc[ci] = mon[iiic];
-								} else {
-									mc[ci] = M[iiic]();
-								}
-								for (integer d = 0; d < NDIM; ++d) {
-									X[d][ci] = (*(com_ptr[0]))[iiic][d];
-								}
-							}
-#if !defined(HPX_HAVE_DATAPAR_VC) || (defined(Vc_IS_VERSION_1) && Vc_IS_VERSION_1)
-							real mtot = mc.sum();
-#else
-                            real mtot = Vc::reduce(mc);
-#endif
-							for (integer d = 0; d < NDIM; ++d) {
-#if !defined(HPX_HAVE_DATAPAR_VC) || (defined(Vc_IS_VERSION_1) && Vc_IS_VERSION_1)
-								(*(com_ptr[1]))[iiip][d] = (X[d] * mc).sum() / mtot;
-#else
-                                (*(com_ptr[1]))[iiip][d] = Vc::reduce(X[d] * mc) / mtot;
-#endif
-							}
-						}
-						taylor<4, simd_vector> mc, mp;
-						std::array<simd_vector, NDIM> x, y, dx;
-						for (integer ci = 0; ci != NCHILD; ++ci) {
-
-							const integer iiic = child_index(ip, jp, kp, ci);
-							const space_vector &X = (*(com_ptr[lev - 1]))[iiic];
-							if (is_leaf) {
-
-								mc()[ci] = mon[iiic];
-								for (integer j = 1; j != 20; ++j) {
-									mc.ptr()[j][ci] = 0.0;
-								}
-
-							} else {
-
-								for (integer j = 0; j != 20; ++j) {
-									mc.ptr()[j][ci] = M[iiic].ptr()[j];
-								}
-
-							}
-							for (integer d = 0; d < NDIM; ++d) {
-
-								x[d][ci] = X[d];
-
-							}
-						}
-						const space_vector &Y = (*(com_ptr[lev]))[iiip];
-						for (integer d = 0; d < NDIM; ++d) {
-							dx[d] = x[d] - simd_vector(Y[d]);
-						}
-
-						mp = mc >> dx;
-						for (integer j = 0; j != 20; ++j) {
-#if !defined(HPX_HAVE_DATAPAR_VC) || (defined(Vc_IS_VERSION_1) && Vc_IS_VERSION_1)
-							MM[j] = mp[j].sum();
-#else
-                            MM[j] = Vc::reduce(mp[j]);
-#endif
-						}
-
+	for (integer ip = 0; ip != INX; ++ip) {
+		for (integer jp = 0; jp != INX; ++jp) {
+			for (integer kp = 0; kp != INX; ++kp) {
+				const integer iiip = INX * INX * ip + INX * jp + kp;
+				if (child_poles == nullptr) {
+					const integer iiih = hindex(ip + H_BW, jp + H_BW, kp + H_BW);
+					const integer iii0 = h0index(ip, jp, kp);
+					if (type == RHO) {
+						mon[iiip] = U[rho_i][iiih] * dx3;
 					} else {
-
-						if (child_poles == nullptr) {
-							const integer iiih = hindex(ip + H_BW, jp + H_BW, kp + H_BW);
-							const integer iii0 = h0index(ip, jp, kp);
-							if (type == RHO) {
-								mon[iiip] = U[rho_i][iiih] * dx3;
-							} else {
-								mon[iiip] = dUdt[rho_i][iii0] * dx3;
-							}
-						} else {
-							assert(M.size());
-							M[iiip] = child_poles->first[index];
-							if (type == RHO) {
-								(*(com_ptr)[lev])[iiip] = child_poles->second[index];
-							}
-							++index;
-						}
-
+						mon[iiip] = dUdt[rho_i][iii0] * dx3;
 					}
-					if (!is_root && (lev == 1)) {
-
-						mret.first[index] = MM;
-						mret.second[index] = (*(com_ptr[lev]))[iiip];
-						++index;
-
+				} else {
+					assert(M.size());
+					M[iiip] = child_poles->first[index];
+					if (type == RHO) {
+						(*(com_ptr)[0])[iiip] = child_poles->second[index];
 					}
+					++index;
 				}
 			}
 		}
-		++lev;
-		index = 0;
+	}
+
+	static thread_local tree_child_moments child_m;
+	static thread_local tree_child_coms child_com;
+	static thread_local tree_parent_moments parent_m;
+	static thread_local tree_parent_coms parent_com;
+	const auto &child_indices = tree_child_indices();
+	const auto &com0 = *(com_ptr[0]);
+	auto &com1 = *(com_ptr[1]);
+	for (std::size_t entry = 0; entry != octotiger::fmm::INNER_CELLS; ++entry) {
+		const integer iiic = child_indices[entry];
+		if (is_leaf) {
+			child_m.set_value(mon[iiic], entry);
+		} else {
+			child_m.set_AoS_value(M[iiic], entry);
+		}
+		child_com.set_AoS_value(com0[iiic], entry);
+	}
+	if (type == RHO) {
+		for (std::size_t iiip = 0; iiip < tree_parents; iiip += m2m_vector::size()) {
+			m2m_vector mtot = 0.0;
+			std::array<m2m_vector, NDIM> Y;
+			Y.fill(0.0);
+			for (integer ci = 0; ci != NCHILD; ++ci) {
+				const std::size_t entry = ci * tree_parents + iiip;
+				const m2m_vector mc = child_m.value<0>(entry);
+				const auto X = load_com(child_com, entry);
+				mtot += mc;
+				for (integer d = 0; d < NDIM; ++d) {
+					Y[d] += X[d] * mc;
+				}
+			}
+			/* If tree_parents is not a multiple of the vector width, the lanes past the last parent read
+			 * the first parents of the next octant (the zeroed SoA padding for the last octant). They
+			 * compute a meaningless center of mass, which is stored only into the padding of parent_com
+			 * and never read. It is 0 / 0 only where those cells have no mass, like any massless parent. */
+			Y[0] /= mtot;
+			Y[0].store(parent_com.pointer<0>(iiip));
+			Y[1] /= mtot;
+			Y[1].store(parent_com.pointer<1>(iiip));
+			Y[2] /= mtot;
+			Y[2].store(parent_com.pointer<2>(iiip));
+		}
+		parent_com.to_non_SoA(com1);
+	} else {
+		for (std::size_t iiip = 0; iiip != tree_parents; ++iiip) {
+			parent_com.set_AoS_value(com1[iiip], iiip);
+		}
+	}
+	/* the moments of the root's parents are never used, only their centers of mass */
+	if (!is_root) {
+		for (std::size_t iiip = 0; iiip < tree_parents; iiip += m2m_vector::size()) {
+			taylor<4, m2m_vector> mp, mc;
+			mp = m2m_vector(0.0);
+			const auto Y = load_com(parent_com, iiip);
+			for (integer ci = 0; ci != NCHILD; ++ci) {
+				const std::size_t entry = ci * tree_parents + iiip;
+				load_taylor(mc, child_m, entry);
+				std::array<m2m_vector, NDIM> dX = load_com(child_com, entry);
+				for (integer d = 0; d < NDIM; ++d) {
+					dX[d] -= Y[d];
+				}
+				mc >>= dX;
+				mp += mc;
+			}
+			store_taylor(mp, parent_m, iiip);
+		}
+		parent_m.to_non_SoA(mret.first);
+		std::copy(com1.begin(), com1.end(), mret.second.begin());
 	}
 
 	return mret;
@@ -1725,40 +1724,6 @@ gravity_boundary_type grid::get_gravity_boundary(const geo::direction &dir, bool
 	return data;
 }
 
-neighbor_gravity_type grid::fill_received_array(neighbor_gravity_type raw_input) {
-	PROFILE();
-	const std::vector<boundary_interaction_type> &list = ilist_n_bnd[raw_input.direction];
-	neighbor_gravity_type filled_array;
-	filled_array.data.allocate();
-	constexpr size_t blocksize = INX * INX * INX;
-	filled_array.direction = raw_input.direction;
-	filled_array.is_monopole = raw_input.is_monopole;
-	if (raw_input.is_monopole) {
-		// fill with unimportant data
-		filled_array.data.m->resize(blocksize);
-		// Overwrite data that matters
-		int counter = 0;
-		for (auto i : list) {
-			const integer iii = i.second;
-			filled_array.data.m->at(iii) = raw_input.data.m->at(counter);
-			counter++;
-		}
-	} else {
-		// fill with unimportant data
-		filled_array.data.M->resize(blocksize);
-		filled_array.data.x->resize(blocksize);
-		// Overwrite data that matters
-		int counter = 0;
-		for (auto i : list) {
-			const integer iii = i.second;
-			filled_array.data.M->at(iii) = raw_input.data.M->at(counter);
-			filled_array.data.x->at(iii) = raw_input.data.x->at(counter);
-			counter++;
-		}
-	}
-	return filled_array;
-}
-
 const std::vector<boundary_interaction_type>& grid::get_ilist_n_bnd(const geo::direction &dir) {
 	return ilist_n_bnd[dir];
 }
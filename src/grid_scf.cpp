@@ -449,7 +449,7 @@ real grid::scf_update(real com, real omega, real c1, real c2, real c1_x, real c2
 }
 
 void node_server::run_scf(std::string const &data_dir) {
-	solve_gravity(false, false);
+	GET(solve_gravity(false, false));
 	real omega = initial_params().omega;
 	real jorb0;
 //	printf( "Starting SCF\n");
@@ -487,7 +487,7 @@ void node_server::run_scf(std::string const &data_dir) {
 			jorb0 = jorb;
 		}
 		real spin_ratio = (j1 + j2) * INVERSE(jorb);
-		solve_gravity(false, false);
+		GET(solve_gravity(false, false));
 		auto axis = grid_ptr->find_axis();
 		auto loc = line_of_centers(axis);
 
@@ -658,7 +658,7 @@ void node_server::run_scf(std::string const &data_dir) {
 //		printf( "%e %e\n", grid::get_A(), grid::get_B());
 		//	printf( "%e %e %e\n", rho1_max.first, rho2_max.first, l1_x);
 		scf_update(com, omega, c_1, c_2, rho1_max.first, rho2_max.first, l1_x, *e1, *e2);
-		solve_gravity(false, false);
+		GET(solve_gravity(false, false));
 		w0 = std::min(w0max, w0 * POWER(w0max / w0init, 1.0 / iter2max));
 
 	}
@@ -65,6 +65,8 @@ static int timestamp;
 static int steps_elapsed;
 static DBfile *db_;
 static dir_map_type node_dir_;
+/* domains of this locality read ahead of the tree construction by load_domains */
+static std::unordered_map<node_location::node_id, silo_load_t> domains_;
 
 #define SILO_TEST(i) \
 	if( i != 0 ) printf( "SILO call failed at %i\n", __LINE__ );
@@ -129,6 +131,51 @@ void load_options_from_silo(std::string fname, DBfile *db) {
 
 }
 
+static void read_domain(DBfile *db, const node_location &loc, silo_load_t &load) {
+	static const auto hydro_names = grid::get_hydro_field_names();
+	load.vars.resize(hydro_names.size());
+	load.outflows.resize(hydro_names.size());
+	const std::string suffix = oct_to_str(loc.to_id());
+	for (int f = 0; f != hydro_names.size(); f++) {
+		const auto this_name = suffix + std::string("/") + hydro_names[f]; /**/
+		auto var = DBGetQuadvar(db, this_name.c_str());
+		load.nx = var->dims[0];
+		const int nvar = load.nx * load.nx * load.nx;
+		load.outflows[f].first = load.vars[f].first = hydro_names[f];
+		load.vars[f].second.resize(nvar);
+		read_silo_var<real> rd;
+		load.outflows[f].second = rd(db, outflow_name(this_name).c_str());
+		std::memcpy(load.vars[f].second.data(), var->vals[0], sizeof(real) * nvar);
+		DBFreeQuadvar(var);
+	}
+}
+
+/* Reads all domains this locality will own, opening each group file only once */
+static void load_domains() {
+	TRACE_SCOPE("load_domains", trace_io);
+	const integer this_id = hpx::get_locality_id();
+	std::map<std::string, std::vector<node_location::node_id>> files;
+	for (const auto &entry : node_dir_) {
+		if (entry.second.load && entry.second.locality_id == this_id) {
+			files[entry.second.filename].push_back(entry.first);
+		}
+	}
+	hpx::threads::run_as_os_thread([&files]() {
+		std::lock_guard<std::mutex> lock(silo_mtx_);
+		for (const auto &file : files) {
+			DBfile *db = DBOpenReal(file.first.c_str(), DB_UNKNOWN, DB_READ);
+			if (db == NULL) {
+				printf("Unable to open SILO file %s\n", file.first.c_str());
+				abort();
+			}
+			for (const auto id : file.second) {
+				read_domain(db, node_location(id), domains_[id]);
+			}
+			DBClose(db);
+		}
+	}).get();
+}
+
 void load_open(std::string fname, dir_map_type map) {
 //	printf("LOAD OPENED on proc %i\n", hpx::get_locality_id());
 	load_options_from_silo(fname, db_); /**/
@@ -143,10 +190,14 @@ void load_open(std::string fname, dir_map_type map) {
 	//	printf("%e\n", silo_output_time());
 //		sleep(100);
 	}).get();
+	if (opts().parallel_restart) {
+		load_domains();
+	}
 }
 
 void load_close() {
 	DBClose(db_);
+	domains_.clear();
 }
 
 HPX_PLAIN_ACTION(load_close, load_close_action);
@@ -182,32 +233,23 @@ node_server::node_server(const node_location &loc) :
 	//	printf("Loading %s on %i\n", loc.to_str().c_str(), int(hpx::get_locality_id()));
 		silo_load_t load;
 		static const auto hydro_names = grid::get_hydro_field_names();
-		load.vars.resize(hydro_names.size());
-		load.outflows.resize(hydro_names.size());
-		hpx::threads::run_as_os_thread([&]() {
-			static std::mutex mtx;
-			std::lock_guard<std::mutex> lock(mtx);
-			const auto this_file = iter->second.filename;
-			DBfile *db = DBOpenReal(this_file.c_str(), DB_UNKNOWN, DB_READ);
-			if (db == NULL) {
-				printf("Unable to open SILO file %s\n", this_file.c_str());
-				abort();
-			}
-			const std::string suffix = oct_to_str(loc.to_id());
-			for (int f = 0; f != hydro_names.size(); f++) {
-				const auto this_name = suffix + std::string("/") + hydro_names[f]; /**/
-				auto var = DBGetQuadvar(db, this_name.c_str());
-				load.nx = var->dims[0];
-				const int nvar = load.nx * load.nx * load.nx;
-				load.outflows[f].first = load.vars[f].first = hydro_names[f];
-				load.vars[f].second.resize(nvar);
-				read_silo_var<real> rd;
-				load.outflows[f].second = rd(db, outflow_name(this_name).c_str());
-				std::memcpy(load.vars[f].second.data(), var->vals[0], sizeof(real) * nvar);
-				DBFreeQuadvar(var);
-			}
-			DBClose(db);
-		}).get();
+		auto domain = domains_.find(loc.to_id());
+		if (domain != domains_.end()) {
+			/* the domain map is not modified until load_close, so only the entry itself is moved from */
+			load = std::move(domain->second);
+		} else {
+			hpx::threads::run_as_os_thread([&]() {
+				std::lock_guard<std::mutex> lock(silo_mtx_);
+				const auto this_file = iter->second.filename;
+				DBfile *db = DBOpenReal(this_file.c_str(), DB_UNKNOWN, DB_READ);
+				if (db == NULL) {
+					printf("Unable to open SILO file %s\n", this_file.c_str());
+					abort();
+				}
+				read_domain(db, loc, load);
+				DBClose(db);
+			}).get();
+		}
 		is_refined = false;
 		for (integer f = 0; f < hydro_names.size(); f++) {
 			grid_ptr->set(load.vars[f].first, load.vars[f].second.data(), version_);
@@ -256,6 +298,7 @@ auto split_mesh_id(const std::string id) {
 
 void load_data_from_silo(std::string fname, node_server *root_ptr, hpx::id_type root) {
 	timings::scope ts(root_ptr->timings_, timings::time_io);
+	TRACE_SCOPE("load_data_from_silo", trace_io);
 	printf( "Reading %s\n", fname.c_str());
 	const auto tstart = time(NULL);
 
@@ -4,6 +4,9 @@
 #include <ctime>
 #include <hpx/runtime/threads/run_as_os_thread.hpp>
 #include <cerrno>
+#include <deque>
+#include <map>
+#include <memory>
 
 #include <sys/stat.h>
 
@@ -18,11 +21,12 @@ struct write_silo_var {
 };
 
 struct node_list_t;
+struct output_header_t;
 
 void output_stage1(std::string fname, int cycle);
 node_list_t output_stage2(std::string fname, int cycle);
 void output_stage3(std::string fname, int cycle, int gn, int gb, int ge);
-void output_stage4(std::string fname, int cycle);
+void output_stage4(const output_header_t &hdr, std::string fname, int cycle);
 
 HPX_PLAIN_ACTION(output_stage1, output_stage1_action);
 HPX_PLAIN_ACTION(output_stage2, output_stage2_action);
@@ -75,16 +79,38 @@ struct mesh_vars_t {
 
 struct mesh_vars_t;
 
-static std::vector<mesh_vars_t> all_mesh_vars;
+/* Everything the root needs to write the master file of one output */
+struct output_header_t {
+	node_list_t node_list;
+	double output_time;
+	double rotation_time;
+	real omega;
+	int nsteps;
+	int timestamp;
+	int time_elapsed;
+	int steps_elapsed;
+};
+
+/* Copy of the leaf data of one output on this locality, kept until stage 3 has written it */
+struct staged_output_t {
+	std::vector<mesh_vars_t> mesh_vars;
+	double rotation_time;
+};
+
+/* Output whose data is staged but not yet written, the writes are chained so only one output is written at a time */
+struct output_in_flight_t {
+	hpx::shared_future<void> write;
+	std::size_t bytes;
+	std::string fname;
+};
+
+static std::map<std::string, staged_output_t> staged_outputs_;
+static hpx::lcos::local::spinlock staged_mtx_;
 static std::vector<hpx::future<mesh_vars_t>> futs_;
-static node_list_t node_list_;
-static int nsteps;
-static int time_elapsed;
+static std::deque<output_in_flight_t> in_flight_;
 
 static time_t start_time = time(nullptr);
 static integer start_step = 0;
-static int timestamp;
-static int steps_elapsed;
 static const int HOST_NAME_LEN = 100;
 
 void output_stage1(std::string fname, int cycle) {
@@ -119,11 +145,14 @@ node_list_t output_stage2(std::string fname, int cycle) {
 	const int this_id = hpx::get_locality_id();
 	const int nfields = grid::get_field_names().size();
 	std::string this_fname = fname + std::string(".") + std::to_string(INX) + std::string(".silo");
-	all_mesh_vars.clear();
+	staged_output_t staged;
+	staged.rotation_time = silo_output_rotation_time();
+	auto &all_mesh_vars = staged.mesh_vars;
 	all_mesh_vars.reserve(futs_.size());
 	for (auto &this_fut : futs_) {
 		all_mesh_vars.push_back(std::move(GET(this_fut)));
 	}
+	futs_.clear();
 	std::vector<node_location::node_id> ids;
 	node_list_t nl;
 	nl.extents.resize(nfields);
@@ -152,18 +181,29 @@ node_list_t output_stage2(std::string fname, int cycle) {
 	nl.silo_leaves = std::move(ids);
 	nl.all = std::move(all);
 	nl.positions = std::move(positions);
+	{
+		std::lock_guard<hpx::lcos::local::spinlock> lock(staged_mtx_);
+		staged_outputs_[fname] = std::move(staged);
+	}
 	printf("Closing output stage 2 on locality %i\n", hpx::get_locality_id());
 	return std::move(nl);
 }
 
 void output_stage3(std::string fname, int cycle, int gn, int gb, int ge) {
 	printf("Opening output stage 3 on locality %i\n", hpx::get_locality_id());
+	TRACE_SCOPE("output_stage3", trace_io);
 	const int this_id = hpx::get_locality_id();
 	const int nfields = grid::get_field_names().size();
 	const auto dir = opts().data_dir;
 	std::string this_fname = dir  + fname + ".silo.data/" + std::to_string(gn) + std::string(".silo");
-	double dtime = silo_output_rotation_time();
-	hpx::threads::run_as_os_thread([&this_fname, this_id, &dtime, gb, gn, ge](integer cycle) {
+	const staged_output_t *staged;
+	{
+		std::lock_guard<hpx::lcos::local::spinlock> lock(staged_mtx_);
+		staged = &staged_outputs_.at(fname);
+	}
+	const auto &all_mesh_vars = staged->mesh_vars;
+	double dtime = staged->rotation_time;
+	hpx::threads::run_as_os_thread([&this_fname, this_id, &dtime, &all_mesh_vars, gb, gn, ge](integer cycle) {
 		DBfile *db;
 		if (this_id == gb) {
 //			printf( "Create %s %i %i %i %i\n", this_fname.c_str(), this_id, gn, gb, ge);
@@ -240,6 +280,10 @@ void output_stage3(std::string fname, int cycle, int gn, int gb, int ge) {
 		DBFreeOptlist(optlist_mesh);
 		DBClose(db);
 	}, cycle).get();
+	{
+		std::lock_guard<hpx::lcos::local::spinlock> lock(staged_mtx_);
+		staged_outputs_.erase(fname);
+	}
 	if (this_id < ge - 1) {
 		auto f = hpx::async<output_stage3_action>(hpx::launch::async(hpx::threads::thread_priority_boost), localities[this_id + 1], fname, cycle, gn, gb, ge);
 
@@ -248,15 +292,15 @@ void output_stage3(std::string fname, int cycle, int gn, int gb, int ge) {
 	printf("Closing output stage 3 on locality %i\n", hpx::get_locality_id());
 }
 
-void output_stage4(std::string fname, int cycle) {
+void output_stage4(const output_header_t &hdr, std::string fname, int cycle) {
 	printf("Opening output stage 4 on locality %i\n", hpx::get_locality_id());
 	const int nfields = grid::get_field_names().size();
 	std::string this_fname = opts().data_dir + "/" + fname + std::string(".silo");
-	double dtime = silo_output_rotation_time();
-	double rtime = silo_output_rotation_time();
-	hpx::threads::run_as_os_thread([&this_fname, fname, nfields, &rtime](int cycle) {
+	double rtime = hdr.rotation_time;
+	hpx::threads::run_as_os_thread([&this_fname, &hdr, fname, nfields, &rtime](int cycle) {
+		const auto &node_list_ = hdr.node_list;
 		auto *db = DBCreateReal(this_fname.c_str(), DB_CLOBBER, DB_LOCAL, "Octo-tiger", SILO_DRIVER);
-		double dtime = silo_output_time();
+		double dtime = hdr.output_time;
 		float ftime = dtime;
 		std::vector<std::pair<int, node_location>> node_locs;
 		std::vector<char*> mesh_names;
@@ -357,7 +401,7 @@ void output_stage4(std::string fname, int cycle) {
 		fi(db, "eos", integer(opts().eos));
 		fi(db, "gravity", integer(opts().gravity));
 		fi(db, "hydro", integer(opts().hydro));
-		fr(db, "omega", grid::get_omega() / opts().code_to_s);
+		fr(db, "omega", hdr.omega / opts().code_to_s);
 		fr(db, "output_frequency", opts().output_dt);
 		fi(db, "problem", integer(opts().problem));
 		fi(db, "radiation", integer(opts().radiation));
@@ -378,13 +422,13 @@ void output_stage4(std::string fname, int cycle) {
 		DBWrite(db, "atomic_number", opts().atomic_number.data(), &nspc, 1, db_type<real>::d);
 		fi(db, "node_count", integer(nnodes));
 		fi(db, "leaf_count", integer(node_list_.silo_leaves.size()));
-		write_silo_var<integer>()(db, "timestamp", timestamp);
+		write_silo_var<integer>()(db, "timestamp", hdr.timestamp);
 		write_silo_var<integer>()(db, "epoch", silo_epoch());
 		write_silo_var<integer>()(db, "locality_count", localities.size());
 		write_silo_var<integer>()(db, "thread_count", localities.size() * std::thread::hardware_concurrency());
-		write_silo_var<integer>()(db, "step_count", nsteps);
-		write_silo_var<integer>()(db, "time_elapsed", time_elapsed);
-		write_silo_var<integer>()(db, "steps_elapsed", steps_elapsed);
+		write_silo_var<integer>()(db, "step_count", hdr.nsteps);
+		write_silo_var<integer>()(db, "time_elapsed", hdr.time_elapsed);
+		write_silo_var<integer>()(db, "steps_elapsed", hdr.steps_elapsed);
 //
 //				// mesh adjacency information
 //				int nleaves = node_locs.size();
@@ -503,6 +547,7 @@ void output_stage4(std::string fname, int cycle) {
 
 void output_all(node_server *root_ptr, std::string fname, int cycle, bool block) {
 	timings::scope ts(root_ptr->timings_, timings::time_io);
+	TRACE_SCOPE("output_all", trace_io);
 
 	printf("Writing %s.silo\n", fname.c_str());
 	const auto tstart = time(NULL);
@@ -521,29 +566,53 @@ void output_all(node_server *root_ptr, std::string fname, int cycle, bool block)
 		}
 	}).get();
 
-	static hpx::future<void> barrier(hpx::make_ready_future<void>());
-	GET(barrier);
-	nsteps = GET(node_registry::begin()->second.get_ptr())->get_step_num();
-	timestamp = time(nullptr);
-	steps_elapsed = nsteps - start_step;
-	time_elapsed = time(nullptr) - start_time;
-	start_time = timestamp;
-	start_step = nsteps;
+	/* Wait for older outputs until this one fits within the bounds on outputs in flight and staging memory.
+	 * The size of this output is estimated by the size of the last one. */
+	static std::size_t last_bytes = 0;
+	const std::size_t max_in_flight = std::max(integer(1), opts().silo_max_in_flight);
+	const std::size_t max_bytes = opts().silo_staging_mb * 1024.0 * 1024.0;
+	const auto staged_bytes = []() {
+		std::size_t bytes = 0;
+		for (const auto &o : in_flight_) {
+			bytes += o.bytes;
+		}
+		return bytes;
+	};
+	const auto name_in_flight = [&fname]() {
+		for (const auto &o : in_flight_) {
+			if (o.fname == fname) {
+				return true;
+			}
+		}
+		return false;
+	};
+	while (!in_flight_.empty()
+			&& (in_flight_.front().write.is_ready() || in_flight_.size() >= max_in_flight || (max_bytes > 0 && staged_bytes() + last_bytes > max_bytes)
+					|| name_in_flight())) {
+		GET(in_flight_.front().write);
+		in_flight_.pop_front();
+	}
+	auto hdr = std::make_shared<output_header_t>();
+	hdr->nsteps = GET(node_registry::begin()->second.get_ptr())->get_step_num();
+	hdr->timestamp = time(nullptr);
+	hdr->steps_elapsed = hdr->nsteps - start_step;
+	hdr->time_elapsed = time(nullptr) - start_time;
+	hdr->omega = grid::get_omega();
+	start_time = hdr->timestamp;
+	start_step = hdr->nsteps;
 	std::vector<hpx::future<void>> futs1;
 	for (auto &id : localities) {
 		futs1.push_back(hpx::async<output_stage1_action>(hpx::launch::async(hpx::threads::thread_priority_boost), id, fname, cycle));
 	}
 	GET(hpx::when_all(futs1));
+	hdr->output_time = silo_output_time();
+	hdr->rotation_time = silo_output_rotation_time();
 
 	std::vector<hpx::future<node_list_t>> id_futs;
 	for (auto &id : localities) {
 		id_futs.push_back(hpx::async < output_stage2_action > (hpx::launch::async(hpx::threads::thread_priority_boost), id, fname, cycle));
 	}
-	node_list_.silo_leaves.clear();
-	node_list_.group_num.clear();
-	node_list_.all.clear();
-	node_list_.positions.clear();
-	node_list_.extents.clear();
+	auto &node_list_ = hdr->node_list;
 	int id = 0;
 	for (auto &f : id_futs) {
 //		printf( "---%i\n", id) ;
@@ -564,29 +633,39 @@ void output_all(node_server *root_ptr, std::string fname, int cycle, bool block)
 		}
 		id++;
 	}
-	const auto ng = opts().silo_num_groups;
-
-	std::vector<hpx::future<void>> futs;
-	for (int i = 0; i < ng; i++) {
-		int gb = (i * localities.size()) / ng;
-		int ge = ((i + 1) * localities.size()) / ng;
-		futs.push_back(hpx::async < output_stage3_action > (hpx::launch::async(hpx::threads::thread_priority_boost), localities[gb], fname, cycle, i, gb, ge));
+	std::size_t bytes = 0;
+	for (const auto zones : node_list_.zone_count) {
+		bytes += zones * grid::get_field_names().size() * sizeof(real);
 	}
+	last_bytes = bytes;
 
-	barrier = hpx::async(hpx::launch::async(hpx::threads::thread_priority_boost), [tstart, fname, cycle](std::vector<hpx::future<void>> &&futs) {
+	/* the leaf data is staged, the solver may continue while it is written */
+	auto previous = in_flight_.empty() ? hpx::make_ready_future<void>().share() : in_flight_.back().write;
+	auto write = previous.then(hpx::launch::async(hpx::threads::thread_priority_boost), [tstart, fname, cycle, hdr](hpx::shared_future<void> &&f) {
+		GET(f);
+		const auto ng = opts().silo_num_groups;
+		std::vector<hpx::future<void>> futs;
+		for (int i = 0; i < ng; i++) {
+			int gb = (i * localities.size()) / ng;
+			int ge = ((i + 1) * localities.size()) / ng;
+			futs.push_back(hpx::async < output_stage3_action > (hpx::launch::async(hpx::threads::thread_priority_boost), localities[gb], fname, cycle, i, gb, ge));
+		}
 		for (auto &f : futs) {
 			GET(f);
 		}
-		output_stage4(fname, cycle);
+		TRACE_SCOPE("output_stage4", trace_io);
+		output_stage4(*hdr, fname, cycle);
 		const auto tstop = time(NULL);
 		printf("Write took %li seconds\n", tstop - tstart);
-	}, std::move(futs));
+	});
+	in_flight_.push_back(output_in_flight_t { write.share(), bytes, fname });
 
 //	block = true;
 	if (block) {
-		GET(barrier);
-		barrier = hpx::make_ready_future<void>();
+		while (!in_flight_.empty()) {
+			GET(in_flight_.front().write);
+			in_flight_.pop_front();
+		}
 	}
 
 }
-
@@ -33,7 +33,8 @@ namespace fmm {
         void p2p_cpu_kernel::apply_stencil(std::vector<real>& local_expansions,
             struct_of_array_data<expansion, real, 20, INNER_CELLS, SOA_PADDING>&
                 potential_expansions_SoA,
-            const std::vector<bool>& stencil_masks, const std::vector<std::array<real, 4>>& four, real dx) {
+            const std::vector<bool>& stencil_masks, const std::vector<std::array<real, 4>>& four, real dx,
+            gsolve_type type) {
                 for (size_t i0 = 0; i0 < INNER_CELLS_PER_DIRECTION; i0++) {
                     for (size_t i1 = 0; i1 < INNER_CELLS_PER_DIRECTION; i1+=2) {
                         // for (size_t i2 = 0; i2 < INNER_CELLS_PER_DIRECTION; i2++) {
@@ -60,12 +61,150 @@ namespace fmm {
 
                             this->cell_interactions(local_expansions, potential_expansions_SoA,
                                 cell_index, cell_flat_index, cell_index_coarse, cell_index_unpadded,
-                                cell_flat_index_unpadded, stencil_masks, four, 0, dx);
+                                cell_flat_index_unpadded, stencil_masks, four, 0, dx, type);
                         }
                     }
                 }
             }
 
+        void p2p_cpu_kernel::apply_stencil_batched(
+            const std::vector<const std::vector<real>*>& mons,
+            const std::vector<struct_of_array_data<expansion, real, 20, INNER_CELLS,
+                SOA_PADDING>*>& potential_expansions_SoA,
+            const std::vector<bool>& stencil_masks, const std::vector<std::array<real, 4>>& four,
+            real dx, gsolve_type type) {
+            for (size_t i0 = 0; i0 < INNER_CELLS_PER_DIRECTION; i0++) {
+                for (size_t i1 = 0; i1 < INNER_CELLS_PER_DIRECTION; i1 += 2) {
+                    for (size_t i2 = 0; i2 < INNER_CELLS_PER_DIRECTION;
+                         i2 += m2m_vector::size()) {
+                        const multiindex<> cell_index(i0 + INNER_CELLS_PADDING_DEPTH,
+                            i1 + INNER_CELLS_PADDING_DEPTH, i2 + INNER_CELLS_PADDING_DEPTH);
+                        const multiindex<> cell_index_unpadded(i0, i1, i2);
+                        const int64_t cell_flat_index_unpadded =
+                            to_inner_flat_index_not_padded(cell_index_unpadded);
+
+                        multiindex<m2m_int_vector> cell_index_coarse(cell_index);
+                        for (size_t j = 0; j < m2m_int_vector::size(); j++) {
+                            cell_index_coarse.z[j] += j;
+                        }
+                        cell_index_coarse.transform_coarse();
+
+                        this->cell_interactions_batched(mons, potential_expansions_SoA,
+                            cell_index, cell_index_coarse, cell_flat_index_unpadded,
+                            stencil_masks, four, dx, type);
+                    }
+                }
+            }
+        }
+
+        void p2p_cpu_kernel::cell_interactions_batched(
+            const std::vector<const std::vector<real>*>& mons,
+            const std::vector<struct_of_array_data<expansion, real, 20, INNER_CELLS,
+                SOA_PADDING>*>& potential_expansions_SoA,
+            const multiindex<>& __restrict__ cell_index,
+            const multiindex<m2m_int_vector>& __restrict__ cell_index_coarse,
+            const size_t cell_flat_index_unpadded, const std::vector<bool>& __restrict__ stencil,
+            const std::vector<std::array<real, 4>>& __restrict__ four_constants, real dx,
+            gsolve_type type) {
+            const size_t batch = mons.size();
+            const m2m_vector d_components[2] = {1.0 / dx, -1.0 / sqr(dx)};
+            m2m_vector tmpstore1[P2P_MAX_BATCH][4];
+            m2m_vector tmpstore2[P2P_MAX_BATCH][4];
+            for (size_t b = 0; b < batch; b++) {
+                tmpstore1[b][0] = potential_expansions_SoA[b]->value<0>(cell_flat_index_unpadded);
+                tmpstore1[b][1] = potential_expansions_SoA[b]->value<1>(cell_flat_index_unpadded);
+                tmpstore1[b][2] = potential_expansions_SoA[b]->value<2>(cell_flat_index_unpadded);
+                tmpstore1[b][3] = potential_expansions_SoA[b]->value<3>(cell_flat_index_unpadded);
+                tmpstore2[b][0] =
+                    potential_expansions_SoA[b]->value<0>(cell_flat_index_unpadded + INX);
+                tmpstore2[b][1] =
+                    potential_expansions_SoA[b]->value<1>(cell_flat_index_unpadded + INX);
+                tmpstore2[b][2] =
+                    potential_expansions_SoA[b]->value<2>(cell_flat_index_unpadded + INX);
+                tmpstore2[b][3] =
+                    potential_expansions_SoA[b]->value<3>(cell_flat_index_unpadded + INX);
+            }
+
+            for (int stencil_x = STENCIL_MIN; stencil_x <= STENCIL_MAX; stencil_x++) {
+                int x = stencil_x - STENCIL_MIN;
+                for (int stencil_y = STENCIL_MIN; stencil_y <= STENCIL_MAX; stencil_y++) {
+                    int y = stencil_y - STENCIL_MIN;
+                    for (int stencil_z = STENCIL_MIN; stencil_z <= STENCIL_MAX; stencil_z++) {
+                        const size_t index = x * STENCIL_INX * STENCIL_INX + y * STENCIL_INX + (stencil_z - STENCIL_MIN);
+                        if (!stencil[index]) {
+                            continue;
+                        }
+
+                        const multiindex<> interaction_partner_index(cell_index.x + stencil_x,
+                            cell_index.y + stencil_y, cell_index.z + stencil_z);
+                        const multiindex<> interaction_partner_index2(cell_index.x + stencil_x,
+                            cell_index.y + stencil_y + 1, cell_index.z + stencil_z);
+                        const size_t interaction_partner_flat_index =
+                            to_flat_index_padded(interaction_partner_index);
+
+                        multiindex<m2m_int_vector> interaction_partner_index_coarse(
+                            interaction_partner_index);
+                        multiindex<m2m_int_vector> interaction_partner_index_coarse2(
+                            interaction_partner_index2);
+                        interaction_partner_index_coarse.z += offset_vector;
+                        interaction_partner_index_coarse2.z += offset_vector;
+                        interaction_partner_index_coarse.transform_coarse();
+                        interaction_partner_index_coarse2.transform_coarse();
+
+                        const m2m_vector theta_c_rec_squared = Vc::simd_cast<m2m_vector>(
+                            detail::distance_squared_reciprocal(
+                                cell_index_coarse, interaction_partner_index_coarse));
+                        const m2m_vector theta_c_rec_squared2 = Vc::simd_cast<m2m_vector>(
+                            detail::distance_squared_reciprocal(
+                                cell_index_coarse, interaction_partner_index_coarse2));
+
+                        const m2m_vector::mask_type mask = theta_rec_squared > theta_c_rec_squared;
+                        const m2m_vector::mask_type mask2 = theta_rec_squared > theta_c_rec_squared2;
+                        if (Vc::none_of(mask) && Vc::none_of(mask2)) {
+                            continue;
+                        }
+
+                        const m2m_vector four[4] = {four_constants[index][0],
+                            four_constants[index][1], four_constants[index][2],
+                            four_constants[index][3]};
+
+                        for (size_t b = 0; b < batch; b++) {
+                            const real* partner = mons[b]->data() + interaction_partner_flat_index;
+                            m2m_vector monopole;
+                            Vc::where(mask, monopole) = m2m_vector(partner);
+                            m2m_vector monopole2;
+                            Vc::where(mask2, monopole2) =
+                                m2m_vector(partner + INX + 2 * STENCIL_MAX);
+                            // DRHODT only uses the potential at the leaves (dphi_dt = G * L())
+                            if (type == RHO) {
+                                compute_monopole_interaction<m2m_vector>(
+                                    monopole, tmpstore1[b], four, d_components);
+                                compute_monopole_interaction<m2m_vector>(
+                                    monopole2, tmpstore2[b], four, d_components);
+                            } else {
+                                compute_monopole_potential<m2m_vector>(
+                                    monopole, tmpstore1[b], four, d_components);
+                                compute_monopole_potential<m2m_vector>(
+                                    monopole2, tmpstore2[b], four, d_components);
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (size_t b = 0; b < batch; b++) {
+                auto& L = *potential_expansions_SoA[b];
+                tmpstore1[b][0].store(L.pointer<0>(cell_flat_index_unpadded));
+                tmpstore1[b][1].store(L.pointer<1>(cell_flat_index_unpadded));
+                tmpstore1[b][2].store(L.pointer<2>(cell_flat_index_unpadded));
+                tmpstore1[b][3].store(L.pointer<3>(cell_flat_index_unpadded));
+                tmpstore2[b][0].store(L.pointer<0>(cell_flat_index_unpadded + INX));
+                tmpstore2[b][1].store(L.pointer<1>(cell_flat_index_unpadded + INX));
+                tmpstore2[b][2].store(L.pointer<2>(cell_flat_index_unpadded + INX));
+                tmpstore2[b][3].store(L.pointer<3>(cell_flat_index_unpadded + INX));
+            }
+        }
+
         void p2p_cpu_kernel::cell_interactions(
             std::vector<real>& mons,
             struct_of_array_data<expansion, real, 20, INNER_CELLS,
@@ -77,7 +216,7 @@ namespace fmm {
             const size_t cell_flat_index_unpadded,
             const std::vector<bool>& __restrict__ stencil,
             const std::vector<std::array<real, 4>>& __restrict__ four_constants,
-            const size_t outer_stencil_index, real dx) {
+            const size_t outer_stencil_index, real dx, gsolve_type type) {
 
             const m2m_vector d_components[2] = {1.0 / dx, -1.0 / sqr(dx)};
             m2m_vector tmpstore1[4];
@@ -161,8 +300,14 @@ namespace fmm {
                             four_constants[index][2],
                             four_constants[index][3]};
 
-                        compute_monopole_interaction<m2m_vector>(monopole, tmpstore1, four, d_components);
-                        compute_monopole_interaction<m2m_vector>(monopole2, tmpstore2, four, d_components);
+                        // DRHODT only uses the potential at the leaves (dphi_dt = G * L())
+                        if (type == RHO) {
+                            compute_monopole_interaction<m2m_vector>(monopole, tmpstore1, four, d_components);
+                            compute_monopole_interaction<m2m_vector>(monopole2, tmpstore2, four, d_components);
+                        } else {
+                            compute_monopole_potential<m2m_vector>(monopole, tmpstore1, four, d_components);
+                            compute_monopole_potential<m2m_vector>(monopole2, tmpstore2, four, d_components);
+                        }
                     }
                 }
             }
@@ -3,18 +3,69 @@
 //  Distributed under the Boost Software License, Version 1.0. (See accompanying
 //  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
+#include "octotiger/buffer_pool.hpp"
 #include "octotiger/common_kernel/interactions_iterators.hpp"
+#include "octotiger/common_kernel/kernel_batch.hpp"
 #include "octotiger/monopole_interactions/calculate_stencil.hpp"
 #include "octotiger/monopole_interactions/p2p_interaction_interface.hpp"
+#include "octotiger/future.hpp"
 #include "octotiger/options.hpp"
 
+#include <hpx/include/lcos.hpp>
+
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstddef>
+#include <memory>
 #include <vector>
 
 namespace octotiger {
 namespace fmm {
     namespace monopole_interactions {
+        namespace {
+            using potential_type =
+                struct_of_array_data<expansion, real, 20, INNER_CELLS, SOA_PADDING>;
+
+            /// Runs one batch of the queue below on the calling thread
+            void run_p2p_batch(const std::vector<p2p_batch_item*>& batch) {
+                using clock = std::chrono::steady_clock;
+                /* reused by every batch that runs on this worker, the kernel accumulates into them */
+                static thread_local std::vector<std::unique_ptr<potential_type>> buffers;
+                /* the batched kernel does not skip empty neighbors */
+                static thread_local std::vector<bool> neighbor_empty(27, false);
+                static thread_local p2p_cpu_kernel kernel(neighbor_empty);
+                const auto start = clock::now();
+                while (buffers.size() < batch.size()) {
+                    buffers.emplace_back(new potential_type);
+                }
+                std::vector<const std::vector<real>*> mons(batch.size());
+                std::vector<potential_type*> potentials(batch.size());
+                for (std::size_t i = 0; i < batch.size(); i++) {
+                    mons[i] = &batch[i]->monopoles;
+                    potentials[i] = buffers[i].get();
+                    potentials[i]->clear();
+                }
+                kernel.apply_stencil_batched(mons, potentials,
+                    p2p_interaction_interface::stencil_masks(),
+                    p2p_interaction_interface::stencil_four_constants(), batch[0]->dx,
+                    batch[0]->type);
+                for (std::size_t i = 0; i < batch.size(); i++) {
+                    potentials[i]->to_non_SoA(batch[i]->grid_ptr->get_L());
+                }
+                const double share =
+                    std::chrono::duration<double>(clock::now() - start).count() / batch.size();
+                for (auto* b : batch) {
+                    b->kernel_share = share;
+                }
+            }
+
+            kernel_batch_queue<p2p_batch_item>& batch_queue() {
+                static kernel_batch_queue<p2p_batch_item> queue(run_p2p_batch);
+                return queue;
+            }
+        }    // namespace
+
         size_t& p2p_interaction_interface::cpu_launch_counter()
         {
             static thread_local size_t cpu_launch_counter_ = 0;
@@ -69,10 +120,46 @@ namespace fmm {
             std::vector<neighbor_gravity_type>& neighbors, gsolve_type type, real dx,
             std::array<bool, geo::direction::count()>& is_direction_empty) {
             cpu_launch_counter()++;
+            other_grids_time_ = 0.0;
+            if (p2p_type == interaction_kernel_type::SOA_CPU && opts().p2p_batch_size > 1) {
+                compute_interactions_batched(monopoles, neighbors, type, dx);
+                return;
+            }
             update_input(monopoles, neighbors, type, local_monopoles_staging_area);
             compute_interactions(type, is_direction_empty, neighbors, dx);
         }
 
+        void p2p_interaction_interface::compute_interactions_batched(
+            std::vector<real>& monopoles, std::vector<neighbor_gravity_type>& neighbors,
+            gsolve_type type, real dx) {
+            using clock = std::chrono::steady_clock;
+            const std::size_t max_batch =
+                std::min(std::size_t(opts().p2p_batch_size), P2P_MAX_BATCH);
+
+            const auto call_start = clock::now();
+            /* the input waits in the queue while this thread is free for other work */
+            batch_item_.monopoles = buffer_pool<real>::get(ENTRIES);
+            update_input(monopoles, neighbors, type, batch_item_.monopoles);
+            batch_item_.grid_ptr = grid_ptr;
+            batch_item_.dx = dx;
+            batch_item_.type = type;
+            batch_item_.kernel_share = 0.0;
+            batch_item_.done = hpx::lcos::local::promise<void>();
+            auto done = batch_item_.done.get_future();
+            const auto staged = clock::now();
+            batch_queue().submit(batch_item_, max_batch);
+            GET(done);
+            buffer_pool<real>::recycle(std::move(batch_item_.monopoles));
+            /* the caller charges the whole call to its sub-grid, which is only right for the
+             * staging and this sub-grid's share of the batch it ran in */
+            const double call_time =
+                std::chrono::duration<double>(clock::now() - call_start).count();
+            const double own_time =
+                std::chrono::duration<double>(staged - call_start).count() +
+                batch_item_.kernel_share;
+            other_grids_time_ = std::max(0.0, call_time - own_time);
+        }
+
         void p2p_interaction_interface::compute_interactions(gsolve_type type,
             std::array<bool, geo::direction::count()>& is_direction_empty,
             std::vector<neighbor_gravity_type>& all_neighbor_interaction_data, real dx) {
@@ -81,7 +168,7 @@ namespace fmm {
                     potential_expansions_SoA;
                 kernel_monopoles.apply_stencil(
                     local_monopoles_staging_area, potential_expansions_SoA,
-                    stencil_masks(), stencil_four_constants(), dx);
+                    stencil_masks(), stencil_four_constants(), dx, type);
                 potential_expansions_SoA.to_non_SoA(grid_ptr->get_L());
             } else {
                 grid_ptr->compute_interactions(type);
@@ -41,6 +41,7 @@ namespace octotiger { namespace fmm { namespace multipole_interactions {
         }
         else
         {    // run on cuda device
+            other_grids_time_ = 0.0;
             if (type == RHO)
                 cuda_launch_counter()++;
             else
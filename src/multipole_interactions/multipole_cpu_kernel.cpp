@@ -82,6 +82,168 @@ namespace fmm {
                 }
             }
         }
+        void multipole_cpu_kernel::apply_stencil_batched(
+            const std::vector<const struct_of_array_data<expansion, real, 20, ENTRIES,
+                SOA_PADDING>*>& local_expansions_SoA,
+            const std::vector<const struct_of_array_data<space_vector, real, 3, ENTRIES,
+                SOA_PADDING>*>& center_of_masses_SoA,
+            const std::vector<struct_of_array_data<expansion, real, 20, INNER_CELLS,
+                SOA_PADDING>*>& potential_expansions_SoA,
+            const std::vector<struct_of_array_data<space_vector, real, 3, INNER_CELLS,
+                SOA_PADDING>*>& angular_corrections_SoA,
+            const std::vector<const std::vector<real>*>& mons, const two_phase_stencil& stencil,
+            gsolve_type type) {
+            const size_t batch_size = local_expansions_SoA.size();
+            size_t partner_flat_index[STENCIL_BLOCKING];
+            m2m_vector::mask_type partner_mask[STENCIL_BLOCKING];
+            m2m_vector::mask_type partner_mask_phase_one[STENCIL_BLOCKING];
+            for (size_t outer_stencil_index = 0;
+                 outer_stencil_index < stencil.stencil_elements.size();
+                 outer_stencil_index += STENCIL_BLOCKING) {
+                for (size_t i0 = 0; i0 < INNER_CELLS_PER_DIRECTION; i0++) {
+                    for (size_t i1 = 0; i1 < INNER_CELLS_PER_DIRECTION; i1++) {
+                        for (size_t i2 = 0; i2 < INNER_CELLS_PER_DIRECTION;
+                             i2 += m2m_vector::size()) {
+                            const multiindex<> cell_index(i0 + INNER_CELLS_PADDING_DEPTH,
+                                i1 + INNER_CELLS_PADDING_DEPTH, i2 + INNER_CELLS_PADDING_DEPTH);
+                            const int64_t cell_flat_index = to_flat_index_padded(cell_index);
+                            const multiindex<> cell_index_unpadded(i0, i1, i2);
+                            const int64_t cell_flat_index_unpadded =
+                                to_inner_flat_index_not_padded(cell_index_unpadded);
+
+                            multiindex<m2m_int_vector> cell_index_coarse(cell_index);
+                            for (size_t j = 0; j < m2m_int_vector::size(); j++) {
+                                cell_index_coarse.z[j] += j;
+                            }
+                            cell_index_coarse.transform_coarse();
+
+                            // opening criterion of this block, shared by the whole batch
+                            size_t partners = 0;
+                            for (size_t inner_stencil_index = 0;
+                                 inner_stencil_index < STENCIL_BLOCKING &&
+                                 outer_stencil_index + inner_stencil_index <
+                                     stencil.stencil_elements.size();
+                                 inner_stencil_index += 1) {
+                                const bool phase_one = stencil.stencil_phase_indicator
+                                    [outer_stencil_index + inner_stencil_index];
+                                const multiindex<>& stencil_element =
+                                    stencil.stencil_elements[outer_stencil_index +
+                                        inner_stencil_index];
+                                const multiindex<> interaction_partner_index(
+                                    cell_index.x + stencil_element.x,
+                                    cell_index.y + stencil_element.y,
+                                    cell_index.z + stencil_element.z);
+
+                                multiindex<m2m_int_vector> interaction_partner_index_coarse(
+                                    interaction_partner_index);
+                                interaction_partner_index_coarse.z += offset_vector;
+                                interaction_partner_index_coarse.transform_coarse();
+
+                                m2m_int_vector theta_c_rec_squared_int =
+                                    detail::distance_squared_reciprocal(
+                                        cell_index_coarse, interaction_partner_index_coarse);
+                                m2m_vector theta_c_rec_squared =
+                                    Vc::simd_cast<m2m_vector>(theta_c_rec_squared_int);
+                                const m2m_vector::mask_type mask =
+                                    theta_rec_squared > theta_c_rec_squared;
+                                if (Vc::none_of(mask)) {
+                                    continue;
+                                }
+                                partner_flat_index[partners] =
+                                    to_flat_index_padded(interaction_partner_index);
+                                partner_mask[partners] = mask;
+                                partner_mask_phase_one[partners] =
+                                    mask & m2m_vector::mask_type(phase_one);
+                                partners++;
+                            }
+                            if (partners == 0) {
+                                continue;
+                            }
+
+                            for (size_t b = 0; b < batch_size; b++) {
+                                this->batched_interaction(type == RHO, *local_expansions_SoA[b],
+                                    *center_of_masses_SoA[b], *potential_expansions_SoA[b],
+                                    *angular_corrections_SoA[b], *mons[b], cell_flat_index,
+                                    cell_flat_index_unpadded, partner_flat_index, partner_mask,
+                                    partner_mask_phase_one, partners);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        void multipole_cpu_kernel::batched_interaction(bool rho,
+            const struct_of_array_data<expansion, real, 20, ENTRIES,
+                SOA_PADDING>& __restrict__ local_expansions_SoA,
+            const struct_of_array_data<space_vector, real, 3, ENTRIES,
+                SOA_PADDING>& __restrict__ center_of_masses_SoA,
+            struct_of_array_data<expansion, real, 20, INNER_CELLS,
+                SOA_PADDING>& __restrict__ potential_expansions_SoA,
+            struct_of_array_data<space_vector, real, 3, INNER_CELLS,
+                SOA_PADDING>& __restrict__ angular_corrections_SoA,
+            const std::vector<real>& mons, const size_t cell_flat_index,
+            const size_t cell_flat_index_unpadded, const size_t* partner_flat_index,
+            const m2m_vector::mask_type* partner_mask,
+            const m2m_vector::mask_type* partner_mask_phase_one, const size_t partners) {
+            m2m_vector X[3];
+            for (size_t d = 0; d < 3; d++) {
+                X[d] = center_of_masses_SoA.value(d, cell_flat_index);
+            }
+            m2m_vector tmpstore[20];
+            m2m_vector tmp_corrections[3];
+            m2m_vector m_cell[20];
+            if (rho) {
+                for (size_t c = 0; c < 20; c++) {
+                    m_cell[c] = local_expansions_SoA.value(c, cell_flat_index);
+                }
+            }
+
+            for (size_t p = 0; p < partners; p++) {
+                const size_t interaction_partner_flat_index = partner_flat_index[p];
+                m2m_vector Y[3];
+                for (size_t d = 0; d < 3; d++) {
+                    Y[d] = center_of_masses_SoA.value(d, interaction_partner_flat_index);
+                }
+                m2m_vector m_partner[20];
+                Vc::where(partner_mask[p], m_partner[0]) =
+                    m2m_vector(mons.data() + interaction_partner_flat_index);
+                const m2m_vector::mask_type& mask = partner_mask_phase_one[p];
+                Vc::where(mask, m_partner[0]) =
+                    m_partner[0] + local_expansions_SoA.value(0, interaction_partner_flat_index);
+                for (size_t c = 1; c < 20; c++) {
+                    Vc::where(mask, m_partner[c]) =
+                        local_expansions_SoA.value(c, interaction_partner_flat_index);
+                }
+
+                if (rho) {
+                    compute_kernel_rho(X, Y, m_partner, tmpstore, tmp_corrections, m_cell,
+                        [](const m2m_vector& one, const m2m_vector& two) -> m2m_vector {
+                            return Vc::max(one, two);
+                        });
+                } else {
+                    compute_kernel_non_rho(X, Y, m_partner, tmpstore,
+                        [](const m2m_vector& one, const m2m_vector& two) -> m2m_vector {
+                            return Vc::max(one, two);
+                        });
+                }
+            }
+
+            for (size_t c = 0; c < 20; c++) {
+                tmpstore[c] = tmpstore[c] +
+                    potential_expansions_SoA.value(c, cell_flat_index_unpadded);
+                tmpstore[c].store(potential_expansions_SoA.pointer(c, cell_flat_index_unpadded));
+            }
+            if (rho) {
+                for (size_t d = 0; d < 3; d++) {
+                    tmp_corrections[d] = tmp_corrections[d] +
+                        angular_corrections_SoA.value(d, cell_flat_index_unpadded);
+                    tmp_corrections[d].store(
+                        angular_corrections_SoA.pointer(d, cell_flat_index_unpadded));
+                }
+            }
+        }
+
         void multipole_cpu_kernel::apply_stencil_non_blocked(const struct_of_array_data<expansion, real, 20, ENTRIES,
                                    SOA_PADDING>& local_expansions_SoA,
                 const struct_of_array_data<space_vector, real, 3, ENTRIES, SOA_PADDING>&
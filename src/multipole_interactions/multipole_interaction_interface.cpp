@@ -8,11 +8,19 @@
 #include "octotiger/multipole_interactions/multipole_cpu_kernel.hpp"
 
 #include "octotiger/common_kernel/interactions_iterators.hpp"
+#include "octotiger/common_kernel/kernel_batch.hpp"
 
+#include "octotiger/future.hpp"
 #include "octotiger/options.hpp"
 
+#include <hpx/synchronization/spinlock.hpp>
+
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 // Big picture questions:
@@ -21,6 +29,93 @@
 namespace octotiger {
 namespace fmm {
     namespace multipole_interactions {
+        namespace {
+            using expansions_type = struct_of_array_data<expansion, real, 20, ENTRIES, SOA_PADDING>;
+            using masses_type = struct_of_array_data<space_vector, real, 3, ENTRIES, SOA_PADDING>;
+            using potential_type =
+                struct_of_array_data<expansion, real, 20, INNER_CELLS, SOA_PADDING>;
+            using corrections_type =
+                struct_of_array_data<space_vector, real, 3, INNER_CELLS, SOA_PADDING>;
+
+            /// Input of one sub-grid while it waits in the batch queue
+            struct multipole_staging
+            {
+                std::vector<real> monopoles = std::vector<real>(ENTRIES);
+                expansions_type local_expansions;
+                masses_type center_of_masses;
+            };
+
+            /* one staging area per sub-grid that is queued at the same time, kept for the next
+             * solve */
+            hpx::lcos::local::spinlock staging_mtx;
+            std::vector<std::unique_ptr<multipole_staging>> free_staging;
+
+            std::unique_ptr<multipole_staging> get_staging() {
+                {
+                    std::lock_guard<hpx::lcos::local::spinlock> lock(staging_mtx);
+                    if (!free_staging.empty()) {
+                        auto staging = std::move(free_staging.back());
+                        free_staging.pop_back();
+                        return staging;
+                    }
+                }
+                return std::unique_ptr<multipole_staging>(new multipole_staging);
+            }
+
+            void recycle_staging(std::unique_ptr<multipole_staging> staging) {
+                std::lock_guard<hpx::lcos::local::spinlock> lock(staging_mtx);
+                free_staging.push_back(std::move(staging));
+            }
+
+            /// Runs one batch of the queue below on the calling thread
+            void run_multipole_batch(const std::vector<multipole_batch_item*>& batch) {
+                using clock = std::chrono::steady_clock;
+                /* reused by every batch that runs on this worker, the kernel accumulates into them */
+                static thread_local std::vector<std::unique_ptr<potential_type>> potential_buffers;
+                static thread_local std::vector<std::unique_ptr<corrections_type>>
+                    correction_buffers;
+                const auto start = clock::now();
+                while (potential_buffers.size() < batch.size()) {
+                    potential_buffers.emplace_back(new potential_type);
+                    correction_buffers.emplace_back(new corrections_type);
+                }
+                std::vector<const expansions_type*> expansions(batch.size());
+                std::vector<const masses_type*> masses(batch.size());
+                std::vector<potential_type*> potentials(batch.size());
+                std::vector<corrections_type*> corrections(batch.size());
+                std::vector<const std::vector<real>*> mons(batch.size());
+                for (std::size_t i = 0; i < batch.size(); i++) {
+                    expansions[i] = batch[i]->local_expansions;
+                    masses[i] = batch[i]->center_of_masses;
+                    mons[i] = batch[i]->monopoles;
+                    potentials[i] = potential_buffers[i].get();
+                    corrections[i] = correction_buffers[i].get();
+                    potentials[i]->clear();
+                    corrections[i]->clear();
+                }
+                const gsolve_type type = batch[0]->type;
+                multipole_cpu_kernel kernel;
+                kernel.apply_stencil_batched(expansions, masses, potentials, corrections, mons,
+                    multipole_interaction_interface::stencil(), type);
+                for (std::size_t i = 0; i < batch.size(); i++) {
+                    if (type == RHO) {
+                        corrections[i]->to_non_SoA(batch[i]->grid_ptr->get_L_c());
+                    }
+                    potentials[i]->add_to_non_SoA(batch[i]->grid_ptr->get_L());
+                }
+                const double share =
+                    std::chrono::duration<double>(clock::now() - start).count() / batch.size();
+                for (auto* b : batch) {
+                    b->kernel_share = share;
+                }
+            }
+
+            kernel_batch_queue<multipole_batch_item>& batch_queue() {
+                static kernel_batch_queue<multipole_batch_item> queue(run_multipole_batch);
+                return queue;
+            }
+        }    // namespace
+
         size_t& multipole_interaction_interface::cpu_launch_counter()
         {
             static thread_local size_t cpu_launch_counter_ = 0;
@@ -74,6 +169,7 @@ namespace fmm {
         multipole_interaction_interface::multipole_interaction_interface() {
             local_monopoles_staging_area = std::vector<real>(ENTRIES);
             this->m2m_type = opts().m2m_kernel_type;
+            this->blocked_stencil = opts().multipole_blocked_stencil;
         }
 
         void multipole_interaction_interface::compute_multipole_interactions(
@@ -86,6 +182,12 @@ namespace fmm {
                 cpu_launch_counter()++;
             else
                 cpu_launch_counter_non_rho()++;
+            other_grids_time_ = 0.0;
+            if (m2m_type == interaction_kernel_type::SOA_CPU && blocked_stencil &&
+                opts().multipole_batch_size > 1) {
+                compute_interactions_batched(monopoles, M_ptr, com_ptr, neighbors, type, dx, xbase);
+                return;
+            }
             update_input(monopoles, M_ptr, com_ptr, neighbors, type, dx, xbase,
                 local_monopoles_staging_area, local_expansions_staging_area,
                 center_of_masses_staging_area);
@@ -93,6 +195,41 @@ namespace fmm {
                 local_expansions_staging_area, center_of_masses_staging_area);
         }
 
+        void multipole_interaction_interface::compute_interactions_batched(
+            std::vector<real>& monopoles, std::vector<multipole>& M_ptr,
+            std::vector<std::shared_ptr<std::vector<space_vector>>>& com_ptr,
+            std::vector<neighbor_gravity_type>& neighbors, gsolve_type type, real dx,
+            std::array<real, NDIM> xbase) {
+            using clock = std::chrono::steady_clock;
+            const std::size_t max_batch =
+                std::min(std::size_t(opts().multipole_batch_size), MULTIPOLE_MAX_BATCH);
+
+            const auto call_start = clock::now();
+            /* the input waits in the queue while this thread is free for other work */
+            auto staging = get_staging();
+            update_input(monopoles, M_ptr, com_ptr, neighbors, type, dx, xbase,
+                staging->monopoles, staging->local_expansions, staging->center_of_masses);
+            batch_item_.monopoles = &staging->monopoles;
+            batch_item_.local_expansions = &staging->local_expansions;
+            batch_item_.center_of_masses = &staging->center_of_masses;
+            batch_item_.grid_ptr = grid_ptr;
+            batch_item_.type = type;
+            batch_item_.kernel_share = 0.0;
+            batch_item_.done = hpx::lcos::local::promise<void>();
+            auto done = batch_item_.done.get_future();
+            const auto staged = clock::now();
+            batch_queue().submit(batch_item_, max_batch);
+            GET(done);
+            recycle_staging(std::move(staging));
+            /* same accounting as the batched p2p call */
+            const double call_time =
+                std::chrono::duration<double>(clock::now() - call_start).count();
+            const double own_time =
+                std::chrono::duration<double>(staged - call_start).count() +
+                batch_item_.kernel_share;
+            other_grids_time_ = std::max(0.0, call_time - own_time);
+        }
+
         void multipole_interaction_interface::compute_interactions(
             std::array<bool, geo::direction::count()>& is_direction_empty,
             std::vector<neighbor_gravity_type>& all_neighbor_interaction_data,
@@ -108,10 +245,16 @@ namespace fmm {
                     angular_corrections_SoA;
 
                 multipole_cpu_kernel kernel;
-                kernel.apply_stencil_non_blocked(local_expansions_SoA,
-                    center_of_masses_SoA, potential_expansions_SoA,
-                    angular_corrections_SoA, local_monopoles, stencil_masks(),
-                    inner_stencil_masks(), type);
+                if (blocked_stencil) {
+                    kernel.apply_stencil(local_expansions_SoA, center_of_masses_SoA,
+                        potential_expansions_SoA, angular_corrections_SoA, local_monopoles,
+                        stencil(), type);
+                } else {
+                    kernel.apply_stencil_non_blocked(local_expansions_SoA,
+                        center_of_masses_SoA, potential_expansions_SoA,
+                        angular_corrections_SoA, local_monopoles, stencil_masks(),
+                        inner_stencil_masks(), type);
+                }
 
                 if (type == RHO) {
                     angular_corrections_SoA.to_non_SoA(grid_ptr->get_L_c());
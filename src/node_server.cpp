@@ -3,6 +3,7 @@
 //  Distributed under the Boost Software License, Version 1.0. (See accompanying
 //  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
+#include "octotiger/buffer_pool.hpp"
 #include "octotiger/defs.hpp"
 #include "octotiger/future.hpp"
 #include "octotiger/node_registry.hpp"
@@ -29,6 +30,13 @@ HPX_REGISTER_COMPONENT(hpx::components::managed_component<node_server>, node_ser
 
 hpx::mutex node_server::node_count_mtx;
 node_count_type node_server::cumulative_node_count;
+node_count_type node_server::locality_load_;
+std::vector<node_location> node_server::regrid_changes_;
+std::vector<node_location> node_server::relink_changes_;
+std::map<std::array<integer, NDIM + 2>, std::vector<std::size_t>> node_server::relink_index_;
+std::vector<bool> node_server::relink_levels_;
+bool node_server::relink_incremental_(false);
+integer node_server::finest_level_(-1);
 bool node_server::static_initialized(false);
 std::atomic<integer> node_server::static_initializing(0);
 
@@ -69,6 +77,36 @@ real node_server::get_rotation_count() const {
 	return current_time;
 }
 
+/* bounds of the faces of face that border the niece in quadrant */
+static void niece_face_bounds(const geo::face &f, const geo::quadrant &quadrant, std::array<integer, NDIM> &lb, std::array<integer, NDIM> &ub) {
+	switch (f.get_dimension()) {
+	case XDIM:
+		lb[XDIM] = f.get_side() == geo::MINUS ? 0 : INX;
+		lb[YDIM] = quadrant.get_side(0) * (INX / 2);
+		lb[ZDIM] = quadrant.get_side(1) * (INX / 2);
+		ub[XDIM] = lb[XDIM] + 1;
+		ub[YDIM] = lb[YDIM] + (INX / 2);
+		ub[ZDIM] = lb[ZDIM] + (INX / 2);
+		break;
+	case YDIM:
+		lb[XDIM] = quadrant.get_side(0) * (INX / 2);
+		lb[YDIM] = f.get_side() == geo::MINUS ? 0 : INX;
+		lb[ZDIM] = quadrant.get_side(1) * (INX / 2);
+		ub[XDIM] = lb[XDIM] + (INX / 2);
+		ub[YDIM] = lb[YDIM] + 1;
+		ub[ZDIM] = lb[ZDIM] + (INX / 2);
+		break;
+	case ZDIM:
+		lb[XDIM] = quadrant.get_side(0) * (INX / 2);
+		lb[YDIM] = quadrant.get_side(1) * (INX / 2);
+		lb[ZDIM] = f.get_side() == geo::MINUS ? 0 : INX;
+		ub[XDIM] = lb[XDIM] + (INX / 2);
+		ub[YDIM] = lb[YDIM] + (INX / 2);
+		ub[ZDIM] = lb[ZDIM] + 1;
+		break;
+	}
+}
+
 future<void> node_server::exchange_flux_corrections() {
 	const geo::octant ci = my_location.get_child_index();
 	constexpr auto full_set = geo::face::full_set();
@@ -103,32 +141,7 @@ future<void> node_server::exchange_flux_corrections() {
 				/*hpx::util::annotated_function(*/[this, f, quadrant](future<std::vector<real> > &&fdata) -> void {
 					const auto face_dim = f.get_dimension();
 					std::array<integer, NDIM> lb, ub;
-					switch (face_dim) {
-						case XDIM:
-						lb[XDIM] = f.get_side() == geo::MINUS ? 0 : INX;
-						lb[YDIM] = quadrant.get_side(0) * (INX / 2);
-						lb[ZDIM] = quadrant.get_side(1) * (INX / 2);
-						ub[XDIM] = lb[XDIM] + 1;
-						ub[YDIM] = lb[YDIM] + (INX / 2);
-						ub[ZDIM] = lb[ZDIM] + (INX / 2);
-						break;
-						case YDIM:
-						lb[XDIM] = quadrant.get_side(0) * (INX / 2);
-						lb[YDIM] = f.get_side() == geo::MINUS ? 0 : INX;
-						lb[ZDIM] = quadrant.get_side(1) * (INX / 2);
-						ub[XDIM] = lb[XDIM] + (INX / 2);
-						ub[YDIM] = lb[YDIM] + 1;
-						ub[ZDIM] = lb[ZDIM] + (INX / 2);
-						break;
-						case ZDIM:
-						lb[XDIM] = quadrant.get_side(0) * (INX / 2);
-						lb[YDIM] = quadrant.get_side(1) * (INX / 2);
-						lb[ZDIM] = f.get_side() == geo::MINUS ? 0 : INX;
-						ub[XDIM] = lb[XDIM] + (INX / 2);
-						ub[YDIM] = lb[YDIM] + (INX / 2);
-						ub[ZDIM] = lb[ZDIM] + 1;
-						break;
-					}
+					niece_face_bounds(f, quadrant, lb, ub);
 					grid_ptr->set_flux_restrict(GET(fdata), lb, ub, face_dim);
 				}/*, "node_server::exchange_flux_corrections::set_flux_restrict")*/);
 			}
@@ -142,13 +155,59 @@ future<void> node_server::exchange_flux_corrections() {
 	});
 }
 
-void node_server::all_hydro_bounds() {
+/* Sends the flux sums at the faces to coarser leaves and clears them, and refluxes the faces to finer leaves with
+ * theirs, see subcycled_step */
+void node_server::exchange_flux_sums(bool send, bool receive) {
+	const geo::octant ci = my_location.get_child_index();
+	if (send) {
+		for (auto &f : geo::face::full_set()) {
+			const auto face_dim = f.get_dimension();
+			auto const &this_aunt = aunts[f];
+			if (!this_aunt.empty()) {
+				std::array<integer, NDIM> lb, ub;
+				lb[XDIM] = lb[YDIM] = lb[ZDIM] = 0;
+				ub[XDIM] = ub[YDIM] = ub[ZDIM] = INX;
+				lb[face_dim] = f.get_side() == geo::MINUS ? 0 : INX;
+				ub[face_dim] = lb[face_dim] + 1;
+				auto data = grid_ptr->get_flux_sum_restrict(lb, ub, face_dim);
+				this_aunt.send_hydro_flux_correct(std::move(data), f.flip(), ci);
+				grid_ptr->clear_flux_sum(f);
+			}
+		}
+	}
+	if (!receive) {
+		return;
+	}
+	for (auto const &f : geo::face::full_set()) {
+		if (this->nieces[f] == +1) {
+			for (auto const &quadrant : geo::quadrant::full_set()) {
+				std::array<integer, NDIM> lb, ub;
+				niece_face_bounds(f, quadrant, lb, ub);
+				auto data = [&]() {
+					TRACE_SCOPE("flux_correction_wait", trace_boundary_wait, my_location.to_id(), step_num);
+					return GET(niece_hydro_channels[f][quadrant].get_future());
+				}();
+				grid_ptr->reflux(data, lb, ub, f);
+			}
+		}
+	}
+}
+
+void node_server::all_hydro_bounds(const std::array<real, geo::direction::count()> *theta) {
 	exchange_interlevel_hydro_data();
-	collect_hydro_boundaries();
+	collect_hydro_boundaries(false, theta);
 	send_hydro_amr_boundaries();
 	++hcycle;
 }
 
+node_server::hydro_exchange node_server::start_hydro_bounds() {
+	exchange_interlevel_hydro_data();
+	auto ex = exchange_hydro_boundaries(false);
+	send_hydro_amr_boundaries();
+	++hcycle;
+	return ex;
+}
+
 void node_server::energy_hydro_bounds() {
 	exchange_interlevel_hydro_data();
 	collect_hydro_boundaries(true);
@@ -161,7 +220,10 @@ void node_server::exchange_interlevel_hydro_data() {
 	if (is_refined) {
 		std::vector<real> outflow(opts().n_fields, ZERO);
 		for (auto const &ci : geo::octant::full_set()) {
-			auto data = GET(child_hydro_channels[ci].get_future(hcycle));
+			auto data = [&]() {
+				TRACE_SCOPE("child_hydro_wait", trace_boundary_wait, my_location.to_id(), step_num);
+				return GET(child_hydro_channels[ci].get_future(hcycle));
+			}();
 			grid_ptr->set_restrict(data, ci);
 			integer fi = 0;
 			for (auto i = data.end() - opts().n_fields; i != data.end(); ++i) {
@@ -178,39 +240,76 @@ void node_server::exchange_interlevel_hydro_data() {
 	}
 }
 
-void node_server::collect_hydro_boundaries(bool energy_only) {
+void node_server::collect_hydro_boundaries(bool energy_only, const std::array<real, geo::direction::count()> *theta) {
+	auto ex = exchange_hydro_boundaries(energy_only, theta);
+	{
+		TRACE_SCOPE("sibling_hydro_wait", trace_boundary_wait, my_location.to_id(), step_num);
+		GET(ex.all);
+	}
+	complete_hydro_boundaries(energy_only);
+}
+
+/* sends the boundaries to the siblings, all is ready once theirs have been written to the ghost zones and the
+ * siblings on this locality, which copy straight from our interior, are done with it */
+node_server::hydro_exchange node_server::exchange_hydro_boundaries(bool energy_only, const std::array<real, geo::direction::count()> *theta) {
 	grid_ptr->clear_amr();
+	std::vector<hpx::shared_future<void>> results;
+	std::array<hpx::shared_future<void>, geo::direction::count()> from_sibling;
 	for (auto const &dir : geo::direction::full_set()) {
 		if (!neighbors[dir].empty()) {
-			const integer width = H_BW;
-			auto bdata = grid_ptr->get_hydro_boundary(dir, energy_only);
+			hydro_boundary_type bdata;
+			/* an interpolated state is not in our interior, it is sent like to a remote sibling */
+			const real dir_theta = theta ? (*theta)[dir] : 1.0;
+			if (neighbors[dir].is_local() && dir_theta == 1.0) {
+				bdata.local_grid = grid_ptr.get();
+				bdata.local_semaphore = &hydro_signals[dir];
+				results.push_back(hydro_signals[dir].get_future());
+			} else {
+				bdata.data = grid_ptr->get_hydro_boundary(dir, energy_only, dir_theta);
+			}
 			neighbors[dir].send_hydro_boundary(std::move(bdata), dir.flip(), hcycle);
 		}
 	}
 
-	std::array<future<void>, geo::direction::count()> results;
-	integer index = 0;
 	for (auto const &dir : geo::direction::full_set()) {
 		if (!(neighbors[dir].empty() && my_location.level() == 0)) {
-			results[index++] = sibling_hydro_channels[dir].get_future(hcycle).then(
+			from_sibling[dir] = sibling_hydro_channels[dir].get_future(hcycle).then(
 			/*hpx::util::annotated_function(*/[this, energy_only, dir](future<sibling_hydro_type> &&f) -> void {
 				auto &&tmp = GET(f);
 				if (!neighbors[dir].empty()) {
-					grid_ptr->set_hydro_boundary(tmp.data, tmp.direction, energy_only);
+					if (tmp.local_grid != nullptr) {
+						grid_ptr->set_hydro_boundary(*tmp.local_grid, tmp.direction, energy_only);
+						tmp.local_semaphore->signal();
+					} else {
+						grid_ptr->set_hydro_boundary(tmp.data, tmp.direction, energy_only);
+						grid::recycle_hydro_buffer(std::move(tmp.data));
+					}
 				} else {
 					grid_ptr->set_hydro_amr_boundary(tmp.data, tmp.direction, energy_only);
 
 				}
 			}/*, "node_server::collect_hydro_boundaries::set_hydro_boundary")*/);
+			results.push_back(from_sibling[dir]);
 		}
 	}
-	while (index < geo::direction::count()) {
-		results[index++] = hpx::make_ready_future();
+	hydro_exchange ex;
+	for (auto const &face : geo::face::full_set()) {
+		const auto dir = face.to_direction();
+		if (!neighbors[dir].empty()) {
+			ex.faces[face] = from_sibling[dir];
+		}
 	}
 //	wait_all_and_propagate_exceptions(std::move(results));
-	for (auto &f : results) {
-		GET(f);
-	}
+	ex.all = hpx::when_all(std::move(results)).then([](future<decltype(results)> fout) {
+		auto fin = GET(fout);
+		for (auto &f : fin) {
+			GET(f);
+		}
+	});
+	return ex;
+}
+
+void node_server::complete_hydro_boundaries(bool energy_only) {
 	grid_ptr->complete_hydro_amr_boundary(energy_only);
 	for (auto &face : geo::face::full_set()) {
 		if (my_location.is_physical_boundary(face)) {
@@ -295,6 +394,8 @@ void node_server::initialize(real t, real rt) {
 	gcycle = hcycle = rcycle = 0;
 	step_num = 0;
 	refinement_flag = 0;
+	regrid_cost = 0.0;
+	subtree_amr_bnd = 0;
 	static_initialize();
 	is_refined = false;
 	neighbors.resize(geo::direction::count());
@@ -335,11 +436,12 @@ node_server::node_server(const node_location &loc, const node_client &parent_id,
 }
 
 node_server::node_server(const node_location &_my_location, integer _step_num, bool _is_refined, real _current_time, real _rotational_time,
-		const std::array<integer, NCHILD> &_child_d, grid _grid, const std::vector<hpx::id_type> &_c, std::size_t _hcycle, std::size_t _rcycle,
-		std::size_t _gcycle, integer position_) {
+		const std::array<node_count_type, NCHILD> &_child_d, grid _grid, const std::vector<hpx::id_type> &_c, std::size_t _hcycle, std::size_t _rcycle,
+		std::size_t _gcycle, integer position_, real regrid_cost_) {
 	my_location = _my_location;
 	initialize(_current_time, _rotational_time);
 	position = position_;
+	regrid_cost = regrid_cost_;
 	hcycle = _hcycle;
 	gcycle = _gcycle;
 	rcycle = _rcycle;
@@ -355,202 +457,255 @@ node_server::node_server(const node_location &_my_location, integer _step_num, b
 	child_descendant_count = _child_d;
 }
 
-void node_server::compute_fmm(gsolve_type type, bool energy_account, bool aonly) {
+/* The solve is a dataflow graph: the multipoles are formed once the children's multipoles have arrived and the
+ * neighbors are done with our previous boundary data, the interactions run once the neighbors' boundaries have
+ * arrived and the expansions once the parent's expansions have arrived. No thread is suspended in between. */
+future<void> node_server::compute_fmm(gsolve_type type, bool energy_account, bool aonly) {
 	if (!opts().gravity) {
-		return;
+		return hpx::make_ready_future();
 	}
 
-	future<void> parent_fut;
 	if (energy_account) {
 		grid_ptr->egas_to_etot();
 	}
-	multipole_pass_type m_out;
-	m_out.first.resize(INX * INX * INX);
-	m_out.second.resize(INX * INX * INX);
+	const std::size_t cycle = gcycle++;
+	auto m_out = std::make_shared<multipole_pass_type>();
 
+	std::vector<future<void>> multipole_futs;
 	for (auto const &dir : geo::direction::full_set()) {
 		if (!neighbors[dir].empty()) {
-			neighbor_signals[dir].wait();
+			multipole_futs.push_back(neighbor_signals[dir].get_future());
 		}
 	}
-
 	if (is_refined) {
-		std::array<future<void>, geo::octant::count()> futs;
-		integer index = 0;
+		m_out->first = buffer_pool<multipole>::get(INX * INX * INX);
+		m_out->second = buffer_pool<space_vector>::get(INX * INX * INX);
 		for (auto &ci : geo::octant::full_set()) {
 			future<multipole_pass_type> m_in_future = child_gravity_channels[ci].get_future();
 
-			futs[index++] = m_in_future.then(/*hpx::util::annotated_function(*/[&m_out, ci](future<multipole_pass_type> &&fut) {
+			multipole_futs.push_back(m_in_future.then(/*hpx::util::annotated_function(*/[m_out, ci](future<multipole_pass_type> &&fut) {
 				const integer x0 = ci.get_side(XDIM) * INX / 2;
 				const integer y0 = ci.get_side(YDIM) * INX / 2;
 				const integer z0 = ci.get_side(ZDIM) * INX / 2;
-				auto m_in = fut.get();
+				auto m_in = GET(fut);
 				for (integer i = 0; i != INX / 2; ++i) {
 					for (integer j = 0; j != INX / 2; ++j) {
 						for (integer k = 0; k != INX / 2; ++k) {
 							const integer ii = i * INX * INX / 4 + j * INX / 2 + k;
 							const integer io = (i + x0) * INX * INX + (j + y0) * INX + k + z0;
-							m_out.first[io] = m_in.first[ii];
-							m_out.second[io] = m_in.second[ii];
+							m_out->first[io] = m_in.first[ii];
+							m_out->second[io] = m_in.second[ii];
 						}
 					}
 				}
-			}/*, "node_server::compute_fmm::gather_from::child_gravity_channels")*/);
+				buffer_pool<multipole>::recycle(std::move(m_in.first));
+				buffer_pool<space_vector>::recycle(std::move(m_in.second));
+			}/*, "node_server::compute_fmm::gather_from::child_gravity_channels")*/));
 		}
-		wait_all_and_propagate_exceptions(std::move(futs));
-		m_out = grid_ptr->compute_multipoles(type, &m_out);
-	} else {
-		m_out = grid_ptr->compute_multipoles(type);
 	}
 
+	std::vector<future<neighbor_gravity_type>> neighbor_futs;
+	for (auto const &dir : geo::direction::full_set()) {
+		if (!neighbors[dir].empty()) {
+			neighbor_futs.push_back(neighbor_gravity_channels[dir].get_future(cycle));
+		}
+	}
+	future<expansion_pass_type> parent_fut;
 	if (my_location.level() != 0) {
-		parent.send_gravity_multipoles(std::move(m_out), my_location.get_child_index());
+		parent_fut = parent_gravity_channel.get_future();
+	} else {
+		parent_fut = hpx::make_ready_future(expansion_pass_type());
 	}
 
-	if (!aonly) {
-		std::vector<future<void>> send_futs;
-		for (auto const &dir : geo::direction::full_set()) {
-			if (!neighbors[dir].empty()) {
-				auto ndir = dir.flip();
-				const bool is_monopole = !is_refined;
-//             const auto gid = neighbors[dir].get_gid();
-				const bool is_local = neighbors[dir].is_local();
-				auto data = grid_ptr->get_gravity_boundary(dir, is_local);
-				if (is_local) {
-					data.local_semaphore = &neighbor_signals[dir];
-				} else {
-					neighbor_signals[dir].signal();
-					data.local_semaphore = nullptr;
+	auto multipoles_fut = hpx::when_all(std::move(multipole_futs)).then(
+			[this, type, aonly, cycle, m_out](future<std::vector<future<void>>> &&fout) {
+				auto fin = GET(fout);
+				for (auto &f : fin) {
+					GET(f);
+				}
+				{
+					timings::scope ts(timings_, timings::time_node_fmm);
+					TRACE_SCOPE("compute_multipoles", trace_fmm, my_location.to_id(), step_num);
+					auto mret = is_refined ? grid_ptr->compute_multipoles(type, m_out.get()) : grid_ptr->compute_multipoles(type);
+					buffer_pool<multipole>::recycle(std::move(m_out->first));
+					buffer_pool<space_vector>::recycle(std::move(m_out->second));
+					*m_out = std::move(mret);
 				}
-				neighbors[dir].send_gravity_boundary(std::move(data), ndir, is_monopole, gcycle);
+
+				if (my_location.level() != 0) {
+					parent.send_gravity_multipoles(std::move(*m_out), my_location.get_child_index());
+				}
+
+				if (!aonly) {
+					for (auto const &dir : geo::direction::full_set()) {
+						if (!neighbors[dir].empty()) {
+							auto ndir = dir.flip();
+							const bool is_monopole = !is_refined;
+							const bool is_local = neighbors[dir].is_local();
+							auto data = grid_ptr->get_gravity_boundary(dir, is_local);
+							if (is_local) {
+								data.local_semaphore = &neighbor_signals[dir];
+							} else {
+								neighbor_signals[dir].signal();
+								data.local_semaphore = nullptr;
+							}
+							neighbors[dir].send_gravity_boundary(std::move(data), ndir, is_monopole, cycle);
+						}
+					}
+				}
+			});
+
+	auto interactions_fut = hpx::dataflow([this, type](future<void> &&mfut, future<std::vector<future<neighbor_gravity_type>>> &&nfut) {
+		GET(mfut);
+		auto nin = GET(nfut);
+
+		/****************************************************************************/
+		// data managemenet for old and new version of interaction computation
+		// all neighbors and placeholder for yourself
+		bool contains_multipole = false;
+		std::vector<neighbor_gravity_type> all_neighbor_interaction_data;
+		std::size_t n = 0;
+		for (geo::direction const &dir : geo::direction::full_set()) {
+			if (!neighbors[dir].empty()) {
+				all_neighbor_interaction_data.push_back(GET(nin[n]));
+				++n;
+				if (!all_neighbor_interaction_data[dir].is_monopole)
+					contains_multipole = true;
+			} else {
+				all_neighbor_interaction_data.emplace_back();
 			}
 		}
-	}
 
-	/****************************************************************************/
-	// data managemenet for old and new version of interaction computation
-	// all neighbors and placeholder for yourself
-	bool contains_multipole = false;
-	std::vector<neighbor_gravity_type> all_neighbor_interaction_data;
-	for (geo::direction const &dir : geo::direction::full_set()) {
-		if (!neighbors[dir].empty()) {
-			all_neighbor_interaction_data.push_back(neighbor_gravity_channels[dir].get_future(gcycle).get());
-			if (!all_neighbor_interaction_data[dir].is_monopole)
-				contains_multipole = true;
-		} else {
-			all_neighbor_interaction_data.emplace_back();
+		std::array<bool, geo::direction::count()> is_direction_empty;
+		for (geo::direction const &dir : geo::direction::full_set()) {
+			if (neighbors[dir].empty()) {
+				is_direction_empty[dir] = true;
+			} else {
+				is_direction_empty[dir] = false;
+			}
 		}
-	}
 
-	std::array<bool, geo::direction::count()> is_direction_empty;
-	for (geo::direction const &dir : geo::direction::full_set()) {
-		if (neighbors[dir].empty()) {
-			is_direction_empty[dir] = true;
+		bool new_style_enabled = true;
+		hpx::util::high_resolution_timer interaction_timer;
+		/***************************************************************************/
+		// new-style interaction calculation (both cannot be active at the same time)
+		//if (new_style_enabled && !grid_ptr->get_leaf() && !grid_ptr->get_root()) {
+		if (new_style_enabled && !grid_ptr->get_root()) {
+
+			// Get all input structures we need as input
+			std::vector<multipole> &M_ptr = grid_ptr->get_M();
+			std::vector<real> &mon_ptr = grid_ptr->get_mon();
+			std::vector<std::shared_ptr<std::vector<space_vector>>> &com_ptr = grid_ptr->get_com_ptr();
+
+			// initialize to zero
+			std::vector<expansion> &L = grid_ptr->get_L();
+			std::vector<space_vector> &L_c = grid_ptr->get_L_c();
+			std::fill(std::begin(L), std::end(L), ZERO);
+			std::fill(std::begin(L_c), std::end(L_c), ZERO);
+
+			// Check if we are a multipole
+			if (!grid_ptr->get_leaf()) {
+				// Input structure, needed for multipole-monopole interactions
+				std::array<real, NDIM> Xbase = { grid_ptr->get_X()[0][hindex(H_BW, H_BW, H_BW)], grid_ptr->get_X()[1][hindex(H_BW, H_BW, H_BW)],
+						grid_ptr->get_X()[2][hindex(H_BW, H_BW, H_BW)] };
+				// Make sure we have the right pointer
+				multipole_interactor.set_grid_ptr(grid_ptr);
+				TRACE_SCOPE("multipole_interactions", trace_fmm_multipole, my_location.to_id(), step_num);
+				// Run unified multipole-multipole multipole-monopole FMM interaction kernel
+				// This will be either run on a cuda device or the cpu (depending on build type and
+				// device load)
+				multipole_interactor.compute_multipole_interactions(mon_ptr, M_ptr, com_ptr, all_neighbor_interaction_data, type, grid_ptr->get_dx(),
+						is_direction_empty, Xbase);
+			} else { // ... we are a monopole
+				TRACE_SCOPE("monopole_interactions", trace_fmm_monopole, my_location.to_id(), step_num);
+				p2p_interactor.set_grid_ptr(grid_ptr);
+				p2p_interactor.compute_p2p_interactions(mon_ptr, all_neighbor_interaction_data, type, grid_ptr->get_dx(), is_direction_empty);
+				if (contains_multipole) {
+					p2m_interactor.set_grid_ptr(grid_ptr);
+					p2m_interactor.compute_p2m_interactions(mon_ptr, M_ptr, com_ptr, all_neighbor_interaction_data, type, is_direction_empty);
+				}
+			}
 		} else {
-			is_direction_empty[dir] = false;
+			// old-style interaction calculation
+			// computes inner interactions
+			grid_ptr->compute_interactions(type);
+			// waits for boundary data and then computes boundary interactions
+			for (auto const &dir : geo::direction::full_set()) {
+				if (!is_direction_empty[dir]) {
+					neighbor_gravity_type &neighbor_data = all_neighbor_interaction_data[dir];
+					grid_ptr->compute_boundary_interactions(type, neighbor_data.direction, neighbor_data.is_monopole, neighbor_data.data);
+				}
+			}
 		}
-	}
 
-	bool new_style_enabled = true;
-	/***************************************************************************/
-	// new-style interaction calculation (both cannot be active at the same time)
-	//if (new_style_enabled && !grid_ptr->get_leaf() && !grid_ptr->get_root()) {
-	if (new_style_enabled && !grid_ptr->get_root()) {
-
-		// Get all input structures we need as input
-		std::vector<multipole> &M_ptr = grid_ptr->get_M();
-		std::vector<real> &mon_ptr = grid_ptr->get_mon();
-		std::vector<std::shared_ptr<std::vector<space_vector>>> &com_ptr = grid_ptr->get_com_ptr();
-
-		// initialize to zero
-		std::vector<expansion> &L = grid_ptr->get_L();
-		std::vector<space_vector> &L_c = grid_ptr->get_L_c();
-		std::fill(std::begin(L), std::end(L), ZERO);
-		std::fill(std::begin(L_c), std::end(L_c), ZERO);
-
-		// Check if we are a multipole
+		/* a batched call also runs the kernel for other sub-grids, which charge their own share */
+		real batched_elsewhere = 0.0;
 		if (!grid_ptr->get_leaf()) {
-			// Input structure, needed for multipole-monopole interactions
-			std::array<real, NDIM> Xbase = { grid_ptr->get_X()[0][hindex(H_BW, H_BW, H_BW)], grid_ptr->get_X()[1][hindex(H_BW, H_BW, H_BW)],
-					grid_ptr->get_X()[2][hindex(H_BW, H_BW, H_BW)] };
-			// Make sure we have the right pointer
-			multipole_interactor.set_grid_ptr(grid_ptr);
-			// Run unified multipole-multipole multipole-monopole FMM interaction kernel
-			// This will be either run on a cuda device or the cpu (depending on build type and
-			// device load)
-			multipole_interactor.compute_multipole_interactions(mon_ptr, M_ptr, com_ptr, all_neighbor_interaction_data, type, grid_ptr->get_dx(),
-					is_direction_empty, Xbase);
-		} else { // ... we are a monopole
-			p2p_interactor.set_grid_ptr(grid_ptr);
-			p2p_interactor.compute_p2p_interactions(mon_ptr, all_neighbor_interaction_data, type, grid_ptr->get_dx(), is_direction_empty);
-			if (contains_multipole) {
-				p2m_interactor.set_grid_ptr(grid_ptr);
-				p2m_interactor.compute_p2m_interactions(mon_ptr, M_ptr, com_ptr, all_neighbor_interaction_data, type, is_direction_empty);
-			}
-		}
-	} else {
-		// old-style interaction calculation
-		// computes inner interactions
-		grid_ptr->compute_interactions(type);
-		// waits for boundary data and then computes boundary interactions
-		for (auto const &dir : geo::direction::full_set()) {
-			if (!is_direction_empty[dir]) {
-				neighbor_gravity_type &neighbor_data = all_neighbor_interaction_data[dir];
-				grid_ptr->compute_boundary_interactions(type, neighbor_data.direction, neighbor_data.is_monopole, neighbor_data.data);
-			}
+			batched_elsewhere = multipole_interactor.other_grids_time();
+		} else if (!grid_ptr->get_root()) {
+			batched_elsewhere = p2p_interactor.other_grids_time();
 		}
-	}
+		timings_.times_[timings::time_node_fmm] += interaction_timer.elapsed() - batched_elsewhere;
 
-	/**************************************************************************/
-	// now that all boundary information has been processed, signal all non-empty neighbors
-	// note that this was done before during boundary calculations
-	for (auto const &dir : geo::direction::full_set()) {
+		/**************************************************************************/
+		// now that all boundary information has been processed, signal all non-empty neighbors
+		// note that this was done before during boundary calculations
+		for (auto const &dir : geo::direction::full_set()) {
 
-		if (!neighbors[dir].empty()) {
-			neighbor_gravity_type &neighbor_data = all_neighbor_interaction_data[dir];
-			if (neighbor_data.data.local_semaphore != nullptr) {
-				neighbor_data.data.local_semaphore->signal();
+			if (!neighbors[dir].empty()) {
+				neighbor_gravity_type &neighbor_data = all_neighbor_interaction_data[dir];
+				if (neighbor_data.data.local_semaphore != nullptr) {
+					neighbor_data.data.local_semaphore->signal();
+				}
 			}
 		}
-	}
+	}, std::move(multipoles_fut), hpx::when_all(std::move(neighbor_futs)));
 	/***************************************************************************/
 
-	expansion_pass_type l_in;
-	if (my_location.level() != 0) {
-		l_in = parent_gravity_channel.get_future().get();
-	}
-	const expansion_pass_type ltmp = grid_ptr->compute_expansions(type, my_location.level() == 0 ? nullptr : &l_in);
-
-	if (is_refined) {
-		for (auto const &ci : geo::octant::full_set()) {
-			expansion_pass_type l_out;
-			l_out.first.resize(INX * INX * INX / NCHILD);
-			if (type == RHO) {
-				l_out.second.resize(INX * INX * INX / NCHILD);
-			}
-			const integer x0 = ci.get_side(XDIM) * INX / 2;
-			const integer y0 = ci.get_side(YDIM) * INX / 2;
-			const integer z0 = ci.get_side(ZDIM) * INX / 2;
-			for (integer i = 0; i != INX / 2; ++i) {
-				for (integer j = 0; j != INX / 2; ++j) {
-					for (integer k = 0; k != INX / 2; ++k) {
-						const integer io = i * INX * INX / 4 + j * INX / 2 + k;
-						const integer ii = (i + x0) * INX * INX + (j + y0) * INX + k + z0;
-						l_out.first[io] = ltmp.first[ii];
-						if (type == RHO) {
-							l_out.second[io] = ltmp.second[ii];
+	return hpx::dataflow([this, type, energy_account](future<void> &&ifut, future<expansion_pass_type> &&lfut) {
+		GET(ifut);
+		expansion_pass_type l_in = GET(lfut);
+		hpx::util::high_resolution_timer expansion_timer;
+		expansion_pass_type ltmp = [&]() {
+			TRACE_SCOPE("compute_expansions", trace_fmm, my_location.to_id(), step_num);
+			return grid_ptr->compute_expansions(type, my_location.level() == 0 ? nullptr : &l_in);
+		}();
+		timings_.times_[timings::time_node_fmm] += expansion_timer.elapsed();
+		buffer_pool<expansion>::recycle(std::move(l_in.first));
+		buffer_pool<space_vector>::recycle(std::move(l_in.second));
+
+		if (is_refined) {
+			for (auto const &ci : geo::octant::full_set()) {
+				expansion_pass_type l_out;
+				l_out.first = buffer_pool<expansion>::get(INX * INX * INX / NCHILD);
+				if (type == RHO) {
+					l_out.second = buffer_pool<space_vector>::get(INX * INX * INX / NCHILD);
+				}
+				const integer x0 = ci.get_side(XDIM) * INX / 2;
+				const integer y0 = ci.get_side(YDIM) * INX / 2;
+				const integer z0 = ci.get_side(ZDIM) * INX / 2;
+				for (integer i = 0; i != INX / 2; ++i) {
+					for (integer j = 0; j != INX / 2; ++j) {
+						for (integer k = 0; k != INX / 2; ++k) {
+							const integer io = i * INX * INX / 4 + j * INX / 2 + k;
+							const integer ii = (i + x0) * INX * INX + (j + y0) * INX + k + z0;
+							l_out.first[io] = ltmp.first[ii];
+							if (type == RHO) {
+								l_out.second[io] = ltmp.second[ii];
+							}
 						}
 					}
 				}
+				children[ci].send_gravity_expansions(std::move(l_out));
 			}
-			children[ci].send_gravity_expansions(std::move(l_out));
+			buffer_pool<expansion>::recycle(std::move(ltmp.first));
+			buffer_pool<space_vector>::recycle(std::move(ltmp.second));
 		}
-	}
 
-	if (energy_account) {
-		grid_ptr->etot_to_egas();
-	}
-	++gcycle;
+		if (energy_account) {
+			grid_ptr->etot_to_egas();
+		}
+	}, std::move(interactions_fut), std::move(parent_fut));
 }
 
 void node_server::report_timing() {
@@ -26,6 +26,8 @@
 #include <array>
 #include <chrono>
 #include <fstream>
+#include <limits>
+#include <utility>
 #include <vector>
 
 using amr_error_action_type = node_server::amr_error_action;
@@ -54,6 +56,37 @@ std::pair<real, real> node_server::amr_error() {
 	return sum;
 }
 
+using level_timesteps_action_type = node_server::level_timesteps_action;
+HPX_REGISTER_ACTION(level_timesteps_action_type);
+
+future<std::vector<std::pair<real, integer>>> node_client::level_timesteps() const {
+	return hpx::async<typename node_server::level_timesteps_action>(get_unmanaged_gid());
+}
+
+std::vector<std::pair<real, integer>> node_server::level_timesteps() {
+	std::vector<std::pair<real, integer>> levels;
+	if (is_refined) {
+		std::vector<hpx::future<std::vector<std::pair<real, integer>>>> kfuts;
+		for (int i = 0; i < NCHILD; i++) {
+			kfuts.push_back(children[i].level_timesteps());
+		}
+		for (auto &f : kfuts) {
+			const auto tmp = GET(f);
+			if (tmp.size() > levels.size()) {
+				levels.resize(tmp.size(), std::make_pair(std::numeric_limits<real>::max(), integer(0)));
+			}
+			for (std::size_t l = 0; l < tmp.size(); l++) {
+				levels[l].first = std::min(levels[l].first, tmp[l].first);
+				levels[l].second += tmp[l].second;
+			}
+		}
+	} else {
+		levels.resize(my_location.level() + 1, std::make_pair(std::numeric_limits<real>::max(), integer(0)));
+		levels[my_location.level()] = std::make_pair(local_dt_, integer(1));
+	}
+	return levels;
+}
+
 using regrid_gather_action_type = node_server::regrid_gather_action;
 HPX_REGISTER_ACTION(regrid_gather_action_type);
 
@@ -64,15 +97,38 @@ future<node_count_type> node_client::regrid_gather(bool rb) const {
 
 
 node_count_type node_server::regrid_gather(bool rebalance_only) {
-	node_registry::delete_(my_location);
+	if (!opts().incremental_regrid || rebalance_only) {
+		node_registry::delete_(my_location);
+	}
 	node_count_type count;
 	count.total = 1;
 	count.leaf = is_refined ? 0 : 1;
+	count.finest_level = my_location.level();
+	regrid_cost = 0.0;
+	if (opts().cost_load_balance) {
+		auto &t = timings_.times_;
+		regrid_cost = t[timings::time_node_hydro] + t[timings::time_node_fmm] + t[timings::time_node_radiation];
+	}
+	timings_.times_[timings::time_node_hydro] = 0.0;
+	timings_.times_[timings::time_node_fmm] = 0.0;
+	timings_.times_[timings::time_node_radiation] = 0.0;
+	if (regrid_cost > 0.0) {
+		count.cost = regrid_cost;
+		count.measured = 1;
+	}
+	/* summed per locality for compute_load_balance, which only asks for it in this case */
+	if (opts().cost_load_balance && options::all_localities.size() > 1) {
+		std::lock_guard<hpx::mutex> lock(node_count_mtx);
+		locality_load_.total++;
+		locality_load_.cost += count.cost;
+		locality_load_.measured += count.measured;
+	}
 	std::vector<hpx::future<void>> kfuts;
 	if (is_refined) {
 		if (!rebalance_only) {
 			/* Turning refinement off */
 			if (refinement_flag == 0) {
+				record_regrid_change(my_location);
 				for (int i = 0; i < NCHILD; i++) {
 					kfuts.push_back(children[i].kill());
 				}
@@ -91,14 +147,17 @@ node_count_type node_server::regrid_gather(bool rebalance_only) {
 			for (auto const &ci : geo::octant::full_set()) {
 				const auto child_cnt = futi->get();
 				++futi;
-				child_descendant_count[ci] = child_cnt.total;
+				child_descendant_count[ci] = child_cnt;
 				count.leaf += child_cnt.leaf;
 				count.total += child_cnt.total;
+				count.cost += child_cnt.cost;
+				count.measured += child_cnt.measured;
+				count.finest_level = std::max(count.finest_level, child_cnt.finest_level);
 			}
 		} else {
 			count.leaf = 1;
 			for (auto const &ci : geo::octant::full_set()) {
-				child_descendant_count[ci] = 0;
+				child_descendant_count[ci] = node_count_type();
 			}
 		}
 	} else if (!rebalance_only) {
@@ -106,14 +165,22 @@ node_count_type node_server::regrid_gather(bool rebalance_only) {
 			refinement_flag = 0;
 			count.total += NCHILD;
 			count.leaf += NCHILD - 1;
+			count.finest_level = my_location.level() + 1;
 
 			/* Turning refinement on*/
 			is_refined = true;
+			record_regrid_change(my_location);
 
 			for (auto &ci : geo::octant::full_set()) {
-				child_descendant_count[ci] = 1;
-
+				node_count_type child_cnt;
+				child_cnt.total = child_cnt.leaf = 1;
+				/* a new leaf does the same work as this node did as a leaf */
+				child_cnt.cost = count.cost;
+				child_cnt.measured = count.measured;
+				child_descendant_count[ci] = child_cnt;
 			}
+			count.cost *= NCHILD + 1;
+			count.measured *= NCHILD + 1;
 		}
 	}
 	grid_ptr->set_leaf(!is_refined);
@@ -121,6 +188,134 @@ node_count_type node_server::regrid_gather(bool rebalance_only) {
 	return count;
 }
 
+node_count_type node_server::locality_load() {
+	std::lock_guard<hpx::mutex> lock(node_count_mtx);
+	const auto rc = locality_load_;
+	locality_load_ = node_count_type();
+	return rc;
+}
+
+HPX_PLAIN_ACTION(node_server::locality_load, locality_load_action);
+
+void node_server::reset_locality_load() {
+	std::lock_guard<hpx::mutex> lock(node_count_mtx);
+	locality_load_ = node_count_type();
+}
+
+HPX_PLAIN_ACTION(node_server::reset_locality_load, reset_locality_load_action);
+
+void node_server::record_regrid_change(const node_location &loc) {
+	if (opts().incremental_regrid) {
+		std::lock_guard<hpx::mutex> lock(node_count_mtx);
+		regrid_changes_.push_back(loc);
+	}
+}
+
+std::vector<node_location> node_server::regrid_changes() {
+	std::lock_guard<hpx::mutex> lock(node_count_mtx);
+	std::vector<node_location> rc;
+	std::swap(rc, regrid_changes_);
+	return rc;
+}
+
+HPX_PLAIN_ACTION(node_server::regrid_changes, regrid_changes_action);
+
+void node_server::set_finest_level(integer level) {
+	finest_level_ = level;
+}
+
+HPX_PLAIN_ACTION(node_server::set_finest_level, set_finest_level_action);
+
+/* A node has to be relinked if it is within its own or the changed node's width of a node that was
+ * refined, derefined or moved. This covers the neighbors, nieces and aunts of the changed node, and
+ * since a child never lies further from a change than its parent, the set is closed towards the root.
+ * Such a change lies within two nodes of this node on the level of the coarser of the two, so only the
+ * changes indexed there under the 5^3 neighborhood are tested. */
+bool node_server::needs_relink() const {
+	if (!relink_incremental_) {
+		return true;
+	}
+	const auto r = my_location.abs_range();
+	const int w = r[XDIM].second - r[XDIM].first;
+	const auto close = [&](const std::vector<std::size_t> &candidates) {
+		for (const auto i : candidates) {
+			const auto rc = relink_changes_[i].abs_range();
+			const int wc = rc[XDIM].second - rc[XDIM].first;
+			int dist = 0;
+			for (int d = 0; d < NDIM; d++) {
+				dist = std::max(dist, std::max(rc[d].first - r[d].second, r[d].first - rc[d].second));
+			}
+			if (dist < w + wc) {
+				return true;
+			}
+		}
+		return false;
+	};
+	const auto near = [&](integer level, integer kind) {
+		const integer shift = my_location.level() - level;
+		std::array<integer, NDIM + 2> key;
+		key[0] = level;
+		key[1] = kind;
+		for (integer i = -2; i <= 2; ++i) {
+			key[2] = (my_location[XDIM] >> shift) + i;
+			for (integer j = -2; j <= 2; ++j) {
+				key[3] = (my_location[YDIM] >> shift) + j;
+				for (integer k = -2; k <= 2; ++k) {
+					key[4] = (my_location[ZDIM] >> shift) + k;
+					const auto it = relink_index_.find(key);
+					if (it != relink_index_.end() && close(it->second)) {
+						return true;
+					}
+				}
+			}
+		}
+		return false;
+	};
+	/* changes on this level or coarser, around the ancestor of this node on their level */
+	for (integer level = 0; level <= my_location.level() && level < integer(relink_levels_.size()); ++level) {
+		if (relink_levels_[level] && near(level, 0)) {
+			return true;
+		}
+	}
+	/* finer changes, around this node through their ancestor on this level */
+	return near(my_location.level(), 1);
+}
+
+/* Called on every locality between regrid_scatter and form_tree. Nodes that form_tree will relink
+ * lose their old family here, so that no aunt is left over from the previous tree. */
+void node_server::prepare_relink(bool incremental, std::vector<node_location> changes) {
+	relink_incremental_ = incremental;
+	relink_changes_ = std::move(changes);
+	relink_index_.clear();
+	relink_levels_.clear();
+	for (std::size_t i = 0; i != relink_changes_.size(); ++i) {
+		const auto &loc = relink_changes_[i];
+		if (integer(relink_levels_.size()) <= loc.level()) {
+			relink_levels_.resize(loc.level() + 1, false);
+		}
+		relink_levels_[loc.level()] = true;
+		for (integer level = 0; level <= loc.level(); ++level) {
+			const integer shift = loc.level() - level;
+			relink_index_[ { level, level == loc.level() ? 0 : 1, loc[XDIM] >> shift, loc[YDIM] >> shift, loc[ZDIM] >> shift }].push_back(i);
+		}
+	}
+	if (incremental) {
+		std::vector<future<node_server*>> futs;
+		futs.reserve(node_registry::size());
+		for (auto i = node_registry::begin(); i != node_registry::end(); ++i) {
+			futs.push_back(i->second.get_ptr());
+		}
+		for (auto &f : futs) {
+			auto *ptr = GET(f);
+			if (ptr->needs_relink()) {
+				ptr->clear_family();
+			}
+		}
+	}
+}
+
+HPX_PLAIN_ACTION(node_server::prepare_relink, prepare_relink_action);
+
 future<hpx::id_type> node_server::create_child(hpx::id_type const &locality, integer ci) {
 	return hpx::async([ci, this](hpx::id_type const locality) {
 
@@ -178,40 +373,46 @@ future<hpx::id_type> node_server::create_child(hpx::id_type const &locality, int
 using regrid_scatter_action_type = node_server::regrid_scatter_action;
 HPX_REGISTER_ACTION(regrid_scatter_action_type);
 
-future<void> node_client::regrid_scatter(integer a, integer b) const {
-	return hpx::async<typename node_server::regrid_scatter_action>(get_unmanaged_gid(), a, b);
+future<void> node_client::regrid_scatter(integer a, integer b, real c, load_balance_type lb) const {
+	return hpx::async<typename node_server::regrid_scatter_action>(get_unmanaged_gid(), a, b, c, lb);
 }
 
-void node_server::regrid_scatter(integer a_, integer total) {
+/* The children are placed along the space filling curve so that every locality gets an equal share of the
+ * tree's weight. a_ is this node's index and c_ its weight offset along the curve. */
+void node_server::regrid_scatter(integer a_, integer total, real c_, load_balance_type lb) {
 	position = a_;
 	refinement_flag = 0;
 	std::array<future<void>, geo::octant::count()> futs;
 	if (is_refined) {
+		const integer nloc = options::all_localities.size();
 		integer a = a_;
 		++a;
+		real c = c_ + (regrid_cost > 0.0 ? regrid_cost : lb.unmeasured);
 		integer index = 0;
 		for (auto &ci : geo::octant::full_set()) {
-			const integer loc_index = a * options::all_localities.size() / total;
+			const integer loc_index = std::min(integer(c * nloc / lb.total), nloc - 1);
 			const auto child_loc = options::all_localities[loc_index];
 			if (children[ci].empty()) {
-				futs[index++] = create_child(child_loc, ci).then([this, ci, a, total](future<hpx::id_type> &&child) {
+				futs[index++] = create_child(child_loc, ci).then([this, ci, a, total, c, lb](future<hpx::id_type> &&child) {
 					children[ci] = GET(child);
-					GET(children[ci].regrid_scatter(a, total));
+					GET(children[ci].regrid_scatter(a, total, c, lb));
 				});
 			} else {
 				const hpx::id_type id = children[ci].get_gid();
 				integer current_child_id = hpx::naming::get_locality_id_from_gid(id.get_gid());
 				auto current_child_loc = options::all_localities[current_child_id];
-				if (child_loc != current_child_loc) {
-					futs[index++] = children[ci].copy_to_locality(child_loc).then([this, ci, a, total](future<hpx::id_type> &&child) {
+				if (lb.migrate && child_loc != current_child_loc) {
+					record_regrid_change(my_location.get_child(ci));
+					futs[index++] = children[ci].copy_to_locality(child_loc).then([this, ci, a, total, c, lb](future<hpx::id_type> &&child) {
 						children[ci] = GET(child);
-						GET(children[ci].regrid_scatter(a, total));
+						GET(children[ci].regrid_scatter(a, total, c, lb));
 					});
 				} else {
-					futs[index++] = children[ci].regrid_scatter(a, total);
+					futs[index++] = children[ci].regrid_scatter(a, total, c, lb);
 				}
 			}
-			a += child_descendant_count[ci];
+			a += child_descendant_count[ci].total;
+			c += lb.weight(child_descendant_count[ci]);
 		}
 	}
 	if (is_refined) {
@@ -219,11 +420,49 @@ void node_server::regrid_scatter(integer a_, integer total) {
 			GET(f);
 		}
 	}
-	clear_family();
+	if (!lb.incremental) {
+		clear_family();
+	}
+}
+
+/* Weights the partition by the measured kernel time of the nodes. Nodes without timings (new or just
+ * moved) count as the mean measured node. With a positive load_balance_threshold, existing nodes are only
+ * moved when the load of the most loaded locality exceeds the mean by more than the threshold. */
+static load_balance_type compute_load_balance(const node_count_type &tree, bool rebalance_only) {
+	load_balance_type lb;
+	lb.unmeasured = tree.measured > 0 ? tree.cost / real(tree.measured) : 1.0;
+	lb.total = lb.weight(tree);
+	lb.migrate = true;
+	lb.incremental = opts().incremental_regrid && !rebalance_only;
+	const integer nloc = options::all_localities.size();
+	if (!opts().cost_load_balance || nloc == 1) {
+		return lb;
+	}
+	std::vector<future<node_count_type>> futs;
+	futs.reserve(nloc);
+	for (const auto &loc : options::all_localities) {
+		futs.push_back(hpx::async<locality_load_action>(loc));
+	}
+	real max_load = 0.0;
+	real sum_load = 0.0;
+	for (auto &f : futs) {
+		const auto load = lb.weight(GET(f));
+		max_load = std::max(max_load, load);
+		sum_load += load;
+	}
+	if (sum_load > 0.0) {
+		const real imbalance = max_load * nloc / sum_load - 1.0;
+		if (opts().load_balance_threshold > 0.0) {
+			lb.migrate = rebalance_only || imbalance > opts().load_balance_threshold;
+		}
+		printf("load imbalance %f, %s\n", imbalance, lb.migrate ? "migrating nodes" : "placing new nodes only");
+	}
+	return lb;
 }
 
 node_count_type node_server::regrid(const hpx::id_type &root_gid, real omega, real new_floor, bool rb, bool grav_energy_comp) {
 	timings::scope ts(timings_, timings::time_regrid);
+	TRACE_SCOPE("regrid", trace_regrid, my_location.to_id(), step_num);
 	hpx::util::high_resolution_timer timer;
 	assert(grid_ptr != nullptr);
 	printf("-----------------------------------------------\n");
@@ -235,23 +474,65 @@ node_count_type node_server::regrid(const hpx::id_type &root_gid, real omega, re
 	}
 	printf("regridding\n");
 	real tstart = timer.elapsed();
+	if (opts().cost_load_balance && options::all_localities.size() > 1) {
+		std::vector<future<void>> futs;
+		for (const auto &loc : options::all_localities) {
+			futs.push_back(hpx::async<reset_locality_load_action>(loc));
+		}
+		for (auto &f : futs) {
+			GET(f);
+		}
+	}
 	auto a = regrid_gather(rb);
 	real tstop = timer.elapsed();
 	printf("Regridded tree in %f seconds\n", real(tstop - tstart));
 	printf("rebalancing %i nodes with %i leaves\n", int(a.total), int(a.leaf));
 	tstart = timer.elapsed();
-	regrid_scatter(0, a.total);
+	regrid_scatter(0, a.total, 0.0, compute_load_balance(a, rb));
 	tstop = timer.elapsed();
 	printf("Rebalanced tree in %f seconds\n", real(tstop - tstart));
 	assert(grid_ptr != nullptr);
 	tstart = timer.elapsed();
+	if (opts().incremental_regrid) {
+		std::vector<node_location> changes;
+		{
+			std::vector<future<std::vector<node_location>>> futs;
+			for (const auto &loc : options::all_localities) {
+				futs.push_back(hpx::async<regrid_changes_action>(loc));
+			}
+			for (auto &f : futs) {
+				const auto these = GET(f);
+				changes.insert(changes.end(), these.begin(), these.end());
+			}
+		}
+		const bool incremental = !rb;
+		if (incremental) {
+			printf("relinking around %i changed nodes\n", int(changes.size()));
+		}
+		std::vector<future<void>> futs;
+		for (const auto &loc : options::all_localities) {
+			futs.push_back(hpx::async<prepare_relink_action>(loc, incremental, changes));
+		}
+		for (auto &f : futs) {
+			GET(f);
+		}
+	}
+	{
+		std::vector<future<void>> futs;
+		for (const auto &loc : options::all_localities) {
+			futs.push_back(hpx::async<set_finest_level_action>(loc, a.finest_level));
+		}
+		for (auto &f : futs) {
+			GET(f);
+		}
+	}
 	printf("forming tree connections\n");
 	a.amr_bnd = form_tree(hpx::unmanaged(root_gid));
 	printf("%i amr boundaries\n", a.amr_bnd);
 	tstop = timer.elapsed();
 	printf("Formed tree in %f seconds\n", real(tstop - tstart));
 	printf("solving gravity\n");
-	solve_gravity(grav_energy_comp, !opts().output_filename.empty());
+	GET(solve_gravity(grav_energy_comp, !opts().output_filename.empty()));
 	double elapsed = timer.elapsed();
 	printf("regrid done in %f seconds\n---------------------------------------\n", elapsed);
 	return a;
@@ -265,7 +546,8 @@ future<void> node_client::set_aunt(const hpx::id_type &aunt, const geo::face &f)
 }
 
 void node_server::set_aunt(const hpx::id_type &aunt, const geo::face &face) {
-	if (aunts[face].get_gid() != hpx::invalid_id) {
+	/* an incremental regrid may relink a neighbor of a node that kept its aunts */
+	if (aunts[face].get_gid() != hpx::invalid_id && aunts[face].get_gid() != aunt) {
 		printf("AUNT ALREADY SET\n");
 		abort();
 	}
@@ -290,23 +572,21 @@ future<void> node_client::solve_gravity(bool ene, bool aonly) const {
 	return hpx::async<typename node_server::solve_gravity_action>(get_unmanaged_gid(), ene, aonly);
 }
 
-void node_server::solve_gravity(bool ene, bool aonly) {
+future<void> node_server::solve_gravity(bool ene, bool aonly) {
 	if (!opts().gravity) {
-		return;
+		return hpx::make_ready_future();
 	}
-	std::array<future<void>, NCHILD> child_futs;
+	std::vector<future<void>> futs;
 	if (is_refined) {
-		integer index = 0;
-		;
 		for (auto &child : children) {
-			child_futs[index++] = child.solve_gravity(ene, aonly);
+			futs.push_back(child.solve_gravity(ene, aonly));
 		}
 	}
-	compute_fmm(RHO, ene, aonly);
-	if (is_refined) {
-		//	wait_all_and_propagate_exceptions(child_futs);
-		for (auto &f : child_futs) {
+	futs.push_back(compute_fmm(RHO, ene, aonly));
+	return hpx::when_all(std::move(futs)).then(hpx::launch::sync, [](future<std::vector<future<void>>> fout) {
+		auto fin = GET(fout);
+		for (auto &f : fin) {
 			GET(f);
 		}
-	}
+	});
 }
@@ -40,7 +40,9 @@ void node_server::check_for_refinement(real omega, real new_floor) {
 			opts().refinement_floor = new_floor;
 		}
 	}
-	node_registry::delete_(my_location);
+	if (!opts().incremental_regrid) {
+		node_registry::delete_(my_location);
+	}
 	bool rc = false;
 	std::array<future<void>, NCHILD + 1> futs;
 	for (integer i = 0; i != NCHILD + 1; ++i) {
@@ -104,6 +106,19 @@ hpx::future<void> node_client::kill() const {
 }
 
 void node_server::kill() {
+	/* an incremental regrid keeps the registry, so a derefined subtree has to leave it itself */
+	if (opts().incremental_regrid) {
+		node_registry::delete_(my_location);
+		if (is_refined) {
+			std::vector<future<void>> futs;
+			for (auto &child : children) {
+				futs.push_back(child.kill());
+			}
+			for (auto &f : futs) {
+				GET(f);
+			}
+		}
+	}
 	clear_family();
 
 }
@@ -127,7 +142,7 @@ future<hpx::id_type> node_server::copy_to_locality(const hpx::id_type &id) {
 		}
 	}
 	auto rc = hpx::new_<node_server>(id, my_location, step_num, bool(is_refined), current_time, rotational_time, child_descendant_count, std::move(*grid_ptr),
-			cids, std::size_t(hcycle), std::size_t(rcycle), std::size_t(gcycle), position);
+			cids, std::size_t(hcycle), std::size_t(rcycle), std::size_t(gcycle), position, regrid_cost);
 	clear_family();
 	parent = hpx::invalid_id;
 	std::fill(neighbors.begin(), neighbors.end(), hpx::invalid_id);
@@ -253,24 +268,7 @@ const diagnostics_t& diagnostics_t::compute() {
 	return *this;
 }
 
-diagnostics_t node_server::diagnostics() {
-
-	if (opts().disable_diagnostics) {
-		return diagnostics_t();
-	}
-
-	diagnostics_t diags;
-	for (integer i = 1; i != (opts().problem == DWD ? 6 : 2); ++i) {
-//		printf( "%i\n", i );
-		diags.stage = i;
-		diags = diagnostics(diags).compute();
-		if (opts().gravity) {
-			diags.grid_com = grid_ptr->center_of_mass();
-
-		} else {
-			//TODO center of mass for non gravity runs
-		}
-	}
+static void diagnostics_output(const diagnostics_t &diags, real current_time) {
 	if (!diags.failed && !opts().disable_diagnostics) {
 
 		FILE *fp = fopen((opts().data_dir + "binary.dat").c_str(), "at");
@@ -311,23 +309,74 @@ diagnostics_t node_server::diagnostics() {
 	} else {
 		printf("Failed to compute Roche geometry\n");
 	}
+}
+
+diagnostics_t node_server::diagnostics() {
+
+	if (opts().disable_diagnostics) {
+		return diagnostics_t();
+	}
+
+	diagnostics_t diags;
+	for (integer i = 1; i <= diagnostics_t::last_stage(); ++i) {
+//		printf( "%i\n", i );
+		diags.stage = i;
+		diags = diagnostics(diags).compute();
+		if (opts().gravity) {
+			diags.grid_com = grid_ptr->center_of_mass();
+
+		} else {
+			//TODO center of mass for non gravity runs
+		}
+	}
+	diagnostics_output(diags, current_time);
 	return diags;
 }
 
+hpx::future<diagnostics_t> node_server::diagnostics_async() {
+	if (opts().disable_diagnostics) {
+		return hpx::make_ready_future(diagnostics_t());
+	}
+	take_diagnostics_snapshot();
+	space_vector grid_com = 0.0;
+	if (opts().gravity) {
+		grid_com = grid_ptr->center_of_mass();
+	}
+	const real time = current_time;
+	return hpx::async([this, grid_com, time]() {
+		diagnostics_t diags;
+		for (integer i = 1; i <= diagnostics_t::last_stage(); ++i) {
+			diags.stage = i;
+			diags = snapshot_diagnostics(diags).compute();
+			diags.grid_com = grid_com;
+		}
+		GET(hpx::threads::run_as_os_thread([&]() {
+			diagnostics_output(diags, time);
+		}));
+		return diags;
+	});
+}
+
 diagnostics_t node_server::root_diagnostics(const diagnostics_t &diags) {
 	return diags;
 }
 
 diagnostics_t node_server::diagnostics(const diagnostics_t &diags) {
+	/* the hydro state does not change between the stages, the boundaries exchanged in the first one stay valid */
+	const bool exchange = diags.stage == 1;
 	if (is_refined) {
 		auto rc = hpx::async([&]() {
 			return child_diagnostics(diags);
 		});
-		all_hydro_bounds();
+		if (exchange) {
+			all_hydro_bounds();
+		}
 		auto diags = GET(rc);
 		return diags;
 	} else {
-		all_hydro_bounds();
+		if (exchange) {
+			all_hydro_bounds();
+		}
 		return local_diagnostics(diags);
 	}
 }
@@ -343,6 +392,57 @@ diagnostics_t node_server::child_diagnostics(const diagnostics_t &diags) {
 	return std::accumulate(child_sums.begin(), child_sums.end(), sums);
 }
 
+using take_diagnostics_snapshot_action_type = node_server::take_diagnostics_snapshot_action;
+HPX_REGISTER_ACTION(take_diagnostics_snapshot_action_type);
+
+future<void> node_client::take_diagnostics_snapshot() const {
+	return hpx::async<typename node_server::take_diagnostics_snapshot_action>(get_unmanaged_gid());
+}
+
+void node_server::take_diagnostics_snapshot() {
+	if (is_refined) {
+		std::array<future<void>, NCHILD> futs;
+		integer index = 0;
+		for (integer ci = 0; ci != NCHILD; ++ci) {
+			futs[index++] = children[ci].take_diagnostics_snapshot();
+		}
+		all_hydro_bounds();
+		for (auto &f : futs) {
+			GET(f);
+		}
+	} else {
+		all_hydro_bounds();
+		diagnostics_snapshot_ = grid_ptr->diagnostics_snapshot();
+	}
+}
+
+using snapshot_diagnostics_action_type = node_server::snapshot_diagnostics_action;
+HPX_REGISTER_ACTION(snapshot_diagnostics_action_type);
+
+future<diagnostics_t> node_client::snapshot_diagnostics(const diagnostics_t &d) const {
+	return hpx::async<typename node_server::snapshot_diagnostics_action>(get_unmanaged_gid(), d);
+}
+
+diagnostics_t node_server::snapshot_diagnostics(const diagnostics_t &diags) {
+	if (is_refined) {
+		diagnostics_t sums;
+		std::array<future<diagnostics_t>, NCHILD> futs;
+		integer index = 0;
+		for (integer ci = 0; ci != NCHILD; ++ci) {
+			futs[index++] = children[ci].snapshot_diagnostics(diags);
+		}
+		auto child_sums = hpx::util::unwrap(futs);
+		return std::accumulate(child_sums.begin(), child_sums.end(), sums);
+	} else {
+		auto rc = diagnostics_snapshot_->diagnostics(diags);
+		if (diags.stage == diagnostics_t::last_stage()) {
+			grid_ptr->set_roche_lobe(std::move(*diagnostics_snapshot_));
+			diagnostics_snapshot_ = nullptr;
+		}
+		return rc;
+	}
+}
+
 diagnostics_t node_server::local_diagnostics(const diagnostics_t &diags) {
 //	all_hydro_bounds();
 	return grid_ptr->diagnostics(diags);
@@ -433,6 +533,9 @@ bool operator!=(const node_client &nc, const hpx::id_type &id) {
 }
 
 int node_server::form_tree(hpx::id_type self_gid, hpx::id_type parent_gid, std::vector<hpx::id_type> neighbor_gids) {
+	if (!needs_relink()) {
+		return subtree_amr_bnd;
+	}
 	int amr_bnd = 0;
 
 	std::fill(nieces.begin(), nieces.end(), 0);
@@ -515,6 +618,7 @@ int node_server::form_tree(hpx::id_type self_gid, hpx::id_type parent_gid, std::
 			GET(f);
 		}
 	}
+	subtree_amr_bnd = amr_bnd;
 	return amr_bnd;
 }
 
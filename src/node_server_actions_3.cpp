@@ -22,6 +22,8 @@
 #include <algorithm>
 #include <array>
 #include <cstdio>
+#include <limits>
+#include <memory>
 
 using send_gravity_boundary_action_type = node_server::send_gravity_boundary_action;
 HPX_REGISTER_ACTION (send_gravity_boundary_action_type);
@@ -63,14 +65,16 @@ void node_server::recv_gravity_multipoles(multipole_pass_type &&v, const geo::oc
 using send_hydro_boundary_action_type = node_server::send_hydro_boundary_action;
 HPX_REGISTER_ACTION (send_hydro_boundary_action_type);
 
-void node_client::send_hydro_boundary(std::vector<real> &&data, const geo::direction &dir, std::size_t cycle) const {
+void node_client::send_hydro_boundary(hydro_boundary_type &&data, const geo::direction &dir, std::size_t cycle) const {
 	hpx::apply<typename node_server::send_hydro_boundary_action>(get_unmanaged_gid(), std::move(data), dir, cycle);
 }
 
-void node_server::recv_hydro_boundary(std::vector<real> &&bdata, const geo::direction &dir, std::size_t cycle) {
+void node_server::recv_hydro_boundary(hydro_boundary_type &&bdata, const geo::direction &dir, std::size_t cycle) {
 	sibling_hydro_type tmp;
-	tmp.data = std::move(bdata);
+	tmp.data = std::move(bdata.data);
 	tmp.direction = dir;
+	tmp.local_grid = bdata.local_grid;
+	tmp.local_semaphore = bdata.local_semaphore;
 	sibling_hydro_channels[dir].set_value(std::move(tmp), cycle);
 }
 
@@ -78,12 +82,14 @@ using send_hydro_amr_boundary_action_type = node_server::send_hydro_amr_boundary
 HPX_REGISTER_ACTION (send_hydro_amr_boundary_action_type);
 
 void node_client::send_hydro_amr_boundary(std::vector<real> &&data, const geo::direction &dir, std::size_t cycle) const {
-	hpx::apply<typename node_server::send_hydro_amr_boundary_action>(get_unmanaged_gid(), std::move(data), dir, cycle);
+	wire_vector<wire_hydro_amr_boundary> wdata;
+	wdata.data = std::move(data);
+	hpx::apply<typename node_server::send_hydro_amr_boundary_action>(get_unmanaged_gid(), std::move(wdata), dir, cycle);
 }
 
-void node_server::recv_hydro_amr_boundary(std::vector<real> &&bdata, const geo::direction &dir, std::size_t cycle) {
+void node_server::recv_hydro_amr_boundary(wire_vector<wire_hydro_amr_boundary> &&bdata, const geo::direction &dir, std::size_t cycle) {
 	sibling_hydro_type tmp;
-	tmp.data = std::move(bdata);
+	tmp.data = std::move(bdata.data);
 	tmp.direction = dir;
 	sibling_hydro_channels[dir].set_value(std::move(tmp), cycle);
 }
@@ -117,10 +123,12 @@ using send_hydro_flux_correct_action_type = node_server::send_hydro_flux_correct
 HPX_REGISTER_ACTION (send_hydro_flux_correct_action_type);
 
 void node_client::send_hydro_flux_correct(std::vector<real> &&data, const geo::face &face, const geo::octant &ci) const {
-	hpx::apply<typename node_server::send_hydro_flux_correct_action>(get_unmanaged_gid(), std::move(data), face, ci);
+	wire_vector<wire_hydro_flux_correct> wdata;
+	wdata.data = std::move(data);
+	hpx::apply<typename node_server::send_hydro_flux_correct_action>(get_unmanaged_gid(), std::move(wdata), face, ci);
 }
 
-void node_server::recv_hydro_flux_correct(std::vector<real> &&data, const geo::face &face, const geo::octant &ci) {
+void node_server::recv_hydro_flux_correct(wire_vector<wire_hydro_flux_correct> &&data, const geo::face &face, const geo::octant &ci) {
 	const geo::quadrant index(ci, face.get_dimension());
 	if (face >= nieces.size()) {
 		for (integer i = 0; i != 100; ++i) {
@@ -135,7 +143,7 @@ void node_server::recv_hydro_flux_correct(std::vector<real> &&data, const geo::f
 		abort();
 	}
 
-	niece_hydro_channels[face][index].set_value(std::move(data));
+	niece_hydro_channels[face][index].set_value(std::move(data.data));
 }
 
 using line_of_centers_action_type = node_server::line_of_centers_action;
@@ -256,6 +264,34 @@ void line_of_centers_analyze(const line_of_centers_t &loc, real omega, std::pair
 	}
 }
 
+/* Prints the smallest CFL step of the leaves on every level and what subcycling with a factor of two per level would
+ * save. With subcycling the root steps with the smallest dt_l * 2^l and a leaf on level l takes 2^l steps per root step,
+ * without it every leaf takes the global dt. */
+static void level_dt_report(const std::vector<std::pair<real, integer>> &levels, real dt) {
+	real coarse_dt = std::numeric_limits<real>::max();
+	real leaves = 0.0;
+	for (std::size_t l = 0; l < levels.size(); l++) {
+		if (levels[l].second > 0) {
+			coarse_dt = std::min(coarse_dt, levels[l].first * real(1 << l));
+			leaves += levels[l].second;
+		}
+	}
+	real subcycled = 0.0;
+	for (std::size_t l = 0; l < levels.size(); l++) {
+		subcycled += real(levels[l].second) * real(1 << l) / coarse_dt;
+	}
+	const real ratio = leaves > 0.0 ? subcycled * dt / leaves : 1.0;
+	hpx::threads::run_as_os_thread([=]() {
+		printf("Level timesteps:\n");
+		for (std::size_t l = 0; l < levels.size(); l++) {
+			if (levels[l].second > 0) {
+				printf("   level %2i %8i leaves min dt %e\n", int(l), int(levels[l].second), double(levels[l].first));
+			}
+		}
+		printf("   leaf updates with subcycling / without = %e\n", double(ratio));
+	});  // do not wait for output to finish
+}
+
 void node_server::execute_solver(bool scf, node_count_type ngrids) {
 	timings_.times_[timings::time_regrid] = 0.0;
 	timings_.times_[timings::time_fmm] = 0.0;
@@ -301,14 +337,14 @@ void node_server::execute_solver(bool scf, node_count_type ngrids) {
 	node_server *root_ptr = GET(fut_ptr);
 	if (!opts().output_filename.empty()) {
 		diagnostics();
-		solve_gravity(false, false);
+		GET(solve_gravity(false, false));
 		output_all(this, opts().output_filename, output_cnt, false);
 		return;
 	}
 
 	if (opts().stop_step != 0) {
 		printf("Solving gravity\n");
-		solve_gravity(false, false);
+		GET(solve_gravity(false, false));
 		ngrids = regrid(me.get_gid(), grid::get_omega(), -1, false);
 	}
 
@@ -322,12 +358,21 @@ void node_server::execute_solver(bool scf, node_count_type ngrids) {
 	printf("%e %e\n", root_ptr->get_rotation_count(), output_dt);
 
 	real bench_start, bench_stop;
+	hpx::future<diagnostics_t> diags_fut;
 	while (current_time < opts().stop_time) {
 		timings::scope ts(timings_, timings::time_total);
 		if (step_num > opts().stop_step)
 			break;
 		auto time_start = std::chrono::high_resolution_clock::now();
-		auto diags = diagnostics();
+		diagnostics_t diags;
+		if (opts().async_diagnostics && opts().stop_step != 0) {
+			/* those of the previous step, they also hand the Roche lobes back for the output below */
+			if (diags_fut.valid()) {
+				diags = GET(diags_fut);
+			}
+		} else {
+			diags = diagnostics();
+		}
 		if (opts().stop_step == 0) {
 			return;
 		}
@@ -346,6 +391,9 @@ void node_server::execute_solver(bool scf, node_count_type ngrids) {
 			++output_cnt;
 
 		}
+		if (opts().async_diagnostics) {
+			diags_fut = diagnostics_async();
+		}
 		if (step_num == 0) {
 			bench_start = hpx::util::high_resolution_clock::now() / 1e9;
 		}
@@ -410,6 +458,11 @@ void node_server::execute_solver(bool scf, node_count_type ngrids) {
 		step_num = next_step;
 
 		if (step_num % refinement_freq() == 0) {
+			/* the leaves still hold their steps from the tree of this interval */
+			if (opts().level_dt_report) {
+				level_dt_report(GET(level_timesteps()), dt_.dt);
+			}
+
 			real new_floor = opts().refinement_floor;
 			if (opts().ngrids > 0) {
 				new_floor *= std::pow(real(ngrids.total) / real(opts().ngrids), 2);
@@ -417,6 +470,10 @@ void node_server::execute_solver(bool scf, node_count_type ngrids) {
 				printf("New refinement floor = %e\n", new_floor);
 			}
 
+			/* the snapshots belong to the leaves of the current tree */
+			if (diags_fut.valid()) {
+				GET(diags_fut);
+			}
 			ngrids = regrid(me.get_gid(), omega, new_floor, false);
 
 			// run output on separate thread
@@ -444,6 +501,9 @@ void node_server::execute_solver(bool scf, node_count_type ngrids) {
 		}
 	}
 
+	if (diags_fut.valid()) {
+		GET(diags_fut);
+	}
 	bench_stop = hpx::util::high_resolution_clock::now() / 1e9;
 	{
 		timings::scope ts(timings_, timings::time_compare_analytic);
@@ -456,7 +516,7 @@ void node_server::execute_solver(bool scf, node_count_type ngrids) {
 		if (get_analytic() != nullptr) {
 			compare_analytic();
 			if (opts().gravity) {
-				solve_gravity(true, false);
+				GET(solve_gravity(true, false));
 			}
 			if (!opts().disable_output) {
 				output_all(this, "analytic", output_cnt, true);
@@ -504,8 +564,8 @@ void node_server::refined_step() {
 
 		{
 			timings::scope ts(timings_, timings::time_fmm);
-			compute_fmm(DRHODT, false);
-			compute_fmm(RHO, true);
+			GET(compute_fmm(DRHODT, false));
+			GET(compute_fmm(RHO, true));
 		}
 		rk == NRK - 1 ? energy_hydro_bounds() : all_hydro_bounds();
 
@@ -531,7 +591,15 @@ future<void> node_server::nonrefined_step() {
 	real cfl0 = opts().cfl;
 	dt_.dt = ZERO;
 
-	all_hydro_bounds();
+	/* the interior fluxes of a stage do not need the ghost zones, with --overlap_hydro_exchange they are computed
+	 * while the siblings' boundaries are on their way (the face averaging experiment needs the whole sub-grid) */
+	const bool overlap = opts().overlap_hydro_exchange && opts().experiment != 1;
+	auto bounds = std::make_shared<hydro_exchange>();
+	if (overlap) {
+		*bounds = start_hydro_bounds();
+	} else {
+		all_hydro_bounds();
+	}
 
 	grid_ptr->store();
 	future<void> fut = hpx::make_ready_future();
@@ -542,11 +610,70 @@ future<void> node_server::nonrefined_step() {
 
 		fut = fut.then(hpx::launch::async(hpx::threads::thread_priority_boost),
 		//hpx::util::annotated_function(
-				[rk, cfl0, this, dt_fut](future<void> f) {
+				[rk, cfl0, this, overlap, bounds](future<void> f) {
 					GET(f);
-					timestep_t a = grid_ptr->compute_fluxes();
+					timestep_t a;
+					if (overlap) {
+						const auto max_speed = [&a](const timestep_t &b) {
+							if (b.a > a.a) {
+								a = b;
+							}
+						};
+						{
+							timings::scope ts(timings_, timings::time_node_hydro);
+							TRACE_SCOPE("compute_fluxes_interior", trace_hydro, my_location.to_id(), step_num);
+							a = grid_ptr->compute_fluxes(hydro::region::interior);
+						}
+						/* While some ghost zones are still missing, the faces next to a sibling whose boundary has
+						 * arrived are done on their own. Once everything is there one pass over the rest is cheaper,
+						 * the face passes reconstruct part of the interior again */
+						std::vector<hpx::shared_future<void>> pending;
+						std::vector<int> pending_faces;
+						for (int face = 0; face < NFACE; face++) {
+							if (bounds->faces[face].valid()) {
+								pending.push_back(bounds->faces[face]);
+								pending_faces.push_back(face);
+							}
+						}
+						int done = 0;
+						while (!pending.empty() && !bounds->all.is_ready()) {
+							auto any = [&]() {
+								TRACE_SCOPE("sibling_hydro_wait", trace_boundary_wait, my_location.to_id(), step_num);
+								return GET(hpx::when_any(pending));
+							}();
+							const auto index = any.index;
+							GET(any.futures[index]);
+							if (bounds->all.is_ready()) {
+								break;
+							}
+							const int face = pending_faces[index];
+							pending.erase(pending.begin() + index);
+							pending_faces.erase(pending_faces.begin() + index);
+							timings::scope ts(timings_, timings::time_node_hydro);
+							TRACE_SCOPE("compute_fluxes_face", trace_hydro, my_location.to_id(), step_num);
+							max_speed(grid_ptr->compute_fluxes(hydro::region::face_of(face)));
+							done |= 1 << face;
+						}
+						{
+							TRACE_SCOPE("sibling_hydro_wait", trace_boundary_wait, my_location.to_id(), step_num);
+							GET(bounds->all);
+						}
+						complete_hydro_boundaries(false);
+						{
+							timings::scope ts(timings_, timings::time_node_hydro);
+							TRACE_SCOPE("compute_fluxes_boundary", trace_hydro, my_location.to_id(), step_num);
+							max_speed(grid_ptr->compute_fluxes(hydro::region::boundary_without(done)));
+						}
+					} else {
+						timings::scope ts(timings_, timings::time_node_hydro);
+						TRACE_SCOPE("compute_fluxes", trace_hydro, my_location.to_id(), step_num);
+						a = grid_ptr->compute_fluxes();
+					}
 					future<void> fut_flux = exchange_flux_corrections();
-					fut_flux.get();
+					{
+						TRACE_SCOPE("flux_correction_wait", trace_boundary_wait, my_location.to_id(), step_num);
+						fut_flux.get();
+					}
 //					a = std::max(a, grid_ptr->compute_positivity_speed_limit());
 					if (rk == 0) {
 						const real dx = TWO * grid::get_scaling_factor() / real(INX << my_location.level());
@@ -556,18 +683,42 @@ future<void> node_server::nonrefined_step() {
 							const real maxdt = (opts().stop_time - current_time) / (refinement_freq() - (step_num % refinement_freq()));
 							dt_.dt = std::min(dt_.dt, maxdt);
 						}
+						local_dt_ = dt_.dt;
 						local_timestep_channels[NCHILD].set_value(dt_);
 					}
-					grid_ptr->compute_sources(current_time, rotational_time);
-					grid_ptr->compute_dudt();
-					compute_fmm(DRHODT, false);
-					if (rk == 0) {
-						dt_ = GET(dt_fut);
+					{
+						timings::scope ts(timings_, timings::time_node_hydro);
+						TRACE_SCOPE("sources", trace_hydro, my_location.to_id(), step_num);
+						grid_ptr->compute_sources(current_time, rotational_time);
+						grid_ptr->compute_dudt();
 					}
-					grid_ptr->next_u(rk, current_time, dt_.dt);
-					compute_fmm(RHO, true);
-					rk == NRK - 1 ? energy_hydro_bounds() : all_hydro_bounds();
+					return compute_fmm(DRHODT, false);
 				}/*, "node_server::nonrefined_step::compute_fluxes")*/);
+
+		/* the solves return futures, the stage continues once they are done instead of holding a thread */
+		fut = hpx::dataflow(hpx::launch::async(hpx::threads::thread_priority_boost), [rk, this](future<void> f, hpx::shared_future<timestep_t> dt_fut) {
+			GET(f);
+			if (rk == 0) {
+				dt_ = GET(dt_fut);
+			}
+			{
+				timings::scope ts(timings_, timings::time_node_hydro);
+				TRACE_SCOPE("next_u", trace_hydro, my_location.to_id(), step_num);
+				grid_ptr->next_u(rk, current_time, dt_.dt);
+			}
+			return compute_fmm(RHO, true);
+		}, std::move(fut), dt_fut);
+
+		fut = fut.then(hpx::launch::async(hpx::threads::thread_priority_boost), [rk, this, overlap, bounds](future<void> f) {
+			GET(f);
+			if (rk == NRK - 1) {
+				energy_hydro_bounds();
+			} else if (overlap) {
+				*bounds = start_hydro_bounds();
+			} else {
+				all_hydro_bounds();
+			}
+		});
 	}
 
 	return fut.then(hpx::launch::sync, [this](future<void> &&f) {
@@ -583,6 +734,125 @@ future<void> node_server::nonrefined_step() {
 	);
 }
 
+/* levels below the finest that take fewer hydro steps with --hydro_subcycle, 0 steps all of them together */
+static integer subcycle_shift(integer finest_level) {
+	finest_level = finest_level >= 0 ? std::min(finest_level, opts().max_level) : opts().max_level;
+	return std::min(opts().hydro_subcycle, finest_level);
+}
+
+/* The step with --hydro_subcycle: a leaf on level l takes a step of stride * dt every stride sub-steps, stride =
+ * 2^min(finest_level - l, shift), and the step is 2^shift sub-steps long. All nodes go through every sub-step and
+ * stage, so the boundary exchanges stay cycle-numbered, but a leaf only computes in the sub-steps its own step starts
+ * at. Between its steps a leaf sends its neighbors its state interpolated in time, the start of its step plus theta
+ * times the change, with theta the time of the stage of the finer receiver within the step. A face to a coarser leaf
+ * sums its fluxes, times dt and the stage weight, over the coarse step and sends the sum when that step ends, the
+ * coarse leaf replaces its own sum on the face by it (reflux). Gravity is solved once, after the last sub-step, when
+ * all levels are at the same time again, until then the sources use the potential of the step before. Every leaf
+ * divides its CFL step by its stride before the minimum is taken, dt_ is the step of the whole sub-step cycle. */
+void node_server::subcycled_step() {
+	timings::scope ts(timings_, timings::time_computation);
+	const integer finest_level = finest_level_ >= 0 ? std::min(finest_level_, opts().max_level) : opts().max_level;
+	const integer shift = subcycle_shift(finest_level_);
+	const integer nsub = integer(1) << shift;
+	const auto stride_of = [finest_level, shift](integer level) {
+		return integer(1) << std::min(std::max(finest_level - level, integer(0)), shift);
+	};
+	const integer level = my_location.level();
+	const integer stride = stride_of(level);
+	const integer niece_stride = stride_of(level + 1);
+	const integer aunt_stride = stride_of(level - 1);
+	const bool refined = is_refined;
+	const real dx = TWO * grid::get_scaling_factor() / real(INX << level);
+
+	hpx::shared_future<timestep_t> dt_fut = global_timestep_channel.get_future();
+	if (refined) {
+		timestep_t tstep;
+		tstep.dt = std::numeric_limits<real>::max();
+		local_timestep_channels[NCHILD].set_value(tstep);
+	} else {
+		grid_ptr->clear_dphi_dt();
+		for (auto const &f : geo::face::full_set()) {
+			grid_ptr->clear_flux_sum(f);
+		}
+	}
+	real sub_dt = ZERO;
+	std::array<real, geo::direction::count()> theta;
+	for (integer i = 0; i != nsub; ++i) {
+		const integer k = i % stride;
+		const bool active = !refined && k == 0;
+		if (active) {
+			grid_ptr->store();
+			for (auto const &f : geo::face::full_set()) {
+				if (aunts[f].empty()) {
+					grid_ptr->clear_flux_sum(f);
+				}
+			}
+		}
+		for (integer rk = 0; rk < NRK; ++rk) {
+			for (auto const &dir : geo::direction::full_set()) {
+				theta[dir] = 1.0;
+				if (refined) {
+					continue;
+				}
+				if (k != 0) {
+					theta[dir] = std::min((real(k) + rk_time[rk] * niece_stride) / real(stride), real(1));
+				} else if (dir.is_face() && nieces[dir.to_face()] == +1) {
+					/* the stage states of this step at the fraction of it the finer neighbor's step takes */
+					theta[dir] = real(niece_stride) / real(stride);
+				}
+			}
+			all_hydro_bounds(&theta);
+			if (!active) {
+				continue;
+			}
+			timestep_t a;
+			{
+				timings::scope ts(timings_, timings::time_node_hydro);
+				TRACE_SCOPE("compute_fluxes", trace_hydro, my_location.to_id(), step_num);
+				a = grid_ptr->compute_fluxes();
+			}
+			/* every leaf starts a step in the first sub-step */
+			if (i == 0 && rk == 0) {
+				dt_ = a;
+				dt_.dt = opts().cfl * dx / a.a;
+				local_dt_ = dt_.dt;
+				dt_.dt /= real(stride);
+				if (opts().stop_time > 0.0) {
+					const real maxdt = (opts().stop_time - current_time) / (refinement_freq() - (step_num % refinement_freq()));
+					dt_.dt = std::min(dt_.dt, maxdt / real(nsub));
+				}
+				local_timestep_channels[NCHILD].set_value(dt_);
+				sub_dt = GET(dt_fut).dt;
+			}
+			const real own_dt = sub_dt * real(stride);
+			const real t = current_time + real(i) * sub_dt;
+			const real rt = rotational_time + (grid::get_omega() != 0.0 ? grid::get_omega() : 1.0) * real(i) * sub_dt;
+			{
+				timings::scope ts(timings_, timings::time_node_hydro);
+				TRACE_SCOPE("next_u", trace_hydro, my_location.to_id(), step_num);
+				grid_ptr->add_flux_sum(rk_weight[rk] * own_dt);
+				grid_ptr->compute_sources(t, rt);
+				grid_ptr->compute_dudt();
+				grid_ptr->next_u(rk, t, own_dt);
+			}
+		}
+		exchange_flux_sums((i + 1) % aunt_stride == 0, (i + 1) % stride == 0);
+	}
+	{
+		timings::scope ts(timings_, timings::time_fmm);
+		GET(compute_fmm(RHO, true));
+	}
+	energy_hydro_bounds();
+
+	dt_ = GET(dt_fut);
+	dt_.dt *= real(nsub);
+	update();
+	if (opts().radiation) {
+		compute_radiation(dt_.dt, grid_ptr->get_omega());
+		all_hydro_bounds();
+	}
+}
+
 void node_server::update() {
 	grid_ptr->dual_energy_update();
 	current_time += dt_.dt;
@@ -623,7 +893,9 @@ future<real> node_server::local_step(integer steps) {
 			auto time_start = std::chrono::high_resolution_clock::now();
 			auto next_dt = timestep_driver_descend();
 
-			if (is_refined) {
+			if (subcycle_shift(finest_level_) > 0) {
+				subcycled_step();
+			} else if (is_refined) {
 				refined_step();
 			} else {
 				GET(nonrefined_step());
@@ -105,9 +105,14 @@ bool options::process_options(int argc, char *argv[]) {
 	("amrbnd_order", po::value<integer>(&(opts().amrbnd_order))->default_value(1), "amr boundary interpolation order")        //
 	("scf_output_frequency", po::value<integer>(&(opts().scf_output_frequency))->default_value(25), "Frequency of SCF output")        //
 	("silo_num_groups", po::value<integer>(&(opts().silo_num_groups))->default_value(-1), "Number of SILO I/O groups")        //
+	("silo_max_in_flight", po::value<integer>(&(opts().silo_max_in_flight))->default_value(1), "number of SILO outputs that are staged or being written while the solver continues, more than 1 lets a new output start before the last one is written")        //
+	("silo_staging_mb", po::value<real>(&(opts().silo_staging_mb))->default_value(1024.0), "bound on the memory (in MB) of older staged SILO outputs a new one may start next to, 0 for no bound")        //
 	("core_refine", po::value<bool>(&(opts().core_refine))->default_value(false), "refine cores by one more level")           //
 	("accretor_refine", po::value<integer>(&(opts().accretor_refine))->default_value(0), "number of extra levels for accretor") //
 	("extra_regrid", po::value<integer>(&(opts().extra_regrid))->default_value(0), "number of extra regrids on startup") //
+	("cost_load_balance", po::value<bool>(&(opts().cost_load_balance))->default_value(false), "weight the load balancer by the measured time of each node instead of the node count") //
+	("load_balance_threshold", po::value<real>(&(opts().load_balance_threshold))->default_value(0.0), "relative load imbalance above which a regrid moves existing nodes, 0 moves them at every regrid") //
+	("incremental_regrid", po::value<bool>(&(opts().incremental_regrid))->default_value(false), "only relink the parts of the tree that changed during a regrid") //
 	("donor_refine", po::value<integer>(&(opts().donor_refine))->default_value(0), "number of extra levels for donor")      //
 	("ngrids", po::value<integer>(&(opts().ngrids))->default_value(-1), "fix numbger of grids")                             //
 	("refinement_floor", po::value<real>(&(opts().refinement_floor))->default_value(1.0e-3), "density refinement floor")      //
@@ -136,6 +141,8 @@ bool options::process_options(int argc, char *argv[]) {
 	("disable_diagnostics", po::value<bool>(&(opts().disable_diagnostics))->default_value(false), "disable diagnostics") //
 	("problem", po::value<problem_type>(&(opts().problem))->default_value(NONE), "problem type")                            //
 	("restart_filename", po::value<std::string>(&(opts().restart_filename))->default_value(""), "restart filename")         //
+	("trace", po::value<bool>(&(opts().trace))->default_value(false), "record a Chrome trace of the main phases on every locality (trace.<locality>.json)")         //
+	("parallel_restart", po::value<bool>(&(opts().parallel_restart))->default_value(false), "on restart every locality reads all of its domains before the tree is built")         //
 	("stop_time", po::value<real>(&(opts().stop_time))->default_value(std::numeric_limits<real>::max()), "time to end simulation") //
 	("stop_step", po::value<integer>(&(opts().stop_step))->default_value(std::numeric_limits<integer>::max() - 1), "number of timesteps to run")          //
 	("min_level", po::value<integer>(&(opts().min_level))->default_value(1), "minimum number of refinement levels")         //
@@ -143,6 +150,22 @@ bool options::process_options(int argc, char *argv[]) {
 	("multipole_kernel_type", po::value<interaction_kernel_type>(&(opts().m2m_kernel_type))->default_value(SOA_CPU), "boundary multipole-multipole kernel type") //
 	("p2p_kernel_type", po::value<interaction_kernel_type>(&(opts().p2p_kernel_type))->default_value(SOA_CPU), "boundary particle-particle kernel type")   //
 	("p2m_kernel_type", po::value<interaction_kernel_type>(&(opts().p2m_kernel_type))->default_value(SOA_CPU), "boundary particle-multipole kernel type") //
+	("multipole_blocked_stencil", po::value<bool>(&(opts().multipole_blocked_stencil))->default_value(false), "use the blocked stencil variant of the SOA_CPU multipole kernel") //
+	("kernel_tuning_file", po::value<std::string>(&(opts().kernel_tuning_file))->default_value("kernel_tuning.dat"), "cache of the kernel choices made by AUTO kernel types") //
+	("reconstruct_kernel_type", po::value<hydro_kernel_type>(&(opts().reconstruct_kernel_type))->default_value(SCALAR), "hydro reconstruction kernel type (SCALAR or VC)") //
+	("flux_kernel_type", po::value<hydro_kernel_type>(&(opts().flux_kernel_type))->default_value(SCALAR), "hydro face flux kernel type (SCALAR or VC)") //
+	("overlap_hydro_exchange", po::value<bool>(&(opts().overlap_hydro_exchange))->default_value(false), "compute the interior hydro fluxes of each stage while the ghost zones are exchanged") //
+	("wire_codec", po::value<bool>(&(opts().wire_codec))->default_value(false), "compress the halo messages sent to other localities (lossless)") //
+	("wire_float_order", po::value<integer>(&(opts().wire_float_order))->default_value(4), "send multipole moments of this order and up to other localities as floats (4 keeps all in double)") //
+	("level_dt_report", po::value<bool>(&(opts().level_dt_report))->default_value(false), "print the smallest CFL step of every refinement level and the work subcycling would save") //
+	("hydro_subcycle", po::value<integer>(&(opts().hydro_subcycle))->default_value(0), "number of the finest levels that take two hydro steps per step of the next coarser one, gravity is solved once per step of the coarsest (0: all levels step together)") //
+	("p2p_batch_size", po::value<integer>(&(opts().p2p_batch_size))->default_value(1), "number of same level sub-grids the SoA CPU p2p kernel computes in one pass (up to 8, 1 runs them one at a time)") //
+	("multipole_batch_size", po::value<integer>(&(opts().multipole_batch_size))->default_value(1), "number of sub-grids the blocked SoA CPU multipole kernel computes in one pass (up to 8, 1 runs them one at a time)") //
+	("async_diagnostics", po::value<bool>(&(opts().async_diagnostics))->default_value(false), "reduce the diagnostics of a step on a snapshot while the next step runs, binary.dat and sums.dat lag by up to one step") //
+	("rad_fld", po::value<bool>(&(opts().rad_fld))->default_value(false), "transport radiation with implicit flux-limited diffusion instead of explicit sub-steps") //
+	("rad_fld_tol", po::value<real>(&(opts().rad_fld_tol))->default_value(1.0e-8), "relative residual of the implicit flux-limited diffusion solve") //
+	("rad_fld_max_iter", po::value<integer>(&(opts().rad_fld_max_iter))->default_value(200), "maximum number of BiCGSTAB iterations of the implicit flux-limited diffusion solve") //
+	("rad_level_steps", po::value<bool>(&(opts().rad_level_steps))->default_value(false), "explicit radiation sub-steps per level, coarse leaves take fewer and longer steps") //
 	("cuda_streams_per_locality", po::value<size_t>(&(opts().cuda_streams_per_locality))->default_value(size_t(0)), "cuda streams per HPX locality") //
 	("cuda_streams_per_gpu", po::value<size_t>(&(opts().cuda_streams_per_gpu))->default_value(size_t(0)), "cuda streams per GPU (per locality)") //
 	("cuda_scheduling_threads", po::value<size_t>(&(opts().cuda_scheduling_threads))->default_value(size_t(0)),
@@ -242,6 +265,7 @@ bool options::process_options(int argc, char *argv[]) {
 		SHOW(core_refine);
 		SHOW(correct_am_grav);
 		SHOW(correct_am_hydro);
+		SHOW(cost_load_balance);
 		SHOW(code_to_cm);
 		SHOW(code_to_g);
 		SHOW(code_to_s);
@@ -259,36 +283,58 @@ bool options::process_options(int argc, char *argv[]) {
 		SHOW(eos);
 		SHOW(entropy_driving_rate);
 		SHOW(entropy_driving_time);
+		SHOW(flux_kernel_type);
 		SHOW(future_wait_time);
 		SHOW(hard_dt);
 		SHOW(hydro);
 		SHOW(inflow_bc);
+		SHOW(incremental_regrid);
 		SHOW(input_file);
+		SHOW(kernel_tuning_file);
+		SHOW(load_balance_threshold);
 		SHOW(m2m_kernel_type);
 		SHOW(min_level);
 		SHOW(max_level);
+		SHOW(multipole_blocked_stencil);
 		SHOW(n_species);
 		SHOW(ngrids);
 		SHOW(omega);
 		SHOW(output_dt);
 		SHOW(output_filename);
+		SHOW(overlap_hydro_exchange);
 		SHOW(p2m_kernel_type);
+		SHOW(parallel_restart);
 		SHOW(p2p_kernel_type);
 		SHOW(problem);
 		SHOW(rad_implicit);
 		SHOW(radiation);
+		SHOW(reconstruct_kernel_type);
 		SHOW(refinement_floor);
 		SHOW(reflect_bc);
 		SHOW(restart_filename);
 		SHOW(rotating_star_amr);
 		SHOW(rotating_star_x);
 		SHOW(scf_output_frequency);
+		SHOW(silo_max_in_flight);
 		SHOW(silo_num_groups);
+		SHOW(silo_staging_mb);
 		SHOW(stop_step);
 		SHOW(stop_time);
 		SHOW(theta);
+		SHOW(trace);
 		SHOW(unigrid);
 		SHOW(v1309);
+		SHOW(wire_codec);
+		SHOW(wire_float_order);
+		SHOW(level_dt_report);
+		SHOW(hydro_subcycle);
+		SHOW(p2p_batch_size);
+		SHOW(multipole_batch_size);
+		SHOW(async_diagnostics);
+		SHOW(rad_fld);
+		SHOW(rad_fld_tol);
+		SHOW(rad_fld_max_iter);
+		SHOW(rad_level_steps);
 		SHOW(idle_rates);
 		SHOW(xscale);
 
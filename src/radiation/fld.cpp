@@ -0,0 +1,454 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+/* Implicit flux-limited diffusion, the radiation transport of --rad_fld. A step solves
+ *
+ *     E - dt div(D grad E) = E^n,     D = c lambda(R) / kappa_R,     R = |grad E| / (kappa_R E)
+ *
+ * with the Levermore-Pomraning limiter lambda(R) = (2 + R) / (6 + 3R + R^2), taken at E^n. The system is solved
+ * matrix-free with BiCGSTAB, right preconditioned with its diagonal, on the leaves of the tree. Every product with the
+ * matrix fills the ghost cells through all_rad_bounds, every dot product is reduced over the tree through
+ * local_fld_channels and global_fld_channel, so all nodes take part in every iteration and take the same decisions.
+ * The coarse ghost cells of fine leaves are prolonged without a limiter, which would make the matrix depend on the
+ * vector it is applied to. After every product the fine leaves send their face fluxes at coarse-fine faces through
+ * exchange_rad_flux_corrections and the coarse leaves replace their own flux there by them, as the explicit sub-steps
+ * do, so the operator conserves energy across refinement boundaries. Physical boundaries are held at their ghost
+ * values of E^n. */
+
+#include "octotiger/defs.hpp"
+#include "octotiger/grid.hpp"
+#include "octotiger/node_client.hpp"
+#include "octotiger/node_server.hpp"
+#include "octotiger/options.hpp"
+#include "octotiger/physcon.hpp"
+#include "octotiger/radiation/opacities.hpp"
+#include "octotiger/radiation/rad_grid.hpp"
+#include "octotiger/real.hpp"
+#include "octotiger/roe.hpp"
+
+#include <hpx/include/future.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+void rad_grid::fld_init(const std::vector<real> &egas, const std::vector<real> &tau, const std::vector<real> &sx, const std::vector<real> &sy,
+		const std::vector<real> &sz, const std::vector<real> &rho, real dt, const std::array<bool, NFACE> &physical) {
+	const real fgamma = grid::get_fgamma();
+	const real clight = physcon().c / opts().clight_retard;
+	const integer D[NDIM] = { DX, DY, DZ };
+	const auto &E = U[er_i];
+	for (auto &v : fld) {
+		v.assign(RAD_N3, 0.0);
+	}
+	fld_D.assign(RAD_N3, 0.0);
+	fld_diag.assign(RAD_N3, 0.0);
+	for (integer d = 0; d != NDIM; ++d) {
+		fld_a[d].assign(RAD_N3, 0.0);
+		fld_c[d].assign(RAD_N3, 0.0);
+	}
+	for (integer xi = 1; xi != RAD_NX - 1; ++xi) {
+		for (integer yi = 1; yi != RAD_NX - 1; ++yi) {
+			for (integer zi = 1; zi != RAD_NX - 1; ++zi) {
+				const integer H = H_BW - RAD_BW;
+				const integer iiir = rindex(xi, yi, zi);
+				const integer iiih = hindex(xi + H, yi + H, zi + H);
+				const real rhoinv = INVERSE(rho[iiih]);
+				real vx = sx[iiih] * rhoinv;
+				real vy = sy[iiih] * rhoinv;
+				real vz = sz[iiih] * rhoinv;
+				real e0 = egas[iiih];
+				e0 -= 0.5 * vx * vx * rho[iiih];
+				e0 -= 0.5 * vy * vy * rho[iiih];
+				e0 -= 0.5 * vz * vz * rho[iiih];
+				if (opts().eos == WD) {
+					e0 -= ztwd_energy(rho[iiih]);
+				}
+				if (e0 < egas[iiih] * 0.001) {
+					e0 = std::pow(tau[iiih], fgamma);
+				}
+				const real kappa = kappa_R(rho[iiih], e0, mmw[iiir], X_spc[iiir], Z_spc[iiir]);
+				real grad2 = 0.0;
+				for (integer d = 0; d != NDIM; ++d) {
+					const real g = (E[iiir + D[d]] - E[iiir - D[d]]) / (2.0 * dx);
+					grad2 += g * g;
+				}
+				/* c lambda(R) / kappa multiplied through by kappa^2, g = kappa R stays finite in optically thin cells */
+				const real g = E[iiir] > 0.0 ? SQRT(grad2) / E[iiir] : 0.0;
+				const real den = 6.0 * kappa * kappa + 3.0 * kappa * g + g * g;
+				fld_D[iiir] = den > 0.0 ? clight * (2.0 * kappa + g) / den : 0.0;
+			}
+		}
+	}
+	/* the coefficient of a face is the harmonic mean of its two cells, kept on the cell above it */
+	const real a0 = dt / (dx * dx);
+	for (integer d = 0; d != NDIM; ++d) {
+		for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW + 1; ++xi) {
+			for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW + 1; ++yi) {
+				for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW + 1; ++zi) {
+					const integer iiir = rindex(xi, yi, zi);
+					const integer id = d == XDIM ? xi : (d == YDIM ? yi : zi);
+					const real dm = fld_D[iiir - D[d]];
+					const real dp = fld_D[iiir];
+					fld_a[d][iiir] = dm + dp > 0.0 ? 2.0 * a0 * dm * dp / (dm + dp) : 0.0;
+					if ((id == RAD_BW && physical[2 * d]) || (id == RAD_NX - RAD_BW && physical[2 * d + 1])) {
+						fld_c[d][iiir] = 0.0;
+					} else {
+						fld_c[d][iiir] = fld_a[d][iiir];
+					}
+				}
+			}
+		}
+	}
+	for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW; ++xi) {
+		for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW; ++yi) {
+			for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW; ++zi) {
+				const integer iiir = rindex(xi, yi, zi);
+				real diag = 1.0;
+				real b = E[iiir];
+				for (integer d = 0; d != NDIM; ++d) {
+					const integer iiip = iiir + D[d];
+					diag += fld_a[d][iiir] + fld_a[d][iiip];
+					b += (fld_a[d][iiir] - fld_c[d][iiir]) * E[iiir - D[d]];
+					b += (fld_a[d][iiip] - fld_c[d][iiip]) * E[iiip];
+				}
+				fld_diag[iiir] = diag;
+				fld[fld_b][iiir] = b;
+				fld[fld_x][iiir] = E[iiir];
+				fld[fld_e0][iiir] = E[iiir];
+			}
+		}
+	}
+}
+
+void rad_grid::fld_precondition(fld_vector in, fld_vector out) {
+	for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW; ++xi) {
+		for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW; ++yi) {
+			for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW; ++zi) {
+				const integer iiir = rindex(xi, yi, zi);
+				fld[out][iiir] = fld[in][iiir] / fld_diag[iiir];
+			}
+		}
+	}
+}
+
+void rad_grid::fld_load(fld_vector v) {
+	for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW; ++xi) {
+		for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW; ++yi) {
+			for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW; ++zi) {
+				const integer iiir = rindex(xi, yi, zi);
+				U[er_i][iiir] = fld[v][iiir];
+			}
+		}
+	}
+}
+
+/* the matrix applied to er, whose ghost cells have been filled */
+void rad_grid::fld_apply(fld_vector out) {
+	const integer D[NDIM] = { DX, DY, DZ };
+	const auto &E = U[er_i];
+	for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW; ++xi) {
+		for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW; ++yi) {
+			for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW; ++zi) {
+				const integer iiir = rindex(xi, yi, zi);
+				real ae = fld_diag[iiir] * E[iiir];
+				for (integer d = 0; d != NDIM; ++d) {
+					ae -= fld_c[d][iiir] * E[iiir - D[d]];
+					ae -= fld_c[d][iiir + D[d]] * E[iiir + D[d]];
+				}
+				fld[out][iiir] = ae;
+			}
+		}
+	}
+}
+
+/* dt F on every face of the interior, in the er flux, for exchange_rad_flux_corrections. A coarse face gets the mean
+ * of its four fine faces, which is its own dt F when the fine cells conserve energy */
+void rad_grid::fld_store_flux() {
+	const integer D[NDIM] = { DX, DY, DZ };
+	const auto &E = U[er_i];
+	for (integer d = 0; d != NDIM; ++d) {
+		for (integer f = 0; f != NRF; ++f) {
+			std::fill(flux[d][f].begin(), flux[d][f].end(), 0.0);
+		}
+		for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW + 1; ++xi) {
+			for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW + 1; ++yi) {
+				for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW + 1; ++zi) {
+					const integer iiir = rindex(xi, yi, zi);
+					flux[d][er_i][iiir] = fld_a[d][iiir] * (E[iiir - D[d]] - E[iiir]) * dx;
+				}
+			}
+		}
+	}
+}
+
+/* swaps the terms of out that come from faces with a refined neighbor, computed from the restricted ghost cells, for
+ * the fluxes the fine leaves sent there. er still holds the vector out was computed from */
+void rad_grid::fld_correct_flux(fld_vector out, const std::array<bool, NFACE> &fine) {
+	const integer D[NDIM] = { DX, DY, DZ };
+	const auto &E = U[er_i];
+	const real dxinv = INVERSE(dx);
+	for (integer face = 0; face != NFACE; ++face) {
+		if (!fine[face]) {
+			continue;
+		}
+		const integer d = face / 2;
+		const bool plus = face % 2;
+		/* the face lies on the lower side of the cell at face_i, the interior cell next to it is cell_i */
+		const integer face_i = plus ? RAD_NX - RAD_BW : RAD_BW;
+		const integer cell_i = plus ? face_i - 1 : face_i;
+		std::array<integer, NDIM> lb, ub;
+		for (integer e = 0; e != NDIM; ++e) {
+			lb[e] = RAD_BW;
+			ub[e] = RAD_NX - RAD_BW;
+		}
+		lb[d] = cell_i;
+		ub[d] = cell_i + 1;
+		for (integer xi = lb[XDIM]; xi != ub[XDIM]; ++xi) {
+			for (integer yi = lb[YDIM]; yi != ub[YDIM]; ++yi) {
+				for (integer zi = lb[ZDIM]; zi != ub[ZDIM]; ++zi) {
+					const integer iiir = rindex(xi, yi, zi);
+					const integer iiif = plus ? iiir + D[d] : iiir;
+					const real w_old = fld_a[d][iiif] * (E[iiif - D[d]] - E[iiif]);
+					const real w_new = flux[d][er_i][iiif] * dxinv;
+					fld[out][iiir] += plus ? w_new - w_old : w_old - w_new;
+				}
+			}
+		}
+	}
+}
+
+real rad_grid::fld_dot(fld_vector a, fld_vector b) const {
+	real sum = 0.0;
+	for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW; ++xi) {
+		for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW; ++yi) {
+			for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW; ++zi) {
+				const integer iiir = rindex(xi, yi, zi);
+				sum += fld[a][iiir] * fld[b][iiir];
+			}
+		}
+	}
+	return sum;
+}
+
+void rad_grid::fld_axpby(fld_vector out, real a, fld_vector x, real b, fld_vector y) {
+	for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW; ++xi) {
+		for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW; ++yi) {
+			for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW; ++zi) {
+				const integer iiir = rindex(xi, yi, zi);
+				fld[out][iiir] = a * fld[x][iiir] + b * fld[y][iiir];
+			}
+		}
+	}
+}
+
+/* the energy gained by the cells of x minus what came in through physical boundaries, the energy of x, and the sum
+ * of the squared cell volumes. b - E^n holds the ghost values of the physical faces times their coefficient */
+std::array<real, 3> rad_grid::fld_balance() const {
+	const integer D[NDIM] = { DX, DY, DZ };
+	const real vol = dx * dx * dx;
+	std::array<real, 3> sums = { 0.0, 0.0, 0.0 };
+	for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW; ++xi) {
+		for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW; ++yi) {
+			for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW; ++zi) {
+				const integer iiir = rindex(xi, yi, zi);
+				const real x = fld[fld_x][iiir];
+				real inflow = fld[fld_b][iiir] - fld[fld_e0][iiir];
+				for (integer d = 0; d != NDIM; ++d) {
+					inflow -= (fld_a[d][iiir] - fld_c[d][iiir]) * x;
+					inflow -= (fld_a[d][iiir + D[d]] - fld_c[d][iiir + D[d]]) * x;
+				}
+				sums[0] += vol * (x - fld[fld_e0][iiir] - inflow);
+				sums[1] += vol * x;
+				sums[2] += vol * vol;
+			}
+		}
+	}
+	return sums;
+}
+
+/* F = -D grad E from the solution, with the ghost cells filled */
+void rad_grid::fld_flux() {
+	const integer D[NDIM] = { DX, DY, DZ };
+	for (integer xi = RAD_BW; xi != RAD_NX - RAD_BW; ++xi) {
+		for (integer yi = RAD_BW; yi != RAD_NX - RAD_BW; ++yi) {
+			for (integer zi = RAD_BW; zi != RAD_NX - RAD_BW; ++zi) {
+				const integer iiir = rindex(xi, yi, zi);
+				for (integer d = 0; d != NDIM; ++d) {
+					U[fx_i + d][iiir] = -fld_D[iiir] * (U[er_i][iiir + D[d]] - U[er_i][iiir - D[d]]) / (2.0 * dx);
+				}
+			}
+		}
+	}
+}
+
+using set_fld_partial_action_type = node_server::set_fld_partial_action;
+HPX_REGISTER_ACTION (set_fld_partial_action_type);
+
+void node_client::set_fld_partial(integer idx, std::vector<real> &&sums) const {
+	hpx::apply<typename node_server::set_fld_partial_action>(get_unmanaged_gid(), idx, std::move(sums));
+}
+
+void node_server::set_fld_partial(integer idx, std::vector<real> &&sums) {
+	local_fld_channels[idx].set_value(std::move(sums));
+}
+
+using fld_total_ascend_action_type = node_server::fld_total_ascend_action;
+HPX_REGISTER_ACTION (fld_total_ascend_action_type);
+
+void node_client::fld_total_ascend(std::vector<real> &&sums) const {
+	hpx::apply<typename node_server::fld_total_ascend_action>(get_unmanaged_gid(), std::move(sums));
+}
+
+void node_server::fld_total_ascend(std::vector<real> &&sums) {
+	if (is_refined) {
+		for (auto &child : children) {
+			child.fld_total_ascend(std::vector<real>(sums));
+		}
+	}
+	global_fld_channel.set_value(std::move(sums));
+}
+
+/* sums over the whole tree, refined nodes pass zeros */
+std::vector<real> node_server::fld_allreduce(std::vector<real> &&sums) {
+	if (is_refined) {
+		for (integer ci = 0; ci != NCHILD; ++ci) {
+			const auto child_sums = GET(local_fld_channels[ci].get_future());
+			for (std::size_t i = 0; i != sums.size(); ++i) {
+				sums[i] += child_sums[i];
+			}
+		}
+	}
+	if (my_location.level() == 0) {
+		fld_total_ascend(std::move(sums));
+	} else {
+		parent.set_fld_partial(my_location.get_child_index(), std::move(sums));
+	}
+	return GET(global_fld_channel.get_future());
+}
+
+void node_server::fld_solve(real dt) {
+	using rg = rad_grid;
+	auto rgrid = rad_grid_ptr;
+	const bool leaf = !is_refined;
+	all_rad_bounds(true);
+	if (leaf) {
+		timings::scope ts(timings_, timings::time_node_radiation);
+		std::array<bool, NFACE> physical;
+		for (auto &face : geo::face::full_set()) {
+			physical[face] = my_location.is_physical_boundary(face);
+		}
+		rgrid->fld_init(grid_ptr->get_field(egas_i), grid_ptr->get_field(tau_i), grid_ptr->get_field(sx_i), grid_ptr->get_field(sy_i),
+				grid_ptr->get_field(sz_i), grid_ptr->get_field(rho_i), dt, physical);
+	}
+	const auto dots = [&](const std::vector<std::pair<rg::fld_vector, rg::fld_vector>> &pairs) {
+		std::vector<real> sums(pairs.size(), 0.0);
+		if (leaf) {
+			for (std::size_t i = 0; i != pairs.size(); ++i) {
+				sums[i] = rgrid->fld_dot(pairs[i].first, pairs[i].second);
+			}
+		}
+		return fld_allreduce(std::move(sums));
+	};
+	std::array<bool, NFACE> fine;
+	for (auto &face : geo::face::full_set()) {
+		fine[face] = nieces[face] == +1;
+	}
+	/* out = A er, with the coarse side of coarse-fine faces taking the fluxes of the fine side */
+	const auto apply = [&](rg::fld_vector out) {
+		if (leaf) {
+			timings::scope ts(timings_, timings::time_node_radiation);
+			rgrid->fld_apply(out);
+			rgrid->fld_store_flux();
+		}
+		GET(exchange_rad_flux_corrections());
+		if (leaf) {
+			rgrid->fld_correct_flux(out, fine);
+		}
+	};
+	/* out = A M^-1 in, with M^-1 in kept in hat */
+	const auto matvec = [&](rg::fld_vector in, rg::fld_vector hat, rg::fld_vector out) {
+		if (leaf) {
+			rgrid->fld_precondition(in, hat);
+			rgrid->fld_load(hat);
+		}
+		all_rad_bounds(true);
+		apply(out);
+	};
+
+	/* er holds x = E^n with its ghost cells, so the first residual needs no bounds exchange */
+	apply(rg::fld_r);
+	if (leaf) {
+		rgrid->fld_axpby(rg::fld_r, 1.0, rg::fld_b, -1.0, rg::fld_r);
+		rgrid->fld_axpby(rg::fld_r0, 1.0, rg::fld_r, 0.0, rg::fld_r);
+	}
+	const auto norms = dots( { { rg::fld_b, rg::fld_b }, { rg::fld_r, rg::fld_r } });
+	const real tol = opts().rad_fld_tol * SQRT(norms[0]);
+	real rnorm = SQRT(norms[1]);
+	real rho = norms[1];
+	real rho_old = 1.0;
+	real alpha = 1.0;
+	real omega = 1.0;
+	integer iter = 0;
+	while (rnorm > tol && iter != opts().rad_fld_max_iter) {
+		const real beta = (rho / rho_old) * (alpha / omega);
+		if (leaf) {
+			rgrid->fld_axpby(rg::fld_p, 1.0, rg::fld_p, -omega, rg::fld_v);
+			rgrid->fld_axpby(rg::fld_p, 1.0, rg::fld_r, beta, rg::fld_p);
+		}
+		matvec(rg::fld_p, rg::fld_ph, rg::fld_v);
+		const real r0v = dots( { { rg::fld_r0, rg::fld_v } })[0];
+		if (r0v == 0.0) {
+			break;
+		}
+		alpha = rho / r0v;
+		if (leaf) {
+			rgrid->fld_axpby(rg::fld_s, 1.0, rg::fld_r, -alpha, rg::fld_v);
+		}
+		matvec(rg::fld_s, rg::fld_sh, rg::fld_t);
+		const auto tt = dots( { { rg::fld_t, rg::fld_s }, { rg::fld_t, rg::fld_t } });
+		omega = tt[1] > 0.0 ? tt[0] / tt[1] : 0.0;
+		if (leaf) {
+			rgrid->fld_axpby(rg::fld_x, 1.0, rg::fld_x, alpha, rg::fld_ph);
+			rgrid->fld_axpby(rg::fld_x, 1.0, rg::fld_x, omega, rg::fld_sh);
+			rgrid->fld_axpby(rg::fld_r, 1.0, rg::fld_s, -omega, rg::fld_t);
+		}
+		rho_old = rho;
+		const auto rr = dots( { { rg::fld_r0, rg::fld_r }, { rg::fld_r, rg::fld_r } });
+		rho = rr[0];
+		rnorm = SQRT(rr[1]);
+		++iter;
+		if (omega == 0.0 || rho == 0.0) {
+			break;
+		}
+	}
+	/* faces between leaves cancel, so the energy balance of x is off by the volume weighted sum of its residual,
+	 * which is at most |r| sqrt(sum vol^2) */
+	std::vector<real> balance(3, 0.0);
+	if (leaf) {
+		const auto b = rgrid->fld_balance();
+		std::copy(b.begin(), b.end(), balance.begin());
+	}
+	balance = fld_allreduce(std::move(balance));
+	if (my_location.level() == 0) {
+		const real bound = rnorm * SQRT(balance[2]) + 1.0e-10 * std::abs(balance[1]);
+		printf("radiation diffusion: %i iterations, residual %e of %e%s, energy balance %e of %e%s\n", int(iter), rnorm, tol,
+				rnorm > tol ? " (not converged)" : "", balance[0], balance[1], std::abs(balance[0]) > bound ? " (not conserved)" : "");
+	}
+	if (leaf) {
+		for (auto &e : rgrid->fld[rg::fld_x]) {
+			e = std::max(e, 0.0);
+		}
+		rgrid->fld_load(rg::fld_x);
+	}
+	all_rad_bounds();
+	if (leaf) {
+		timings::scope ts(timings_, timings::time_node_radiation);
+		rgrid->fld_flux();
+	}
+}
@@ -18,6 +18,7 @@
 
 #include <hpx/include/future.hpp>
 
+#include <algorithm>
 #include <array>
 #include <iostream>
 #include <string>
@@ -157,7 +158,13 @@ void rad_grid::rad_imp(std::vector<real> &egas, std::vector<real> &tau, std::vec
 	const real clight = physcon().c / opts().clight_retard;
 	const real clightinv = INVERSE(clight);
 	const real fgamma = grid::get_fgamma();
-	octotiger::radiation::radiation_kernel<er_i, fx_i, fy_i, fz_i>(d, rho, sx, sy, sz, egas, tau, fgamma, U, mmw, X_spc, Z_spc, dt, clightinv);
+	const auto unconverged = octotiger::radiation::radiation_kernel<er_i, fx_i, fy_i, fz_i>(d, rho, sx, sy, sz, egas, tau, fgamma, U, mmw, X_spc,
+			Z_spc, dt, clightinv);
+	if (!unconverged.empty()) {
+		const integer iiir = unconverged.front();
+		printf("Implicit radiation solver failed to converge in %i cells, they keep the last iterate. The first is at (%e, %e, %e)\n",
+				int(unconverged.size()), X[XDIM][iiir], X[YDIM][iiir], X[ZDIM][iiir]);
+	}
 }
 
 void rad_grid::set_dx(real _dx) {
@@ -241,6 +248,47 @@ void rad_grid::compute_mmw(const std::vector<std::vector<safe_real>> &U) {
 
 }
 
+/* bounds of the block faces of face, the plane of the face is the lower face of the cells at lb[dim] */
+static void block_face_bounds(const geo::face &face, std::array<integer, NDIM> &lb, std::array<integer, NDIM> &ub) {
+	const auto dim = face.get_dimension();
+	lb[XDIM] = lb[YDIM] = lb[ZDIM] = RAD_BW;
+	ub[XDIM] = ub[YDIM] = ub[ZDIM] = INX + RAD_BW;
+	lb[dim] = face.get_side() == geo::MINUS ? RAD_BW : INX + RAD_BW;
+	ub[dim] = lb[dim] + 1;
+}
+
+/* bounds of the faces of face that border the niece in quadrant */
+static void niece_face_bounds(const geo::face &f, const geo::quadrant &quadrant, std::array<integer, NDIM> &lb, std::array<integer, NDIM> &ub) {
+	const auto face_dim = f.get_dimension();
+	switch (face_dim) {
+	case XDIM:
+		lb[XDIM] = (f.get_side() == geo::MINUS ? 0 : INX) + RAD_BW;
+		lb[YDIM] = quadrant.get_side(0) * (INX / 2) + RAD_BW;
+		lb[ZDIM] = quadrant.get_side(1) * (INX / 2) + RAD_BW;
+		ub[XDIM] = lb[XDIM] + 1;
+		ub[YDIM] = lb[YDIM] + (INX / 2);
+		ub[ZDIM] = lb[ZDIM] + (INX / 2);
+		break;
+	case YDIM:
+		lb[XDIM] = quadrant.get_side(0) * (INX / 2) + RAD_BW;
+		lb[YDIM] = (f.get_side() == geo::MINUS ? 0 : INX) + RAD_BW;
+		lb[ZDIM] = quadrant.get_side(1) * (INX / 2) + RAD_BW;
+		ub[XDIM] = lb[XDIM] + (INX / 2);
+		ub[YDIM] = lb[YDIM] + 1;
+		ub[ZDIM] = lb[ZDIM] + (INX / 2);
+		break;
+	case ZDIM:
+	default:
+		lb[XDIM] = quadrant.get_side(0) * (INX / 2) + RAD_BW;
+		lb[YDIM] = quadrant.get_side(1) * (INX / 2) + RAD_BW;
+		lb[ZDIM] = (f.get_side() == geo::MINUS ? 0 : INX) + RAD_BW;
+		ub[XDIM] = lb[XDIM] + (INX / 2);
+		ub[YDIM] = lb[YDIM] + (INX / 2);
+		ub[ZDIM] = lb[ZDIM] + 1;
+		break;
+	}
+}
+
 void node_server::compute_radiation(real dt, real omega) {
 //	physcon().c = 1.0;
 	if (my_location.level() == 0) {
@@ -249,15 +297,31 @@ void node_server::compute_radiation(real dt, real omega) {
 
 	rad_grid_ptr->set_dx(grid_ptr->get_dx());
 	auto rgrid = rad_grid_ptr;
-	rad_grid_ptr->compute_mmw(grid_ptr->U);
-	const real min_dx = TWO * grid::get_scaling_factor() / real(INX << opts().max_level);
+	{
+		timings::scope ts(timings_, timings::time_node_radiation);
+		rad_grid_ptr->compute_mmw(grid_ptr->U);
+	}
+	/* the sub-steps resolve the finest cells in the tree, which need not be on max_level yet */
+	const integer finest_level = finest_level_ >= 0 ? std::min(finest_level_, opts().max_level) : opts().max_level;
+	const real min_dx = TWO * grid::get_scaling_factor() / real(INX << finest_level);
 	const real clight = physcon().c / opts().clight_retard;
 	const real max_dt = min_dx / clight * 0.2;
-	const real ns = std::ceil(dt * INVERSE(max_dt));
+	/* the implicit diffusion solve takes the whole step at once */
+	const real ns = opts().rad_fld ? 1.0 : std::ceil(dt * INVERSE(max_dt));
 	if (ns > std::numeric_limits<int>::max()) {
 		printf("Number of substeps greater than %i. dt = %e max_dt = %e\n", std::numeric_limits<int>::max(), dt, max_dt);
 	}
 	integer nsteps = std::max(int(ns), 1);
+	/* with rad_level_steps a leaf steps once every 2^(finest_level - level) sub-steps, at most every 2^max_shift, and
+	 * the longest of these steps has to end with the last sub-step */
+	integer max_shift = 0;
+	if (opts().rad_level_steps && !opts().rad_fld) {
+		while (max_shift < finest_level && (integer(8) << (max_shift + 1)) <= nsteps) {
+			max_shift++;
+		}
+		const integer longest = integer(1) << max_shift;
+		nsteps = ((nsteps + longest - 1) / longest) * longest;
+	}
 
 	const real this_dt = dt * INVERSE(real(nsteps));
 	auto &egas = grid_ptr->get_field(egas_i);
@@ -272,8 +336,21 @@ void node_server::compute_radiation(real dt, real omega) {
 //		printf("Explicit\n");
 //	}
 	if (opts().rad_implicit) {
+		timings::scope ts(timings_, timings::time_node_radiation);
 		rgrid->rad_imp(egas, tau, sx, sy, sz, rho, 0.5 * dt);
 	}
+	/* A refined node's interior is replaced by its children's at every all_rad_bounds, before any of it is sent to
+	 * a neighbor, and the flux corrections at its faces come from its children. It only takes part in the exchanges.
+	 * All leaves take the sub-steps of the finest level, the exchanges below are cycle-numbered and run in lockstep
+	 * over the whole tree. */
+	const bool refined = is_refined;
+	if (opts().rad_fld) {
+		fld_solve(dt);
+		nsteps = 0;
+	} else if (opts().rad_level_steps) {
+		radiation_level_steps(nsteps, this_dt, omega, finest_level, max_shift);
+		nsteps = 0;
+	}
 	for (integer i = 0; i != nsteps; ++i) {
 		//	rgrid->sanity_check();
 		if (my_location.level() == 0) {
@@ -281,19 +358,28 @@ void node_server::compute_radiation(real dt, real omega) {
 			fflush(stdout);
 		}
 
-		rgrid->store();
+		if (!refined) {
+			rgrid->store();
+		}
 		const double beta[3] = { 1.0, 0.25, 2.0 / 3.0 };
 		for (int rk = 0; rk < 3; rk++) {
 			all_rad_bounds();
-			rgrid->compute_flux(omega);
+			if (!refined) {
+				timings::scope ts(timings_, timings::time_node_radiation);
+				rgrid->compute_flux(omega);
+			}
 //			if( my_location.level() == 0 ) printf( "\nbounds 10\n");
 			GET(exchange_rad_flux_corrections());
 //			if( my_location.level() == 0 ) printf( "\nbounds 11\n");
-			rgrid->advance(this_dt, beta[rk]);
+			if (!refined) {
+				timings::scope ts(timings_, timings::time_node_radiation);
+				rgrid->advance(this_dt, beta[rk]);
+			}
 		}
 
 	}
 	if (opts().rad_implicit) {
+		timings::scope ts(timings_, timings::time_node_radiation);
 		rgrid->rad_imp(egas, tau, sx, sy, sz, rho, 0.5 * dt);
 	}
 //	rgrid->sanity_check();
@@ -304,6 +390,102 @@ void node_server::compute_radiation(real dt, real omega) {
 	}
 }
 
+/* The explicit sub-steps with a step per level: a leaf on level l takes a step of stride * dt every stride sub-steps,
+ * stride = 2^min(finest_level - l, max_shift), so the coarse leaves take the same number of steps per cell crossing
+ * as the finest ones and not more. The exchanges still run on every sub-step and stage, all nodes advance rcycle in
+ * lockstep. What a leaf sends to its neighbors between its own steps is its state interpolated in time, the start of
+ * its step plus theta times the change, with theta the time of the stage of the finer receiver within the step. A
+ * face to a coarser leaf sums its weighted fluxes, dt times the stage weight {1/6, 1/6, 2/3}, over the coarse step
+ * and sends the sum when that step ends. The coarse leaf replaces its own sum on the face by it (reflux). */
+void node_server::radiation_level_steps(integer nsteps, real dt, real omega, integer finest_level, integer max_shift) {
+	const auto stride_of = [finest_level, max_shift](integer level) {
+		return integer(1) << std::min(std::max(finest_level - level, integer(0)), max_shift);
+	};
+	const integer level = my_location.level();
+	const integer stride = stride_of(level);
+	const integer niece_stride = stride_of(level + 1);
+	const integer aunt_stride = stride_of(level - 1);
+	const real own_dt = dt * real(stride);
+	const bool refined = is_refined;
+	const double beta[3] = { 1.0, 0.25, 2.0 / 3.0 };
+	/* the weight of each stage's flux in the step, and the time of its state within the step */
+	const double weight[3] = { 1.0 / 6.0, 1.0 / 6.0, 2.0 / 3.0 };
+	const double stage_time[3] = { 0.0, 1.0, 0.5 };
+	auto rgrid = rad_grid_ptr;
+	for (auto const &f : geo::face::full_set()) {
+		rgrid->clear_flux_sum(f);
+	}
+	std::array<real, geo::direction::count()> theta;
+	for (integer i = 0; i != nsteps; ++i) {
+		if (my_location.level() == 0) {
+			printf("radiation sub-step %i of %i\r", int(i + 1), int(nsteps));
+			fflush(stdout);
+		}
+		const integer k = i % stride;
+		const bool active = !refined && k == 0;
+		if (active) {
+			rgrid->store();
+			for (auto const &f : geo::face::full_set()) {
+				if (aunts[f].empty()) {
+					rgrid->clear_flux_sum(f);
+				}
+			}
+		}
+		for (int rk = 0; rk < 3; rk++) {
+			for (auto const &dir : geo::direction::full_set()) {
+				theta[dir] = 1.0;
+				if (refined) {
+					continue;
+				}
+				if (k != 0) {
+					theta[dir] = std::min((real(k) + stage_time[rk] * niece_stride) / real(stride), real(1));
+				} else if (dir.is_face() && nieces[dir.to_face()] == +1) {
+					/* the stage states of this step at the fraction of it the finer neighbor's step takes */
+					theta[dir] = real(niece_stride) / real(stride);
+				}
+			}
+			all_rad_bounds(false, &theta);
+			if (active) {
+				timings::scope ts(timings_, timings::time_node_radiation);
+				rgrid->compute_flux(omega);
+				rgrid->add_flux_sum(weight[rk] * own_dt);
+				rgrid->advance(own_dt, beta[rk]);
+			}
+		}
+		exchange_rad_flux_sums((i + 1) % aunt_stride == 0, (i + 1) % stride == 0);
+	}
+}
+
+/* Sends the flux sums at the faces to coarser leaves and clears them, and refluxes the faces to finer leaves with
+ * theirs, see radiation_level_steps */
+void node_server::exchange_rad_flux_sums(bool send, bool receive) {
+	const geo::octant ci = my_location.get_child_index();
+	if (send) {
+		for (auto &f : geo::face::full_set()) {
+			auto const &this_aunt = aunts[f];
+			if (!this_aunt.empty()) {
+				std::array<integer, NDIM> lb, ub;
+				block_face_bounds(f, lb, ub);
+				auto data = rad_grid_ptr->get_flux_sum_restrict(lb, ub, f.get_dimension());
+				this_aunt.send_rad_flux_correct(std::move(data), f.flip(), ci);
+				rad_grid_ptr->clear_flux_sum(f);
+			}
+		}
+	}
+	if (!receive) {
+		return;
+	}
+	for (auto const &f : geo::face::full_set()) {
+		if (this->nieces[f] == +1) {
+			for (auto const &quadrant : geo::quadrant::full_set()) {
+				std::array<integer, NDIM> lb, ub;
+				niece_face_bounds(f, quadrant, lb, ub);
+				rad_grid_ptr->reflux(GET(niece_rad_channels[f][quadrant].get_future()), lb, ub, f);
+			}
+		}
+	}
+}
+
 template<class T>
 T minmod(T a, T b) {
 	return (std::copysign(0.5, a) + std::copysign(0.5, b)) * std::min(std::abs(a), std::abs(b));
@@ -314,8 +496,10 @@ void rad_grid::allocate() {
 	U.resize(NRF);
 	Ushad.resize(NRF);
 	flux.resize(NDIM);
+	flux_sum.resize(NDIM);
 	for (int d = 0; d < NDIM; d++) {
 		flux[d].resize(NRF);
+		flux_sum[d].resize(NRF);
 	}
 	for (integer f = 0; f != NRF; ++f) {
 		U0[f].resize(RAD_N3);
@@ -323,6 +507,7 @@ void rad_grid::allocate() {
 		Ushad[f].resize(RAD_N3);
 		for (integer d = 0; d != NDIM; ++d) {
 			flux[d][f].resize(RAD_N3);
+			flux_sum[d][f].resize(RAD_N3);
 		}
 	}
 }
@@ -508,33 +693,7 @@ hpx::future<void> node_server::exchange_rad_flux_corrections() {
 				{
 					const auto face_dim = f.get_dimension();
 					std::array<integer, NDIM> lb, ub;
-					switch (face_dim) {
-						case XDIM:
-						lb[XDIM] = (f.get_side() == geo::MINUS ? 0 : INX) + RAD_BW;
-						lb[YDIM] = quadrant.get_side(0) * (INX / 2) + RAD_BW;
-						lb[ZDIM] = quadrant.get_side(1) * (INX / 2) + RAD_BW;
-						ub[XDIM] = lb[XDIM] + 1;
-						ub[YDIM] = lb[YDIM] + (INX / 2);
-						ub[ZDIM] = lb[ZDIM] + (INX / 2);
-						break;
-						case YDIM:
-						lb[XDIM] = quadrant.get_side(0) * (INX / 2) + RAD_BW;
-						lb[YDIM] = (f.get_side() == geo::MINUS ? 0 : INX) + RAD_BW;
-						lb[ZDIM] = quadrant.get_side(1) * (INX / 2) + RAD_BW;
-						ub[XDIM] = lb[XDIM] + (INX / 2);
-						ub[YDIM] = lb[YDIM] + 1;
-						ub[ZDIM] = lb[ZDIM] + (INX / 2);
-						break;
-						case ZDIM:
-						default:
-						lb[XDIM] = quadrant.get_side(0) * (INX / 2) + RAD_BW;
-						lb[YDIM] = quadrant.get_side(1) * (INX / 2) + RAD_BW;
-						lb[ZDIM] = (f.get_side() == geo::MINUS ? 0 : INX) + RAD_BW;
-						ub[XDIM] = lb[XDIM] + (INX / 2);
-						ub[YDIM] = lb[YDIM] + (INX / 2);
-						ub[ZDIM] = lb[ZDIM] + 1;
-						break;
-					}
+					niece_face_bounds(f, quadrant, lb, ub);
 					rad_grid_ptr->set_flux_restrict(GET(fdata), lb, ub, face_dim);
 				});
 			}
@@ -566,6 +725,15 @@ void rad_grid::set_flux_restrict(const std::vector<real> &data, const std::array
 }
 
 std::vector<real> rad_grid::get_flux_restrict(const std::array<integer, NDIM> &lb, const std::array<integer, NDIM> &ub, const geo::dimension &dim) const {
+	return restrict_faces(flux, lb, ub, dim);
+}
+
+std::vector<real> rad_grid::get_flux_sum_restrict(const std::array<integer, NDIM> &lb, const std::array<integer, NDIM> &ub, const geo::dimension &dim) const {
+	return restrict_faces(flux_sum, lb, ub, dim);
+}
+
+std::vector<real> rad_grid::restrict_faces(const std::vector<std::vector<std::vector<real>>> &f, const std::array<integer, NDIM> &lb,
+		const std::array<integer, NDIM> &ub, const geo::dimension &dim) {
 
 	std::vector<real> data;
 	integer size = 1;
@@ -586,10 +754,10 @@ std::vector<real> rad_grid::get_flux_restrict(const std::array<integer, NDIM> &l
 					const integer i01 = i00 + stride2;
 					const integer i11 = i00 + stride1 + stride2;
 					real value = ZERO;
-					value += flux[dim][field][i00];
-					value += flux[dim][field][i10];
-					value += flux[dim][field][i01];
-					value += flux[dim][field][i11];
+					value += f[dim][field][i00];
+					value += f[dim][field][i10];
+					value += f[dim][field][i01];
+					value += f[dim][field][i11];
 					value /= real(4);
 					data.push_back(value);
 				}
@@ -599,11 +767,71 @@ std::vector<real> rad_grid::get_flux_restrict(const std::array<integer, NDIM> &l
 	return data;
 }
 
-void node_server::all_rad_bounds() {
+void rad_grid::add_flux_sum(real weight) {
+	std::array<integer, NDIM> lb, ub;
+	for (auto const &face : geo::face::full_set()) {
+		const integer dim = face.get_dimension();
+		block_face_bounds(face, lb, ub);
+		for (integer field = 0; field != NRF; ++field) {
+			for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
+				for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
+					for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
+						const integer iii = rindex(i, j, k);
+						flux_sum[dim][field][iii] += weight * flux[dim][field][iii];
+					}
+				}
+			}
+		}
+	}
+}
+
+void rad_grid::clear_flux_sum(const geo::face &face) {
+	std::array<integer, NDIM> lb, ub;
+	const integer dim = face.get_dimension();
+	block_face_bounds(face, lb, ub);
+	for (integer field = 0; field != NRF; ++field) {
+		for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
+			for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
+				for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
+					flux_sum[dim][field][rindex(i, j, k)] = 0.0;
+				}
+			}
+		}
+	}
+}
+
+/* replaces the summed flux through the faces between lb and ub, which have a refined neighbor across face, with the
+ * sum the fine side sent */
+void rad_grid::reflux(const std::vector<real> &data, const std::array<integer, NDIM> &lb, const std::array<integer, NDIM> &ub,
+		const geo::face &face) {
+	const integer D[NDIM] = { DX, DY, DZ };
+	const integer dim = face.get_dimension();
+	const bool plus = face.get_side() == geo::PLUS;
+	const real dxinv = INVERSE(dx);
+	integer index = 0;
+	for (integer field = 0; field != NRF; ++field) {
+		for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
+			for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
+				for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
+					const integer iii = rindex(i, j, k);
+					const real change = (data[index] - flux_sum[dim][field][iii]) * dxinv;
+					if (plus) {
+						U[field][iii - D[dim]] -= change;
+					} else {
+						U[field][iii] += change;
+					}
+					++index;
+				}
+			}
+		}
+	}
+}
+
+void node_server::all_rad_bounds(bool linear, const std::array<real, geo::direction::count()> *theta) {
 //	if( my_location.level() == 0 ) printf( "\nbounds 1\n");
 	GET(exchange_interlevel_rad_data());
 //	if( my_location.level() == 0 ) printf( "\nbounds 2\n");
-	collect_radiation_bounds();
+	collect_radiation_bounds(linear, theta);
 //	if( my_location.level() == 0 ) printf( "\nbounds 3\n");
 	send_rad_amr_bounds();
 //	if( my_location.level() == 0 ) printf( "\nbounds 4\n");
@@ -628,13 +856,13 @@ hpx::future<void> node_server::exchange_interlevel_rad_data() {
 	return hpx::make_ready_future();
 }
 
-void node_server::collect_radiation_bounds() {
+void node_server::collect_radiation_bounds(bool linear, const std::array<real, geo::direction::count()> *theta) {
 
 	rad_grid_ptr->clear_amr();
 	for (auto const &dir : geo::direction::full_set()) {
 		if (!neighbors[dir].empty()) {
 			const integer width = H_BW;
-			auto bdata = rad_grid_ptr->get_boundary(dir);
+			auto bdata = rad_grid_ptr->get_boundary(dir, theta ? (*theta)[dir] : 1.0);
 			neighbors[dir].send_rad_boundary(std::move(bdata), dir.flip(), rcycle);
 		}
 	}
@@ -662,7 +890,7 @@ void node_server::collect_radiation_bounds() {
 	for (auto &f : results) {
 		GET(f);
 	}
-	rad_grid_ptr->complete_rad_amr_boundary();
+	rad_grid_ptr->complete_rad_amr_boundary(linear);
 	for (auto &face : geo::face::full_set()) {
 		if (my_location.is_physical_boundary(face)) {
 			rad_grid_ptr->set_physical_boundaries(face, current_time);
@@ -716,7 +944,7 @@ void rad_grid::set_boundary(const std::vector<real> &data, const geo::direction
 	}
 }
 
-std::vector<real> rad_grid::get_boundary(const geo::direction &dir) {
+std::vector<real> rad_grid::get_boundary(const geo::direction &dir, real theta) {
 
 	std::array<integer, NDIM> lb, ub;
 	std::vector<real> data;
@@ -726,10 +954,16 @@ std::vector<real> rad_grid::get_boundary(const geo::direction &dir) {
 
 	for (integer field = 0; field != NRF; ++field) {
 		auto &Ufield = U[field];
+		auto &U0field = U0[field];
 		for (integer i = lb[XDIM]; i < ub[XDIM]; ++i) {
 			for (integer j = lb[YDIM]; j < ub[YDIM]; ++j) {
 				for (integer k = lb[ZDIM]; k < ub[ZDIM]; ++k) {
-					data[iter] = Ufield[rindex(i, j, k)];
+					const integer iii = rindex(i, j, k);
+					if (theta == 1.0) {
+						data[iter] = Ufield[iii];
+					} else {
+						data[iter] = U0field[iii] + theta * (Ufield[iii] - U0field[iii]);
+					}
 					++iter;
 				}
 			}
@@ -920,7 +1154,7 @@ void rad_grid::set_rad_amr_boundary(const std::vector<real>& data, const geo::di
 	assert(l == data.size());
 }
 
-void rad_grid::complete_rad_amr_boundary() {
+void rad_grid::complete_rad_amr_boundary(bool linear) {
 	PROFILE();
 
 	using oct_array = std::array<std::array<std::array<double, 2>, 2>, 2>;
@@ -931,8 +1165,8 @@ void rad_grid::complete_rad_amr_boundary() {
 		xmin[dim] = X[dim][0];
 	}
 
-	const auto limiter = [](double a, double b) {
-		return minmod_theta(a, b, 64./37.);
+	const auto limiter = [linear](double a, double b) {
+		return linear ? 0.5 * (a + b) : minmod_theta(a, b, 64./37.);
 	};
 
 	for (int f = 0; f < NRF; f++) {
@@ -0,0 +1,157 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "octotiger/trace.hpp"
+#include "octotiger/future.hpp"
+#include "octotiger/options.hpp"
+
+#include <hpx/include/actions.hpp>
+#include <hpx/include/run_as.hpp>
+#include <hpx/include/runtime.hpp>
+#include <hpx/timing.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+bool trace_enabled_ = false;
+
+static const char *phase_names[trace_phase_last] = { "hydro_reconstruct", "hydro_flux", "hydro", "fmm_multipole", "fmm_monopole", "fmm",
+		"boundary_wait", "regrid", "io" };
+
+struct trace_event {
+	const char *name;
+	trace_phase phase;
+	std::uint64_t id;
+	int start_thread;
+	int stop_thread;
+	std::uint64_t node;
+	std::int64_t step;
+	std::uint64_t start;
+	std::uint64_t duration;
+};
+
+/* events are appended to a buffer owned by the OS thread. Its lock is only ever contended by trace_flush,
+ * which holds it just long enough to swap the events out. */
+struct trace_buffer {
+	static constexpr std::size_t max_events = std::size_t(1) << 20;
+	std::mutex mtx;
+	std::vector<trace_event> events;
+	std::size_t dropped = 0;
+};
+
+static std::atomic<std::uint64_t> next_span_id_(0);
+static std::mutex buffers_mtx_;
+static std::vector<std::shared_ptr<trace_buffer>> buffers_;
+
+static trace_buffer& this_thread_buffer() {
+	static thread_local std::shared_ptr<trace_buffer> buffer;
+	if (buffer == nullptr) {
+		buffer = std::make_shared<trace_buffer>();
+		std::lock_guard<std::mutex> lock(buffers_mtx_);
+		buffers_.push_back(buffer);
+	}
+	return *buffer;
+}
+
+void trace_initialize() {
+	trace_enabled_ = opts().trace;
+}
+
+std::uint64_t trace_now() {
+	return hpx::util::high_resolution_clock::now();
+}
+
+int trace_worker() {
+	return int(hpx::get_worker_thread_num());
+}
+
+void trace_record(const char *name, trace_phase phase, std::uint64_t node, std::int64_t step, std::uint64_t start, int start_thread) {
+	const auto stop = trace_now();
+	auto &buffer = this_thread_buffer();
+	std::lock_guard<std::mutex> lock(buffer.mtx);
+	if (buffer.events.size() < trace_buffer::max_events) {
+		buffer.events.push_back(trace_event { name, phase, next_span_id_++, start_thread, trace_worker(), node, step, start, stop - start });
+	} else {
+		buffer.dropped++;
+	}
+}
+
+/* writes this locality's trace, returns the seconds and span count of every phase followed by the number of dropped spans */
+std::vector<double> trace_flush() {
+	std::vector<double> summary(2 * trace_phase_last + 1, 0.0);
+	if (!trace_enabled_) {
+		return summary;
+	}
+	const int locality = hpx::get_locality_id();
+	const std::string fname = opts().data_dir + "trace." + std::to_string(locality) + ".json";
+	hpx::threads::run_as_os_thread([&]() {
+		std::lock_guard<std::mutex> lock(buffers_mtx_);
+		FILE *fp = fopen(fname.c_str(), "wt");
+		if (fp == NULL) {
+			printf("Unable to open %s for writing\n", fname.c_str());
+		}
+		if (fp != NULL) {
+			fprintf(fp, "{\"traceEvents\":[\n");
+			fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%i,\"args\":{\"name\":\"locality %i\"}}", locality, locality);
+		}
+		for (const auto &buffer : buffers_) {
+			std::vector<trace_event> events;
+			std::size_t dropped;
+			{
+				std::lock_guard<std::mutex> buffer_lock(buffer->mtx);
+				std::swap(events, buffer->events);
+				dropped = buffer->dropped;
+				buffer->dropped = 0;
+			}
+			for (const auto &e : events) {
+				summary[e.phase] += e.duration * 1.0e-9;
+				summary[trace_phase_last + e.phase] += 1.0;
+				if (fp != NULL) {
+					fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"b\",\"id\":%llu,\"ts\":%.3f,\"pid\":%i,\"tid\":%i,"
+							"\"args\":{\"node\":%llu,\"step\":%lli}}", e.name, phase_names[e.phase], (unsigned long long) e.id, e.start * 1.0e-3,
+							locality, e.start_thread, (unsigned long long) e.node, (long long) e.step);
+					fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\",\"id\":%llu,\"ts\":%.3f,\"pid\":%i,\"tid\":%i}", e.name,
+							phase_names[e.phase], (unsigned long long) e.id, (e.start + e.duration) * 1.0e-3, locality, e.stop_thread);
+				}
+			}
+			summary[2 * trace_phase_last] += dropped;
+		}
+		if (fp != NULL) {
+			fprintf(fp, "\n]}\n");
+			fclose(fp);
+		}
+	}).get();
+	return summary;
+}
+
+HPX_PLAIN_ACTION(trace_flush, trace_flush_action);
+
+void trace_output() {
+	if (!trace_enabled_) {
+		return;
+	}
+	std::vector<hpx::future<std::vector<double>>> futs;
+	for (const auto &loc : options::all_localities) {
+		futs.push_back(hpx::async<trace_flush_action>(loc));
+	}
+	std::vector<double> summary(2 * trace_phase_last + 1, 0.0);
+	for (auto &f : futs) {
+		const auto this_summary = GET(f);
+		for (std::size_t i = 0; i < summary.size(); i++) {
+			summary[i] += this_summary[i];
+		}
+	}
+	printf("Trace summary (seconds summed over all threads, nested phases are included in their parents):\n");
+	for (int p = 0; p < trace_phase_last; p++) {
+		printf("   %-20s %12.0f spans %14.3f s\n", phase_names[p], summary[trace_phase_last + p], summary[p]);
+	}
+	if (summary[2 * trace_phase_last] > 0.0) {
+		printf("   %.0f spans were dropped, the per thread buffers were full\n", summary[2 * trace_phase_last]);
+	}
+}
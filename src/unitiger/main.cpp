@@ -43,7 +43,7 @@ void run_test(typename PHYS::test_type problem, bool with_correction, bool writi
 	for (int s = 0; s < 5; s++) {
 		computer.use_disc_detect(PHYS::spc_i + s);
 	}
-	std::vector<std::vector<std::vector<safe_real>>> F(NDIM, std::vector<std::vector<safe_real>>(nf, std::vector<safe_real>(H_N3)));
+	hydro::flux_type F(NDIM, nf, H_N3);
 	std::vector<std::vector<safe_real>> U(nf, std::vector<safe_real>(H_N3));
 	std::vector<std::vector<safe_real>> U0(nf, std::vector<safe_real>(H_N3));
 	hydro::x_type X(NDIM);
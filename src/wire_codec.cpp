@@ -0,0 +1,124 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "octotiger/wire_codec.hpp"
+#include "octotiger/future.hpp"
+#include "octotiger/options.hpp"
+
+#include <hpx/include/actions.hpp>
+#include <hpx/include/runtime.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+static const char *message_names[wire_message_type_last] = { "hydro_boundary", "hydro_amr_boundary", "hydro_flux_correct",
+		"gravity_boundary" };
+
+static std::array<std::atomic<std::uint64_t>, wire_message_type_last> raw_bytes_;
+static std::array<std::atomic<std::uint64_t>, wire_message_type_last> wire_bytes_;
+static std::array<std::atomic<std::uint64_t>, wire_message_type_last> messages_;
+
+bool wire_codec_enabled() {
+	return opts().wire_codec;
+}
+
+int wire_float_order() {
+	return std::max(0, std::min(4, int(opts().wire_float_order)));
+}
+
+static_assert(sizeof(real) == sizeof(std::uint64_t), "the wire codec packs 64 bit reals");
+
+/* one header byte per value, the number of leading zero bytes in the high nibble and of trailing zero bytes in the
+ * low nibble, followed by the bytes in between, most significant first */
+void wire_compress(const real *data, std::size_t n, std::vector<std::uint8_t> &out) {
+	out.clear();
+	out.reserve(n * (sizeof(real) + 1));
+	std::uint64_t prev = 0;
+	for (std::size_t i = 0; i != n; ++i) {
+		std::uint64_t bits;
+		std::memcpy(&bits, data + i, sizeof(bits));
+		const std::uint64_t x = bits ^ prev;
+		prev = bits;
+		int lead = 0;
+		while (lead != 8 && ((x >> (56 - 8 * lead)) & 0xFF) == 0) {
+			++lead;
+		}
+		int trail = 0;
+		if (lead != 8) {
+			while (((x >> (8 * trail)) & 0xFF) == 0) {
+				++trail;
+			}
+		}
+		out.push_back(std::uint8_t((lead << 4) | trail));
+		for (int b = 7 - lead; b >= trail; --b) {
+			out.push_back(std::uint8_t(x >> (8 * b)));
+		}
+	}
+}
+
+void wire_decompress(const std::vector<std::uint8_t> &in, real *data, std::size_t n) {
+	std::size_t pos = 0;
+	std::uint64_t prev = 0;
+	for (std::size_t i = 0; i != n; ++i) {
+		const int lead = in[pos] >> 4;
+		const int trail = in[pos] & 0xF;
+		++pos;
+		std::uint64_t x = 0;
+		for (int b = 7 - lead; b >= trail; --b) {
+			x |= std::uint64_t(in[pos++]) << (8 * b);
+		}
+		prev ^= x;
+		std::memcpy(data + i, &prev, sizeof(prev));
+	}
+}
+
+void wire_count(wire_message_type type, std::size_t raw_bytes, std::size_t wire_bytes) {
+	raw_bytes_[type] += raw_bytes;
+	wire_bytes_[type] += wire_bytes;
+	messages_[type]++;
+}
+
+/* returns the raw bytes, the encoded bytes and the number of encoded arrays of every message type */
+std::vector<std::uint64_t> wire_statistics() {
+	std::vector<std::uint64_t> stats(3 * wire_message_type_last);
+	for (int t = 0; t < wire_message_type_last; t++) {
+		stats[t] = raw_bytes_[t];
+		stats[wire_message_type_last + t] = wire_bytes_[t];
+		stats[2 * wire_message_type_last + t] = messages_[t];
+	}
+	return stats;
+}
+
+HPX_PLAIN_ACTION(wire_statistics, wire_statistics_action);
+
+void wire_output() {
+	std::vector<hpx::future<std::vector<std::uint64_t>>> futs;
+	for (const auto &loc : options::all_localities) {
+		futs.push_back(hpx::async<wire_statistics_action>(loc));
+	}
+	std::vector<std::uint64_t> stats(3 * wire_message_type_last, 0);
+	for (auto &f : futs) {
+		const auto this_stats = GET(f);
+		for (std::size_t i = 0; i < stats.size(); i++) {
+			stats[i] += this_stats[i];
+		}
+	}
+	if (std::all_of(stats.begin(), stats.end(), [](std::uint64_t s) {
+		return s == 0;
+	})) {
+		return;
+	}
+	printf("Inter-locality halo traffic (%s, moments from order %i on as floats):\n", wire_codec_enabled() ? "compressed" : "uncompressed",
+			wire_float_order());
+	for (int t = 0; t < wire_message_type_last; t++) {
+		const double raw = stats[t];
+		const double sent = stats[wire_message_type_last + t];
+		printf("   %-20s %12llu arrays %14.0f bytes raw %14.0f bytes sent %7.3f ratio\n", message_names[t],
+				(unsigned long long) stats[2 * wire_message_type_last + t], raw, sent, raw > 0.0 ? sent / raw : 1.0);
+	}
+}
@@ -0,0 +1,450 @@
+//  Copyright (c) 2019 AUTHORS
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+/* Per kernel throughput benchmark. Every hot kernel is run on a synthetic sub-grid of the compiled
+ * size (OCTOTIGER_WITH_GRIDDIM), without a tree and without any communication, and the rate is
+ * reported in updated cells per second. Kernels with a known interaction count also report an
+ * estimated GFLOP/s. The results are appended to kernel_bench.dat so runs with different compilers
+ * or Vc versions can be compared line by line. Kernel variants are chosen with the usual options,
+ * e.g. --reconstruct_kernel_type=VC or --flux_kernel_type=VC. With --check nothing is timed, the batched kernels
+ * are compared against their scalar counterparts instead and the exit code is the number of failed checks. */
+
+#include "octotiger/buffer_pool.hpp"
+#include "octotiger/compute_factor.hpp"
+#include "octotiger/defs.hpp"
+#include "octotiger/grid.hpp"
+#include "octotiger/grid_fmm.hpp"
+#include "octotiger/options.hpp"
+#include "octotiger/physcon.hpp"
+#include "octotiger/problem.hpp"
+#include "octotiger/radiation/cpu_kernel.hpp"
+#include "octotiger/unitiger/hydro.hpp"
+#include "octotiger/unitiger/physics.hpp"
+#include "octotiger/unitiger/physics_impl.hpp"
+#include "octotiger/unitiger/hydro_impl/reconstruct.hpp"
+#include "octotiger/unitiger/hydro_impl/flux.hpp"
+
+#include "octotiger/common_kernel/interaction_constants.hpp"
+#include "octotiger/common_kernel/struct_of_array_data.hpp"
+#include "octotiger/monopole_interactions/p2m_interaction_interface.hpp"
+#include "octotiger/monopole_interactions/p2m_kernel.hpp"
+#include "octotiger/monopole_interactions/p2p_cpu_kernel.hpp"
+#include "octotiger/monopole_interactions/p2p_interaction_interface.hpp"
+#include "octotiger/multipole_interactions/multipole_cpu_kernel.hpp"
+#include "octotiger/multipole_interactions/multipole_interaction_interface.hpp"
+
+#include <hpx/hpx_init.hpp>
+#include <hpx/timing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace octotiger::fmm;
+
+/* rough operation counts of a single interaction, only used to turn interaction rates into GFLOP/s */
+constexpr double p2p_ops = 12.0;
+constexpr double m2l_ops = 455.0;
+constexpr double p2m_ops = 455.0;
+/* per child cell, one shift of its moments or of its parent's expansion plus the accumulation */
+constexpr double m2m_ops = 268.0;
+constexpr double l2l_ops = 365.0;
+
+/* every kernel runs at least this often and for at least this long */
+constexpr int min_reps = 5;
+constexpr double min_seconds = 0.5;
+
+struct bench_result {
+	std::string name;
+	double cells;
+	double ops;
+	double seconds;
+};
+
+static std::vector<bench_result> results;
+
+template<class F>
+static void run_kernel(const std::string &name, double cells, double ops, F &&f) {
+	/* the first call sets up the thread_local staging areas and warms the caches */
+	f();
+	int reps = 0;
+	hpx::util::high_resolution_timer timer;
+	do {
+		f();
+		reps++;
+	} while (reps < min_reps || timer.elapsed() < min_seconds);
+	results.push_back(bench_result { name, cells, ops, timer.elapsed() / reps });
+}
+
+static std::size_t count_true(const std::vector<bool> &mask) {
+	return std::count(mask.begin(), mask.end(), true);
+}
+
+/* smooth, strictly positive state with density and pressure contrasts of about a factor two */
+static std::vector<real> synthetic_state(real x, real y, real z, real) {
+	using phys = physics<NDIM>;
+	std::vector<real> u(opts().n_fields, 0.0);
+	const real s = std::sin(2.0 * M_PI * x) * std::cos(2.0 * M_PI * y) * std::sin(2.0 * M_PI * z);
+	const real rho = 1.0 + 0.5 * s;
+	const real ein = 2.5 - s;
+	const real vx = 0.1 * std::cos(2.0 * M_PI * z);
+	const real vy = 0.1 * std::sin(2.0 * M_PI * x);
+	const real vz = 0.1 * s;
+	u[phys::rho_i] = rho;
+	u[phys::sx_i] = rho * vx;
+	u[phys::sy_i] = rho * vy;
+	u[phys::sz_i] = rho * vz;
+	u[phys::egas_i] = ein + 0.5 * rho * (vx * vx + vy * vy + vz * vz);
+	u[phys::tau_i] = std::pow(ein, 1.0 / grid::get_fgamma());
+	u[phys::pot_i] = -rho;
+	for (integer n = 0; n < opts().n_species; n++) {
+		u[phys::spc_i + n] = rho / opts().n_species;
+	}
+	return u;
+}
+
+static void bench_hydro() {
+	using phys = physics<NDIM>;
+	const real dx = 1.0 / INX;
+	hydro::state_type U(opts().n_fields, std::vector<safe_real>(H_N3));
+	hydro::x_type X(NDIM, std::vector<safe_real>(H_N3));
+	for (integer i = 0; i != H_NX; ++i) {
+		for (integer j = 0; j != H_NX; ++j) {
+			for (integer k = 0; k != H_NX; ++k) {
+				const integer iii = hindex(i, j, k);
+				X[XDIM][iii] = (real(i - H_BW) + HALF) * dx;
+				X[YDIM][iii] = (real(j - H_BW) + HALF) * dx;
+				X[ZDIM][iii] = (real(k - H_BW) + HALF) * dx;
+				const auto u = synthetic_state(X[XDIM][iii], X[YDIM][iii], X[ZDIM][iii], dx);
+				for (integer f = 0; f != opts().n_fields; ++f) {
+					U[f][iii] = u[f];
+				}
+			}
+		}
+	}
+
+	/* configured like grid::compute_fluxes */
+	hydro_computer<NDIM, INX, phys> hydro;
+	hydro.use_experiment(opts().experiment);
+	hydro.use_simd_reconstruct(opts().reconstruct_kernel_type == VC);
+	hydro.use_simd_flux(opts().flux_kernel_type == VC);
+	if (opts().correct_am_hydro) {
+		hydro.use_angmom_correction(phys::sx_i);
+	}
+	if (opts().cdisc_detect) {
+		hydro.use_disc_detect(phys::rho_i);
+		for (int i = phys::spc_i; i < phys::spc_i + opts().n_species; i++) {
+			hydro.use_disc_detect(i);
+		}
+	}
+	hydro.use_smooth_recon(phys::pot_i);
+	const real omega = 0.1;
+
+	const auto cells = double(INX * INX * INX);
+	const auto kernel = [](hydro_kernel_type t) {
+		return std::string(t == VC ? " (VC)" : " (SCALAR)");
+	};
+	run_kernel("reconstruct_ppm" + kernel(opts().reconstruct_kernel_type), cells, 0.0, [&]() {
+		hydro.reconstruct(U, X, omega);
+	});
+	const auto &Q = hydro.reconstruct(U, X, omega);
+	hydro::flux_type F(NDIM, opts().n_fields, H_N3);
+	run_kernel("flux" + kernel(opts().flux_kernel_type), cells, 0.0, [&]() {
+		hydro.flux(U, Q, F, X, omega);
+	});
+}
+
+static void bench_fmm() {
+	const real dx = 1.0 / INX;
+	const auto cells = double(INNER_CELLS);
+
+	/* a multipole with a center of mass slightly off the cell center in every padded cell */
+	struct_of_array_data<expansion, real, 20, ENTRIES, SOA_PADDING> local_expansions_SoA;
+	struct_of_array_data<space_vector, real, 3, ENTRIES, SOA_PADDING> center_of_masses_SoA;
+	for (std::size_t i = 0; i < PADDED_STRIDE; i++) {
+		for (std::size_t j = 0; j < PADDED_STRIDE; j++) {
+			for (std::size_t k = 0; k < PADDED_STRIDE; k++) {
+				const std::size_t flat_index = (i * PADDED_STRIDE + j) * PADDED_STRIDE + k;
+				expansion m;
+				for (integer n = 0; n != 20; ++n) {
+					m[n] = (n == 0 ? 1.0 : 1.0e-3) * (1.0 + 0.01 * ((flat_index + n) % 7));
+				}
+				space_vector x;
+				x[0] = (i + 0.5 + 0.01 * (flat_index % 3)) * dx;
+				x[1] = (j + 0.5 + 0.01 * (flat_index % 5)) * dx;
+				x[2] = (k + 0.5 + 0.01 * (flat_index % 11)) * dx;
+				local_expansions_SoA.set_AoS_value(std::move(m), flat_index);
+				center_of_masses_SoA.set_AoS_value(std::move(x), flat_index);
+			}
+		}
+	}
+	struct_of_array_data<expansion, real, 20, INNER_CELLS, SOA_PADDING> potential_expansions_SoA;
+	struct_of_array_data<space_vector, real, 3, INNER_CELLS, SOA_PADDING> angular_corrections_SoA;
+
+	{
+		using intfc = multipole_interactions::multipole_interaction_interface;
+		const std::vector<real> mons(ENTRIES, 0.0);
+		multipole_interactions::multipole_cpu_kernel kernel;
+		const auto interactions = double(count_true(intfc::stencil_masks()));
+		run_kernel("multipole apply_stencil", cells, interactions * m2l_ops, [&]() {
+			kernel.apply_stencil(local_expansions_SoA, center_of_masses_SoA, potential_expansions_SoA, angular_corrections_SoA, mons,
+					intfc::stencil(), RHO);
+		});
+		run_kernel("multipole non_blocked", cells, interactions * m2l_ops, [&]() {
+			kernel.apply_stencil_non_blocked(local_expansions_SoA, center_of_masses_SoA, potential_expansions_SoA, angular_corrections_SoA,
+					mons, intfc::stencil_masks(), intfc::inner_stencil_masks(), RHO);
+		});
+	}
+	{
+		using intfc = monopole_interactions::p2p_interaction_interface;
+		std::vector<real> mons(ENTRIES, 1.0);
+		std::vector<bool> neighbor_empty(27, false);
+		monopole_interactions::p2p_cpu_kernel kernel(neighbor_empty);
+		const auto interactions = double(count_true(intfc::stencil_masks()));
+		run_kernel("p2p_cpu_kernel", cells, interactions * p2p_ops, [&]() {
+			kernel.apply_stencil(mons, potential_expansions_SoA, intfc::stencil_masks(), intfc::stencil_four_constants(), dx, RHO);
+		});
+		using potential_type = struct_of_array_data<expansion, real, 20, INNER_CELLS, SOA_PADDING>;
+		const std::size_t batch = monopole_interactions::P2P_MAX_BATCH;
+		std::vector<const std::vector<real>*> batch_mons(batch, &mons);
+		std::vector<std::unique_ptr<potential_type>> batch_results;
+		std::vector<potential_type*> batch_potentials;
+		for (std::size_t b = 0; b < batch; b++) {
+			batch_results.emplace_back(new potential_type);
+			batch_potentials.push_back(batch_results.back().get());
+		}
+		run_kernel("p2p_cpu_kernel batched", cells * batch, interactions * p2p_ops, [&]() {
+			kernel.apply_stencil_batched(batch_mons, batch_potentials, intfc::stencil_masks(), intfc::stencil_four_constants(), dx, RHO);
+		});
+	}
+	{
+		using intfc = monopole_interactions::p2m_interaction_interface;
+		std::vector<bool> neighbor_empty(27, false);
+		monopole_interactions::p2m_kernel kernel(neighbor_empty);
+		/* the center block is the monopole sub-grid itself, all 26 neighbors hold multipoles */
+		bool x_skip[3][3][3] = { };
+		bool y_skip[3][3] = { };
+		bool z_skip[3] = { };
+		x_skip[1][1][1] = true;
+		const auto interactions = double(intfc::stencil().size()) * 26.0 / 27.0;
+		run_kernel("p2m_kernel", cells, interactions * p2m_ops, [&]() {
+			kernel.apply_stencil(local_expansions_SoA, center_of_masses_SoA, potential_expansions_SoA, angular_corrections_SoA,
+					intfc::stencil(), RHO, x_skip, y_skip, z_skip);
+		});
+	}
+	{
+		/* a refined node below the root, the root skips the shifts to and from its parents */
+		const integer nchild = INX * INX * INX;
+		const integer nparent = nchild / NCHILD;
+		multipole_pass_type child_poles;
+		child_poles.first.resize(nchild);
+		child_poles.second.resize(nchild);
+		for (integer i = 0; i != INX; ++i) {
+			for (integer j = 0; j != INX; ++j) {
+				for (integer k = 0; k != INX; ++k) {
+					const integer iii = INX * INX * i + INX * j + k;
+					for (integer n = 0; n != 20; ++n) {
+						child_poles.first[iii][n] = (n == 0 ? 1.0 : 1.0e-3) * (1.0 + 0.01 * ((iii + n) % 7));
+					}
+					child_poles.second[iii][0] = (i + 0.5 + 0.01 * (iii % 3)) * dx;
+					child_poles.second[iii][1] = (j + 0.5 + 0.01 * (iii % 5)) * dx;
+					child_poles.second[iii][2] = (k + 0.5 + 0.01 * (iii % 11)) * dx;
+				}
+			}
+		}
+		expansion_pass_type parent_expansions;
+		parent_expansions.first.resize(nparent);
+		parent_expansions.second.resize(nparent);
+		for (integer iiip = 0; iiip != nparent; ++iiip) {
+			for (integer n = 0; n != 20; ++n) {
+				parent_expansions.first[iiip][n] = 1.0e-3 * (1.0 + 0.01 * ((iiip + n) % 7));
+			}
+			for (integer d = 0; d != NDIM; ++d) {
+				parent_expansions.second[iiip][d] = 1.0e-6;
+			}
+		}
+		grid g(synthetic_state, dx, std::array<real, NDIM> { { 0.0, 0.0, 0.0 } });
+		g.set_leaf(false);
+		run_kernel("grid::compute_multipoles", cells, m2m_ops, [&]() {
+			auto mret = g.compute_multipoles(RHO, &child_poles);
+			buffer_pool<multipole>::recycle(std::move(mret.first));
+			buffer_pool<space_vector>::recycle(std::move(mret.second));
+		});
+		run_kernel("grid::compute_expansions", cells, l2l_ops, [&]() {
+			auto lret = g.compute_expansions(RHO, &parent_expansions);
+			buffer_pool<expansion>::recycle(std::move(lret.first));
+			buffer_pool<space_vector>::recycle(std::move(lret.second));
+		});
+	}
+}
+
+static void bench_radiation() {
+	/* stellar interior conditions in cgs, the radiation energy is 10% off equilibrium */
+	const integer n = INX * INX * INX;
+	const real mmw = 0.6;
+	const real X = 0.7;
+	const real Z = 0.02;
+	const real dt = 1.0e-3;
+	std::vector<real> rho(n), e(n), E(n);
+	std::vector<space_vector> F(n), u(n);
+	for (integer i = 0; i != n; ++i) {
+		const real s = std::sin(0.1 * i);
+		const real T = 1.0e+7 * (1.0 + 0.1 * s);
+		rho[i] = 1.0 + 0.5 * s;
+		e[i] = 1.5 * rho[i] * physcon().kb * T / (mmw * physcon().mh);
+		E[i] = 1.1 * 4.0 * physcon().sigma / physcon().c * T * T * T * T;
+		for (integer d = 0; d != NDIM; ++d) {
+			u[i][d] = 1.0e+5 * s;
+			F[i][d] = 1.0e-3 * physcon().c * E[i] * s;
+		}
+	}
+	run_kernel("implicit_radiation_step", double(n), 0.0, [&]() {
+		for (integer i = 0; i != n; ++i) {
+			real ei = e[i];
+			octotiger::radiation::detail::implicit_radiation_step(E[i], ei, F[i], u[i], rho[i], mmw, X, Z, dt);
+		}
+	});
+	/* the same cells for the batched solver */
+	octotiger::radiation::detail::implicit_radiation_batch batch;
+	batch.resize(n);
+	for (integer i = 0; i != n; ++i) {
+		batch.set_cell(i, rho[i], e[i], mmw, X, Z, E[i], { F[i][0], F[i][1], F[i][2] }, { u[i][0], u[i][1], u[i][2] }, dt);
+	}
+	std::size_t unconverged = 0;
+	run_kernel("implicit_radiation batched", double(n), 0.0, [&]() {
+		unconverged = octotiger::radiation::detail::implicit_radiation_solve(batch, n);
+	});
+	if (unconverged != 0) {
+		printf("implicit_radiation batched: %i cells did not converge\n", int(unconverged));
+	}
+}
+
+/* random cells over a wide range of temperatures, densities and departures from equilibrium, solved by the batched
+ * Newton iteration and by the scalar bisection of implicit_radiation_step. Both stop at a residual of 1e-9 of the
+ * total energy, the new radiation energy, flux and internal energy have to agree to well within 1e-6 of it. The time
+ * step puts the Planck absorption per step between 1e-3 and 1e+3, beyond that the bisection does not reach its
+ * tolerance in 50 steps */
+static int check_radiation() {
+	const integer n = 4096;
+	const real mmw = 0.6;
+	const real X = 0.7;
+	const real Z = 0.02;
+	const real c = physcon().c;
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<real> unit(0.0, 1.0);
+	std::vector<real> rho(n), e(n), E(n), dt(n);
+	std::vector<space_vector> F(n), u(n);
+	octotiger::radiation::detail::implicit_radiation_batch batch;
+	batch.resize(n);
+	for (integer i = 0; i != n; ++i) {
+		const real T = std::pow(10.0, 5.0 + 3.0 * unit(gen));
+		rho[i] = std::pow(10.0, -3.0 + 5.0 * unit(gen));
+		e[i] = 1.5 * rho[i] * physcon().kb * T / (mmw * physcon().mh);
+		dt[i] = std::pow(10.0, 6.0 * unit(gen) - 3.0) / (kappa_p(rho[i], e[i], mmw, X, Z) * c);
+		E[i] = std::pow(10.0, 2.0 * unit(gen) - 1.0) * 4.0 * physcon().sigma / c * T * T * T * T;
+		for (integer d = 0; d != NDIM; ++d) {
+			u[i][d] = 1.0e-3 * c * (2.0 * unit(gen) - 1.0);
+			F[i][d] = 0.5 * c * E[i] * (2.0 * unit(gen) - 1.0) / std::sqrt(3.0);
+		}
+		batch.set_cell(i, rho[i], e[i], mmw, X, Z, E[i], { F[i][0], F[i][1], F[i][2] }, { u[i][0], u[i][1], u[i][2] }, dt[i]);
+	}
+	int failed = 0;
+	const std::size_t unconverged = octotiger::radiation::detail::implicit_radiation_solve(batch, n);
+	if (unconverged != 0) {
+		printf("implicit_radiation batched: %i cells did not converge\n", int(unconverged));
+		failed++;
+	}
+	real max_err = 0.0;
+	for (integer i = 0; i != n; ++i) {
+		const real rhoc2 = rho[i] * c * c;
+		real e1 = e[i];
+		const auto dU = octotiger::radiation::detail::implicit_radiation_step(E[i], e1, F[i], u[i], rho[i], mmw, X, Z, dt[i]);
+		real u2 = 0.0;
+		for (integer d = 0; d != NDIM; ++d) {
+			u2 += u[i][d] * u[i][d];
+		}
+		const real scale = E[i] + e[i] + 0.5 * rho[i] * u2;
+		real err = std::abs(batch.E[i] * rhoc2 - (E[i] + dU.first * dt[i]));
+		err = std::max(err, std::abs(batch.ei[i] * rhoc2 - e1));
+		for (integer d = 0; d != NDIM; ++d) {
+			err = std::max(err, std::abs(batch.F[d][i] * rhoc2 - (F[i][d] + dU.second[d] * dt[i]) / c));
+		}
+		max_err = std::max(max_err, err / scale);
+	}
+	printf("implicit_radiation batched vs scalar: max. relative difference %e over %i cells\n", max_err, int(n));
+	if (!(max_err < 1.0e-6)) {
+		failed++;
+	}
+	return failed;
+}
+
+static void output_results() {
+	printf("\nKernel benchmark, INX = %i, %i species\n", int(INX), int(opts().n_species));
+	printf("%-34s %14s %14s %12s\n", "kernel", "s / call", "cells / s", "est. GFLOP/s");
+	FILE *fp = fopen((opts().data_dir + "kernel_bench.dat").c_str(), "at");
+	for (const auto &r : results) {
+		const double rate = r.cells / r.seconds;
+		if (r.ops > 0.0) {
+			printf("%-34s %14.4e %14.4e %12.3f\n", r.name.c_str(), r.seconds, rate, rate * r.ops * 1.0e-9);
+		} else {
+			printf("%-34s %14.4e %14.4e %12s\n", r.name.c_str(), r.seconds, rate, "-");
+		}
+		if (fp != NULL) {
+			fprintf(fp, "%i \"%s\" %e %e\n", int(INX), r.name.c_str(), rate, rate * r.ops * 1.0e-9);
+		}
+	}
+	if (fp != NULL) {
+		fclose(fp);
+	}
+}
+
+static bool check_only = false;
+
+int hpx_main(int argc, char *argv[]) {
+	int failed = 0;
+	if (opts().process_options(argc, argv)) {
+		options::all_localities = hpx::find_all_localities();
+		physics<NDIM>::set_n_species(opts().n_species);
+		physics<NDIM>::update_n_field();
+		physics<NDIM>::set_fgamma(grid::get_fgamma());
+		physics<NDIM>::set_dual_energy_switches(opts().dual_energy_sw1, opts().dual_energy_sw2);
+		compute_ilist();
+		compute_factor();
+		grid::static_init();
+		normalize_constants();
+
+		if (check_only) {
+			failed += check_radiation();
+		} else {
+			bench_hydro();
+			bench_fmm();
+			bench_radiation();
+			output_results();
+		}
+	}
+	hpx::finalize();
+	return failed;
+}
+
+int main(int argc, char *argv[]) {
+	/* --check is ours, the rest goes to HPX and the options */
+	std::vector<char*> args;
+	for (int i = 0; i != argc; ++i) {
+		if (std::strcmp(argv[i], "--check") == 0) {
+			check_only = true;
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+	/* a single worker, the kernels are measured one sub-grid at a time */
+	std::vector<std::string> cfg = { "hpx.commandline.allow_unknown=1", "hpx.os_threads=1" };
+	return hpx::init(int(args.size()), args.data(), cfg);
+}